@@ -0,0 +1,144 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stulto-activity.h"
+
+/* Quiet for this long after output counts as silence */
+#define STULTO_ACTIVITY_SILENCE_US (10 * G_USEC_PER_SEC)
+/* Only after output that went on for at least this long, so a lone prompt doesn't count */
+#define STULTO_ACTIVITY_MIN_BUSY_US (10 * G_USEC_PER_SEC)
+
+struct _StultoActivity {
+    StultoActivityChangedFunc changed_func;
+    gpointer user_data;
+
+    StultoActivityState state;
+    /* Being shown; nothing is marked meanwhile */
+    gboolean watched;
+
+    gint64 last_output_us;
+    /* The start of the current stretch of output */
+    gint64 busy_since_us;
+    guint silence_source;
+};
+
+static void set_state(StultoActivity *activity, StultoActivityState state) {
+    if (activity->state != state) {
+        activity->state = state;
+        activity->changed_func(state, activity->user_data);
+    }
+}
+
+static void schedule_silence_check(StultoActivity *activity, gint64 delay_us);
+
+static gboolean silence_cb(gpointer data) {
+    StultoActivity *activity = data;
+    gint64 quiet_us = g_get_monotonic_time() - activity->last_output_us;
+
+    activity->silence_source = 0;
+
+    if (activity->watched || activity->state != STULTO_ACTIVITY_OUTPUT) {
+        return G_SOURCE_REMOVE;
+    }
+
+    /* There has been output since the check was scheduled */
+    if (quiet_us < STULTO_ACTIVITY_SILENCE_US) {
+        schedule_silence_check(activity, STULTO_ACTIVITY_SILENCE_US - quiet_us);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (activity->last_output_us - activity->busy_since_us >= STULTO_ACTIVITY_MIN_BUSY_US) {
+        set_state(activity, STULTO_ACTIVITY_SILENCE);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_silence_check(StultoActivity *activity, gint64 delay_us) {
+    if (activity->silence_source == 0) {
+        activity->silence_source = g_timeout_add((guint) (delay_us / 1000) + 1, silence_cb, activity);
+    }
+}
+
+StultoActivity *stulto_activity_new(StultoActivityChangedFunc changed_func, gpointer user_data) {
+    StultoActivity *activity = g_new0(StultoActivity, 1);
+
+    activity->changed_func = changed_func;
+    activity->user_data = user_data;
+
+    return activity;
+}
+
+void stulto_activity_free(StultoActivity *activity) {
+    if (activity == NULL) {
+        return;
+    }
+
+    if (activity->silence_source != 0) {
+        g_source_remove(activity->silence_source);
+    }
+
+    g_free(activity);
+}
+
+/*
+ * Called for every read of output, so it must stay cheap
+ */
+void stulto_activity_note_output(StultoActivity *activity) {
+    gint64 now = g_get_monotonic_time();
+
+    if (now - activity->last_output_us >= STULTO_ACTIVITY_SILENCE_US) {
+        activity->busy_since_us = now;
+    }
+
+    activity->last_output_us = now;
+
+    if (activity->watched) {
+        return;
+    }
+
+    if (activity->state == STULTO_ACTIVITY_NONE || activity->state == STULTO_ACTIVITY_SILENCE) {
+        set_state(activity, STULTO_ACTIVITY_OUTPUT);
+    }
+
+    if (activity->state == STULTO_ACTIVITY_OUTPUT) {
+        schedule_silence_check(activity, STULTO_ACTIVITY_SILENCE_US);
+    }
+}
+
+void stulto_activity_note_bell(StultoActivity *activity) {
+    if (!activity->watched) {
+        set_state(activity, STULTO_ACTIVITY_BELL);
+    }
+}
+
+/*
+ * Showing the session clears whatever was marked
+ */
+void stulto_activity_set_watched(StultoActivity *activity, gboolean watched) {
+    activity->watched = watched;
+
+    if (watched) {
+        set_state(activity, STULTO_ACTIVITY_NONE);
+    }
+}
+
+StultoActivityState stulto_activity_get_state(StultoActivity *activity) {
+    return activity->state;
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_ACTIVITY_H
+#define STULTO_ACTIVITY_H
+
+#include <glib.h>
+
+/*
+ * What a session has been up to while nobody was looking at it: new output, a bell, or silence after a stretch of
+ * output (e.g., a long job finishing)
+ *
+ * Output only updates a timestamp and, the first time after the session is left, the state; silence is noticed by a
+ * single timer per stretch of output, which re-arms itself at most once per silence period however much output there
+ * is. The changed callback runs only when the state actually changes
+ */
+
+typedef enum {
+    STULTO_ACTIVITY_NONE,
+    STULTO_ACTIVITY_OUTPUT,
+    STULTO_ACTIVITY_SILENCE,
+    STULTO_ACTIVITY_BELL,
+} StultoActivityState;
+
+typedef struct _StultoActivity StultoActivity;
+
+typedef void (*StultoActivityChangedFunc)(StultoActivityState state, gpointer user_data);
+
+StultoActivity *stulto_activity_new(StultoActivityChangedFunc changed_func, gpointer user_data);
+void stulto_activity_free(StultoActivity *activity);
+
+void stulto_activity_note_output(StultoActivity *activity);
+void stulto_activity_note_bell(StultoActivity *activity);
+void stulto_activity_set_watched(StultoActivity *activity, gboolean watched);
+
+StultoActivityState stulto_activity_get_state(StultoActivity *activity);
+
+#endif //STULTO_ACTIVITY_H
@@ -33,6 +33,9 @@ typedef struct _StultoAppConfig {
     gchar *initial_profile_path;
     StultoTerminalProfile *initial_profile;
     gint64 disable_headerbar;
+    gchar *workspace_path;
+    /* Start hidden, as a drop-down toggled over the control socket */
+    gboolean drop_down;
 } StultoAppConfig;
 
 #endif //STULTO_APP_CONFIG_H
@@ -29,9 +29,25 @@
 #include "stulto-app-config.h"
 #include "stulto-exec-data.h"
 #include "stulto-main-window.h"
+#include "stulto-session-state.h"
+#include "stulto-journal.h"
+#include "stulto-holder.h"
+#include "stulto-control.h"
+#include "stulto-control-protocol.h"
 
 static const gchar *HEADER_BAR_ENVAR_NAME = "STULTO_HEADERBAR_TYPE";
 
+/*
+ * Show the window, or for the drop-down, have it ready to be shown
+ */
+static void show_window(StultoMainWindow *window, StultoAppConfig *config) {
+    if (config->drop_down) {
+        stulto_main_window_prebuild(window);
+    } else {
+        gtk_widget_show_all(GTK_WIDGET(window));
+    }
+}
+
 gboolean stulto_application_create(int argc, char *argv[]) {
     StultoAppConfig *config = g_new0(StultoAppConfig, 1);
     gchar **cmd_argv = NULL;
@@ -59,6 +75,21 @@ gboolean stulto_application_create(int argc, char *argv[]) {
                     .description = "Set window role",
                     .arg_description = "ROLE",
             },
+            {
+                    .long_name = "workspace",
+                    .short_name = 'w',
+                    .arg = G_OPTION_ARG_FILENAME,
+                    .arg_data = &config->workspace_path,
+                    .description = "Open the sessions of a workspace file",
+                    .arg_description = "FILE",
+            },
+            {
+                    .long_name = "drop-down",
+                    .short_name = 'd',
+                    .arg = G_OPTION_ARG_NONE,
+                    .arg_data = &config->drop_down,
+                    .description = "Start hidden, to drop down with 'stultoctl --drop-down toggle'",
+            },
             {
                     .long_name = "disable-headerbar",
                     .arg = G_OPTION_ARG_NONE,
@@ -68,7 +99,7 @@ gboolean stulto_application_create(int argc, char *argv[]) {
             {
                     .long_name = G_OPTION_REMAINING,
                     .arg = G_OPTION_ARG_STRING_ARRAY,
-                    .arg_data = cmd_argv,
+                    .arg_data = &cmd_argv,
             },
             {} /* terminator */
     };
@@ -85,6 +116,18 @@ gboolean stulto_application_create(int argc, char *argv[]) {
         return FALSE;
     }
 
+    /* There is one drop-down to toggle; a second would only take its socket */
+    if (config->drop_down && stulto_control_is_running(STULTO_CONTROL_DROP_DOWN_SOCKET)) {
+        g_printerr("A drop-down is already running; show it with 'stultoctl --drop-down toggle'\n");
+
+        return FALSE;
+    }
+
+    /* The drop-down has no window decorations, so the header bar goes inside it */
+    if (config->drop_down && config->disable_headerbar == 0) {
+        config->disable_headerbar = 1;
+    }
+
     StultoExecData *exec_data = stulto_exec_data_create(cmd_argv);
     StultoTerminalProfile *profile = stulto_terminal_profile_parse(config->initial_profile_path);
     config->initial_profile = profile;
@@ -111,10 +154,56 @@ gboolean stulto_application_create(int argc, char *argv[]) {
         return FALSE;
     }
 
+    /* Every launch path records and holds its PTYs, a workspace's sessions as much as restored ones */
+    if (profile->journal) {
+        stulto_journal_enable((gsize) profile->journal_size * 1024 * 1024);
+    }
+
+    if (profile->pty_holder) {
+        GError *error = NULL;
+
+        if (!stulto_holder_connect(&error)) {
+            g_printerr("Error connecting to the PTY holder: %s\n", error->message);
+            g_error_free(error);
+        }
+    }
+
+    if (config->workspace_path != NULL) {
+        StultoMainWindow *window = stulto_main_window_new(NULL, config);
+
+        if (!stulto_main_window_open_workspace(window, config->workspace_path, &error)) {
+            g_printerr("Error opening workspace '%s': %s\n", config->workspace_path, error->message);
+            g_error_free(error);
+            gtk_widget_destroy(GTK_WIDGET(window));
+
+            return FALSE;
+        }
+
+        show_window(window, config);
+
+        return TRUE;
+    }
+
+    /* A command given on the command line takes the place of the saved sessions */
+    if (cmd_argv == NULL
+        && ((profile->persist_sessions && stulto_session_state_exists())
+            || (profile->journal && stulto_journal_can_recover())
+            || stulto_holder_get_default() != NULL)) {
+        StultoMainWindow *window = stulto_main_window_new(NULL, config);
+
+        if (stulto_main_window_restore_sessions(window)) {
+            show_window(window, config);
+
+            return TRUE;
+        }
+
+        gtk_widget_destroy(GTK_WIDGET(window));
+    }
+
     StultoTerminal *terminal = stulto_terminal_new(profile, exec_data);
     StultoMainWindow *window = stulto_main_window_new(terminal, config);
 
-    gtk_widget_show_all(GTK_WIDGET(window));
+    show_window(window, config);
 
     return TRUE;
 }
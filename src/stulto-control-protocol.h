@@ -0,0 +1,34 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_CONTROL_PROTOCOL_H
+#define STULTO_CONTROL_PROTOCOL_H
+
+/*
+ * Where Stulto's control sockets live: one per instance, in $XDG_RUNTIME_DIR/stulto/control-PID.sock, named to its
+ * terminals' programs by $STULTO_CONTROL_SOCKET. The drop-down instance's is always drop-down.sock, for hotkeys to find
+ */
+
+#define STULTO_CONTROL_SOCKET_ENV "STULTO_CONTROL_SOCKET"
+#define STULTO_CONTROL_SOCKET_DIR "stulto"
+#define STULTO_CONTROL_SOCKET_PREFIX "control-"
+#define STULTO_CONTROL_SOCKET_SUFFIX ".sock"
+#define STULTO_CONTROL_DROP_DOWN_SOCKET "drop-down.sock"
+
+#endif //STULTO_CONTROL_PROTOCOL_H
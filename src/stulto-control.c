@@ -0,0 +1,676 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+
+#include "stulto-control.h"
+#include "stulto-control-protocol.h"
+#include "stulto-export.h"
+#include "stulto-main-window.h"
+
+#define STULTO_CONTROL_READ_SIZE 65536
+/* A client sending a longer line without a newline is dropped */
+#define STULTO_CONTROL_MAX_LINE (1024 * 1024)
+
+struct _StultoControl {
+    StultoSessionManager *session_manager;
+    StultoTerminalProfile *profile;
+    gchar *socket_path;
+    gint listen_fd;
+    guint listen_source;
+    /* Of ControlClient */
+    GPtrArray *clients;
+};
+
+typedef struct _ControlClient {
+    StultoControl *control;
+    gint fd;
+    guint read_source;
+    guint write_source;
+    GString *in;
+    GString *out;
+    /* The client is done sending; it is dropped once its replies are out */
+    gboolean closing;
+    /* The terminal whose output the connection is handed over to, once the replies so far are out */
+    StultoTerminal *subscribe_to;
+} ControlClient;
+
+// region Replies
+
+static void append_json_string(GString *out, const gchar *text) {
+    g_string_append_c(out, '"');
+
+    for (const gchar *p = text; *p != '\0'; p++) {
+        guchar c = *p;
+
+        switch (c) {
+            case '"':
+                g_string_append(out, "\\\"");
+                break;
+            case '\\':
+                g_string_append(out, "\\\\");
+                break;
+            case '\n':
+                g_string_append(out, "\\n");
+                break;
+            case '\r':
+                g_string_append(out, "\\r");
+                break;
+            case '\t':
+                g_string_append(out, "\\t");
+                break;
+            default:
+                if (c < 0x20) {
+                    g_string_append_printf(out, "\\u%04x", c);
+                } else {
+                    g_string_append_c(out, (gchar) c);
+                }
+                break;
+        }
+    }
+
+    g_string_append_c(out, '"');
+}
+
+G_GNUC_PRINTF(2, 3)
+static void reply_error(GString *out, const gchar *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    gchar *message = g_strdup_vprintf(format, args);
+    va_end(args);
+
+    g_string_append(out, "{\"ok\":false,\"error\":");
+    append_json_string(out, message);
+    g_string_append(out, "}\n");
+
+    g_free(message);
+}
+
+static void reply_ok(GString *out) {
+    g_string_append(out, "{\"ok\":true}\n");
+}
+
+// endregion
+
+// region Commands
+
+/*
+ * A session by its number, or else by its name
+ */
+static StultoSession *find_session(StultoControl *control, const gchar *spec) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(control->session_manager);
+    gint n_pages = gtk_notebook_get_n_pages(notebook);
+    gchar *end;
+    gint64 number = g_ascii_strtoll(spec, &end, 10);
+
+    if (*spec != '\0' && *end == '\0') {
+        return number >= 0 && number < n_pages ? STULTO_SESSION(gtk_notebook_get_nth_page(notebook, (gint) number)) : NULL;
+    }
+
+    for (gint i = 0; i < n_pages; i++) {
+        GtkWidget *page = gtk_notebook_get_nth_page(notebook, i);
+        const gchar *name = gtk_notebook_get_tab_label_text(notebook, page);
+
+        if (g_strcmp0(name, spec) == 0) {
+            return STULTO_SESSION(page);
+        }
+    }
+
+    return NULL;
+}
+
+static void run_list(StultoControl *control, GString *out) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(control->session_manager);
+    gint n_pages = gtk_notebook_get_n_pages(notebook);
+    gint active = gtk_notebook_get_current_page(notebook);
+
+    g_string_append(out, "{\"ok\":true,\"sessions\":[");
+
+    for (gint i = 0; i < n_pages; i++) {
+        StultoSession *session = STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i));
+        const gchar *name = gtk_notebook_get_tab_label_text(notebook, GTK_WIDGET(session));
+        const StultoWorkspaceSession *pending = stulto_session_get_pending(session);
+        const gchar *foreground = stulto_session_get_foreground(session);
+        guint n_panes;
+
+        if (pending != NULL) {
+            n_panes = pending->panes->len;
+        } else {
+            GList *terminals = stulto_session_get_terminals(session);
+
+            n_panes = g_list_length(terminals);
+            g_list_free(terminals);
+        }
+
+        g_string_append_printf(out, "%s{\"session\":%d,\"name\":", i > 0 ? "," : "", i);
+        append_json_string(out, name != NULL ? name : "");
+        g_string_append_printf(out, ",\"panes\":%u,\"active\":%s,\"started\":%s,\"foreground\":",
+                               n_panes, i == active ? "true" : "false", pending != NULL ? "false" : "true");
+
+        if (foreground != NULL) {
+            append_json_string(out, foreground);
+        } else {
+            g_string_append(out, "null");
+        }
+
+        const StultoResourceUsage *usage = stulto_session_get_resource_usage(session);
+
+        g_string_append_printf(out, ",\"processes\":%u,\"cpu_ms\":%" G_GUINT64_FORMAT ",\"rss\":%" G_GUINT64_FORMAT
+                               ",\"io\":%" G_GUINT64_FORMAT "}",
+                               usage->n_processes, usage->cpu_time_ms, usage->rss_bytes, usage->io_bytes);
+    }
+
+    g_string_append(out, "]}\n");
+}
+
+static void run_new_session(StultoControl *control, gchar **argv, GString *out) {
+    StultoExecData *exec_data = stulto_exec_data_create(argv[0] != NULL ? g_strdupv(argv) : NULL);
+
+    stulto_session_manager_add_session(control->session_manager, stulto_terminal_new(control->profile, exec_data));
+
+    g_string_append_printf(out, "{\"ok\":true,\"session\":%d}\n",
+                           stulto_session_manager_get_n_sessions(control->session_manager) - 1);
+}
+
+static StultoTerminal *get_terminal(StultoSession *session) {
+    /* Scripts may address sessions never shown yet */
+    stulto_session_materialize(session);
+
+    return stulto_session_get_active_terminal(session);
+}
+
+static void run_send(StultoSession *session, const gchar *text, GString *out) {
+    StultoTerminal *terminal = get_terminal(session);
+    gchar *data = g_strcompress(text);
+
+    if (terminal != NULL) {
+        stulto_terminal_write(terminal, data, strlen(data));
+        reply_ok(out);
+    } else {
+        reply_error(out, "Session has no terminal");
+    }
+
+    g_free(data);
+}
+
+static void run_get_text(StultoSession *session, GString *out) {
+    StultoTerminal *terminal = get_terminal(session);
+
+    if (terminal == NULL) {
+        reply_error(out, "Session has no terminal");
+        return;
+    }
+
+    stulto_terminal_flush_output(terminal);
+
+    VteTerminal *terminal_widget = stulto_terminal_get_terminal_widget(terminal);
+    GBytes *bytes = stulto_export_render(terminal_widget, STULTO_EXPORT_FORMAT_TEXT, FALSE,
+                                         vte_terminal_get_row_count(terminal_widget));
+    gsize len;
+    const gchar *data = g_bytes_get_data(bytes, &len);
+    gchar *text = g_strndup(data, len);
+
+    g_string_append(out, "{\"ok\":true,\"text\":");
+    append_json_string(out, text);
+    g_string_append(out, "}\n");
+
+    g_free(text);
+    g_bytes_unref(bytes);
+}
+
+/*
+ * Start exporting the active pane's scrollback and screen; the export carries on after the reply
+ */
+static void run_export(StultoSession *session, const gchar *path, const gchar *format_name, GString *out) {
+    StultoTerminal *terminal = get_terminal(session);
+    StultoExportFormat format = stulto_export_format_from_path(path);
+    GError *error = NULL;
+
+    if (terminal == NULL) {
+        reply_error(out, "Session has no terminal");
+        return;
+    }
+
+    /* Relative to what? The client's working directory isn't ours */
+    if (!g_path_is_absolute(path)) {
+        reply_error(out, "Path must be absolute: %s", path);
+        return;
+    }
+
+    if (format_name != NULL && !stulto_export_format_from_name(format_name, &format)) {
+        reply_error(out, "Unknown format %s", format_name);
+        return;
+    }
+
+    if (!stulto_terminal_export(terminal, path, format, &error)) {
+        reply_error(out, "%s", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    reply_ok(out);
+}
+
+static void run_subscribe(ControlClient *client, StultoSession *session) {
+    StultoTerminal *terminal = get_terminal(session);
+
+    if (terminal == NULL) {
+        reply_error(client->out, "Session has no terminal");
+        return;
+    }
+
+    reply_ok(client->out);
+    client->subscribe_to = terminal;
+}
+
+static void run_close(StultoControl *control, StultoSession *session, GString *out) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(control->session_manager);
+
+    /* Closing the last session would close the window, and the socket with it */
+    if (gtk_notebook_get_n_pages(notebook) == 1) {
+        reply_error(out, "Can't close the only session");
+        return;
+    }
+
+    gtk_notebook_remove_page(notebook, gtk_notebook_page_num(notebook, GTK_WIDGET(session)));
+    reply_ok(out);
+}
+
+static void run_toggle(StultoControl *control, GString *out) {
+    GtkWidget *window = gtk_widget_get_toplevel(GTK_WIDGET(control->session_manager));
+
+    if (!STULTO_IS_MAIN_WINDOW(window)) {
+        reply_error(out, "No window to toggle");
+        return;
+    }
+
+    stulto_main_window_toggle(STULTO_MAIN_WINDOW(window));
+    reply_ok(out);
+}
+
+static void run_command(ControlClient *client, gchar *line) {
+    StultoControl *control = client->control;
+    GString *out = client->out;
+    GError *error = NULL;
+    gchar **argv = NULL;
+    gint argc;
+
+    /* Blank lines aren't commands, and get no reply */
+    if (*g_strchug(line) == '\0') {
+        return;
+    }
+
+    if (!g_shell_parse_argv(line, &argc, &argv, &error)) {
+        reply_error(out, "%s", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    const gchar *command = argv[0];
+    StultoSession *session = NULL;
+
+    if (g_str_equal(command, "list") && argc == 1) {
+        run_list(control, out);
+    } else if (g_str_equal(command, "toggle") && argc == 1) {
+        run_toggle(control, out);
+    } else if (g_str_equal(command, "new-session")) {
+        run_new_session(control, argv + 1, out);
+    } else if ((g_str_equal(command, "send") && argc == 3)
+               || (g_str_equal(command, "export") && (argc == 3 || argc == 4))
+               || ((g_str_equal(command, "get-text") || g_str_equal(command, "subscribe")
+                    || g_str_equal(command, "switch") || g_str_equal(command, "close"))
+                   && argc == 2)) {
+        session = find_session(control, argv[1]);
+
+        if (session == NULL) {
+            reply_error(out, "No session %s", argv[1]);
+        } else if (g_str_equal(command, "send")) {
+            run_send(session, argv[2], out);
+        } else if (g_str_equal(command, "get-text")) {
+            run_get_text(session, out);
+        } else if (g_str_equal(command, "export")) {
+            run_export(session, argv[2], argv[3], out);
+        } else if (g_str_equal(command, "subscribe")) {
+            run_subscribe(client, session);
+        } else if (g_str_equal(command, "switch")) {
+            stulto_session_manager_set_active_session(control->session_manager, session);
+            reply_ok(out);
+        } else {
+            run_close(control, session, out);
+        }
+    } else {
+        reply_error(out, "Unknown command, or wrong number of arguments: %s", command);
+    }
+
+    g_strfreev(argv);
+}
+
+// endregion
+
+// region Clients
+
+static void client_free(ControlClient *client) {
+    if (client->read_source != 0) {
+        g_source_remove(client->read_source);
+    }
+    if (client->write_source != 0) {
+        g_source_remove(client->write_source);
+    }
+
+    if (client->fd >= 0) {
+        close(client->fd);
+    }
+    g_string_free(client->in, TRUE);
+    g_string_free(client->out, TRUE);
+    g_free(client);
+}
+
+static void drop_client(ControlClient *client) {
+    g_ptr_array_remove(client->control->clients, client);
+}
+
+/*
+ * Write as much of the pending replies as the socket takes; FALSE if the client went away
+ */
+static gboolean flush_out(ControlClient *client) {
+    while (client->out->len > 0) {
+        gssize n = send(client->fd, client->out->str, client->out->len, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN;
+        }
+
+        g_string_erase(client->out, 0, n);
+    }
+
+    return TRUE;
+}
+
+static gboolean client_writable_cb(gint fd, GIOCondition condition, gpointer data) {
+    ControlClient *client = data;
+
+    if (flush_out(client) && client->out->len > 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    client->write_source = 0;
+
+    if (client->closing || client->out->len > 0) {
+        drop_client(client);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Run every complete command received so far; their replies go out together
+ *
+ * Returns whether the connection was handed over to a terminal's output, which ends the batch
+ */
+static gboolean run_commands(ControlClient *client) {
+    gchar *start = client->in->str;
+    gchar *end = client->in->str + client->in->len;
+    gchar *newline;
+    guint n_commands = 0;
+    gint64 start_time = g_get_monotonic_time();
+
+    while (client->subscribe_to == NULL && (newline = memchr(start, '\n', end - start)) != NULL) {
+        *newline = '\0';
+        run_command(client, start);
+
+        start = newline + 1;
+        n_commands++;
+    }
+
+    g_string_erase(client->in, 0, start - client->in->str);
+
+    if (n_commands > 0) {
+        g_debug("Ran %u control commands in %.1f ms", n_commands, (g_get_monotonic_time() - start_time) / 1000.0);
+    }
+
+    if (client->subscribe_to == NULL) {
+        return FALSE;
+    }
+
+    /* Any replies still unsent go ahead of the output */
+    stulto_terminal_subscribe_output(client->subscribe_to, client->fd, client->out->str, client->out->len);
+    client->fd = -1;
+
+    return TRUE;
+}
+
+static gboolean client_readable_cb(gint fd, GIOCondition condition, gpointer data) {
+    static gchar buf[STULTO_CONTROL_READ_SIZE];
+    ControlClient *client = data;
+    gssize n;
+
+    /* Everything that has arrived makes up the batch */
+    while (TRUE) {
+        n = read(fd, buf, sizeof(buf));
+
+        if (n > 0) {
+            g_string_append_len(client->in, buf, n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            break;
+        }
+    }
+
+    gboolean eof = n == 0 || (n < 0 && errno != EAGAIN);
+
+    /* A last command without a newline still counts */
+    if (eof && client->in->len > 0 && client->in->str[client->in->len - 1] != '\n') {
+        g_string_append_c(client->in, '\n');
+    }
+
+    if (run_commands(client)) {
+        client->read_source = 0;
+        drop_client(client);
+
+        return G_SOURCE_REMOVE;
+    }
+
+    if (client->in->len > STULTO_CONTROL_MAX_LINE || !flush_out(client)) {
+        client->read_source = 0;
+        drop_client(client);
+
+        return G_SOURCE_REMOVE;
+    }
+
+    if (eof) {
+        client->read_source = 0;
+        client->closing = TRUE;
+    }
+
+    if (client->out->len == 0) {
+        if (eof) {
+            drop_client(client);
+        }
+    } else if (client->write_source == 0) {
+        client->write_source = g_unix_fd_add(fd, G_IO_OUT, client_writable_cb, client);
+    }
+
+    return eof ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
+}
+
+static gboolean listen_cb(gint fd, GIOCondition condition, gpointer data) {
+    StultoControl *control = data;
+    gint client_fd = accept(fd, NULL, NULL);
+
+    if (client_fd < 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    ControlClient *client = g_new0(ControlClient, 1);
+
+    client->control = control;
+    client->fd = client_fd;
+    client->in = g_string_new(NULL);
+    client->out = g_string_new(NULL);
+
+    g_unix_set_fd_nonblocking(client_fd, TRUE, NULL);
+    client->read_source = g_unix_fd_add(client_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, client_readable_cb, client);
+
+    g_ptr_array_add(control->clients, client);
+
+    return G_SOURCE_CONTINUE;
+}
+
+// endregion
+
+// region Lifecycle
+
+/*
+ * Whether something accepts connections on addr; a socket file nobody listens on is only left over
+ */
+static gboolean is_listening(const struct sockaddr_un *addr) {
+    gint fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        return FALSE;
+    }
+
+    gboolean listening = connect(fd, (const struct sockaddr *) addr, sizeof(*addr)) == 0;
+
+    close(fd);
+
+    return listening;
+}
+
+/*
+ * Whether another Stulto is already listening on the socket named socket_name
+ */
+gboolean stulto_control_is_running(const gchar *socket_name) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    gchar *socket_path = g_build_filename(g_get_user_runtime_dir(), STULTO_CONTROL_SOCKET_DIR, socket_name, NULL);
+    gboolean running = FALSE;
+
+    if (strlen(socket_path) < sizeof(addr.sun_path)) {
+        strcpy(addr.sun_path, socket_path);
+        running = is_listening(&addr);
+    }
+
+    g_free(socket_path);
+
+    return running;
+}
+
+/*
+ * Listen for commands on this instance's socket, named socket_name or else after the pid, and name it to the programs
+ * started from here on
+ */
+StultoControl *stulto_control_new(StultoSessionManager *session_manager,
+                                  StultoTerminalProfile *profile,
+                                  const gchar *socket_name,
+                                  GError **error) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    gchar *dir = g_build_filename(g_get_user_runtime_dir(), STULTO_CONTROL_SOCKET_DIR, NULL);
+    gchar *file_name = socket_name != NULL
+            ? g_strdup(socket_name)
+            : g_strdup_printf(STULTO_CONTROL_SOCKET_PREFIX "%d" STULTO_CONTROL_SOCKET_SUFFIX, getpid());
+    gchar *socket_path = g_build_filename(dir, file_name, NULL);
+    gint fd = -1;
+
+    g_free(file_name);
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FILENAME_TOO_LONG, "Socket path too long: %s", socket_path);
+        goto fail;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    g_mkdir_with_parents(dir, 0700);
+
+    /* Never take a socket over from a live Stulto, the drop-down already running say */
+    if (is_listening(&addr)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE, "Another Stulto is listening on %s", socket_path);
+        goto fail;
+    }
+
+    /* Left over from an earlier Stulto that had this pid, or that was the drop-down */
+    g_unlink(socket_path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        int saved_errno = errno;
+
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                    "Error listening on %s: %s", socket_path, g_strerror(saved_errno));
+        goto fail;
+    }
+
+    StultoControl *control = g_new0(StultoControl, 1);
+
+    control->session_manager = g_object_ref(session_manager);
+    control->profile = profile;
+    control->socket_path = socket_path;
+    control->listen_fd = fd;
+    control->listen_source = g_unix_fd_add(fd, G_IO_IN, listen_cb, control);
+    control->clients = g_ptr_array_new_with_free_func((GDestroyNotify) client_free);
+
+    g_setenv(STULTO_CONTROL_SOCKET_ENV, socket_path, TRUE);
+
+    g_free(dir);
+
+    return control;
+
+fail:
+    if (fd >= 0) {
+        close(fd);
+    }
+    g_free(socket_path);
+    g_free(dir);
+
+    return NULL;
+}
+
+void stulto_control_free(StultoControl *control) {
+    if (control == NULL) {
+        return;
+    }
+
+    g_source_remove(control->listen_source);
+    close(control->listen_fd);
+    g_unlink(control->socket_path);
+
+    g_ptr_array_unref(control->clients);
+    g_object_unref(control->session_manager);
+    g_free(control->socket_path);
+    g_free(control);
+}
+
+const gchar *stulto_control_get_socket_path(StultoControl *control) {
+    return control->socket_path;
+}
+
+// endregion
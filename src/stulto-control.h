@@ -0,0 +1,64 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_CONTROL_H
+#define STULTO_CONTROL_H
+
+#include <gtk/gtk.h>
+
+#include "stulto-session-manager.h"
+
+/*
+ * A Unix socket for scripting a window's sessions (see stulto-control-protocol.h for where it lives)
+ *
+ * Clients write commands, one per line, with shell quoting:
+ *
+ *   list                     each session's number, name, pane count, and active pane's foreground process, and
+ *                            with resource-usage on, its process count, CPU time (ms), RSS and I/O (bytes) as of
+ *                            the last sample
+ *   new-session [COMMAND [ARG...]]
+ *   send SESSION TEXT        TEXT takes C escapes (\n, \t, \033, ...) and goes straight to the active pane's PTY
+ *   get-text SESSION         the active pane's screen, as plain text
+ *   export SESSION PATH [FORMAT]
+ *                            the active pane's scrollback and screen, written to PATH (absolute) in the background
+ *                            as text, ansi or html, by default as PATH's extension suggests
+ *   subscribe SESSION        the active pane's raw output from then on, streamed after the reply until the client
+ *                            disconnects; commands after it are ignored
+ *   switch SESSION
+ *   close SESSION
+ *   toggle                   show and focus the window, or hide it if it is already in view
+ *
+ * where SESSION is a session's number or name. Each command is answered with a line of JSON, {"ok": true, ...} or
+ * {"ok": false, "error": "..."}, in order. All the commands that arrive together are run together and answered with
+ * a single write, so a client can pipeline a whole batch in one round trip
+ */
+
+typedef struct _StultoControl StultoControl;
+
+StultoControl *stulto_control_new(StultoSessionManager *session_manager,
+                                  StultoTerminalProfile *profile,
+                                  const gchar *socket_name,
+                                  GError **error);
+void stulto_control_free(StultoControl *control);
+
+gboolean stulto_control_is_running(const gchar *socket_name);
+
+const gchar *stulto_control_get_socket_path(StultoControl *control);
+
+#endif //STULTO_CONTROL_H
@@ -63,4 +63,14 @@ StultoExecData *stulto_exec_data_create(gchar **cmd_argv) {
     exec_data->command_argv = cmd_argv;
 
     return exec_data;
-}
\ No newline at end of file
+}
+
+void stulto_exec_data_free(StultoExecData *exec_data) {
+    if (exec_data == NULL) {
+        return;
+    }
+
+    g_strfreev(exec_data->command_argv);
+    g_free(exec_data->cwd);
+    g_free(exec_data);
+}
@@ -28,10 +28,16 @@
 
 typedef struct _StultoExecData {
     gchar **command_argv;
+    /* NULL for Stulto's own working directory */
+    gchar *cwd;
+    /* The PTY holder's id of the PTY to attach to instead of starting the command, or 0 */
+    guint holder_id;
 } StultoExecData;
 
 StultoExecData *stulto_exec_data_default();
 
 StultoExecData *stulto_exec_data_create(gchar **cmd_argv);
 
+void stulto_exec_data_free(StultoExecData *exec_data);
+
 #endif //STULTO_EXEC_DATA_H
@@ -0,0 +1,700 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "stulto-export.h"
+
+/* Rows read from VTE at a time */
+#define STULTO_EXPORT_SLICE_ROWS 500
+/* Time spent reading per main loop iteration before yielding to input and redraws */
+#define STULTO_EXPORT_SLICE_USEC 4000
+/* Slices allowed to queue up for the worker before reading waits for the disk */
+#define STULTO_EXPORT_MAX_BACKLOG 16
+/* How long to wait for the worker to catch up */
+#define STULTO_EXPORT_BACKLOG_WAIT_MS 10
+
+static const gchar HTML_HEADER[] =
+        "<!DOCTYPE html>\n"
+        "<html>\n"
+        "<head><meta charset=\"utf-8\"><title>Stulto</title></head>\n"
+        "<body>\n"
+        "<pre>";
+static const gchar HTML_FOOTER[] =
+        "</pre>\n"
+        "</body>\n"
+        "</html>\n";
+static const gchar ANSI_FOOTER[] = "\033[0m";
+
+struct _StultoExport {
+    VteTerminal *terminal_widget;
+    gchar *path;
+    gint fd;
+    StultoExportFormat format;
+    /* Prefix each line with the time it arrived, if set */
+    StultoLineTimes *line_times;
+    gboolean at_line_start;
+
+    guint source;
+    glong first_row;
+    glong row;
+    glong end_row;
+    /* Rows that scrolled out of the scrollback before they were read */
+    glong rows_lost;
+    gboolean producing;
+    gboolean cancelled;
+    gint64 start_time;
+
+    /* Resets for the attributes of each open HTML tag, while converting to ANSI */
+    GPtrArray *ansi_resets;
+
+    GThreadPool *pool;
+    gint failed;
+    /* Set by the worker only, and read once it is done */
+    GError *error;
+
+    StultoExportProgressFunc progress_func;
+    StultoExportFinishedFunc finished_func;
+    gpointer user_data;
+};
+
+// region Formats
+
+gboolean stulto_export_format_from_name(const gchar *name, StultoExportFormat *format) {
+    if (g_ascii_strcasecmp(name, "text") == 0 || g_ascii_strcasecmp(name, "txt") == 0) {
+        *format = STULTO_EXPORT_FORMAT_TEXT;
+    } else if (g_ascii_strcasecmp(name, "ansi") == 0) {
+        *format = STULTO_EXPORT_FORMAT_ANSI;
+    } else if (g_ascii_strcasecmp(name, "html") == 0) {
+        *format = STULTO_EXPORT_FORMAT_HTML;
+    } else {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+StultoExportFormat stulto_export_format_from_path(const gchar *path) {
+    const gchar *extension = strrchr(path, '.');
+    StultoExportFormat format = STULTO_EXPORT_FORMAT_TEXT;
+
+    if (extension != NULL && g_ascii_strcasecmp(extension, ".htm") == 0) {
+        return STULTO_EXPORT_FORMAT_HTML;
+    }
+
+    if (extension != NULL) {
+        stulto_export_format_from_name(extension + 1, &format);
+    }
+
+    return format;
+}
+
+static gboolean parse_hex_color(const gchar *p, gint rgb[3]) {
+    for (gint i = 0; i < 3; i++) {
+        gint high = g_ascii_xdigit_value(p[2 * i]);
+        gint low = high >= 0 ? g_ascii_xdigit_value(p[2 * i + 1]) : -1;
+
+        if (low < 0) {
+            return FALSE;
+        }
+        rgb[i] = high << 4 | low;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Find a color attribute (color="#rrggbb") or style property (color:#rrggbb) in a tag's attributes
+ */
+static gboolean find_color(const gchar *attributes, const gchar *key, gint rgb[3]) {
+    for (const gchar *p = strstr(attributes, key); p != NULL; p = strstr(p + 1, key)) {
+        /* "color" is also the end of "background-color" */
+        if (p > attributes && (p[-1] == '-' || g_ascii_isalnum(p[-1]))) {
+            continue;
+        }
+
+        p += strlen(key);
+        while (*p == ' ' || *p == '=' || *p == ':' || *p == '"' || *p == '\'') {
+            p++;
+        }
+
+        if (*p == '#' && parse_hex_color(p + 1, rgb)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void append_tag_as_ansi(StultoExport *export, GString *out, const gchar *tag, gsize len) {
+    gchar *name_end = NULL;
+    gchar *tag_text = g_strndup(tag, len);
+    const gchar *reset = "";
+
+    if (tag_text[0] == '/') {
+        /* Closing tags undo whatever their opening tag set */
+        if (export->ansi_resets->len > 0) {
+            gchar *resets = g_ptr_array_steal_index(export->ansi_resets, export->ansi_resets->len - 1);
+
+            g_string_append(out, resets);
+            g_free(resets);
+        }
+        g_free(tag_text);
+        return;
+    }
+
+    name_end = tag_text + strcspn(tag_text, " /");
+
+    gchar *name = g_ascii_strdown(tag_text, name_end - tag_text);
+    const gchar *attributes = name_end;
+
+    if (g_str_equal(name, "br")) {
+        g_string_append_c(out, '\n');
+        g_free(name);
+        g_free(tag_text);
+        return;
+    }
+
+    GString *resets = g_string_new(NULL);
+    gint rgb[3];
+
+    if (g_str_equal(name, "b")) {
+        g_string_append(out, "\033[1m");
+        reset = "\033[22m";
+    } else if (g_str_equal(name, "i")) {
+        g_string_append(out, "\033[3m");
+        reset = "\033[23m";
+    } else if (g_str_equal(name, "u")) {
+        g_string_append(out, "\033[4m");
+        reset = "\033[24m";
+    } else if (g_str_equal(name, "s") || g_str_equal(name, "strike")) {
+        g_string_append(out, "\033[9m");
+        reset = "\033[29m";
+    }
+    g_string_append(resets, reset);
+
+    if (find_color(attributes, "color", rgb)) {
+        g_string_append_printf(out, "\033[38;2;%d;%d;%dm", rgb[0], rgb[1], rgb[2]);
+        g_string_append(resets, "\033[39m");
+    }
+    if (find_color(attributes, "background-color", rgb) || find_color(attributes, "bgcolor", rgb)) {
+        g_string_append_printf(out, "\033[48;2;%d;%d;%dm", rgb[0], rgb[1], rgb[2]);
+        g_string_append(resets, "\033[49m");
+    }
+
+    g_ptr_array_add(export->ansi_resets, g_string_free(resets, FALSE));
+
+    g_free(name);
+    g_free(tag_text);
+}
+
+static void append_entity(GString *out, const gchar *entity, gsize len) {
+    gunichar c = 0;
+
+    if (len > 1 && entity[0] == '#') {
+        c = entity[1] == 'x' || entity[1] == 'X'
+                ? g_ascii_strtoull(entity + 2, NULL, 16)
+                : g_ascii_strtoull(entity + 1, NULL, 10);
+    } else if (strncmp(entity, "lt", len) == 0) {
+        c = '<';
+    } else if (strncmp(entity, "gt", len) == 0) {
+        c = '>';
+    } else if (strncmp(entity, "amp", len) == 0) {
+        c = '&';
+    } else if (strncmp(entity, "quot", len) == 0) {
+        c = '"';
+    } else if (strncmp(entity, "apos", len) == 0) {
+        c = '\'';
+    } else if (strncmp(entity, "nbsp", len) == 0) {
+        c = ' ';
+    }
+
+    if (c != 0 && g_unichar_validate(c)) {
+        g_string_append_unichar(out, c);
+    }
+}
+
+/*
+ * VTE renders attributes as HTML only; turn its markup back into SGR sequences
+ */
+static void append_html_as_ansi(StultoExport *export, GString *out, const gchar *html) {
+    const gchar *p = html;
+
+    while (*p != '\0') {
+        if (*p == '<') {
+            const gchar *end = strchr(p, '>');
+
+            if (end == NULL) {
+                break;
+            }
+            append_tag_as_ansi(export, out, p + 1, end - p - 1);
+            p = end + 1;
+        } else if (*p == '&') {
+            const gchar *end = strchr(p, ';');
+
+            if (end != NULL && end - p <= 10) {
+                append_entity(out, p + 1, end - p - 1);
+                p = end + 1;
+            } else {
+                g_string_append_c(out, *p++);
+            }
+        } else {
+            const gchar *end = p + strcspn(p, "<&");
+
+            g_string_append_len(out, p, end - p);
+            p = end;
+        }
+    }
+}
+
+/*
+ * VTE wraps every range it renders as HTML in its own <pre>
+ */
+static void append_html(GString *out, const gchar *html) {
+    gsize len = strlen(html);
+
+    if (g_str_has_prefix(html, "<pre>")) {
+        html += strlen("<pre>");
+        len -= strlen("<pre>");
+    }
+    if (g_str_has_suffix(html, "</pre>")) {
+        len -= strlen("</pre>");
+    }
+
+    g_string_append_len(out, html, len);
+}
+
+static void append_rows(StultoExport *export, GString *out, glong start_row, glong end_row) {
+    glong columns = vte_terminal_get_column_count(export->terminal_widget);
+    gchar *text;
+
+#if VTE_CHECK_VERSION(0, 72, 0)
+    text = vte_terminal_get_text_range_format(
+            export->terminal_widget,
+            export->format == STULTO_EXPORT_FORMAT_TEXT ? VTE_FORMAT_TEXT : VTE_FORMAT_HTML,
+            start_row, 0,
+            end_row - 1, columns - 1,
+            NULL);
+
+    if (text != NULL) {
+        switch (export->format) {
+            case STULTO_EXPORT_FORMAT_TEXT:
+                g_string_append(out, text);
+                break;
+            case STULTO_EXPORT_FORMAT_ANSI:
+                append_html_as_ansi(export, out, text);
+                break;
+            case STULTO_EXPORT_FORMAT_HTML:
+                append_html(out, text);
+                break;
+        }
+    }
+#else
+    /* No attributes to be had; ANSI degrades to plain text */
+    text = vte_terminal_get_text_range(
+            export->terminal_widget,
+            start_row, 0,
+            end_row - 1, columns - 1,
+            NULL, NULL, NULL);
+
+    if (text != NULL) {
+        if (export->format == STULTO_EXPORT_FORMAT_HTML) {
+            gchar *escaped = g_markup_escape_text(text, -1);
+
+            g_string_append(out, escaped);
+            g_free(escaped);
+        } else {
+            g_string_append(out, text);
+        }
+    }
+#endif
+
+    g_free(text);
+}
+
+/*
+ * Whether the output ends a line, i.e. nothing but markup or SGR sequences follows its last newline
+ */
+static gboolean ends_line(const gchar *text) {
+    const gchar *p = strrchr(text, '\n');
+
+    if (p == NULL) {
+        return FALSE;
+    }
+
+    for (p++; *p != '\0'; p++) {
+        const gchar *end;
+
+        if (*p == '<') {
+            end = strchr(p, '>');
+        } else if (*p == '\033') {
+            end = strchr(p, 'm');
+        } else {
+            return FALSE;
+        }
+
+        if (end == NULL) {
+            return FALSE;
+        }
+        p = end;
+    }
+
+    return TRUE;
+}
+
+static GBytes *read_rows(StultoExport *export, glong start_row, glong end_row) {
+    GString *out = g_string_new(NULL);
+
+    if (export->line_times == NULL) {
+        append_rows(export, out, start_row, end_row);
+        return g_string_free_to_bytes(out);
+    }
+
+    /* Row by row, to tell where each line starts */
+    for (glong row = start_row; row < end_row; row++) {
+        if (export->at_line_start) {
+            gchar *time = stulto_line_times_format(export->line_times, row);
+
+            g_string_append_printf(out, "[%s] ", time != NULL ? time : "-");
+            g_free(time);
+        }
+
+        gsize len = out->len;
+
+        append_rows(export, out, row, row + 1);
+        export->at_line_start = ends_line(out->str + len);
+    }
+
+    return g_string_free_to_bytes(out);
+}
+
+// endregion
+
+// region Worker thread
+
+static gboolean export_finished_cb(gpointer data) {
+    StultoExport *export = data;
+
+    if (export->error != NULL || export->cancelled) {
+        g_unlink(export->path);
+    }
+
+    g_debug("Exported %ld of %ld rows to %s in %.1f ms, %ld lost%s",
+            export->row - export->first_row - export->rows_lost, export->end_row - export->first_row, export->path,
+            (g_get_monotonic_time() - export->start_time) / 1000.0,
+            export->rows_lost,
+            export->cancelled ? " (cancelled)" : "");
+
+    export->finished_func(export->error, export->cancelled, export->rows_lost, export->user_data);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void set_errno_error(StultoExport *export, int saved_errno) {
+    if (export->error == NULL) {
+        export->error = g_error_new(
+                G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                "Failed to write %s: %s", export->path, g_strerror(saved_errno));
+    }
+    g_atomic_int_set(&export->failed, TRUE);
+}
+
+/*
+ * Write a slice out; an empty slice marks the end of the export
+ */
+static void export_write_slice(gpointer slice_data, gpointer export_data) {
+    GBytes *slice = slice_data;
+    StultoExport *export = export_data;
+
+    gsize len;
+    const gchar *data = g_bytes_get_data(slice, &len);
+
+    if (len == 0) {
+        if (close(export->fd) < 0) {
+            set_errno_error(export, errno);
+        }
+        export->fd = -1;
+
+        g_idle_add(export_finished_cb, export);
+    }
+
+    while (len > 0 && !g_atomic_int_get(&export->failed)) {
+        gssize n = write(export->fd, data, len);
+
+        if (n < 0) {
+            if (errno != EINTR) {
+                set_errno_error(export, errno);
+            }
+            continue;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    g_bytes_unref(slice);
+}
+
+// endregion
+
+// region Reading
+
+static gboolean export_slice_cb(gpointer data);
+
+static void schedule_slice(StultoExport *export, gboolean backlogged) {
+    if (backlogged) {
+        export->source = g_timeout_add(STULTO_EXPORT_BACKLOG_WAIT_MS, export_slice_cb, export);
+    } else {
+        export->source = g_idle_add(export_slice_cb, export);
+    }
+}
+
+static void push_bytes(StultoExport *export, const gchar *data) {
+    g_thread_pool_push(export->pool, g_bytes_new(data, strlen(data)), NULL);
+}
+
+static void finish_reading(StultoExport *export) {
+    export->producing = FALSE;
+
+    if (!export->cancelled) {
+        switch (export->format) {
+            case STULTO_EXPORT_FORMAT_TEXT:
+                break;
+            case STULTO_EXPORT_FORMAT_ANSI:
+                push_bytes(export, ANSI_FOOTER);
+                break;
+            case STULTO_EXPORT_FORMAT_HTML:
+                push_bytes(export, HTML_FOOTER);
+                break;
+        }
+    }
+
+    g_thread_pool_push(export->pool, g_bytes_new(NULL, 0), NULL);
+}
+
+static gboolean export_slice_cb(gpointer data) {
+    StultoExport *export = data;
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(export->terminal_widget));
+
+    gint64 deadline = g_get_monotonic_time() + STULTO_EXPORT_SLICE_USEC;
+    gboolean backlogged = FALSE;
+
+    export->source = 0;
+
+    /* Output that arrived since the last slice may have pushed rows we hadn't read yet out of the scrollback */
+    glong lower = (glong) gtk_adjustment_get_lower(adjustment);
+
+    if (export->row < lower) {
+        export->rows_lost += MIN(lower, export->end_row) - export->row;
+        export->row = MIN(lower, export->end_row);
+    }
+
+    do {
+        if (g_atomic_int_get(&export->failed) || export->row >= export->end_row) {
+            finish_reading(export);
+            return G_SOURCE_REMOVE;
+        }
+
+        if (g_thread_pool_unprocessed(export->pool) >= STULTO_EXPORT_MAX_BACKLOG) {
+            backlogged = TRUE;
+            break;
+        }
+
+        glong end_row = MIN(export->row + STULTO_EXPORT_SLICE_ROWS, export->end_row);
+
+        g_thread_pool_push(export->pool, read_rows(export, export->row, end_row), NULL);
+        export->row = end_row;
+    } while (g_get_monotonic_time() < deadline);
+
+    export->progress_func(export->row - export->first_row, export->end_row - export->first_row, export->user_data);
+
+    schedule_slice(export, backlogged);
+
+    return G_SOURCE_REMOVE;
+}
+
+// endregion
+
+StultoExport *stulto_export_new(VteTerminal *terminal_widget,
+                                const gchar *path,
+                                StultoExportFormat format,
+                                StultoLineTimes *line_times,
+                                StultoExportProgressFunc progress_func,
+                                StultoExportFinishedFunc finished_func,
+                                gpointer user_data,
+                                GError **error) {
+    gint fd = g_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        int saved_errno = errno;
+
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Failed to open %s: %s", path, g_strerror(saved_errno));
+        return NULL;
+    }
+
+    StultoExport *export = g_new0(StultoExport, 1);
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal_widget));
+
+    export->terminal_widget = g_object_ref(terminal_widget);
+    export->path = g_strdup(path);
+    export->fd = fd;
+    export->format = format;
+    export->line_times = line_times;
+    export->at_line_start = TRUE;
+    export->ansi_resets = g_ptr_array_new_with_free_func(g_free);
+
+    export->progress_func = progress_func;
+    export->finished_func = finished_func;
+    export->user_data = user_data;
+
+    /* Rows written after the export starts aren't included; rows above may scroll out before they are read */
+    export->first_row = (glong) gtk_adjustment_get_lower(adjustment);
+    export->row = export->first_row;
+    export->end_row = (glong) gtk_adjustment_get_upper(adjustment);
+
+    export->pool = g_thread_pool_new_full(export_write_slice, export, (GDestroyNotify) g_bytes_unref, 1, FALSE, NULL);
+
+    if (format == STULTO_EXPORT_FORMAT_HTML) {
+        push_bytes(export, HTML_HEADER);
+    }
+
+    export->producing = TRUE;
+    export->start_time = g_get_monotonic_time();
+    schedule_slice(export, FALSE);
+
+    return export;
+}
+
+/*
+ * Stop reading; the finished callback still follows once the worker has closed the file
+ */
+void stulto_export_cancel(StultoExport *export) {
+    if (!export->producing) {
+        return;
+    }
+
+    if (export->source != 0) {
+        g_source_remove(export->source);
+        export->source = 0;
+    }
+
+    export->cancelled = TRUE;
+    finish_reading(export);
+}
+
+void stulto_export_free(StultoExport *export) {
+    if (export == NULL) {
+        return;
+    }
+
+    if (export->source != 0) {
+        g_source_remove(export->source);
+    }
+
+    /* Drop queued slices, but let the write in progress finish before the export goes away */
+    g_thread_pool_free(export->pool, TRUE, TRUE);
+
+    /* The worker may have finished just now, with the notification still pending */
+    g_idle_remove_by_data(export);
+
+    /* Freed before finishing - the file is incomplete */
+    if (export->fd >= 0) {
+        close(export->fd);
+        g_unlink(export->path);
+    }
+
+    g_clear_error(&export->error);
+    g_ptr_array_unref(export->ansi_resets);
+    g_object_unref(export->terminal_widget);
+    g_free(export->path);
+    g_free(export);
+}
+
+/*
+ * Render the last max_rows rows of the scrollback and screen at once (all of them if max_rows < 0), e.g. while
+ * quitting, when there is no main loop left to spread the work over
+ *
+ * With crlf, lines end in "\r\n", so the result can be fed back to a terminal as is
+ */
+GBytes *stulto_export_render(VteTerminal *terminal_widget, StultoExportFormat format, gboolean crlf, glong max_rows) {
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal_widget));
+    StultoExport export = {
+            .terminal_widget = terminal_widget,
+            .format = format,
+            .at_line_start = TRUE,
+            .ansi_resets = g_ptr_array_new_with_free_func(g_free),
+    };
+    GString *out = g_string_new(format == STULTO_EXPORT_FORMAT_HTML ? HTML_HEADER : NULL);
+    glong start_row = (glong) gtk_adjustment_get_lower(adjustment);
+    glong end_row = (glong) gtk_adjustment_get_upper(adjustment);
+
+    if (max_rows >= 0) {
+        start_row = MAX(start_row, end_row - max_rows);
+    }
+
+    for (glong row = start_row; row < end_row; row += STULTO_EXPORT_SLICE_ROWS) {
+        GBytes *slice = read_rows(&export, row, MIN(row + STULTO_EXPORT_SLICE_ROWS, end_row));
+        gsize len;
+        const gchar *data = g_bytes_get_data(slice, &len);
+
+        if (!crlf) {
+            g_string_append_len(out, data, len);
+        } else {
+            for (const gchar *p = data, *end = data + len; p < end; p++) {
+                if (*p == '\n') {
+                    g_string_append_c(out, '\r');
+                }
+                g_string_append_c(out, *p);
+            }
+        }
+
+        g_bytes_unref(slice);
+    }
+
+    if (format == STULTO_EXPORT_FORMAT_ANSI) {
+        g_string_append(out, ANSI_FOOTER);
+    } else if (format == STULTO_EXPORT_FORMAT_HTML) {
+        g_string_append(out, HTML_FOOTER);
+    }
+
+    g_ptr_array_unref(export.ansi_resets);
+
+    return g_string_free_to_bytes(out);
+}
+
+gboolean stulto_export_save(VteTerminal *terminal_widget,
+                            const gchar *path,
+                            StultoExportFormat format,
+                            gboolean crlf,
+                            GError **error) {
+    GBytes *contents = stulto_export_render(terminal_widget, format, crlf, -1);
+    gsize len;
+    const gchar *data = g_bytes_get_data(contents, &len);
+    gboolean saved = g_file_set_contents(path, data, (gssize) len, error);
+
+    g_bytes_unref(contents);
+
+    return saved;
+}
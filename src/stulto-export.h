@@ -0,0 +1,73 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_EXPORT_H
+#define STULTO_EXPORT_H
+
+#include <vte/vte.h>
+
+#include "stulto-line-times.h"
+
+/*
+ * An export of a terminal's scrollback and screen to a file, in progress
+ *
+ * The contents are read from VTE a slice of rows per main loop iteration, within a small time budget, and written out
+ * by a worker thread, so exporting a million lines neither blocks input nor waits on the disk. Slices are only read
+ * as fast as the worker writes them
+ *
+ * Given line times, which must outlive the export, each line is prefixed with the time it arrived
+ */
+
+typedef enum {
+    STULTO_EXPORT_FORMAT_TEXT,
+    STULTO_EXPORT_FORMAT_ANSI,
+    STULTO_EXPORT_FORMAT_HTML,
+} StultoExportFormat;
+
+typedef struct _StultoExport StultoExport;
+
+typedef void (*StultoExportProgressFunc)(glong rows_done, glong rows_total, gpointer user_data);
+/*
+ * The error is owned by the export; on failure or cancellation the partial file is removed. Otherwise, rows_lost counts
+ * rows that scrolled out of the scrollback before they could be read, and are missing from the file
+ */
+typedef void (*StultoExportFinishedFunc)(GError *error, gboolean cancelled, glong rows_lost, gpointer user_data);
+
+gboolean stulto_export_format_from_name(const gchar *name, StultoExportFormat *format);
+StultoExportFormat stulto_export_format_from_path(const gchar *path);
+
+StultoExport *stulto_export_new(VteTerminal *terminal_widget,
+                                const gchar *path,
+                                StultoExportFormat format,
+                                StultoLineTimes *line_times,
+                                StultoExportProgressFunc progress_func,
+                                StultoExportFinishedFunc finished_func,
+                                gpointer user_data,
+                                GError **error);
+void stulto_export_cancel(StultoExport *export);
+void stulto_export_free(StultoExport *export);
+
+GBytes *stulto_export_render(VteTerminal *terminal_widget, StultoExportFormat format, gboolean crlf, glong max_rows);
+gboolean stulto_export_save(VteTerminal *terminal_widget,
+                            const gchar *path,
+                            StultoExportFormat format,
+                            gboolean crlf,
+                            GError **error);
+
+#endif //STULTO_EXPORT_H
@@ -0,0 +1,315 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stulto-global-search.h"
+#include "stulto-search-index.h"
+
+struct _StultoGlobalSearch {
+    GtkWindow parent_instance;
+
+    StultoSessionManager *session_manager;
+
+    GtkSearchEntry *search_entry;
+    GtkListBox *list_box;
+    GtkLabel *status_label;
+
+    /* The text of the latest query, which the rows refer to */
+    gchar *query_text;
+    gboolean disposed;
+};
+
+G_DEFINE_FINAL_TYPE(StultoGlobalSearch, stulto_global_search, GTK_TYPE_WINDOW)
+
+typedef struct _SessionHit {
+    gint session_id;
+    guint order;
+    StultoSearchIndexHit *hit;
+} SessionHit;
+
+// region Declarations
+
+/* Vfunc implementations */
+static void stulto_global_search_dispose(GObject *object);
+static void stulto_global_search_finalize(GObject *object);
+
+static void stulto_global_search_class_init(StultoGlobalSearchClass *klass);
+static void stulto_global_search_init(StultoGlobalSearch *global_search);
+
+StultoGlobalSearch *stulto_global_search_new(GtkWindow *parent, StultoSessionManager *session_manager);
+
+// endregion
+
+// region Callbacks
+
+static gint session_hit_compare(gconstpointer a, gconstpointer b) {
+    const SessionHit *hit_a = a;
+    const SessionHit *hit_b = b;
+
+    if (hit_a->session_id != hit_b->session_id) {
+        return hit_a->session_id - hit_b->session_id;
+    }
+
+    return hit_a->order < hit_b->order ? -1 : hit_a->order > hit_b->order;
+}
+
+static GtkWidget *create_row(const SessionHit *session_hit) {
+    GtkWidget *row = gtk_list_box_row_new();
+    GtkWidget *label = gtk_label_new(session_hit->hit->line);
+
+    gtk_label_set_xalign(GTK_LABEL(label), 0);
+    gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+    gtk_widget_set_margin_start(label, 12);
+    gtk_container_add(GTK_CONTAINER(row), label);
+
+    g_object_set_data(G_OBJECT(row), "session-id", GINT_TO_POINTER(session_hit->session_id));
+    g_object_set_data(G_OBJECT(row), "source-id", GUINT_TO_POINTER(session_hit->hit->source_id));
+    g_object_set_data(G_OBJECT(row), "nth-from-end", GINT_TO_POINTER(session_hit->hit->nth_from_end));
+
+    return row;
+}
+
+static void clear_rows(StultoGlobalSearch *global_search) {
+    GList *rows = gtk_container_get_children(GTK_CONTAINER(global_search->list_box));
+
+    for (GList *l = rows; l != NULL; l = l->next) {
+        gtk_widget_destroy(GTK_WIDGET(l->data));
+    }
+
+    g_list_free(rows);
+}
+
+static void query_results_cb(GPtrArray *hits, const StultoSearchIndexStats *stats, gpointer data) {
+    StultoGlobalSearch *global_search = data;
+
+    if (hits == NULL || global_search->disposed) {
+        g_object_unref(global_search);
+        return;
+    }
+
+    /* Only this window's sessions are of interest; group their hits by session, in session order */
+    GArray *session_hits = g_array_new(FALSE, FALSE, sizeof(SessionHit));
+    guint n_sessions = 0;
+    gint last_session_id = -1;
+
+    for (guint i = 0; i < hits->len; i++) {
+        StultoSearchIndexHit *hit = g_ptr_array_index(hits, i);
+        SessionHit session_hit = {
+                .session_id = stulto_session_manager_find_session_by_index_id(
+                        global_search->session_manager, hit->source_id),
+                .order = i,
+                .hit = hit,
+        };
+
+        if (session_hit.session_id >= 0) {
+            g_array_append_val(session_hits, session_hit);
+        }
+    }
+
+    g_array_sort(session_hits, session_hit_compare);
+
+    clear_rows(global_search);
+
+    for (guint i = 0; i < session_hits->len; i++) {
+        SessionHit *session_hit = &g_array_index(session_hits, SessionHit, i);
+
+        if (session_hit->session_id != last_session_id) {
+            last_session_id = session_hit->session_id;
+            n_sessions++;
+        }
+
+        gtk_container_add(GTK_CONTAINER(global_search->list_box), create_row(session_hit));
+    }
+
+    gtk_widget_show_all(GTK_WIDGET(global_search->list_box));
+
+    gchar *index_size = g_format_size(stats->bytes);
+    gchar *status = g_strdup_printf(
+            "%u matching lines in %u sessions — %" G_GSIZE_FORMAT " lines indexed in %s, searched in %.1f ms",
+            session_hits->len, n_sessions, stats->lines, index_size, stats->query_usec / 1000.0);
+
+    gtk_label_set_text(global_search->status_label, status);
+
+    g_free(status);
+    g_free(index_size);
+    g_array_free(session_hits, TRUE);
+
+    g_object_unref(global_search);
+}
+
+static void search_changed_cb(GtkSearchEntry *entry, gpointer data) {
+    StultoGlobalSearch *global_search = data;
+    const gchar *text = gtk_entry_get_text(GTK_ENTRY(entry));
+
+    g_free(global_search->query_text);
+    global_search->query_text = g_strdup(text);
+
+    if (text[0] == '\0') {
+        clear_rows(global_search);
+        gtk_label_set_text(global_search->status_label, "");
+        return;
+    }
+
+    stulto_search_index_query(
+            stulto_search_index_get_default(),
+            text,
+            query_results_cb,
+            g_object_ref(global_search));
+}
+
+static void update_header_cb(GtkListBoxRow *row, GtkListBoxRow *before, gpointer data) {
+    StultoGlobalSearch *global_search = data;
+    gint session_id = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(row), "session-id"));
+
+    if (before != NULL && GPOINTER_TO_INT(g_object_get_data(G_OBJECT(before), "session-id")) == session_id) {
+        gtk_list_box_row_set_header(row, NULL);
+        return;
+    }
+
+    if (gtk_list_box_row_get_header(row) != NULL) {
+        return;
+    }
+
+    GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(global_search->session_manager), session_id);
+    StultoTerminal *terminal = page ? stulto_session_get_active_terminal(STULTO_SESSION(page)) : NULL;
+    const gchar *title = terminal ? vte_terminal_get_window_title(stulto_terminal_get_terminal_widget(terminal)) : NULL;
+
+    // GtkNotebook uses zero-based page numbering, hence we add 1 for user-friendly output
+    gchar *text = g_markup_printf_escaped("<b>[%d] %s</b>", session_id + 1, title ? title : "");
+    GtkWidget *header = gtk_label_new(NULL);
+
+    gtk_label_set_markup(GTK_LABEL(header), text);
+    gtk_label_set_xalign(GTK_LABEL(header), 0);
+    gtk_label_set_ellipsize(GTK_LABEL(header), PANGO_ELLIPSIZE_END);
+    gtk_list_box_row_set_header(row, header);
+
+    g_free(text);
+}
+
+static void row_activated_cb(GtkListBox *list_box, GtkListBoxRow *row, gpointer data) {
+    StultoGlobalSearch *global_search = data;
+    gint session_id = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(row), "session-id"));
+    guint source_id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(row), "source-id"));
+    gint nth_from_end = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(row), "nth-from-end"));
+    GtkWidget *page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(global_search->session_manager), session_id);
+
+    if (page == NULL || global_search->query_text == NULL) {
+        return;
+    }
+
+    StultoTerminal *terminal = stulto_session_find_terminal_by_index_id(STULTO_SESSION(page), source_id);
+
+    stulto_session_manager_set_active_session(global_search->session_manager, STULTO_SESSION(page));
+    if (terminal != NULL) {
+        stulto_session_set_active_terminal(STULTO_SESSION(page), terminal);
+    }
+    stulto_session_search_for(STULTO_SESSION(page), global_search->query_text, nth_from_end);
+
+    gtk_widget_destroy(GTK_WIDGET(global_search));
+}
+
+static void search_activate_cb(GtkEntry *entry, gpointer data) {
+    StultoGlobalSearch *global_search = data;
+    GtkListBoxRow *row = gtk_list_box_get_row_at_index(global_search->list_box, 0);
+
+    if (row != NULL) {
+        row_activated_cb(global_search->list_box, row, global_search);
+    }
+}
+
+static void stop_search_cb(GtkSearchEntry *entry, gpointer data) {
+    gtk_widget_destroy(GTK_WIDGET(data));
+}
+
+// endregion
+
+// region GObject/GtkWidget lifecycle
+
+static void stulto_global_search_dispose(GObject *object) {
+    StultoGlobalSearch *global_search = STULTO_GLOBAL_SEARCH(object);
+
+    /* Queries still in flight hold a reference, and must find out the widgets are gone */
+    global_search->disposed = TRUE;
+
+    G_OBJECT_CLASS(stulto_global_search_parent_class)->dispose(object);
+}
+
+static void stulto_global_search_finalize(GObject *object) {
+    StultoGlobalSearch *global_search = STULTO_GLOBAL_SEARCH(object);
+
+    g_free(global_search->query_text);
+
+    G_OBJECT_CLASS(stulto_global_search_parent_class)->finalize(object);
+}
+
+static void stulto_global_search_class_init(StultoGlobalSearchClass *klass) {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+    object_class->dispose = stulto_global_search_dispose;
+    object_class->finalize = stulto_global_search_finalize;
+}
+
+static void stulto_global_search_init(StultoGlobalSearch *global_search) {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_container_set_border_width(GTK_CONTAINER(box), 6);
+
+    GtkWidget *search_entry = gtk_search_entry_new();
+    gtk_box_pack_start(GTK_BOX(box), search_entry, FALSE, FALSE, 0);
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_box_pack_start(GTK_BOX(box), scrolled_window, TRUE, TRUE, 0);
+
+    GtkWidget *list_box = gtk_list_box_new();
+    gtk_list_box_set_header_func(GTK_LIST_BOX(list_box), update_header_cb, global_search, NULL);
+    gtk_list_box_set_activate_on_single_click(GTK_LIST_BOX(list_box), FALSE);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), list_box);
+
+    GtkWidget *status_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(status_label), 0);
+    gtk_label_set_ellipsize(GTK_LABEL(status_label), PANGO_ELLIPSIZE_END);
+    gtk_box_pack_end(GTK_BOX(box), status_label, FALSE, FALSE, 0);
+
+    gtk_container_add(GTK_CONTAINER(global_search), box);
+
+    global_search->search_entry = GTK_SEARCH_ENTRY(search_entry);
+    global_search->list_box = GTK_LIST_BOX(list_box);
+    global_search->status_label = GTK_LABEL(status_label);
+
+    gtk_window_set_title(GTK_WINDOW(global_search), "Search All Sessions");
+    gtk_window_set_default_size(GTK_WINDOW(global_search), 720, 480);
+    gtk_window_set_type_hint(GTK_WINDOW(global_search), GDK_WINDOW_TYPE_HINT_DIALOG);
+    gtk_window_set_destroy_with_parent(GTK_WINDOW(global_search), TRUE);
+
+    g_signal_connect(search_entry, "search-changed", G_CALLBACK(search_changed_cb), global_search);
+    g_signal_connect(search_entry, "activate", G_CALLBACK(search_activate_cb), global_search);
+    g_signal_connect(search_entry, "stop-search", G_CALLBACK(stop_search_cb), global_search);
+    g_signal_connect(list_box, "row-activated", G_CALLBACK(row_activated_cb), global_search);
+}
+
+StultoGlobalSearch *stulto_global_search_new(GtkWindow *parent, StultoSessionManager *session_manager) {
+    StultoGlobalSearch *global_search = STULTO_GLOBAL_SEARCH(g_object_new(STULTO_TYPE_GLOBAL_SEARCH, NULL));
+
+    global_search->session_manager = session_manager;
+
+    gtk_window_set_transient_for(GTK_WINDOW(global_search), parent);
+
+    return global_search;
+}
+
+// endregion
@@ -21,6 +21,13 @@
 
 struct _StultoHeaderBar {
     GtkHeaderBar parent_instance;
+
+    GtkLabel *indicator_label;
+    /* One mark per session; drawn only when a session's state actually changes */
+    GtkWidget *activity_strip;
+    /* Of StultoActivityState, by session */
+    GArray *activity;
+    gint current_session;
 };
 
 G_DEFINE_FINAL_TYPE(StultoHeaderBar, stulto_header_bar, GTK_TYPE_HEADER_BAR)
@@ -37,6 +44,10 @@ static guint signals[LAST_SIGNAL];
 #define HEADER_BAR_STYLE_CLASS "stulto-header-bar"
 #define SESSION_INDICATOR_STYLE_CLASS "session-indicator"
 
+/* Size of, and space between, the activity strip's marks */
+#define ACTIVITY_MARK_SIZE 8
+#define ACTIVITY_MARK_SPACING 4
+
 
 static void stulto_header_bar_dispose(GObject *object);
 static void stulto_header_bar_finalize(GObject *object);
@@ -63,11 +74,56 @@ static void next_session_btn_clicked_cb(GtkButton *button, gpointer data) {
     g_signal_emit(G_OBJECT(header_bar), signals[NEXT_SESSION], 0, NULL);
 }
 
+/*
+ * The current session as a solid mark in the text color, the rest as faint ones, colored by what they've been up to
+ */
+static gboolean activity_strip_draw_cb(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    StultoHeaderBar *header_bar = data;
+    GtkStyleContext *style_context = gtk_widget_get_style_context(widget);
+    gint height = gtk_widget_get_allocated_height(widget);
+    GdkRGBA color;
+
+    gtk_style_context_get_color(style_context, gtk_style_context_get_state(style_context), &color);
+
+    for (guint i = 0; i < header_bar->activity->len; i++) {
+        gdouble x = i * (ACTIVITY_MARK_SIZE + ACTIVITY_MARK_SPACING);
+        gdouble y = (height - ACTIVITY_MARK_SIZE) / 2.0;
+
+        if ((gint) i == header_bar->current_session) {
+            cairo_set_source_rgba(cr, color.red, color.green, color.blue, color.alpha);
+        } else {
+            switch (g_array_index(header_bar->activity, StultoActivityState, i)) {
+                case STULTO_ACTIVITY_OUTPUT:
+                    cairo_set_source_rgb(cr, 0.35, 0.6, 0.9);
+                    break;
+                case STULTO_ACTIVITY_SILENCE:
+                    cairo_set_source_rgb(cr, 0.95, 0.7, 0.2);
+                    break;
+                case STULTO_ACTIVITY_BELL:
+                    cairo_set_source_rgb(cr, 0.9, 0.3, 0.3);
+                    break;
+                default:
+                    cairo_set_source_rgba(cr, color.red, color.green, color.blue, color.alpha * 0.3);
+                    break;
+            }
+        }
+
+        cairo_rectangle(cr, x, y, ACTIVITY_MARK_SIZE, ACTIVITY_MARK_SIZE);
+        cairo_fill(cr);
+    }
+
+    return TRUE;
+}
+
 static void stulto_header_bar_dispose(GObject *object) {
     G_OBJECT_CLASS(stulto_header_bar_parent_class)->dispose(object);
 }
 
 static void stulto_header_bar_finalize(GObject *object) {
+    StultoHeaderBar *header_bar = STULTO_HEADER_BAR(object);
+
+    g_array_free(header_bar->activity, TRUE);
+
     G_OBJECT_CLASS(stulto_header_bar_parent_class)->finalize(object);
 }
 
@@ -104,8 +160,23 @@ static void stulto_header_bar_init(StultoHeaderBar *header_bar) {
     gtk_container_add(GTK_CONTAINER(tab_ctrl_box), prev_session_btn);
     gtk_container_add(GTK_CONTAINER(tab_ctrl_box), next_session_btn);
 
+    GtkWidget *indicator_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    gtk_style_context_add_class(gtk_widget_get_style_context(indicator_box), SESSION_INDICATOR_STYLE_CLASS);
+
+    GtkWidget *activity_strip = gtk_drawing_area_new();
+    g_signal_connect(activity_strip, "draw", G_CALLBACK(activity_strip_draw_cb), header_bar);
+    gtk_box_pack_start(GTK_BOX(indicator_box), activity_strip, FALSE, FALSE, 0);
+
+    GtkWidget *indicator_label = gtk_label_new(NULL);
+    gtk_box_pack_start(GTK_BOX(indicator_box), indicator_label, FALSE, FALSE, 0);
+
     gtk_header_bar_pack_start(GTK_HEADER_BAR(header_bar), nav_btn_box);
     gtk_header_bar_pack_end(GTK_HEADER_BAR(header_bar), tab_ctrl_box);
+    gtk_header_bar_pack_end(GTK_HEADER_BAR(header_bar), indicator_box);
+
+    header_bar->indicator_label = GTK_LABEL(indicator_label);
+    header_bar->activity_strip = activity_strip;
+    header_bar->activity = g_array_new(FALSE, TRUE, sizeof(StultoActivityState));
 }
 
 static void stulto_header_bar_class_init(StultoHeaderBarClass *klass) {
@@ -149,3 +220,41 @@ static void stulto_header_bar_class_init(StultoHeaderBarClass *klass) {
 StultoHeaderBar *stulto_header_bar_new() {
     return STULTO_HEADER_BAR(g_object_new(STULTO_TYPE_HEADER_BAR, NULL));
 }
+
+/*
+ * Show which session is current, out of how many; sessions new to the strip start out with nothing to mark
+ */
+void stulto_header_bar_set_session_indicator_label(StultoHeaderBar *header_bar, gint current_session, gint num_sessions) {
+    g_return_if_fail(STULTO_IS_HEADER_BAR(header_bar));
+
+    gchar *text = g_strdup_printf("%d/%d", current_session + 1, num_sessions);
+
+    gtk_label_set_text(header_bar->indicator_label, text);
+    g_free(text);
+
+    if (header_bar->activity->len != (guint) num_sessions) {
+        g_array_set_size(header_bar->activity, num_sessions);
+        gtk_widget_set_size_request(
+                header_bar->activity_strip,
+                MAX(num_sessions * (ACTIVITY_MARK_SIZE + ACTIVITY_MARK_SPACING) - ACTIVITY_MARK_SPACING, 0),
+                ACTIVITY_MARK_SIZE);
+    }
+
+    header_bar->current_session = current_session;
+    gtk_widget_queue_draw(header_bar->activity_strip);
+}
+
+/*
+ * Mark what a session has been up to; the strip is redrawn, with the next frame, only if that changes anything
+ */
+void stulto_header_bar_set_session_activity(StultoHeaderBar *header_bar, gint session, StultoActivityState state) {
+    g_return_if_fail(STULTO_IS_HEADER_BAR(header_bar));
+    g_return_if_fail(session >= 0 && (guint) session < header_bar->activity->len);
+
+    StultoActivityState *current = &g_array_index(header_bar->activity, StultoActivityState, session);
+
+    if (*current != state) {
+        *current = state;
+        gtk_widget_queue_draw(header_bar->activity_strip);
+    }
+}
@@ -22,9 +22,14 @@
 
 #include <gtk/gtk.h>
 
+#include "stulto-activity.h"
+
 /*
  * A Gtk CSD widget for Stulto
  * This implementation is currently WIP
+ *
+ * Besides the session buttons, it shows a strip with a mark per session, which tells the current one apart and flags
+ * the others that have had output, a bell, or gone quiet since they were last shown
  */
 
 G_BEGIN_DECLS
@@ -35,6 +40,7 @@ G_DECLARE_FINAL_TYPE(StultoHeaderBar, stulto_header_bar, STULTO, HEADER_BAR, Gtk
 StultoHeaderBar *stulto_header_bar_new();
 
 void stulto_header_bar_set_session_indicator_label(StultoHeaderBar *header_bar, gint current_session, gint num_sessions);
+void stulto_header_bar_set_session_activity(StultoHeaderBar *header_bar, gint session, StultoActivityState state);
 
 G_END_DECLS
 
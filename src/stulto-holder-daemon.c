@@ -0,0 +1,565 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+#include <vte/vte.h>
+
+#include "stulto-holder-daemon.h"
+#include "stulto-holder-protocol.h"
+
+/* Output kept per detached PTY, for replaying */
+#define STULTO_HOLDER_RING_SIZE (256 * 1024)
+/* How far past the cut the ring looks for a line start, so replay doesn't begin in the middle of a sequence */
+#define STULTO_HOLDER_RING_SLACK 4096
+#define STULTO_HOLDER_READ_SIZE 65536
+/* How long a holder nobody connected to waits before giving up */
+#define STULTO_HOLDER_STARTUP_TIMEOUT_S 10
+
+#define SESSION_GROUP_PREFIX "session:"
+#define PANE_GROUP_PREFIX "pane:"
+
+typedef struct _HolderClient {
+    gint fd;
+    guint source;
+} HolderClient;
+
+typedef struct _HeldPty {
+    guint id;
+    VtePty *vte_pty;
+    GPid pid;
+    /* NULL while detached, when the holder reads the output itself */
+    HolderClient *client;
+    guint read_source;
+    guint child_watch;
+    GByteArray *snapshot;
+    GByteArray *ring;
+} HeldPty;
+
+typedef struct _Holder {
+    gint listen_fd;
+    /* Of HeldPty, by id */
+    GHashTable *ptys;
+    GPtrArray *clients;
+    gchar *layout;
+    guint next_id;
+    GMainLoop *loop;
+} Holder;
+
+static Holder holder;
+
+static void maybe_quit() {
+    if (g_hash_table_size(holder.ptys) == 0 && holder.clients->len == 0) {
+        g_main_loop_quit(holder.loop);
+    }
+}
+
+// region Held PTYs
+
+static void held_pty_free(HeldPty *pty) {
+    if (pty->read_source != 0) {
+        g_source_remove(pty->read_source);
+    }
+    if (pty->child_watch != 0) {
+        g_source_remove(pty->child_watch);
+    }
+
+    g_object_unref(pty->vte_pty);
+    g_byte_array_unref(pty->snapshot);
+    g_byte_array_unref(pty->ring);
+    g_free(pty);
+}
+
+static void append_ring(HeldPty *pty, const gchar *data, gsize len) {
+    GByteArray *ring = pty->ring;
+
+    g_byte_array_append(ring, (const guint8 *) data, len);
+
+    if (ring->len <= STULTO_HOLDER_RING_SIZE) {
+        return;
+    }
+
+    gsize cut = ring->len - STULTO_HOLDER_RING_SIZE;
+    const guint8 *newline = memchr(ring->data + cut, '\n', MIN(STULTO_HOLDER_RING_SLACK, ring->len - cut));
+
+    if (newline != NULL) {
+        cut = newline - ring->data + 1;
+    }
+
+    g_byte_array_remove_range(ring, 0, cut);
+}
+
+static gboolean held_readable_cb(gint fd, GIOCondition condition, gpointer data) {
+    static gchar buf[STULTO_HOLDER_READ_SIZE];
+    HeldPty *pty = data;
+
+    for (gint i = 0; i < 4; i++) {
+        gssize n = read(fd, buf, sizeof(buf));
+
+        if (n > 0) {
+            append_ring(pty, buf, n);
+            continue;
+        }
+
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            return G_SOURCE_CONTINUE;
+        }
+
+        /* Hung up; the child watch takes it from here */
+        pty->read_source = 0;
+
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void start_reading(HeldPty *pty) {
+    if (pty->read_source == 0) {
+        pty->read_source = g_unix_fd_add(
+                vte_pty_get_fd(pty->vte_pty), G_IO_IN | G_IO_HUP | G_IO_ERR, held_readable_cb, pty);
+    }
+}
+
+static void stop_reading(HeldPty *pty) {
+    if (pty->read_source != 0) {
+        g_source_remove(pty->read_source);
+        pty->read_source = 0;
+    }
+}
+
+static void child_exited_cb(GPid pid, gint status, gpointer data) {
+    HeldPty *pty = data;
+
+    pty->child_watch = 0;
+    g_spawn_close_pid(pid);
+
+    if (pty->client != NULL) {
+        stulto_holder_send(pty->client->fd, STULTO_HOLDER_EXITED, pty->id, &status, sizeof(status), -1);
+    }
+
+    g_hash_table_remove(holder.ptys, GUINT_TO_POINTER(pty->id));
+
+    maybe_quit();
+}
+
+// endregion
+
+// region Layout
+
+/*
+ * The layout Stulto last left, less the panes whose PTYs are gone, plus a session for each PTY it doesn't mention
+ */
+static gchar *build_layout() {
+    GKeyFile *file = g_key_file_new();
+    GHashTable *listed = g_hash_table_new(NULL, NULL);
+    GHashTable *dropped = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    GPtrArray *empty_sessions = g_ptr_array_new_with_free_func(g_free);
+    gchar *session_group = NULL;
+    guint session_panes = 0;
+    guint n_sessions = 0;
+
+    if (holder.layout != NULL) {
+        g_key_file_load_from_data(file, holder.layout, -1, G_KEY_FILE_NONE, NULL);
+    }
+
+    gchar **groups = g_key_file_get_groups(file, NULL);
+
+    for (gchar **group = groups; ; group++) {
+        gboolean is_session = *group != NULL && g_str_has_prefix(*group, SESSION_GROUP_PREFIX);
+
+        if (*group == NULL || is_session) {
+            if (session_group != NULL && session_panes == 0) {
+                g_ptr_array_add(empty_sessions, session_group);
+            } else {
+                n_sessions += session_group != NULL;
+                g_free(session_group);
+            }
+
+            if (*group == NULL) {
+                break;
+            }
+
+            session_group = g_strdup(*group);
+            session_panes = 0;
+        } else if (g_str_has_prefix(*group, PANE_GROUP_PREFIX)) {
+            guint id = (guint) g_key_file_get_integer(file, *group, STULTO_HOLDER_PANE_KEY, NULL);
+            HeldPty *pty = g_hash_table_lookup(holder.ptys, GUINT_TO_POINTER(id));
+            gchar *parent = g_key_file_get_string(file, *group, "parent", NULL);
+
+            /* Panes never started have nothing to attach to, and start once shown */
+            if (id != 0 && (pty == NULL || pty->client != NULL)) {
+                g_hash_table_add(dropped, g_strdup(*group + strlen(PANE_GROUP_PREFIX)));
+                g_key_file_remove_group(file, *group, NULL);
+            } else {
+                if (parent != NULL && g_hash_table_contains(dropped, parent)) {
+                    g_key_file_remove_key(file, *group, "parent", NULL);
+                }
+                if (pty != NULL) {
+                    g_hash_table_add(listed, pty);
+                }
+                session_panes++;
+            }
+
+            g_free(parent);
+        }
+    }
+
+    for (guint i = 0; i < empty_sessions->len; i++) {
+        g_key_file_remove_group(file, g_ptr_array_index(empty_sessions, i), NULL);
+    }
+
+    GHashTableIter iter;
+    HeldPty *pty;
+
+    g_hash_table_iter_init(&iter, holder.ptys);
+
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &pty)) {
+        if (pty->client != NULL || g_hash_table_contains(listed, pty)) {
+            continue;
+        }
+
+        gchar *session = g_strdup_printf(SESSION_GROUP_PREFIX "held%u", pty->id);
+        gchar *pane = g_strdup_printf(PANE_GROUP_PREFIX "held%u", pty->id);
+        gchar *name = g_strdup_printf("%u", pty->id);
+
+        g_key_file_set_string(file, session, "name", name);
+        g_key_file_set_integer(file, pane, STULTO_HOLDER_PANE_KEY, (gint) pty->id);
+        n_sessions++;
+
+        g_free(name);
+        g_free(pane);
+        g_free(session);
+    }
+
+    g_key_file_set_boolean(file, "workspace", "lazy", TRUE);
+
+    gchar *data = n_sessions > 0 ? g_key_file_to_data(file, NULL, NULL) : g_strdup("");
+
+    g_strfreev(groups);
+    g_ptr_array_unref(empty_sessions);
+    g_hash_table_unref(dropped);
+    g_hash_table_unref(listed);
+    g_key_file_free(file);
+
+    return data;
+}
+
+// endregion
+
+// region Requests
+
+static void send_error(HolderClient *client, const gchar *message) {
+    stulto_holder_send(client->fd, STULTO_HOLDER_ERROR, 0, message, strlen(message), -1);
+}
+
+static void handle_spawn(HolderClient *client, GBytes *payload) {
+    GKeyFile *file = g_key_file_new();
+    gsize len;
+    const gchar *data = g_bytes_get_data(payload, &len);
+    GError *error = NULL;
+    VtePty *vte_pty = NULL;
+    gchar **argv = NULL;
+    gchar **envv = NULL;
+    gchar *cwd = NULL;
+    GPid pid;
+
+    if (!g_key_file_load_from_data(file, data, len, G_KEY_FILE_NONE, &error)
+        || (argv = g_key_file_get_string_list(file, "spawn", "argv", NULL, &error)) == NULL) {
+        goto out;
+    }
+
+    envv = g_key_file_get_string_list(file, "spawn", "env", NULL, NULL);
+    cwd = g_key_file_get_string(file, "spawn", "cwd", NULL);
+
+    vte_pty = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, &error);
+
+    if (vte_pty == NULL) {
+        goto out;
+    }
+
+    gint rows = g_key_file_get_integer(file, "spawn", "rows", NULL);
+    gint columns = g_key_file_get_integer(file, "spawn", "columns", NULL);
+
+    if (rows > 0 && columns > 0) {
+        vte_pty_set_size(vte_pty, rows, columns, NULL);
+    }
+
+    if (!g_spawn_async(cwd, argv, envv, G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                       (GSpawnChildSetupFunc) vte_pty_child_setup, vte_pty, &pid, &error)) {
+        goto out;
+    }
+
+    HeldPty *pty = g_new0(HeldPty, 1);
+
+    pty->id = ++holder.next_id;
+    pty->vte_pty = g_steal_pointer(&vte_pty);
+    pty->pid = pid;
+    pty->client = client;
+    pty->snapshot = g_byte_array_new();
+    pty->ring = g_byte_array_new();
+    pty->child_watch = g_child_watch_add(pid, child_exited_cb, pty);
+
+    g_unix_set_fd_nonblocking(vte_pty_get_fd(pty->vte_pty), TRUE, NULL);
+    g_hash_table_insert(holder.ptys, GUINT_TO_POINTER(pty->id), pty);
+
+    stulto_holder_send(client->fd, STULTO_HOLDER_SPAWNED, pty->id, &pid, sizeof(pid), vte_pty_get_fd(pty->vte_pty));
+
+out:
+    if (error != NULL) {
+        send_error(client, error->message);
+        g_error_free(error);
+    }
+
+    g_clear_object(&vte_pty);
+    g_free(cwd);
+    g_strfreev(envv);
+    g_strfreev(argv);
+    g_key_file_free(file);
+}
+
+static void handle_attach(HolderClient *client, guint id) {
+    HeldPty *pty = g_hash_table_lookup(holder.ptys, GUINT_TO_POINTER(id));
+
+    if (pty == NULL || pty->client != NULL) {
+        send_error(client, pty == NULL ? "No such session" : "Session is attached elsewhere");
+        return;
+    }
+
+    /* Whatever output is still unread goes to Stulto directly from here on */
+    stop_reading(pty);
+
+    GByteArray *payload = g_byte_array_sized_new(sizeof(pty->pid) + pty->snapshot->len + pty->ring->len);
+
+    g_byte_array_append(payload, (const guint8 *) &pty->pid, sizeof(pty->pid));
+    g_byte_array_append(payload, pty->snapshot->data, pty->snapshot->len);
+    g_byte_array_append(payload, pty->ring->data, pty->ring->len);
+
+    if (stulto_holder_send(client->fd, STULTO_HOLDER_ATTACHED, id, payload->data, payload->len,
+                           vte_pty_get_fd(pty->vte_pty))) {
+        pty->client = client;
+        g_byte_array_set_size(pty->snapshot, 0);
+        g_byte_array_set_size(pty->ring, 0);
+    } else {
+        start_reading(pty);
+    }
+
+    g_byte_array_unref(payload);
+}
+
+static void handle_detach(HolderClient *client, guint id, GBytes *snapshot) {
+    HeldPty *pty = g_hash_table_lookup(holder.ptys, GUINT_TO_POINTER(id));
+    gsize len;
+    const guint8 *data = g_bytes_get_data(snapshot, &len);
+
+    if (pty == NULL || pty->client != client) {
+        return;
+    }
+
+    pty->client = NULL;
+
+    g_byte_array_set_size(pty->snapshot, 0);
+    g_byte_array_append(pty->snapshot, data, len);
+    g_byte_array_set_size(pty->ring, 0);
+
+    start_reading(pty);
+}
+
+/*
+ * Reap a closed PTY's child, which nobody is waiting on any more
+ */
+static void closed_child_exited_cb(GPid pid, gint status, gpointer data) {
+    g_spawn_close_pid(pid);
+}
+
+static void handle_close(HolderClient *client, guint id) {
+    HeldPty *pty = g_hash_table_lookup(holder.ptys, GUINT_TO_POINTER(id));
+
+    if (pty == NULL || pty->client != client) {
+        return;
+    }
+
+    /* Same courtesy VTE extends to children of a destroyed widget; closing the master hangs up the rest */
+    kill(pty->pid, SIGHUP);
+    g_child_watch_add(pty->pid, closed_child_exited_cb, NULL);
+
+    g_hash_table_remove(holder.ptys, GUINT_TO_POINTER(id));
+
+    maybe_quit();
+}
+
+static void client_free(HolderClient *client) {
+    GHashTableIter iter;
+    HeldPty *pty;
+
+    /* Whatever it had attached is detached now, without a snapshot */
+    g_hash_table_iter_init(&iter, holder.ptys);
+
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &pty)) {
+        if (pty->client == client) {
+            pty->client = NULL;
+            start_reading(pty);
+        }
+    }
+
+    close(client->fd);
+    g_free(client);
+}
+
+static gboolean client_readable_cb(gint fd, GIOCondition condition, gpointer data) {
+    HolderClient *client = data;
+    guint32 type;
+    guint32 id;
+    GBytes *payload;
+    gint received_fd;
+
+    if (!stulto_holder_receive(fd, &type, &id, &payload, &received_fd)) {
+        g_ptr_array_remove(holder.clients, client);
+        client_free(client);
+        maybe_quit();
+
+        return G_SOURCE_REMOVE;
+    }
+
+    if (received_fd >= 0) {
+        close(received_fd);
+    }
+
+    switch (type) {
+        case STULTO_HOLDER_SPAWN:
+            handle_spawn(client, payload);
+            break;
+        case STULTO_HOLDER_ATTACH:
+            handle_attach(client, id);
+            break;
+        case STULTO_HOLDER_DETACH:
+            handle_detach(client, id, payload);
+            break;
+        case STULTO_HOLDER_CLOSE:
+            handle_close(client, id);
+            break;
+        case STULTO_HOLDER_SET_LAYOUT:
+            g_free(holder.layout);
+            holder.layout = g_strndup(g_bytes_get_data(payload, NULL), g_bytes_get_size(payload));
+            break;
+        case STULTO_HOLDER_GET_LAYOUT: {
+            gchar *layout = build_layout();
+
+            stulto_holder_send(fd, STULTO_HOLDER_LAYOUT, 0, layout, strlen(layout), -1);
+            g_free(layout);
+        }
+            break;
+        default:
+            send_error(client, "Unknown request");
+            break;
+    }
+
+    g_bytes_unref(payload);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean listen_cb(gint fd, GIOCondition condition, gpointer data) {
+    gint client_fd = accept(fd, NULL, NULL);
+
+    if (client_fd < 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    HolderClient *client = g_new0(HolderClient, 1);
+
+    client->fd = client_fd;
+    client->source = g_unix_fd_add(client_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, client_readable_cb, client);
+
+    g_ptr_array_add(holder.clients, client);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean startup_timeout_cb(gpointer data) {
+    maybe_quit();
+
+    return G_SOURCE_REMOVE;
+}
+
+// endregion
+
+/*
+ * Run the holder until it has nothing left to hold; this process must not have a display connection to lose
+ */
+int stulto_holder_daemon_run(const gchar *socket_path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    gchar *dir = g_path_get_dirname(socket_path);
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGHUP, SIG_IGN);
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        g_printerr("Socket path too long: %s\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    holder.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    /* Another Stulto may have started a holder first */
+    if (connect(holder.listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        close(holder.listen_fd);
+        return EXIT_SUCCESS;
+    }
+
+    close(holder.listen_fd);
+    holder.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    /* A socket nobody answers on is left over from a holder that is gone */
+    g_unlink(socket_path);
+
+    if (bind(holder.listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(holder.listen_fd, 16) < 0) {
+        g_printerr("Error listening on %s: %s\n", socket_path, g_strerror(errno));
+        close(holder.listen_fd);
+        return EXIT_FAILURE;
+    }
+
+    holder.ptys = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify) held_pty_free);
+    /* Ids differ between holders, so that one saved with sessions from an earlier holder never names another PTY */
+    holder.next_id = g_random_int_range(0, G_MAXINT32 / 2);
+    holder.clients = g_ptr_array_new();
+    holder.loop = g_main_loop_new(NULL, FALSE);
+
+    g_unix_fd_add(holder.listen_fd, G_IO_IN, listen_cb, NULL);
+    g_timeout_add_seconds(STULTO_HOLDER_STARTUP_TIMEOUT_S, startup_timeout_cb, NULL);
+
+    g_main_loop_run(holder.loop);
+
+    g_unlink(socket_path);
+    close(holder.listen_fd);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_HOLDER_DAEMON_H
+#define STULTO_HOLDER_DAEMON_H
+
+#include <glib.h>
+
+/*
+ * The PTY holder: a small process, without any display connection, that owns terminals' PTYs and children so that they
+ * outlive Stulto itself
+ *
+ * Stulto is handed each PTY's master (over the socket, with SCM_RIGHTS) and reads and writes it directly while
+ * attached; the holder does nothing on that path. Once Stulto detaches, or goes away, the holder reads the output
+ * instead, keeping a bounded ring of the most recent, to replay on the next attach along with the snapshot of the
+ * screen Stulto left it. The holder exits once it holds no PTYs and no Stulto is connected
+ */
+
+#define STULTO_HOLDER_DAEMON_OPTION "--pty-holder"
+
+int stulto_holder_daemon_run(const gchar *socket_path);
+
+#endif //STULTO_HOLDER_DAEMON_H
@@ -0,0 +1,173 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "stulto-holder-protocol.h"
+
+/* Payloads are small, except for replayed output */
+#define STULTO_HOLDER_MAX_PAYLOAD (64 * 1024 * 1024)
+
+typedef struct _MessageHeader {
+    guint32 type;
+    guint32 id;
+    guint32 len;
+} MessageHeader;
+
+gchar *stulto_holder_get_socket_path() {
+    return g_build_filename(g_get_user_runtime_dir(), "stulto", "holder.sock", NULL);
+}
+
+static gboolean write_all(gint socket_fd, const gchar *data, gsize len) {
+    while (len > 0) {
+        gssize n = send(socket_fd, data, len, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return TRUE;
+}
+
+static gboolean read_all(gint socket_fd, gchar *data, gsize len) {
+    while (len > 0) {
+        gssize n = recv(socket_fd, data, len, 0);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return FALSE;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Send a message, with a file descriptor unless fd is -1; blocks until it is all sent
+ */
+gboolean stulto_holder_send(gint socket_fd, guint32 type, guint32 id, const void *payload, gsize len, gint fd) {
+    MessageHeader header = {.type = type, .id = id, .len = (guint32) len};
+    struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    union {
+        struct cmsghdr align;
+        gchar buf[CMSG_SPACE(sizeof(gint))];
+    } control;
+    gssize n;
+
+    if (fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(gint));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(gint));
+    }
+
+    /* The descriptor travels with the header's first byte */
+    do {
+        n = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return FALSE;
+    }
+
+    return write_all(socket_fd, (const gchar *) &header + n, sizeof(header) - n)
+           && write_all(socket_fd, payload, len);
+}
+
+/*
+ * Receive a whole message; blocks until it has all arrived. fd is -1 unless one came with it
+ */
+gboolean stulto_holder_receive(gint socket_fd, guint32 *type, guint32 *id, GBytes **payload, gint *fd) {
+    MessageHeader header;
+    struct iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+    union {
+        struct cmsghdr align;
+        gchar buf[CMSG_SPACE(sizeof(gint))];
+    } control;
+    struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.buf,
+            .msg_controllen = sizeof(control.buf),
+    };
+    gssize n;
+
+    *fd = -1;
+
+    do {
+        n = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        return FALSE;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(gint));
+        }
+    }
+
+    if (!read_all(socket_fd, (gchar *) &header + n, sizeof(header) - n) || header.len > STULTO_HOLDER_MAX_PAYLOAD) {
+        goto fail;
+    }
+
+    gchar *data = g_malloc(header.len);
+
+    if (!read_all(socket_fd, data, header.len)) {
+        g_free(data);
+        goto fail;
+    }
+
+    *type = header.type;
+    *id = header.id;
+    *payload = g_bytes_new_take(data, header.len);
+
+    return TRUE;
+
+fail:
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_HOLDER_PROTOCOL_H
+#define STULTO_HOLDER_PROTOCOL_H
+
+#include <glib.h>
+
+/*
+ * Messages between Stulto and its PTY holder, over a Unix stream socket
+ *
+ * Each message is a header (type, held PTY id, payload length) followed by its payload, and may carry a single file
+ * descriptor (a PTY master) as SCM_RIGHTS ancillary data. Requests are answered in order; the holder also reports
+ * children exiting, at any time
+ */
+
+typedef enum {
+    /* Stulto to the holder */
+    STULTO_HOLDER_SPAWN = 1,     /* payload: key file with argv, env, cwd, rows and columns */
+    STULTO_HOLDER_ATTACH,        /* id */
+    STULTO_HOLDER_DETACH,        /* id; payload: a snapshot of the screen and recent history to replay */
+    STULTO_HOLDER_CLOSE,         /* id */
+    STULTO_HOLDER_SET_LAYOUT,    /* payload: workspace description of the sessions, by holder id */
+    STULTO_HOLDER_GET_LAYOUT,
+
+    /* The holder to Stulto */
+    STULTO_HOLDER_SPAWNED = 64,  /* id; payload: pid; fd */
+    STULTO_HOLDER_ATTACHED,      /* id; payload: pid, then output to replay; fd */
+    STULTO_HOLDER_LAYOUT,        /* payload: workspace description of the sessions still held */
+    STULTO_HOLDER_EXITED,        /* id; payload: wait status */
+    STULTO_HOLDER_ERROR,         /* payload: message */
+} StultoHolderMessageType;
+
+/* Key naming the held PTY of a pane in a layout */
+#define STULTO_HOLDER_PANE_KEY "holder-id"
+
+gchar *stulto_holder_get_socket_path();
+
+gboolean stulto_holder_send(gint socket_fd, guint32 type, guint32 id, const void *payload, gsize len, gint fd);
+gboolean stulto_holder_receive(gint socket_fd, guint32 *type, guint32 *id, GBytes **payload, gint *fd);
+
+#endif //STULTO_HOLDER_PROTOCOL_H
@@ -0,0 +1,451 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+
+#include "stulto-holder.h"
+#include "stulto-holder-daemon.h"
+#include "stulto-holder-protocol.h"
+
+/* How long a freshly started holder gets to start listening */
+#define STULTO_HOLDER_CONNECT_TIMEOUT_US (2 * G_USEC_PER_SEC)
+#define STULTO_HOLDER_CONNECT_RETRY_US (5 * 1000)
+
+typedef struct _HolderWatch {
+    StultoHolderExitedFunc func;
+    gpointer user_data;
+} HolderWatch;
+
+typedef struct _HolderExit {
+    guint id;
+    gint status;
+} HolderExit;
+
+struct _StultoHolder {
+    gint fd;
+    guint read_source;
+
+    /* Of HolderWatch, by id */
+    GHashTable *watches;
+
+    /* Exits reported while waiting for an answer, dispatched from the main loop */
+    GQueue pending_exits;
+    guint dispatch_source;
+};
+
+static StultoHolder *default_holder = NULL;
+
+// region Connection
+
+static gint connect_socket(const gchar *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    gint fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+static void holder_child_setup(gpointer data) {
+    /* Out of Stulto's session, so closing its terminal doesn't take the holder along */
+    setsid();
+}
+
+/*
+ * Start the holder from Stulto's own executable; GLib's intermediate child leaves it to init
+ */
+static gboolean start_daemon(const gchar *socket_path, GError **error) {
+    gchar *exe = g_file_read_link("/proc/self/exe", error);
+
+    if (exe == NULL) {
+        return FALSE;
+    }
+
+    gchar *argv[] = {exe, STULTO_HOLDER_DAEMON_OPTION, (gchar *) socket_path, NULL};
+    gboolean spawned = g_spawn_async("/", argv, NULL, G_SPAWN_STDIN_FROM_DEV_NULL | G_SPAWN_STDOUT_TO_DEV_NULL,
+                                     holder_child_setup, NULL, NULL, error);
+
+    g_free(exe);
+
+    return spawned;
+}
+
+static void dispatch_exit(StultoHolder *holder, guint id, gint status) {
+    HolderWatch *watch = g_hash_table_lookup(holder->watches, GUINT_TO_POINTER(id));
+
+    if (watch == NULL) {
+        return;
+    }
+
+    StultoHolderExitedFunc func = watch->func;
+    gpointer user_data = watch->user_data;
+
+    g_hash_table_remove(holder->watches, GUINT_TO_POINTER(id));
+
+    func(status, user_data);
+}
+
+static gint read_status(GBytes *payload) {
+    gint status = 0;
+
+    if (g_bytes_get_size(payload) >= sizeof(status)) {
+        memcpy(&status, g_bytes_get_data(payload, NULL), sizeof(status));
+    }
+
+    return status;
+}
+
+static gboolean dispatch_cb(gpointer data) {
+    StultoHolder *holder = data;
+    HolderExit *exit;
+
+    holder->dispatch_source = 0;
+
+    while ((exit = g_queue_pop_head(&holder->pending_exits)) != NULL) {
+        dispatch_exit(holder, exit->id, exit->status);
+        g_free(exit);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void lose_holder(StultoHolder *holder) {
+    g_printerr("Lost the connection to the PTY holder\n");
+
+    if (holder->read_source != 0) {
+        g_source_remove(holder->read_source);
+        holder->read_source = 0;
+    }
+
+    close(holder->fd);
+    holder->fd = -1;
+}
+
+static gboolean holder_readable_cb(gint fd, GIOCondition condition, gpointer data) {
+    StultoHolder *holder = data;
+    guint32 type;
+    guint32 id;
+    GBytes *payload;
+    gint received_fd;
+
+    if (!stulto_holder_receive(fd, &type, &id, &payload, &received_fd)) {
+        holder->read_source = 0;
+        lose_holder(holder);
+
+        return G_SOURCE_REMOVE;
+    }
+
+    if (received_fd >= 0) {
+        close(received_fd);
+    }
+
+    if (type == STULTO_HOLDER_EXITED) {
+        dispatch_exit(holder, id, read_status(payload));
+    }
+
+    g_bytes_unref(payload);
+
+    return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Send a request and wait for its answer, setting aside the exits reported in the meantime
+ */
+static gboolean request(StultoHolder *holder,
+                        guint32 type,
+                        guint32 id,
+                        const void *data,
+                        gsize len,
+                        guint32 *reply_id,
+                        GBytes **reply,
+                        gint *reply_fd,
+                        GError **error) {
+    guint32 received_type;
+    guint32 received_id;
+    GBytes *payload;
+    gint received_fd;
+
+    if (holder->fd < 0 || !stulto_holder_send(holder->fd, type, id, data, len, -1)) {
+        goto lost;
+    }
+
+    while (TRUE) {
+        if (!stulto_holder_receive(holder->fd, &received_type, &received_id, &payload, &received_fd)) {
+            goto lost;
+        }
+
+        if (received_type != STULTO_HOLDER_EXITED) {
+            break;
+        }
+
+        HolderExit *exit = g_new(HolderExit, 1);
+
+        exit->id = received_id;
+        exit->status = read_status(payload);
+        g_queue_push_tail(&holder->pending_exits, exit);
+
+        if (holder->dispatch_source == 0) {
+            holder->dispatch_source = g_idle_add(dispatch_cb, holder);
+        }
+
+        g_bytes_unref(payload);
+    }
+
+    if (received_type == STULTO_HOLDER_ERROR) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%.*s",
+                    (gint) g_bytes_get_size(payload), (const gchar *) g_bytes_get_data(payload, NULL));
+
+        if (received_fd >= 0) {
+            close(received_fd);
+        }
+        g_bytes_unref(payload);
+
+        return FALSE;
+    }
+
+    if (reply_id != NULL) {
+        *reply_id = received_id;
+    }
+
+    if (reply_fd != NULL) {
+        *reply_fd = received_fd;
+    } else if (received_fd >= 0) {
+        close(received_fd);
+    }
+
+    if (reply != NULL) {
+        *reply = payload;
+    } else {
+        g_bytes_unref(payload);
+    }
+
+    return TRUE;
+
+lost:
+    if (holder->fd >= 0) {
+        lose_holder(holder);
+    }
+
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE, "Lost the connection to the PTY holder");
+
+    return FALSE;
+}
+
+/*
+ * Connect to the holder, starting it first if it isn't running
+ */
+gboolean stulto_holder_connect(GError **error) {
+    g_return_val_if_fail(default_holder == NULL, FALSE);
+
+    gchar *socket_path = stulto_holder_get_socket_path();
+    gint fd = connect_socket(socket_path);
+
+    if (fd < 0) {
+        if (!start_daemon(socket_path, error)) {
+            g_free(socket_path);
+            return FALSE;
+        }
+
+        gint64 deadline = g_get_monotonic_time() + STULTO_HOLDER_CONNECT_TIMEOUT_US;
+
+        while ((fd = connect_socket(socket_path)) < 0 && g_get_monotonic_time() < deadline) {
+            g_usleep(STULTO_HOLDER_CONNECT_RETRY_US);
+        }
+    }
+
+    if (fd < 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT, "The PTY holder isn't listening on %s", socket_path);
+        g_free(socket_path);
+        return FALSE;
+    }
+
+    g_free(socket_path);
+
+    StultoHolder *holder = g_new0(StultoHolder, 1);
+
+    holder->fd = fd;
+    holder->watches = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    holder->read_source = g_unix_fd_add(fd, G_IO_IN | G_IO_HUP | G_IO_ERR, holder_readable_cb, holder);
+    g_queue_init(&holder->pending_exits);
+
+    default_holder = holder;
+
+    return TRUE;
+}
+
+StultoHolder *stulto_holder_get_default() {
+    return default_holder;
+}
+
+// endregion
+
+// region Held PTYs
+
+/*
+ * Start a command on a new PTY in the holder; returns the id of the held PTY, or 0 on error
+ */
+guint stulto_holder_spawn(StultoHolder *holder,
+                          gchar **argv,
+                          gchar **envv,
+                          const gchar *cwd,
+                          glong rows,
+                          glong columns,
+                          gint *fd,
+                          GPid *pid,
+                          GError **error) {
+    GKeyFile *file = g_key_file_new();
+    GBytes *reply = NULL;
+    guint32 id = 0;
+
+    g_key_file_set_string_list(file, "spawn", "argv", (const gchar *const *) argv, g_strv_length(argv));
+    g_key_file_set_string_list(file, "spawn", "env", (const gchar *const *) envv, g_strv_length(envv));
+    if (cwd != NULL) {
+        g_key_file_set_string(file, "spawn", "cwd", cwd);
+    }
+    g_key_file_set_integer(file, "spawn", "rows", (gint) rows);
+    g_key_file_set_integer(file, "spawn", "columns", (gint) columns);
+
+    gsize len;
+    gchar *data = g_key_file_to_data(file, &len, NULL);
+
+    if (request(holder, STULTO_HOLDER_SPAWN, 0, data, len, &id, &reply, fd, error)) {
+        if (*fd < 0 || g_bytes_get_size(reply) < sizeof(*pid)) {
+            g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "The PTY holder sent no PTY");
+            id = 0;
+        } else {
+            memcpy(pid, g_bytes_get_data(reply, NULL), sizeof(*pid));
+        }
+
+        g_bytes_unref(reply);
+    }
+
+    g_free(data);
+    g_key_file_free(file);
+
+    return id;
+}
+
+/*
+ * Take over a detached PTY; replay is the output to show before any new output, starting with the snapshot Stulto left
+ */
+gboolean stulto_holder_attach(StultoHolder *holder, guint id, gint *fd, GPid *pid, GBytes **replay, GError **error) {
+    GBytes *reply;
+
+    if (!request(holder, STULTO_HOLDER_ATTACH, id, NULL, 0, NULL, &reply, fd, error)) {
+        return FALSE;
+    }
+
+    gsize len = g_bytes_get_size(reply);
+
+    if (*fd < 0 || len < sizeof(*pid)) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "The PTY holder sent no PTY");
+        g_bytes_unref(reply);
+
+        return FALSE;
+    }
+
+    memcpy(pid, g_bytes_get_data(reply, NULL), sizeof(*pid));
+    *replay = g_bytes_new_from_bytes(reply, sizeof(*pid), len - sizeof(*pid));
+
+    g_bytes_unref(reply);
+
+    return TRUE;
+}
+
+/*
+ * Hand a PTY back to the holder, which keeps reading it until the next attach
+ */
+void stulto_holder_detach(StultoHolder *holder, guint id, const gchar *snapshot, gsize len) {
+    stulto_holder_unwatch(holder, id);
+
+    if (holder->fd >= 0 && !stulto_holder_send(holder->fd, STULTO_HOLDER_DETACH, id, snapshot, len, -1)) {
+        lose_holder(holder);
+    }
+}
+
+void stulto_holder_close(StultoHolder *holder, guint id) {
+    stulto_holder_unwatch(holder, id);
+
+    if (holder->fd >= 0 && !stulto_holder_send(holder->fd, STULTO_HOLDER_CLOSE, id, NULL, 0, -1)) {
+        lose_holder(holder);
+    }
+}
+
+void stulto_holder_watch(StultoHolder *holder, guint id, StultoHolderExitedFunc func, gpointer user_data) {
+    HolderWatch *watch = g_new(HolderWatch, 1);
+
+    watch->func = func;
+    watch->user_data = user_data;
+
+    g_hash_table_insert(holder->watches, GUINT_TO_POINTER(id), watch);
+}
+
+void stulto_holder_unwatch(StultoHolder *holder, guint id) {
+    g_hash_table_remove(holder->watches, GUINT_TO_POINTER(id));
+}
+
+// endregion
+
+// region Layout
+
+void stulto_holder_set_layout(StultoHolder *holder, const gchar *layout) {
+    if (holder->fd >= 0 && !stulto_holder_send(holder->fd, STULTO_HOLDER_SET_LAYOUT, 0, layout, strlen(layout), -1)) {
+        lose_holder(holder);
+    }
+}
+
+/*
+ * The sessions the holder still has PTYs for, in the workspace format; NULL if there are none
+ */
+gchar *stulto_holder_get_layout(StultoHolder *holder) {
+    GBytes *reply;
+    GError *error = NULL;
+
+    if (!request(holder, STULTO_HOLDER_GET_LAYOUT, 0, NULL, 0, NULL, &reply, NULL, &error)) {
+        g_printerr("Error getting the held sessions: %s\n", error->message);
+        g_error_free(error);
+
+        return NULL;
+    }
+
+    gsize len = g_bytes_get_size(reply);
+    gchar *layout = len > 0 ? g_strndup(g_bytes_get_data(reply, NULL), len) : NULL;
+
+    g_bytes_unref(reply);
+
+    return layout;
+}
+
+// endregion
@@ -0,0 +1,58 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_HOLDER_H
+#define STULTO_HOLDER_H
+
+#include <glib.h>
+
+/*
+ * Stulto's connection to its PTY holder (see stulto-holder-daemon.h), which is started on first use
+ *
+ * Requests are synchronous: the holder answers them right away, and none but spawning does any real work. Children
+ * exiting are reported through the callback registered with stulto_holder_watch(), from the main loop
+ */
+
+typedef struct _StultoHolder StultoHolder;
+
+typedef void (*StultoHolderExitedFunc)(gint status, gpointer user_data);
+
+gboolean stulto_holder_connect(GError **error);
+StultoHolder *stulto_holder_get_default();
+
+guint stulto_holder_spawn(StultoHolder *holder,
+                          gchar **argv,
+                          gchar **envv,
+                          const gchar *cwd,
+                          glong rows,
+                          glong columns,
+                          gint *fd,
+                          GPid *pid,
+                          GError **error);
+gboolean stulto_holder_attach(StultoHolder *holder, guint id, gint *fd, GPid *pid, GBytes **replay, GError **error);
+void stulto_holder_detach(StultoHolder *holder, guint id, const gchar *snapshot, gsize len);
+void stulto_holder_close(StultoHolder *holder, guint id);
+
+void stulto_holder_watch(StultoHolder *holder, guint id, StultoHolderExitedFunc func, gpointer user_data);
+void stulto_holder_unwatch(StultoHolder *holder, guint id);
+
+void stulto_holder_set_layout(StultoHolder *holder, const gchar *layout);
+gchar *stulto_holder_get_layout(StultoHolder *holder);
+
+#endif //STULTO_HOLDER_H
@@ -0,0 +1,654 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "stulto-journal.h"
+
+/* How often buffered records are written out and synced */
+#define STULTO_JOURNAL_FLUSH_MS 1000
+/* Output buffered before it is written out early, without waiting for the next sync */
+#define STULTO_JOURNAL_MAX_PENDING (1024 * 1024)
+/* Writes allowed to queue up for the worker before output is dropped rather than buffered */
+#define STULTO_JOURNAL_MAX_BACKLOG 16
+
+#define LOG_SUFFIX ".journal"
+/* Put in a recovered pane's scrollback where the journal had to drop its output */
+#define GAP_MARKER "\r\n\033[7m[Output lost: the journal fell behind]\033[m\r\n"
+/* A gap record's pane id when output of several panes was dropped */
+#define GAP_ALL_PANES G_MAXUINT32
+/* Type, pane id and length */
+#define RECORD_HEADER_SIZE 9
+
+typedef enum {
+    RECORD_OUTPUT = 'O',
+    RECORD_LAYOUT = 'L',
+    /* Output dropped under backlog; empty, with the pane it was dropped from */
+    RECORD_GAP = 'G',
+} RecordType;
+
+typedef struct _JournalRecord {
+    gchar type;
+    guint32 pane_id;
+    const gchar *data;
+    guint32 len;
+} JournalRecord;
+
+struct _StultoJournalLog {
+    StultoJournal *journal;
+
+    /* Main thread only */
+    GByteArray *pending;
+    /* Roughly how large the file has grown since it was last compacted */
+    gsize size;
+    /* Output dropped since the last flush, and whose, for the gap record the next flush writes */
+    gsize dropped;
+    guint32 dropped_pane_id;
+
+    /* Worker thread only */
+    gchar *path;
+    gint fd;
+};
+
+struct _StultoJournal {
+    gchar *dir;
+    /* Shared by all the logs */
+    gsize quota;
+    guint next_serial;
+    guint flush_source;
+    GThreadPool *pool;
+
+    /* Main thread only */
+    GPtrArray *logs;
+};
+
+typedef enum {
+    TASK_WRITE,
+    TASK_COMPACT,
+    TASK_CLOSE,
+} JournalTaskType;
+
+typedef struct _JournalTask {
+    JournalTaskType type;
+    StultoJournalLog *log;
+    GBytes *bytes;
+    gboolean sync;
+    /* Output compaction keeps */
+    gsize keep;
+} JournalTask;
+
+static StultoJournal *default_journal = NULL;
+
+static gchar *get_journal_dir() {
+#if GLIB_CHECK_VERSION(2, 72, 0)
+    return g_build_filename(g_get_user_state_dir(), "stulto", "journal", NULL);
+#else
+    const gchar *state_home = g_getenv("XDG_STATE_HOME");
+
+    if (state_home != NULL && g_path_is_absolute(state_home)) {
+        return g_build_filename(state_home, "stulto", "journal", NULL);
+    }
+
+    return g_build_filename(g_get_home_dir(), ".local", "state", "stulto", "journal", NULL);
+#endif
+}
+
+// region Records
+
+static void append_record(GByteArray *out, gchar type, guint32 pane_id, const gchar *data, guint32 len) {
+    guint8 header[RECORD_HEADER_SIZE];
+
+    header[0] = type;
+    memcpy(header + 1, &pane_id, sizeof(pane_id));
+    memcpy(header + 5, &len, sizeof(len));
+
+    g_byte_array_append(out, header, sizeof(header));
+    g_byte_array_append(out, (const guint8 *) data, len);
+}
+
+/*
+ * Read the record at *p and move past it, unless it was cut short (as the last one may be, after a crash)
+ */
+static gboolean next_record(const gchar **p, const gchar *end, JournalRecord *record) {
+    if (end - *p < RECORD_HEADER_SIZE) {
+        return FALSE;
+    }
+
+    record->type = (*p)[0];
+    memcpy(&record->pane_id, *p + 1, sizeof(record->pane_id));
+    memcpy(&record->len, *p + 5, sizeof(record->len));
+
+    if ((gsize) (end - *p - RECORD_HEADER_SIZE) < record->len) {
+        return FALSE;
+    }
+
+    record->data = *p + RECORD_HEADER_SIZE;
+    *p = record->data + record->len;
+
+    return TRUE;
+}
+
+// endregion
+
+// region Worker thread
+
+static gboolean write_all(gint fd, const guint8 *data, gsize len) {
+    while (len > 0) {
+        gssize n = write(fd, data, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Rewrite a log as its latest layout followed by as much of its newest output as fits in keep bytes
+ */
+static void compact_log(StultoJournalLog *log, gsize keep) {
+    gchar *contents = NULL;
+    gsize len;
+
+    if (log->fd < 0 || !g_file_get_contents(log->path, &contents, &len, NULL)) {
+        return;
+    }
+
+    GArray *outputs = g_array_new(FALSE, FALSE, sizeof(JournalRecord));
+    JournalRecord layout = {0};
+    JournalRecord record;
+
+    for (const gchar *p = contents; next_record(&p, contents + len, &record);) {
+        if (record.type == RECORD_LAYOUT) {
+            layout = record;
+        } else {
+            g_array_append_val(outputs, record);
+        }
+    }
+
+    guint first = outputs->len;
+    gsize kept = 0;
+
+    while (first > 0 && kept + g_array_index(outputs, JournalRecord, first - 1).len <= keep) {
+        kept += g_array_index(outputs, JournalRecord, first - 1).len;
+        first--;
+    }
+
+    GByteArray *out = g_byte_array_sized_new(kept + layout.len + (outputs->len - first + 1) * RECORD_HEADER_SIZE);
+
+    if (layout.type == RECORD_LAYOUT) {
+        append_record(out, layout.type, layout.pane_id, layout.data, layout.len);
+    }
+    for (guint i = first; i < outputs->len; i++) {
+        JournalRecord *output = &g_array_index(outputs, JournalRecord, i);
+
+        append_record(out, output->type, output->pane_id, output->data, output->len);
+    }
+
+    /* The old log stays whole until the new one has replaced it */
+    gchar *tmp_path = g_strconcat(log->path, ".tmp", NULL);
+    gint fd = g_open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    if (fd >= 0 && write_all(fd, out->data, out->len) && fdatasync(fd) == 0 && g_rename(tmp_path, log->path) == 0) {
+        close(log->fd);
+        log->fd = fd;
+    } else {
+        g_printerr("Error compacting %s: %s\n", log->path, g_strerror(errno));
+
+        if (fd >= 0) {
+            close(fd);
+        }
+        g_unlink(tmp_path);
+    }
+
+    g_free(tmp_path);
+    g_byte_array_unref(out);
+    g_array_unref(outputs);
+    g_free(contents);
+}
+
+static void journal_process_task(gpointer task_data, gpointer journal_data) {
+    JournalTask *task = task_data;
+    StultoJournalLog *log = task->log;
+
+    switch (task->type) {
+        case TASK_WRITE: {
+            gsize len;
+            const guint8 *data = g_bytes_get_data(task->bytes, &len);
+
+            if (log->fd >= 0 && (!write_all(log->fd, data, len) || (task->sync && fdatasync(log->fd) < 0))) {
+                g_printerr("Error writing %s: %s\n", log->path, g_strerror(errno));
+            }
+            break;
+        }
+        case TASK_COMPACT:
+            compact_log(log, task->keep);
+            break;
+        case TASK_CLOSE:
+            /* Closed sessions have nothing to recover */
+            if (log->fd >= 0) {
+                close(log->fd);
+            }
+            g_unlink(log->path);
+            g_free(log->path);
+            g_free(log);
+            break;
+    }
+
+    g_clear_pointer(&task->bytes, g_bytes_unref);
+    g_free(task);
+}
+
+// endregion
+
+// region Logs
+
+static void push_task(StultoJournalLog *log, JournalTaskType type, GBytes *bytes, gboolean sync, gsize keep) {
+    JournalTask *task = g_new0(JournalTask, 1);
+
+    task->type = type;
+    task->log = log;
+    task->bytes = bytes;
+    task->sync = sync;
+    task->keep = keep;
+
+    g_thread_pool_push(log->journal->pool, task, NULL);
+}
+
+static void flush_log(StultoJournalLog *log, gboolean sync) {
+    StultoJournal *journal = log->journal;
+
+    /* Output is only dropped after what is pending, so the gap goes at its end */
+    if (log->dropped > 0) {
+        g_debug("Journal fell behind, dropped %" G_GSIZE_FORMAT " bytes of output", log->dropped);
+
+        /* So that recovery shows where output is missing, rather than passing what is left off as complete */
+        append_record(log->pending, RECORD_GAP, log->dropped_pane_id, NULL, 0);
+        log->dropped = 0;
+    }
+
+    gsize len = log->pending->len;
+
+    if (len == 0) {
+        return;
+    }
+
+    push_task(log, TASK_WRITE, g_byte_array_free_to_bytes(log->pending), sync, 0);
+    log->pending = g_byte_array_new();
+
+    log->size += len;
+
+    /* Each log gets an even share of the quota, so the total stays within it however many sessions there are */
+    gsize share = journal->quota / MAX(journal->logs->len, 1);
+
+    if (log->size > share) {
+        push_task(log, TASK_COMPACT, NULL, FALSE, share / 2);
+        log->size = share / 2;
+    }
+}
+
+static gboolean flush_cb(gpointer data) {
+    StultoJournal *journal = data;
+
+    for (guint i = 0; i < journal->logs->len; i++) {
+        flush_log(g_ptr_array_index(journal->logs, i), TRUE);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Start journaling, with a quota of bytes for all the sessions' logs together; until then, there is no default journal
+ */
+void stulto_journal_enable(gsize quota) {
+    g_return_if_fail(default_journal == NULL);
+
+    StultoJournal *journal = g_new0(StultoJournal, 1);
+
+    journal->dir = get_journal_dir();
+    journal->quota = quota;
+    journal->logs = g_ptr_array_new();
+
+    if (g_mkdir_with_parents(journal->dir, 0700) < 0) {
+        g_printerr("Error creating %s: %s\n", journal->dir, g_strerror(errno));
+    }
+
+    /* A single thread keeps each log's records in order */
+    journal->pool = g_thread_pool_new(journal_process_task, journal, 1, FALSE, NULL);
+    journal->flush_source = g_timeout_add(STULTO_JOURNAL_FLUSH_MS, flush_cb, journal);
+
+    default_journal = journal;
+}
+
+StultoJournal *stulto_journal_get_default() {
+    return default_journal;
+}
+
+/*
+ * Write out everything still buffered and wait for the worker; logs still open at this point are left for recovery
+ */
+void stulto_journal_shutdown() {
+    StultoJournal *journal = default_journal;
+
+    if (journal == NULL) {
+        return;
+    }
+
+    default_journal = NULL;
+
+    g_source_remove(journal->flush_source);
+
+    for (guint i = 0; i < journal->logs->len; i++) {
+        flush_log(g_ptr_array_index(journal->logs, i), TRUE);
+    }
+
+    g_thread_pool_free(journal->pool, FALSE, TRUE);
+
+    g_ptr_array_unref(journal->logs);
+    g_free(journal->dir);
+    g_free(journal);
+}
+
+StultoJournalLog *stulto_journal_open_log(StultoJournal *journal) {
+    StultoJournalLog *log = g_new0(StultoJournalLog, 1);
+    gchar *name = g_strdup_printf("%d-%u" LOG_SUFFIX, getpid(), ++journal->next_serial);
+
+    log->journal = journal;
+    log->pending = g_byte_array_new();
+    log->path = g_build_filename(journal->dir, name, NULL);
+    log->fd = g_open(log->path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+
+    if (log->fd < 0) {
+        g_printerr("Error opening %s: %s\n", log->path, g_strerror(errno));
+    }
+
+    g_ptr_array_add(journal->logs, log);
+
+    g_free(name);
+
+    return log;
+}
+
+/*
+ * Stop journaling a session and remove its log; the log must not be used afterwards
+ */
+void stulto_journal_close_log(StultoJournalLog *log) {
+    g_ptr_array_remove(log->journal->logs, log);
+
+    g_byte_array_unref(log->pending);
+    log->pending = NULL;
+
+    push_task(log, TASK_CLOSE, NULL, FALSE, 0);
+}
+
+void stulto_journal_append_output(StultoJournalLog *log, guint pane_id, const gchar *data, gsize len) {
+    if (log->pending->len >= STULTO_JOURNAL_MAX_PENDING) {
+        /* The disk can't keep up; the journal loses some output rather than growing without bound */
+        if (g_thread_pool_unprocessed(log->journal->pool) >= STULTO_JOURNAL_MAX_BACKLOG) {
+            if (log->dropped == 0) {
+                log->dropped_pane_id = pane_id;
+            } else if (log->dropped_pane_id != pane_id) {
+                log->dropped_pane_id = GAP_ALL_PANES;
+            }
+            log->dropped += len;
+            return;
+        }
+
+        flush_log(log, FALSE);
+    }
+
+    append_record(log->pending, RECORD_OUTPUT, pane_id, data, (guint32) len);
+}
+
+/*
+ * Record the session's current layout, a workspace description whose panes name their journal pane ids
+ */
+void stulto_journal_set_layout(StultoJournalLog *log, const gchar *layout) {
+    append_record(log->pending, RECORD_LAYOUT, 0, layout, (guint32) strlen(layout));
+}
+
+// endregion
+
+// region Recovery
+
+/*
+ * Logs left behind by a Stulto that is no longer running; only meaningful before this one has opened any
+ */
+static GPtrArray *find_orphans() {
+    GPtrArray *orphans = g_ptr_array_new_with_free_func(g_free);
+    gchar *dir_path = get_journal_dir();
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    const gchar *name;
+
+    while (dir != NULL && (name = g_dir_read_name(dir)) != NULL) {
+        gchar *end;
+        pid_t pid = (pid_t) g_ascii_strtoll(name, &end, 10);
+
+        if (!g_str_has_suffix(name, LOG_SUFFIX) || end == name || *end != '-') {
+            continue;
+        }
+
+        if (pid != getpid() && (kill(pid, 0) == 0 || errno == EPERM)) {
+            continue;
+        }
+
+        g_ptr_array_add(orphans, g_build_filename(dir_path, name, NULL));
+    }
+
+    if (dir != NULL) {
+        g_dir_close(dir);
+    }
+    g_free(dir_path);
+
+    return orphans;
+}
+
+gboolean stulto_journal_can_recover() {
+    GPtrArray *orphans = find_orphans();
+    gboolean found = orphans->len > 0;
+
+    g_ptr_array_unref(orphans);
+
+    return found;
+}
+
+static void copy_pane_key(GKeyFile *to, const gchar *group, GKeyFile *from, const gchar *from_group, const gchar *key,
+                          const gchar *prefix, GHashTable *outputs, const gchar *scrollback_prefix) {
+    gchar *value = g_key_file_get_value(from, from_group, key, NULL);
+
+    if (g_str_equal(key, "parent")) {
+        gchar *parent = g_strconcat(prefix, value, NULL);
+
+        g_key_file_set_value(to, group, key, parent);
+        g_free(parent);
+    } else if (g_str_equal(key, STULTO_JOURNAL_PANE_KEY)) {
+        guint pane_id = (guint) g_ascii_strtoull(value, NULL, 10);
+        GByteArray *output = g_hash_table_lookup(outputs, GUINT_TO_POINTER(pane_id));
+
+        if (output != NULL) {
+            gchar *scrollback_path = g_strdup_printf("%s-p%u.ansi", scrollback_prefix, pane_id);
+
+            if (g_file_set_contents(scrollback_path, (const gchar *) output->data, output->len, NULL)) {
+                g_key_file_set_string(to, group, "scrollback", scrollback_path);
+            }
+            g_free(scrollback_path);
+        }
+    } else {
+        g_key_file_set_value(to, group, key, value);
+    }
+
+    g_free(value);
+}
+
+/*
+ * Add a log's session to the recovered workspace, with its panes' output for scrollback; returns whether it had one
+ */
+static gboolean recover_log(GKeyFile *recovered, const gchar *path, guint index, const gchar *state_dir) {
+    gchar *contents = NULL;
+    gsize len;
+
+    if (!g_file_get_contents(path, &contents, &len, NULL)) {
+        return FALSE;
+    }
+
+    GHashTable *outputs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) g_byte_array_unref);
+    JournalRecord layout = {0};
+    JournalRecord record;
+
+    for (const gchar *p = contents; next_record(&p, contents + len, &record);) {
+        if (record.type == RECORD_LAYOUT) {
+            layout = record;
+        } else if (record.type == RECORD_GAP && record.pane_id == GAP_ALL_PANES) {
+            GHashTableIter iter;
+            GByteArray *output;
+
+            g_hash_table_iter_init(&iter, outputs);
+            while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &output)) {
+                g_byte_array_append(output, (const guint8 *) GAP_MARKER, strlen(GAP_MARKER));
+            }
+        } else {
+            GByteArray *output = g_hash_table_lookup(outputs, GUINT_TO_POINTER(record.pane_id));
+
+            if (output == NULL) {
+                output = g_byte_array_new();
+                g_hash_table_insert(outputs, GUINT_TO_POINTER(record.pane_id), output);
+            }
+
+            if (record.type == RECORD_GAP) {
+                g_byte_array_append(output, (const guint8 *) GAP_MARKER, strlen(GAP_MARKER));
+            } else {
+                g_byte_array_append(output, (const guint8 *) record.data, record.len);
+            }
+        }
+    }
+
+    GKeyFile *file = g_key_file_new();
+    gboolean found = layout.type == RECORD_LAYOUT
+            && g_key_file_load_from_data(file, layout.data, layout.len, G_KEY_FILE_NONE, NULL);
+
+    if (found) {
+        /* Group and pane names are only unique within their own log */
+        gchar *prefix = g_strdup_printf("j%u-", index);
+        gchar *base_name = g_path_get_basename(path);
+        gchar *scrollback_prefix;
+        gchar **groups = g_key_file_get_groups(file, NULL);
+
+        base_name[strlen(base_name) - strlen(LOG_SUFFIX)] = '\0';
+        scrollback_prefix = g_build_filename(state_dir, base_name, NULL);
+
+        for (gchar **group = groups; *group != NULL; group++) {
+            const gchar *colon = strchr(*group, ':');
+
+            if (colon == NULL) {
+                continue;
+            }
+
+            gchar *new_group = g_strdup_printf("%.*s%s%s", (gint) (colon - *group + 1), *group, prefix, colon + 1);
+            gchar **keys = g_key_file_get_keys(file, *group, NULL, NULL);
+
+            for (gchar **key = keys; key != NULL && *key != NULL; key++) {
+                copy_pane_key(recovered, new_group, file, *group, *key, prefix, outputs, scrollback_prefix);
+            }
+
+            g_strfreev(keys);
+            g_free(new_group);
+        }
+
+        g_strfreev(groups);
+        g_free(scrollback_prefix);
+        g_free(base_name);
+        g_free(prefix);
+    }
+
+    g_key_file_free(file);
+    g_hash_table_unref(outputs);
+    g_free(contents);
+
+    return found;
+}
+
+/*
+ * Write the sessions of logs left behind by a crash to a lazy workspace file in dir, with the output they journaled
+ * for scrollback, and remove the logs; returns the file's path, or NULL if there was nothing to recover
+ */
+gchar *stulto_journal_recover(const gchar *dir, GError **error) {
+    GPtrArray *orphans = find_orphans();
+    GKeyFile *recovered = g_key_file_new();
+    gchar *workspace_path = NULL;
+    gint64 start_time = g_get_monotonic_time();
+    guint n_sessions = 0;
+
+    if (g_mkdir_with_parents(dir, 0700) < 0) {
+        int saved_errno = errno;
+
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Failed to create %s: %s", dir, g_strerror(saved_errno));
+        goto out;
+    }
+
+    g_key_file_set_boolean(recovered, "workspace", "lazy", TRUE);
+
+    for (guint i = 0; i < orphans->len; i++) {
+        n_sessions += recover_log(recovered, g_ptr_array_index(orphans, i), i, dir);
+    }
+
+    if (n_sessions > 0) {
+        gchar *data = g_key_file_to_data(recovered, NULL, NULL);
+
+        workspace_path = g_build_filename(dir, "recovered.ini", NULL);
+
+        if (!g_file_set_contents(workspace_path, data, -1, error)) {
+            g_clear_pointer(&workspace_path, g_free);
+        }
+
+        g_free(data);
+    }
+
+    /* What the logs held lives on in the workspace now; logs without any session never will */
+    if (workspace_path != NULL || n_sessions == 0) {
+        for (guint i = 0; i < orphans->len; i++) {
+            g_unlink(g_ptr_array_index(orphans, i));
+        }
+    }
+
+    g_debug("Recovered %u sessions from %u journals in %.1f ms",
+            n_sessions, orphans->len, (g_get_monotonic_time() - start_time) / 1000.0);
+
+out:
+    g_key_file_free(recovered);
+    g_ptr_array_unref(orphans);
+
+    return workspace_path;
+}
+
+// endregion
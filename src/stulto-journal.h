@@ -0,0 +1,57 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_JOURNAL_H
+#define STULTO_JOURNAL_H
+
+#include <glib.h>
+
+/*
+ * A crash-safe journal of each session's output and layout, under $XDG_STATE_HOME/stulto/journal
+ *
+ * Every session appends to a log of its own: its panes' output as it arrives and a description of its layout (in
+ * the workspace format) whenever that changes. Records are buffered in memory and written out by a worker thread
+ * once a second, with one fsync per write, so heavy output costs a memcpy per read. The logs share one quota evenly; a
+ * log outgrowing its share is compacted to its latest layout and its newest output. Output dropped because the disk
+ * fell behind leaves a gap record, which recovery marks in the pane's scrollback
+ *
+ * Logs are removed when their sessions close; those left behind by a Stulto that didn't quit are turned back into
+ * sessions on the next start
+ */
+
+/* Key naming the journal pane id of a pane in a layout description */
+#define STULTO_JOURNAL_PANE_KEY "journal-id"
+
+typedef struct _StultoJournal StultoJournal;
+typedef struct _StultoJournalLog StultoJournalLog;
+
+void stulto_journal_enable(gsize quota);
+StultoJournal *stulto_journal_get_default();
+void stulto_journal_shutdown();
+
+StultoJournalLog *stulto_journal_open_log(StultoJournal *journal);
+void stulto_journal_close_log(StultoJournalLog *log);
+
+void stulto_journal_append_output(StultoJournalLog *log, guint pane_id, const gchar *data, gsize len);
+void stulto_journal_set_layout(StultoJournalLog *log, const gchar *layout);
+
+gboolean stulto_journal_can_recover();
+gchar *stulto_journal_recover(const gchar *dir, GError **error);
+
+#endif //STULTO_JOURNAL_H
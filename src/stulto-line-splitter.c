@@ -0,0 +1,141 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stulto-line-splitter.h"
+
+typedef enum {
+    STRIP_GROUND,
+    STRIP_ESCAPE,
+    /* After intermediate bytes, e.g., the '(' of ESC ( B selecting a character set */
+    STRIP_ESCAPE_INTERMEDIATE,
+    STRIP_CSI,
+    STRIP_STRING,
+    STRIP_STRING_ESCAPE,
+} StripState;
+
+struct _StultoLineSplitter {
+    GString *line;
+    /* Lines longer than this keep their first bytes only */
+    gsize max_line;
+    StripState strip_state;
+    gboolean pending_cr;
+};
+
+StultoLineSplitter *stulto_line_splitter_new(gsize max_line) {
+    StultoLineSplitter *splitter = g_new0(StultoLineSplitter, 1);
+
+    splitter->line = g_string_sized_new(256);
+    splitter->max_line = max_line;
+
+    return splitter;
+}
+
+void stulto_line_splitter_free(StultoLineSplitter *splitter) {
+    if (splitter == NULL) {
+        return;
+    }
+
+    g_string_free(splitter->line, TRUE);
+    g_free(splitter);
+}
+
+/*
+ * Forget the partial line, e.g., when output was skipped and the rest of it is meaningless
+ */
+void stulto_line_splitter_reset(StultoLineSplitter *splitter) {
+    g_string_truncate(splitter->line, 0);
+    splitter->strip_state = STRIP_GROUND;
+    splitter->pending_cr = FALSE;
+}
+
+/*
+ * The line so far, not yet ended by a newline, e.g., a prompt waiting for input
+ */
+const gchar *stulto_line_splitter_peek(StultoLineSplitter *splitter, gsize *len) {
+    *len = splitter->line->len;
+
+    return splitter->line->str;
+}
+
+void stulto_line_splitter_feed(StultoLineSplitter *splitter,
+                               const gchar *data,
+                               gsize len,
+                               StultoLineFunc line_func,
+                               gpointer user_data) {
+    const guchar *p = (const guchar *) data;
+    const guchar *end = p + len;
+
+    for (; p < end; p++) {
+        guchar c = *p;
+
+        switch (splitter->strip_state) {
+            case STRIP_GROUND:
+                if (c == '\n') {
+                    splitter->pending_cr = FALSE;
+                    line_func(splitter->line->str, splitter->line->len, user_data);
+                    g_string_truncate(splitter->line, 0);
+                } else if (c == '\r') {
+                    splitter->pending_cr = TRUE;
+                } else if (c == '\033') {
+                    splitter->strip_state = STRIP_ESCAPE;
+                } else if (c >= 0x20 || c == '\t') {
+                    if (splitter->pending_cr) {
+                        g_string_truncate(splitter->line, 0);
+                        splitter->pending_cr = FALSE;
+                    }
+                    if (splitter->line->len < splitter->max_line) {
+                        g_string_append_c(splitter->line, c);
+                    }
+                }
+                break;
+            case STRIP_ESCAPE:
+                if (c == '[') {
+                    splitter->strip_state = STRIP_CSI;
+                } else if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_') {
+                    splitter->strip_state = STRIP_STRING;
+                } else if (c >= 0x20 && c <= 0x2f) {
+                    splitter->strip_state = STRIP_ESCAPE_INTERMEDIATE;
+                } else {
+                    splitter->strip_state = STRIP_GROUND;
+                }
+                break;
+            case STRIP_ESCAPE_INTERMEDIATE:
+                /* Further intermediates (0x20-0x2f) keep the sequence going; the final byte (0x30-0x7e) ends it */
+                if (c < 0x20 || c > 0x2f) {
+                    splitter->strip_state = STRIP_GROUND;
+                }
+                break;
+            case STRIP_CSI:
+                if (c >= 0x40 && c <= 0x7e) {
+                    splitter->strip_state = STRIP_GROUND;
+                }
+                break;
+            case STRIP_STRING:
+                if (c == '\007') {
+                    splitter->strip_state = STRIP_GROUND;
+                } else if (c == '\033') {
+                    splitter->strip_state = STRIP_STRING_ESCAPE;
+                }
+                break;
+            case STRIP_STRING_ESCAPE:
+                splitter->strip_state = c == '\\' ? STRIP_GROUND : STRIP_STRING;
+                break;
+        }
+    }
+}
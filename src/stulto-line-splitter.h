@@ -0,0 +1,47 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_LINE_SPLITTER_H
+#define STULTO_LINE_SPLITTER_H
+
+#include <glib.h>
+
+/*
+ * Splits raw terminal output into lines of text as they'd be displayed, minus escape sequences and control characters
+ *
+ * A carriage return not followed by a newline starts the line over, as it does on screen. Splitters keep no locks and
+ * are meant to be fed from one (worker) thread
+ */
+
+typedef struct _StultoLineSplitter StultoLineSplitter;
+
+typedef void (*StultoLineFunc)(const gchar *line, gsize len, gpointer user_data);
+
+StultoLineSplitter *stulto_line_splitter_new(gsize max_line);
+void stulto_line_splitter_free(StultoLineSplitter *splitter);
+
+void stulto_line_splitter_feed(StultoLineSplitter *splitter,
+                               const gchar *data,
+                               gsize len,
+                               StultoLineFunc line_func,
+                               gpointer user_data);
+void stulto_line_splitter_reset(StultoLineSplitter *splitter);
+const gchar *stulto_line_splitter_peek(StultoLineSplitter *splitter, gsize *len);
+
+#endif //STULTO_LINE_SPLITTER_H
@@ -0,0 +1,215 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stulto-line-times.h"
+
+/* Rows per block; a lookup decodes at most this many deltas */
+#define STULTO_LINE_TIMES_BLOCK_ROWS 256
+
+typedef struct _LineTimesBlock {
+    glong first_row;
+    gint64 first_time_ms;
+    guint rows;
+    /* Time of the block's last row, to encode the next delta against */
+    gint64 last_time_ms;
+    GByteArray *deltas;
+} LineTimesBlock;
+
+struct _StultoLineTimes {
+    /* Of LineTimesBlock, in row order, so lookups can bisect them */
+    GArray *blocks;
+    /* The next row to be recorded */
+    glong next_row;
+};
+
+static void block_clear(gpointer data) {
+    LineTimesBlock *block = data;
+
+    g_byte_array_unref(block->deltas);
+}
+
+static void append_varint(GByteArray *array, guint64 value) {
+    guint8 byte;
+
+    do {
+        byte = value & 0x7f;
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+        g_byte_array_append(array, &byte, 1);
+    } while (value != 0);
+}
+
+static guint64 read_varint(const guint8 **p) {
+    guint64 value = 0;
+    guint shift = 0;
+    guint8 byte;
+
+    do {
+        byte = *(*p)++;
+        value |= (guint64) (byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return value;
+}
+
+StultoLineTimes *stulto_line_times_new() {
+    StultoLineTimes *line_times = g_new0(StultoLineTimes, 1);
+
+    line_times->blocks = g_array_new(FALSE, FALSE, sizeof(LineTimesBlock));
+    g_array_set_clear_func(line_times->blocks, block_clear);
+    line_times->next_row = -1;
+
+    return line_times;
+}
+
+void stulto_line_times_free(StultoLineTimes *line_times) {
+    if (line_times == NULL) {
+        return;
+    }
+
+    g_array_unref(line_times->blocks);
+    g_free(line_times);
+}
+
+/*
+ * Record the time for every row up to and including row which hasn't got one yet
+ */
+void stulto_line_times_record(StultoLineTimes *line_times, glong row, gint64 time_ms) {
+    if (line_times->next_row < 0) {
+        line_times->next_row = row;
+    }
+
+    for (; line_times->next_row <= row; line_times->next_row++) {
+        guint n_blocks = line_times->blocks->len;
+        LineTimesBlock *block = n_blocks > 0 ? &g_array_index(line_times->blocks, LineTimesBlock, n_blocks - 1) : NULL;
+
+        if (block == NULL || block->rows == STULTO_LINE_TIMES_BLOCK_ROWS) {
+            LineTimesBlock new_block = {
+                    .first_row = line_times->next_row,
+                    .first_time_ms = time_ms,
+                    .last_time_ms = time_ms,
+                    .deltas = g_byte_array_sized_new(STULTO_LINE_TIMES_BLOCK_ROWS),
+            };
+
+            g_array_append_val(line_times->blocks, new_block);
+            block = &g_array_index(line_times->blocks, LineTimesBlock, n_blocks);
+        }
+
+        /* Zigzag, as the wall clock can go backwards */
+        gint64 delta = time_ms - block->last_time_ms;
+
+        append_varint(block->deltas, ((guint64) delta << 1) ^ (guint64) (delta >> 63));
+        block->last_time_ms = time_ms;
+        block->rows++;
+    }
+}
+
+/*
+ * Forget rows which have scrolled out of the scrollback
+ */
+void stulto_line_times_prune(StultoLineTimes *line_times, glong first_row) {
+    guint n = 0;
+
+    while (n < line_times->blocks->len) {
+        LineTimesBlock *block = &g_array_index(line_times->blocks, LineTimesBlock, n);
+
+        if (block->first_row + (glong) block->rows > first_row) {
+            break;
+        }
+        n++;
+    }
+
+    if (n > 0) {
+        g_array_remove_range(line_times->blocks, 0, n);
+    }
+}
+
+gboolean stulto_line_times_lookup(StultoLineTimes *line_times, glong row, gint64 *time_ms) {
+    guint low = 0;
+    guint high = line_times->blocks->len;
+    LineTimesBlock *block = NULL;
+
+    /* The last block starting at or before row */
+    while (low < high) {
+        guint mid = low + (high - low) / 2;
+        LineTimesBlock *mid_block = &g_array_index(line_times->blocks, LineTimesBlock, mid);
+
+        if (mid_block->first_row <= row) {
+            block = mid_block;
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (block == NULL || row >= block->first_row + (glong) block->rows) {
+        return FALSE;
+    }
+
+    const guint8 *p = block->deltas->data;
+    gint64 time = block->first_time_ms;
+
+    for (glong i = block->first_row; i <= row; i++) {
+        guint64 zigzag = read_varint(&p);
+
+        time += (gint64) (zigzag >> 1) ^ -(gint64) (zigzag & 1);
+    }
+
+    *time_ms = time;
+
+    return TRUE;
+}
+
+/*
+ * The row's time as local time, or NULL if it isn't known
+ */
+gchar *stulto_line_times_format(StultoLineTimes *line_times, glong row) {
+    gint64 time_ms;
+
+    if (!stulto_line_times_lookup(line_times, row, &time_ms)) {
+        return NULL;
+    }
+
+    GDateTime *date_time = g_date_time_new_from_unix_local(time_ms / 1000);
+    gchar *seconds = g_date_time_format(date_time, "%Y-%m-%d %H:%M:%S");
+    gchar *formatted = g_strdup_printf("%s.%03d", seconds, (gint) (time_ms % 1000));
+
+    g_free(seconds);
+    g_date_time_unref(date_time);
+
+    return formatted;
+}
+
+/*
+ * Memory used, in bytes
+ */
+gsize stulto_line_times_get_size(StultoLineTimes *line_times) {
+    gsize size = sizeof(StultoLineTimes);
+
+    size += line_times->blocks->len * sizeof(LineTimesBlock);
+
+    for (guint i = 0; i < line_times->blocks->len; i++) {
+        size += g_array_index(line_times->blocks, LineTimesBlock, i).deltas->len;
+    }
+
+    return size;
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_LINE_TIMES_H
+#define STULTO_LINE_TIMES_H
+
+#include <glib.h>
+
+/*
+ * When each row of a terminal's scrollback received its first output
+ *
+ * Rows are recorded in order, once per batch of output VTE processes rather than per byte, as the cursor moves past
+ * them. Times are stored as zigzag varint deltas from the previous row in blocks of consecutive rows, each block
+ * anchored by its first row and time, so a row costs a byte or two and lookups decode a single block. Blocks are kept
+ * in an array, bisected on lookup, and trimmed along with the scrollback
+ */
+
+typedef struct _StultoLineTimes StultoLineTimes;
+
+StultoLineTimes *stulto_line_times_new();
+void stulto_line_times_free(StultoLineTimes *line_times);
+
+void stulto_line_times_record(StultoLineTimes *line_times, glong row, gint64 time_ms);
+void stulto_line_times_prune(StultoLineTimes *line_times, glong first_row);
+
+gboolean stulto_line_times_lookup(StultoLineTimes *line_times, glong row, gint64 *time_ms);
+gchar *stulto_line_times_format(StultoLineTimes *line_times, glong row);
+
+gsize stulto_line_times_get_size(StultoLineTimes *line_times);
+
+#endif //STULTO_LINE_TIMES_H
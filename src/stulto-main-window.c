@@ -24,6 +24,21 @@
 #include "exit-status.h"
 #include "stulto-app-config.h"
 #include "stulto-header-bar.h"
+#include "stulto-global-search.h"
+#include "stulto-switcher.h"
+#include "stulto-workspace.h"
+#include "stulto-session-state.h"
+#include "stulto-journal.h"
+#include "stulto-holder.h"
+#include "stulto-holder-protocol.h"
+#include "stulto-control.h"
+#include "stulto-control-protocol.h"
+
+#include <glib/gstdio.h>
+
+#ifdef GDK_WINDOWING_X11
+#include <gdk/gdkx.h>
+#endif
 
 struct _StultoMainWindow {
     GtkWindow parent_instance;
@@ -31,20 +46,82 @@ struct _StultoMainWindow {
     StultoAppConfig *config;
     StultoSessionManager *session_manager;
     StultoHeaderBar *header_bar;
+    GtkWidget *global_search;
+    GtkWidget *switcher;
+    StultoControl *control;
+    guint resources_source;
+
+    /* What decides how eagerly the terminals paint */
+    GdkWindowState window_state;
+    gboolean obscured;
+    StultoRenderRate render_rate;
+
+    /* Snap the window to the active terminal's cells, recomputed at most once a frame */
+    GdkGeometry geometry;
+    guint geometry_tick_id;
+
+    /* An interactive resize is under way until the size stops changing for a while */
+    gint last_width;
+    gint last_height;
+    guint resize_settle_source;
+    guint resizes;
+    gint64 resize_start_time;
+
+    /* When the window was last toggled into view, until its first frame */
+    gint64 toggle_time;
 };
 
 G_DEFINE_FINAL_TYPE(StultoMainWindow, stulto_main_window, GTK_TYPE_WINDOW)
 
+enum {
+    PROP_0,
+    PROP_RENDER_RATE,
+    N_PROPS
+};
+
+static GParamSpec *pspecs[N_PROPS] = {NULL };
+
+/* How often the sessions' resource usage is sampled */
+#define STULTO_MAIN_WINDOW_RESOURCES_INTERVAL_S 5
+
+/* How long the size has to stay put for a resize to count as finished */
+#define STULTO_MAIN_WINDOW_RESIZE_SETTLE_MS 250
+
+/* How much of the monitor's height the drop-down takes */
+#define STULTO_MAIN_WINDOW_DROP_DOWN_HEIGHT_PERCENT 40
+
 static void stulto_main_window_dispose(GObject *object);
 static void stulto_main_window_finalize(GObject *object);
 
+static void stulto_main_window_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+
 static void stulto_main_window_realize(GtkWidget *widget);
 
 static void stulto_main_window_init(StultoMainWindow *main_window);
 static void stulto_main_window_class_init(StultoMainWindowClass *klass);
 
+gboolean stulto_main_window_open_workspace(StultoMainWindow *main_window, const gchar *path, GError **error);
+gboolean stulto_main_window_restore_sessions(StultoMainWindow *main_window);
+void stulto_main_window_prebuild(StultoMainWindow *main_window);
+void stulto_main_window_toggle(StultoMainWindow *main_window);
+
 // region Signal Callbacks
 
+/*
+ * A new terminal running the shell, in the working directory of the active one
+ */
+static StultoTerminal *new_terminal(StultoMainWindow *main_window) {
+    StultoSession *session = stulto_session_manager_get_active_session(main_window->session_manager);
+    StultoTerminal *active = session != NULL ? stulto_session_get_active_terminal(session) : NULL;
+    StultoExecData *exec_data = stulto_exec_data_default();
+
+    if (active != NULL) {
+        exec_data->cwd = stulto_terminal_get_cwd(active);
+    }
+
+    return stulto_terminal_new(main_window->config->initial_profile, exec_data);
+}
+
 static void header_bar_add_session_cb(StultoHeaderBar *header_bar, gpointer data) {
     StultoMainWindow *main_window = data;
 
@@ -56,7 +133,7 @@ static void header_bar_add_session_cb(StultoHeaderBar *header_bar, gpointer data
 
     g_return_if_fail(STULTO_IS_SESSION_MANAGER(session_manager));
 
-    stulto_session_manager_add_session(session_manager, stulto_terminal_new(config->initial_profile, stulto_exec_data_default()));
+    stulto_session_manager_add_session(session_manager, new_terminal(main_window));
 }
 
 static void header_bar_prev_session_cb(StultoHeaderBar *header_bar, gpointer data) {
@@ -90,12 +167,202 @@ static void screen_changed_cb(GtkWidget *widget, GdkScreen *old_screen, gpointer
     gtk_widget_set_visual(widget, visual);
 }
 
-static void delete_event_cb(GtkWidget *window, GdkEvent *event, gpointer data) {
+/*
+ * Leave every running terminal to the PTY holder, along with the layout to bring them back in
+ */
+static void detach_sessions(StultoMainWindow *main_window, StultoHolder *holder) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(main_window->session_manager);
+    gchar *layout = stulto_session_state_describe_all(main_window->session_manager, main_window->config->initial_profile);
+
+    stulto_holder_set_layout(holder, layout);
+
+    for (gint i = 0; i < gtk_notebook_get_n_pages(notebook); i++) {
+        GList *terminals = stulto_session_get_terminals(STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i)));
+
+        for (GList *l = terminals; l != NULL; l = l->next) {
+            stulto_terminal_detach(STULTO_TERMINAL(l->data));
+        }
+
+        g_list_free(terminals);
+    }
+
+    g_free(layout);
+}
+
+static void quit(StultoMainWindow *main_window) {
+    GtkWidget *window = GTK_WIDGET(main_window);
+    StultoTerminalProfile *profile = main_window->config->initial_profile;
+    StultoHolder *holder = stulto_holder_get_default();
+    GError *error = NULL;
+
+    if (profile->persist_sessions
+        && !stulto_session_state_save(main_window->session_manager, profile, &error)) {
+        g_printerr("Error saving sessions: %s\n", error->message);
+        g_error_free(error);
+    }
+
+    if (holder != NULL) {
+        detach_sessions(main_window, holder);
+    }
+
     stulto_set_exit_status(EXIT_SUCCESS);
 
     stulto_destroy_and_quit(window);
 }
 
+static void confirm_quit_response_cb(GtkDialog *dialog, gint response_id, gpointer data) {
+    StultoMainWindow *main_window = data;
+
+    gtk_widget_destroy(GTK_WIDGET(dialog));
+
+    if (response_id == GTK_RESPONSE_ACCEPT) {
+        quit(main_window);
+    }
+}
+
+/*
+ * The sessions running something besides their shells, as "name (n)" for each; NULL if there are none
+ */
+static gchar *describe_busy_sessions(StultoMainWindow *main_window) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(main_window->session_manager);
+    GString *busy = NULL;
+
+    for (gint i = 0; i < gtk_notebook_get_n_pages(notebook); i++) {
+        StultoSession *session = STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i));
+        const gchar *name = stulto_session_get_foreground(session);
+
+        if (!stulto_session_is_busy(session)) {
+            continue;
+        }
+
+        if (busy == NULL) {
+            busy = g_string_new(NULL);
+        } else {
+            g_string_append(busy, ", ");
+        }
+
+        g_string_append_printf(busy, "%s (%d)", name != NULL ? name : "?", i + 1);
+    }
+
+    return busy != NULL ? g_string_free(busy, FALSE) : NULL;
+}
+
+static gboolean delete_event_cb(GtkWidget *window, GdkEvent *event, gpointer data) {
+    StultoMainWindow *main_window = STULTO_MAIN_WINDOW(window);
+
+    /* The drop-down only goes out of the way */
+    if (main_window->config->drop_down) {
+        gtk_widget_hide(window);
+        return TRUE;
+    }
+
+    /* Terminals left to the PTY holder keep running */
+    gchar *busy = stulto_holder_get_default() == NULL ? describe_busy_sessions(main_window) : NULL;
+
+    if (busy == NULL) {
+        quit(main_window);
+        return TRUE;
+    }
+
+    GtkWidget *dialog = gtk_message_dialog_new(
+            GTK_WINDOW(main_window),
+            GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_QUESTION,
+            GTK_BUTTONS_NONE,
+            "Close Stulto?");
+
+    gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog), "Still running: %s", busy);
+    gtk_dialog_add_buttons(GTK_DIALOG(dialog), "_Cancel", GTK_RESPONSE_CANCEL, "_Close", GTK_RESPONSE_ACCEPT, NULL);
+
+    g_signal_connect(dialog, "response", G_CALLBACK(confirm_quit_response_cb), main_window);
+    gtk_widget_show(dialog);
+
+    g_free(busy);
+
+    return TRUE;
+}
+
+static void show_global_search(StultoMainWindow *main_window) {
+    if (main_window->global_search == NULL) {
+        main_window->global_search = GTK_WIDGET(stulto_global_search_new(
+                GTK_WINDOW(main_window),
+                main_window->session_manager));
+
+        g_signal_connect(main_window->global_search, "destroy", G_CALLBACK(gtk_widget_destroyed), &main_window->global_search);
+        gtk_widget_show_all(main_window->global_search);
+    }
+
+    gtk_window_present(GTK_WINDOW(main_window->global_search));
+}
+
+static void show_switcher(StultoMainWindow *main_window) {
+    if (main_window->switcher == NULL) {
+        main_window->switcher = GTK_WIDGET(stulto_switcher_new(
+                GTK_WINDOW(main_window),
+                main_window->session_manager));
+
+        g_signal_connect(main_window->switcher, "destroy", G_CALLBACK(gtk_widget_destroyed), &main_window->switcher);
+    }
+
+    gtk_window_present(GTK_WINDOW(main_window->switcher));
+}
+
+static void split_active_session(StultoMainWindow *main_window, GtkOrientation orientation) {
+    StultoSession *session = stulto_session_manager_get_active_session(main_window->session_manager);
+
+    stulto_session_split(session, new_terminal(main_window), orientation);
+}
+
+static gboolean arrow_key_direction(guint keyval, GtkDirectionType *direction) {
+    switch (keyval) {
+        case GDK_KEY_Up:
+            *direction = GTK_DIR_UP;
+            return TRUE;
+        case GDK_KEY_Down:
+            *direction = GTK_DIR_DOWN;
+            return TRUE;
+        case GDK_KEY_Left:
+            *direction = GTK_DIR_LEFT;
+            return TRUE;
+        case GDK_KEY_Right:
+            *direction = GTK_DIR_RIGHT;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+static void workspace_dialog_response_cb(GtkNativeDialog *dialog, gint response_id, gpointer data) {
+    StultoMainWindow *main_window = data;
+    GError *error = NULL;
+
+    if (response_id == GTK_RESPONSE_ACCEPT) {
+        gchar *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+
+        if (!stulto_main_window_open_workspace(main_window, path, &error)) {
+            g_printerr("Error opening workspace '%s': %s\n", path, error->message);
+            g_error_free(error);
+        }
+
+        g_free(path);
+    }
+
+    g_object_unref(dialog);
+    g_object_unref(main_window);
+}
+
+static void show_workspace_dialog(StultoMainWindow *main_window) {
+    GtkFileChooserNative *dialog = gtk_file_chooser_native_new(
+            "Open Workspace",
+            GTK_WINDOW(main_window),
+            GTK_FILE_CHOOSER_ACTION_OPEN,
+            "_Open",
+            "_Cancel");
+
+    g_signal_connect(dialog, "response", G_CALLBACK(workspace_dialog_response_cb), g_object_ref(main_window));
+    gtk_native_dialog_show(GTK_NATIVE_DIALOG(dialog));
+}
+
 static gboolean key_press_event_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
     StultoMainWindow *main_widow = STULTO_MAIN_WINDOW(widget);
     StultoSessionManager *session_manager = main_widow->session_manager;
@@ -109,9 +376,7 @@ static gboolean key_press_event_cb(GtkWidget *widget, GdkEvent *event, gpointer
         switch (gdk_keyval_to_lower(event->key.keyval))
         {
             case GDK_KEY_t:
-                stulto_session_manager_add_session(
-                        session_manager,
-                        stulto_terminal_new(main_widow->config->initial_profile, stulto_exec_data_default()));
+                stulto_session_manager_add_session(session_manager, new_terminal(main_widow));
                 return TRUE;
             case GDK_KEY_Page_Up:
                 stulto_session_manager_prev_session(session_manager);
@@ -119,31 +384,424 @@ static gboolean key_press_event_cb(GtkWidget *widget, GdkEvent *event, gpointer
             case GDK_KEY_Page_Down:
                 stulto_session_manager_next_session(session_manager);
                 return TRUE;
+            case GDK_KEY_f:
+                stulto_session_start_search(stulto_session_manager_get_active_session(session_manager));
+                return TRUE;
+            case GDK_KEY_s:
+                show_global_search(main_widow);
+                return TRUE;
+            case GDK_KEY_k:
+                show_switcher(main_widow);
+                return TRUE;
+            case GDK_KEY_d:
+                split_active_session(main_widow, GTK_ORIENTATION_HORIZONTAL);
+                return TRUE;
+            case GDK_KEY_b:
+                split_active_session(main_widow, GTK_ORIENTATION_VERTICAL);
+                return TRUE;
+            case GDK_KEY_z:
+                stulto_session_toggle_zoom(stulto_session_manager_get_active_session(session_manager));
+                return TRUE;
+            case GDK_KEY_a:
+                stulto_session_toggle_broadcast(stulto_session_manager_get_active_session(session_manager));
+                return TRUE;
+            case GDK_KEY_l:
+                show_workspace_dialog(main_widow);
+                return TRUE;
         }
     }
 
+    GtkDirectionType direction;
+
+    /* Alt+Shift+arrow moves between panes, Ctrl+Alt+Shift+arrow resizes the active one */
+    if ((event->key.state & modifiers) == (GDK_MOD1_MASK | GDK_SHIFT_MASK) &&
+        arrow_key_direction(event->key.keyval, &direction)) {
+        stulto_session_focus_neighbor(stulto_session_manager_get_active_session(session_manager), direction);
+        return TRUE;
+    }
+
+    if ((event->key.state & modifiers) == (GDK_CONTROL_MASK | GDK_MOD1_MASK | GDK_SHIFT_MASK) &&
+        arrow_key_direction(event->key.keyval, &direction)) {
+        stulto_session_resize_active(stulto_session_manager_get_active_session(session_manager), direction, 2);
+        return TRUE;
+    }
+
     return FALSE;
 }
 
-static void stulto_main_window_session_manager_notify_active_session_cb(GObject *object, GParamSpec *pspec, gpointer data) {
-    GtkWindow *window = data;
+/*
+ * Show the active session's resource usage under the title
+ */
+static void update_resource_usage(StultoMainWindow *main_window) {
+    StultoSession *session = stulto_session_manager_get_active_session(main_window->session_manager);
+    gchar *usage = session != NULL ? stulto_session_describe_resource_usage(session) : NULL;
+
+    gtk_header_bar_set_subtitle(GTK_HEADER_BAR(main_window->header_bar), usage);
+
+    g_free(usage);
+}
+
+/*
+ * Sample every session's process trees in one go
+ */
+static gboolean resources_timeout_cb(gpointer data) {
+    StultoMainWindow *main_window = data;
+    GtkNotebook *notebook = GTK_NOTEBOOK(main_window->session_manager);
+    gint n_sessions = gtk_notebook_get_n_pages(notebook);
+    GArray *roots = g_array_new(FALSE, FALSE, sizeof(GPid));
+    /* The session each root's terminal is in */
+    GArray *owners = g_array_new(FALSE, FALSE, sizeof(gint));
+
+    for (gint i = 0; i < n_sessions; i++) {
+        GList *terminals = stulto_session_get_terminals(STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i)));
+
+        for (GList *l = terminals; l != NULL; l = l->next) {
+            GPid pid = stulto_terminal_get_child_pid(STULTO_TERMINAL(l->data));
+
+            if (pid > 0) {
+                g_array_append_val(roots, pid);
+                g_array_append_val(owners, i);
+            }
+        }
+
+        g_list_free(terminals);
+    }
+
+    StultoResourceUsage *usages = g_new(StultoResourceUsage, MAX(roots->len, 1));
+    StultoResourceUsage *totals = g_new0(StultoResourceUsage, MAX(n_sessions, 1));
+    gint64 now_ms = g_get_monotonic_time() / 1000;
+
+    stulto_resources_collect((GPid *) roots->data, usages, roots->len);
+
+    for (guint i = 0; i < roots->len; i++) {
+        stulto_resources_add(&totals[g_array_index(owners, gint, i)], &usages[i]);
+    }
+
+    for (gint i = 0; i < n_sessions; i++) {
+        stulto_session_set_resource_usage(STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i)), &totals[i], now_ms);
+    }
+
+    update_resource_usage(main_window);
+
+    g_free(totals);
+    g_free(usages);
+    g_array_free(owners, TRUE);
+    g_array_free(roots, TRUE);
+
+    return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Give the window manager the active terminal's cell size as the window's size increment, over whatever surrounds the
+ * terminal's cells as the base size. In a direction with several panes across, the window's size doesn't follow from
+ * any one pane's cells, so it has no increment there
+ */
+static gboolean update_geometry_tick_cb(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data) {
+    StultoMainWindow *main_window = STULTO_MAIN_WINDOW(widget);
+    StultoSession *session = stulto_session_manager_get_active_session(main_window->session_manager);
+    StultoTerminal *terminal = session != NULL ? stulto_session_get_active_terminal(session) : NULL;
+
+    main_window->geometry_tick_id = 0;
+
+    /* The terminals lag behind the window mid-resize; wait for them to catch up */
+    if (terminal == NULL || main_window->resize_settle_source != 0) {
+        return G_SOURCE_REMOVE;
+    }
+
+    VteTerminal *terminal_widget = stulto_terminal_get_terminal_widget(terminal);
+    GdkGeometry geometry = {0};
+    gint width;
+    gint height;
+
+    gtk_window_get_size(GTK_WINDOW(main_window), &width, &height);
+
+    geometry.width_inc = 1;
+    geometry.height_inc = 1;
+
+    if (stulto_session_count_panes(session, GTK_ORIENTATION_HORIZONTAL) == 1) {
+        geometry.width_inc = (gint) vte_terminal_get_char_width(terminal_widget);
+        geometry.base_width = width - geometry.width_inc * (gint) vte_terminal_get_column_count(terminal_widget);
+    }
+    if (stulto_session_count_panes(session, GTK_ORIENTATION_VERTICAL) == 1) {
+        geometry.height_inc = (gint) vte_terminal_get_char_height(terminal_widget);
+        geometry.base_height = height - geometry.height_inc * (gint) vte_terminal_get_row_count(terminal_widget);
+    }
+
+    if (geometry.width_inc <= 0 || geometry.height_inc <= 0 || geometry.base_width < 0 || geometry.base_height < 0) {
+        return G_SOURCE_REMOVE;
+    }
+
+    if (geometry.width_inc != main_window->geometry.width_inc ||
+        geometry.height_inc != main_window->geometry.height_inc ||
+        geometry.base_width != main_window->geometry.base_width ||
+        geometry.base_height != main_window->geometry.base_height) {
+        main_window->geometry = geometry;
+        gtk_window_set_geometry_hints(
+                GTK_WINDOW(main_window),
+                NULL,
+                &geometry,
+                GDK_HINT_RESIZE_INC | GDK_HINT_BASE_SIZE);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void queue_geometry_update(StultoMainWindow *main_window) {
+    if (main_window->geometry_tick_id == 0) {
+        main_window->geometry_tick_id = gtk_widget_add_tick_callback(
+                GTK_WIDGET(main_window),
+                update_geometry_tick_cb,
+                NULL,
+                NULL);
+    }
+}
+
+/*
+ * Only the visible session is resized along with the window, so only its terminals have rewrap put off; hidden
+ * sessions are sized once, when shown. Rewrap is restored everywhere, in case the user switched sessions meanwhile.
+ */
+static void set_rewrap_deferred(StultoMainWindow *main_window, gboolean deferred) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(main_window->session_manager);
+    gint n_sessions = gtk_notebook_get_n_pages(notebook);
+    gint current = gtk_notebook_get_current_page(notebook);
+
+    for (gint i = 0; i < n_sessions; i++) {
+        if (deferred && i != current) {
+            continue;
+        }
+
+        GList *terminals = stulto_session_get_terminals(STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i)));
+
+        for (GList *l = terminals; l != NULL; l = l->next) {
+            stulto_terminal_set_rewrap_deferred(l->data, deferred);
+        }
+
+        g_list_free(terminals);
+    }
+}
+
+static gboolean resize_settled_cb(gpointer data) {
+    StultoMainWindow *main_window = data;
+    gint64 rewrap_start_time = g_get_monotonic_time();
+
+    main_window->resize_settle_source = 0;
+
+    if (main_window->resizes > 1) {
+        set_rewrap_deferred(main_window, FALSE);
+    }
+
+    g_debug("Resize: %u sizes in %.1f ms, rewrapped in %.1f ms",
+            main_window->resizes,
+            (rewrap_start_time - main_window->resize_start_time) / 1000.0,
+            (g_get_monotonic_time() - rewrap_start_time) / 1000.0);
+
+    main_window->resizes = 0;
+    queue_geometry_update(main_window);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * A single change of size (maximizing, say) rewraps at once; from the second change in quick succession on, rewrap is
+ * put off until the size settles
+ */
+static gboolean configure_event_cb(GtkWidget *widget, GdkEventConfigure *event, gpointer data) {
+    StultoMainWindow *main_window = STULTO_MAIN_WINDOW(widget);
+
+    if (event->width == main_window->last_width && event->height == main_window->last_height) {
+        return FALSE;
+    }
+
+    main_window->last_width = event->width;
+    main_window->last_height = event->height;
+
+    if (main_window->resizes++ == 0) {
+        main_window->resize_start_time = g_get_monotonic_time();
+    } else if (main_window->resizes == 2) {
+        set_rewrap_deferred(main_window, TRUE);
+    }
+
+    if (main_window->resize_settle_source != 0) {
+        g_source_remove(main_window->resize_settle_source);
+    }
+    main_window->resize_settle_source = g_timeout_add(
+            STULTO_MAIN_WINDOW_RESIZE_SETTLE_MS,
+            resize_settled_cb,
+            main_window);
+
+    return FALSE;
+}
+
+static void session_manager_size_allocate_cb(GtkWidget *widget, GdkRectangle *allocation, gpointer data) {
+    queue_geometry_update(data);
+}
 
-    StultoSessionManager *session_manager = STULTO_SESSION_MANAGER(object);
+static void session_notify_active_terminal_cb(GObject *object, GParamSpec *pspec, gpointer data) {
+    StultoMainWindow *main_window = data;
+
+    if (STULTO_SESSION(object) == stulto_session_manager_get_active_session(main_window->session_manager)) {
+        queue_geometry_update(main_window);
+    }
+}
+
+/*
+ * Bring the header bar's session strip up to date; only the sessions whose marks change are redrawn
+ */
+static void update_activity_strip(StultoMainWindow *main_window) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(main_window->session_manager);
+    gint n_sessions = gtk_notebook_get_n_pages(notebook);
+
+    /* Sessions go after the header bar when the window is destroyed */
+    if (gtk_widget_in_destruction(GTK_WIDGET(main_window))) {
+        return;
+    }
+
+    stulto_header_bar_set_session_indicator_label(
+            main_window->header_bar,
+            gtk_notebook_get_current_page(notebook),
+            n_sessions);
+
+    for (gint i = 0; i < n_sessions; i++) {
+        StultoSession *session = STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i));
+
+        stulto_header_bar_set_session_activity(main_window->header_bar, i, stulto_session_get_activity(session));
+    }
+}
+
+static void update_title(StultoMainWindow *main_window) {
+    StultoSessionManager *session_manager = main_window->session_manager;
+    StultoSession *session = stulto_session_manager_get_active_session(session_manager);
 
     gint terminal_id = stulto_session_manager_get_active_session_id(session_manager);
     gint num_sessions = stulto_session_manager_get_n_sessions(session_manager);
+    const gchar *foreground = session != NULL ? stulto_session_get_foreground(session) : NULL;
 
     // GtkNotebook uses zero-based page numbering, hence we add 1 for user-friendly output
-    gchar *new_title = g_strdup_printf("[%d/%d] Stulto", terminal_id + 1, num_sessions);
+    gchar *new_title = foreground != NULL
+            ? g_strdup_printf("[%d/%d] %s - Stulto", terminal_id + 1, num_sessions, foreground)
+            : g_strdup_printf("[%d/%d] Stulto", terminal_id + 1, num_sessions);
 
-    gtk_window_set_title(window, new_title);
+    gtk_window_set_title(GTK_WINDOW(main_window), new_title);
 
     g_free(new_title);
 }
 
+static void stulto_main_window_session_manager_notify_active_session_cb(GObject *object, GParamSpec *pspec, gpointer data) {
+    StultoMainWindow *main_window = data;
+
+    update_title(main_window);
+    update_activity_strip(main_window);
+    queue_geometry_update(main_window);
+
+    if (main_window->resources_source != 0) {
+        update_resource_usage(main_window);
+    }
+}
+
+static void session_notify_foreground_cb(GObject *object, GParamSpec *pspec, gpointer data) {
+    StultoMainWindow *main_window = data;
+
+    if (STULTO_SESSION(object) == stulto_session_manager_get_active_session(main_window->session_manager)) {
+        update_title(main_window);
+    }
+}
+
+static void session_notify_activity_cb(GObject *object, GParamSpec *pspec, gpointer data) {
+    update_activity_strip(data);
+}
+
+static void session_manager_page_added_cb(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer data) {
+    g_signal_connect_object(child, "notify::foreground", G_CALLBACK(session_notify_foreground_cb), data, 0);
+    g_signal_connect_object(child, "notify::activity", G_CALLBACK(session_notify_activity_cb), data, 0);
+    g_signal_connect_object(child, "notify::active-terminal", G_CALLBACK(session_notify_active_terminal_cb), data, 0);
+
+    update_activity_strip(data);
+}
+
+static void session_manager_page_removed_cb(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer data) {
+    update_activity_strip(data);
+}
+
+/*
+ * Full speed while focused, reduced while merely visible, and paused while minimized, unmapped or covered up
+ */
+static void update_render_rate(StultoMainWindow *main_window) {
+    GtkWidget *widget = GTK_WIDGET(main_window);
+    StultoRenderRate render_rate;
+
+    if (!gtk_widget_get_mapped(widget) ||
+        main_window->obscured ||
+        (main_window->window_state & (GDK_WINDOW_STATE_ICONIFIED | GDK_WINDOW_STATE_WITHDRAWN))) {
+        render_rate = STULTO_RENDER_RATE_PAUSED;
+    } else if (!gtk_window_is_active(GTK_WINDOW(main_window))) {
+        render_rate = STULTO_RENDER_RATE_REDUCED;
+    } else {
+        render_rate = STULTO_RENDER_RATE_FULL;
+    }
+
+    if (render_rate == main_window->render_rate) {
+        return;
+    }
+
+    g_debug("Window %p: render rate %d -> %d", (gpointer) main_window, main_window->render_rate, render_rate);
+
+    main_window->render_rate = render_rate;
+    g_object_notify_by_pspec(G_OBJECT(main_window), pspecs[PROP_RENDER_RATE]);
+}
+
+static gboolean window_state_event_cb(GtkWidget *widget, GdkEventWindowState *event, gpointer data) {
+    STULTO_MAIN_WINDOW(widget)->window_state = event->new_window_state;
+    update_render_rate(STULTO_MAIN_WINDOW(widget));
+
+    return FALSE;
+}
+
+/*
+ * Only X servers without a compositor tell when a window is covered up; elsewhere this never fires
+ */
+static gboolean visibility_notify_event_cb(GtkWidget *widget, GdkEventVisibility *event, gpointer data) {
+    STULTO_MAIN_WINDOW(widget)->obscured = event->state == GDK_VISIBILITY_FULLY_OBSCURED;
+    update_render_rate(STULTO_MAIN_WINDOW(widget));
+
+    return FALSE;
+}
+
+static void notify_is_active_cb(GObject *object, GParamSpec *pspec, gpointer data) {
+    update_render_rate(STULTO_MAIN_WINDOW(object));
+}
+
+static void map_changed_cb(GtkWidget *widget, gpointer data) {
+    update_render_rate(STULTO_MAIN_WINDOW(widget));
+}
+
+static gboolean draw_cb(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    StultoMainWindow *main_window = STULTO_MAIN_WINDOW(widget);
+
+    if (main_window->toggle_time != 0) {
+        g_debug("Toggled into view, first frame in %.1f ms", (g_get_monotonic_time() - main_window->toggle_time) / 1000.0);
+        main_window->toggle_time = 0;
+    }
+
+    return FALSE;
+}
+
 // endregion
 
 static void stulto_main_window_dispose(GObject *object) {
+    StultoMainWindow *main_window = STULTO_MAIN_WINDOW(object);
+
+    g_clear_pointer(&main_window->control, stulto_control_free);
+
+    if (main_window->resources_source != 0) {
+        g_source_remove(main_window->resources_source);
+        main_window->resources_source = 0;
+    }
+
+    if (main_window->resize_settle_source != 0) {
+        g_source_remove(main_window->resize_settle_source);
+        main_window->resize_settle_source = 0;
+    }
+
     G_OBJECT_CLASS(stulto_main_window_parent_class)->dispose(object);
 }
 
@@ -151,6 +809,19 @@ static void stulto_main_window_finalize(GObject *object) {
     G_OBJECT_CLASS(stulto_main_window_parent_class)->finalize(object);
 }
 
+static void stulto_main_window_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+    StultoMainWindow *main_window = STULTO_MAIN_WINDOW(object);
+
+    switch (prop_id) {
+        case PROP_RENDER_RATE:
+            g_value_set_int(value, main_window->render_rate);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+            break;
+    }
+}
+
 static void stulto_main_window_realize(GtkWidget *widget) {
     StultoMainWindow *main_window = STULTO_MAIN_WINDOW(widget);
     StultoAppConfig *config = main_window->config;
@@ -185,6 +856,32 @@ static void stulto_main_window_init(StultoMainWindow *main_window) {
 
     g_signal_connect(window_widget, "key-press-event", G_CALLBACK(key_press_event_cb), NULL);
 
+    /* Until it is shown, the window isn't painted */
+    main_window->render_rate = STULTO_RENDER_RATE_PAUSED;
+    gtk_widget_add_events(window_widget, GDK_VISIBILITY_NOTIFY_MASK);
+    g_signal_connect(window_widget, "window-state-event", G_CALLBACK(window_state_event_cb), NULL);
+    g_signal_connect(window_widget, "visibility-notify-event", G_CALLBACK(visibility_notify_event_cb), NULL);
+    g_signal_connect(window_widget, "notify::is-active", G_CALLBACK(notify_is_active_cb), NULL);
+    g_signal_connect_after(window_widget, "map", G_CALLBACK(map_changed_cb), NULL);
+    g_signal_connect_after(window_widget, "unmap", G_CALLBACK(map_changed_cb), NULL);
+    g_signal_connect(window_widget, "configure-event", G_CALLBACK(configure_event_cb), NULL);
+    g_signal_connect_after(window_widget, "draw", G_CALLBACK(draw_cb), NULL);
+
+    g_signal_connect(main_window->session_manager,
+                     "page-added",
+                     G_CALLBACK(session_manager_page_added_cb),
+                     main_window);
+
+    g_signal_connect(main_window->session_manager,
+                     "page-removed",
+                     G_CALLBACK(session_manager_page_removed_cb),
+                     main_window);
+
+    g_signal_connect_after(main_window->session_manager,
+                           "size-allocate",
+                           G_CALLBACK(session_manager_size_allocate_cb),
+                           main_window);
+
     g_signal_connect(main_window->session_manager,
                      "notify::active-session",
                      G_CALLBACK(stulto_main_window_session_manager_notify_active_session_cb),
@@ -205,14 +902,60 @@ static void stulto_main_window_class_init(StultoMainWindowClass *klass) {
 
     object_class->dispose = stulto_main_window_dispose;
     object_class->finalize = stulto_main_window_finalize;
+    object_class->get_property = stulto_main_window_get_property;
 
     widget_class->realize = stulto_main_window_realize;
+
+    pspecs[PROP_RENDER_RATE] = g_param_spec_int(
+            "render-rate",
+            "render-rate",
+            "How eagerly the window's terminals paint, as a StultoRenderRate",
+            STULTO_RENDER_RATE_FULL,
+            STULTO_RENDER_RATE_PAUSED,
+            STULTO_RENDER_RATE_PAUSED,
+            G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties(object_class, N_PROPS, pspecs);
+}
+
+/*
+ * Move the drop-down to the top of the primary monitor, across its width
+ */
+static void place_drop_down(StultoMainWindow *main_window, gboolean resize) {
+    GdkDisplay *display = gtk_widget_get_display(GTK_WIDGET(main_window));
+    GdkMonitor *monitor = gdk_display_get_primary_monitor(display);
+    GdkRectangle workarea;
+
+    /* Not every display names a primary monitor */
+    if (monitor == NULL) {
+        monitor = gdk_display_get_monitor(display, 0);
+    }
+
+    if (monitor == NULL) {
+        return;
+    }
+
+    gdk_monitor_get_workarea(monitor, &workarea);
+
+    gtk_window_move(GTK_WINDOW(main_window), workarea.x, workarea.y);
+
+    if (resize) {
+        gtk_window_resize(
+                GTK_WINDOW(main_window),
+                workarea.width,
+                workarea.height * STULTO_MAIN_WINDOW_DROP_DOWN_HEIGHT_PERCENT / 100);
+    }
 }
 
+/*
+ * A window with a first session around the terminal, or without any sessions given NULL (for opening a workspace)
+ */
 StultoMainWindow *stulto_main_window_new(StultoTerminal *terminal, StultoAppConfig *config) {
     StultoMainWindow *main_window = STULTO_MAIN_WINDOW(g_object_new(STULTO_TYPE_MAIN_WINDOW, NULL));
 
-    stulto_session_manager_add_session(main_window->session_manager, terminal);
+    if (terminal != NULL) {
+        stulto_session_manager_add_session(main_window->session_manager, terminal);
+    }
     main_window->config = config;
 
     GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
@@ -240,5 +983,215 @@ StultoMainWindow *stulto_main_window_new(StultoTerminal *terminal, StultoAppConf
 
     gtk_container_add(GTK_CONTAINER(main_window), GTK_WIDGET(box));
 
+    if (config->drop_down) {
+        GtkWindow *window = GTK_WINDOW(main_window);
+
+        gtk_window_set_decorated(window, FALSE);
+        gtk_window_set_skip_taskbar_hint(window, TRUE);
+        gtk_window_set_skip_pager_hint(window, TRUE);
+        gtk_window_set_keep_above(window, TRUE);
+        gtk_window_stick(window);
+        place_drop_down(main_window, TRUE);
+    }
+
+    /* Whole seconds, so the wakeups line up with the system's other timers */
+    if (config->initial_profile->resource_usage) {
+        main_window->resources_source = g_timeout_add_seconds(
+                STULTO_MAIN_WINDOW_RESOURCES_INTERVAL_S, resources_timeout_cb, main_window);
+    }
+
+    /* The drop-down is toggled over its socket */
+    if (config->initial_profile->control_socket || config->drop_down) {
+        GError *error = NULL;
+
+        main_window->control = stulto_control_new(
+                main_window->session_manager,
+                config->initial_profile,
+                config->drop_down ? STULTO_CONTROL_DROP_DOWN_SOCKET : NULL,
+                &error);
+
+        if (main_window->control == NULL) {
+            g_printerr("Error opening the control socket: %s\n", error->message);
+            g_error_free(error);
+        }
+    }
+
     return main_window;
 }
+
+/*
+ * Add the sessions of a workspace file to the window
+ */
+gboolean stulto_main_window_open_workspace(StultoMainWindow *main_window, const gchar *path, GError **error) {
+    g_return_val_if_fail(STULTO_IS_MAIN_WINDOW(main_window), FALSE);
+
+    StultoWorkspace *workspace = stulto_workspace_load(path, error);
+
+    if (workspace == NULL) {
+        return FALSE;
+    }
+
+    stulto_session_manager_add_workspace(main_window->session_manager, workspace, main_window->config->initial_profile);
+    stulto_workspace_free(workspace);
+
+    return TRUE;
+}
+
+/*
+ * Reattach the terminals the PTY holder kept, in the layout last left with it; a recovered layout takes its place
+ */
+static gboolean restore_held_sessions(StultoMainWindow *main_window, StultoHolder *holder, const gchar *recovered_path) {
+    gchar *recovered = NULL;
+
+    /* The holder keeps the panes that still have their PTYs, and adds those the layout is missing */
+    if (recovered_path != NULL && g_file_get_contents(recovered_path, &recovered, NULL, NULL)) {
+        stulto_holder_set_layout(holder, recovered);
+        g_free(recovered);
+    }
+
+    gchar *layout = stulto_holder_get_layout(holder);
+
+    if (layout == NULL) {
+        return FALSE;
+    }
+
+    GError *error = NULL;
+    gchar *socket_path = stulto_holder_get_socket_path();
+    StultoWorkspace *workspace = stulto_workspace_load_data(layout, socket_path, &error);
+
+    if (workspace != NULL) {
+        stulto_session_manager_add_workspace(main_window->session_manager, workspace, main_window->config->initial_profile);
+        stulto_workspace_free(workspace);
+    } else {
+        g_printerr("Error restoring held sessions: %s\n", error->message);
+        g_error_free(error);
+    }
+
+    g_free(socket_path);
+    g_free(layout);
+
+    return workspace != NULL;
+}
+
+/*
+ * Add the sessions the PTY holder kept running, those journaled by a Stulto that crashed, and those saved when Stulto
+ * last quit; returns whether any were added
+ *
+ * Held sessions take the place of the others, which describe the same sessions less their running programs
+ */
+gboolean stulto_main_window_restore_sessions(StultoMainWindow *main_window) {
+    g_return_val_if_fail(STULTO_IS_MAIN_WINDOW(main_window), FALSE);
+
+    StultoTerminalProfile *profile = main_window->config->initial_profile;
+    StultoHolder *holder = stulto_holder_get_default();
+    gboolean restored = FALSE;
+    gboolean held = FALSE;
+    GError *error = NULL;
+    gchar *path = NULL;
+
+    if (profile->journal && stulto_journal_can_recover()) {
+        gchar *state_dir = stulto_session_state_get_dir();
+
+        path = stulto_journal_recover(state_dir, &error);
+
+        if (error != NULL) {
+            g_printerr("Error recovering sessions: %s\n", error->message);
+            g_clear_error(&error);
+        }
+
+        g_free(state_dir);
+    }
+
+    if (holder != NULL && restore_held_sessions(main_window, holder, path)) {
+        restored = held = TRUE;
+    } else if (path != NULL) {
+        if (stulto_main_window_open_workspace(main_window, path, &error)) {
+            restored = TRUE;
+        } else {
+            g_printerr("Error recovering sessions: %s\n", error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    if (path != NULL) {
+        g_unlink(path);
+        g_free(path);
+    }
+
+    if (!held && profile->persist_sessions && stulto_session_state_exists()) {
+        if (stulto_session_state_restore(main_window->session_manager, profile, &error)) {
+            restored = TRUE;
+        } else {
+            g_printerr("Error restoring sessions: %s\n", error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    return restored;
+}
+
+/*
+ * Do all the work of showing the window but the mapping: lay it out, realize its widgets and start its terminals'
+ * children, so that it can be toggled into view at once
+ */
+void stulto_main_window_prebuild(StultoMainWindow *main_window) {
+    g_return_if_fail(STULTO_IS_MAIN_WINDOW(main_window));
+
+    GtkNotebook *notebook = GTK_NOTEBOOK(main_window->session_manager);
+    gint n_sessions = gtk_notebook_get_n_pages(notebook);
+    gint64 start_time = g_get_monotonic_time();
+
+    gtk_widget_show_all(gtk_bin_get_child(GTK_BIN(main_window)));
+    gtk_widget_realize(GTK_WIDGET(main_window));
+
+    for (gint i = 0; i < n_sessions; i++) {
+        GList *terminals = stulto_session_get_terminals(STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i)));
+
+        for (GList *l = terminals; l != NULL; l = l->next) {
+            gtk_widget_realize(GTK_WIDGET(l->data));
+        }
+
+        g_list_free(terminals);
+    }
+
+    g_debug("Window built hidden in %.1f ms", (g_get_monotonic_time() - start_time) / 1000.0);
+}
+
+/*
+ * The time to hand the window manager with a request for focus. Toggling comes over a socket rather than from an
+ * event, and without a real timestamp focus stealing prevention may leave the window behind the one in use.
+ */
+static guint32 get_present_time(StultoMainWindow *main_window) {
+#ifdef GDK_WINDOWING_X11
+    GdkWindow *gdk_window = gtk_widget_get_window(GTK_WIDGET(main_window));
+
+    if (gdk_window != NULL && GDK_IS_X11_WINDOW(gdk_window)) {
+        return gdk_x11_get_server_time(gdk_window);
+    }
+#endif
+
+    return GDK_CURRENT_TIME;
+}
+
+/*
+ * Bring the window into view and focus, or hide it if it is already in view, focused or not (whatever runs the
+ * toggle command, a hotkey daemon say, may hold the focus meanwhile); showing a prebuilt window is only a map
+ */
+void stulto_main_window_toggle(StultoMainWindow *main_window) {
+    g_return_if_fail(STULTO_IS_MAIN_WINDOW(main_window));
+
+    GtkWindow *window = GTK_WINDOW(main_window);
+
+    if (gtk_widget_get_mapped(GTK_WIDGET(main_window)) && !main_window->obscured) {
+        gtk_widget_hide(GTK_WIDGET(main_window));
+        return;
+    }
+
+    /* Window managers don't all remember where a hidden window was */
+    if (main_window->config->drop_down && !gtk_widget_get_mapped(GTK_WIDGET(main_window))) {
+        place_drop_down(main_window, FALSE);
+    }
+
+    main_window->toggle_time = g_get_monotonic_time();
+    gtk_window_present_with_time(window, get_present_time(main_window));
+}
@@ -36,6 +36,10 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE(StultoMainWindow, stulto_main_window, STULTO, MAIN_WINDOW, GtkWindow)
 
 StultoMainWindow *stulto_main_window_new(StultoTerminal *terminal, StultoAppConfig *config);
+gboolean stulto_main_window_open_workspace(StultoMainWindow *main_window, const gchar *path, GError **error);
+gboolean stulto_main_window_restore_sessions(StultoMainWindow *main_window);
+void stulto_main_window_prebuild(StultoMainWindow *main_window);
+void stulto_main_window_toggle(StultoMainWindow *main_window);
 void *stulto_main_window_add_terminal();
 
 G_END_DECLS
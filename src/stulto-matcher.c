@@ -0,0 +1,269 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string.h>
+
+#include "stulto-matcher.h"
+
+#define RULE_GROUP_FORMAT "rule%u"
+
+StultoMatcher *stulto_matcher_new() {
+    StultoMatcher *matcher = g_new0(StultoMatcher, 1);
+
+    matcher->rules = g_ptr_array_new();
+
+    return matcher;
+}
+
+/*
+ * Add a rule, checking that its regex compiles on its own so that errors can be reported against the rule rather than
+ * against the combined alternation. Backreferences are refused: inside the alternation, the rule's groups are numbered
+ * after those of the rules before it, so a \1 would refer to some other rule's group
+ */
+gboolean stulto_matcher_add_rule(StultoMatcher *matcher,
+                                 const gchar *name,
+                                 const gchar *regex,
+                                 const gchar *program,
+                                 gboolean batch,
+                                 gboolean end_of_options,
+                                 GError **error) {
+    g_return_val_if_fail(matcher->vte_regex == NULL, FALSE);
+
+#ifdef VTE_TYPE_REGEX
+    VteRegex *check = vte_regex_new_for_match(regex, -1, PCRE2_MULTILINE, error);
+
+    if (check == NULL) {
+        return FALSE;
+    }
+    vte_regex_unref(check);
+
+    /* VTE's regex doesn't expose the pattern's info */
+    int error_code;
+    PCRE2_SIZE error_offset;
+    uint32_t max_backref = 0;
+    pcre2_code *code = pcre2_compile(
+            (PCRE2_SPTR) regex, PCRE2_ZERO_TERMINATED,
+            PCRE2_UTF | PCRE2_MULTILINE,
+            &error_code, &error_offset,
+            NULL);
+
+    if (code != NULL) {
+        pcre2_pattern_info(code, PCRE2_INFO_BACKREFMAX, &max_backref);
+        pcre2_code_free(code);
+    }
+#else
+    GRegex *check = g_regex_new(regex, G_REGEX_MULTILINE, 0, error);
+
+    if (check == NULL) {
+        return FALSE;
+    }
+    gint max_backref = g_regex_get_max_backref(check);
+    g_regex_unref(check);
+#endif
+
+    if (max_backref > 0) {
+        g_set_error(error, G_REGEX_ERROR, G_REGEX_ERROR_COMPILE,
+                    "Backreferences aren't supported, as all rules are matched through one combined regex");
+        return FALSE;
+    }
+
+    StultoMatchRule *rule = g_new0(StultoMatchRule, 1);
+
+    rule->name = g_strdup(name);
+    rule->regex = g_strdup(regex);
+    rule->program = g_strdup(program);
+    rule->batch = batch;
+    rule->end_of_options = end_of_options;
+
+    g_ptr_array_add(matcher->rules, rule);
+
+    return TRUE;
+}
+
+gboolean stulto_matcher_compile(StultoMatcher *matcher, GError **error) {
+    g_return_val_if_fail(matcher->rules->len > 0, FALSE);
+
+    GString *pattern = g_string_new(NULL);
+
+    for (guint i = 0; i < matcher->rules->len; i++) {
+        StultoMatchRule *rule = g_ptr_array_index(matcher->rules, i);
+
+        if (i > 0) {
+            g_string_append_c(pattern, '|');
+        }
+        g_string_append_printf(pattern, "(?<" RULE_GROUP_FORMAT ">%s)", i, rule->regex);
+    }
+
+    matcher->rule_groups = g_new0(gint, matcher->rules->len);
+
+#ifdef VTE_TYPE_REGEX
+    matcher->vte_regex = vte_regex_new_for_match(pattern->str, pattern->len, PCRE2_MULTILINE, error);
+
+    if (matcher->vte_regex == NULL) {
+        g_string_free(pattern, TRUE);
+        return FALSE;
+    }
+
+    /* Not fatal - PCRE2 falls back to the interpreter where JIT isn't available */
+    vte_regex_jit(matcher->vte_regex, PCRE2_JIT_COMPLETE, NULL);
+
+    int error_code;
+    PCRE2_SIZE error_offset;
+
+    matcher->dispatch_code = pcre2_compile(
+            (PCRE2_SPTR) pattern->str, pattern->len,
+            PCRE2_UTF | PCRE2_MULTILINE,
+            &error_code, &error_offset,
+            NULL);
+
+    if (matcher->dispatch_code == NULL) {
+        PCRE2_UCHAR message[256];
+
+        pcre2_get_error_message(error_code, message, sizeof(message));
+        g_set_error(error, G_REGEX_ERROR, G_REGEX_ERROR_COMPILE, "%s at offset %" G_GSIZE_FORMAT,
+                    (gchar *) message, (gsize) error_offset);
+
+        g_clear_pointer(&matcher->vte_regex, vte_regex_unref);
+        g_string_free(pattern, TRUE);
+        return FALSE;
+    }
+
+    pcre2_jit_compile(matcher->dispatch_code, PCRE2_JIT_COMPLETE);
+    matcher->dispatch_match_data = pcre2_match_data_create_from_pattern(matcher->dispatch_code, NULL);
+
+    for (guint i = 0; i < matcher->rules->len; i++) {
+        gchar *group_name = g_strdup_printf(RULE_GROUP_FORMAT, i);
+
+        matcher->rule_groups[i] = pcre2_substring_number_from_name(matcher->dispatch_code, (PCRE2_SPTR) group_name);
+        g_free(group_name);
+    }
+#else
+    matcher->vte_regex = g_regex_new(pattern->str, G_REGEX_MULTILINE | G_REGEX_OPTIMIZE, 0, error);
+
+    if (matcher->vte_regex == NULL) {
+        g_string_free(pattern, TRUE);
+        return FALSE;
+    }
+
+    matcher->dispatch_code = g_regex_ref(matcher->vte_regex);
+
+    for (guint i = 0; i < matcher->rules->len; i++) {
+        gchar *group_name = g_strdup_printf(RULE_GROUP_FORMAT, i);
+
+        matcher->rule_groups[i] = g_regex_get_string_number(matcher->dispatch_code, group_name);
+        g_free(group_name);
+    }
+#endif
+
+    g_string_free(pattern, TRUE);
+
+    return TRUE;
+}
+
+void stulto_matcher_apply(StultoMatcher *matcher, VteTerminal *terminal_widget) {
+    g_return_if_fail(matcher->vte_regex != NULL);
+
+#ifdef VTE_TYPE_REGEX
+    int id = vte_terminal_match_add_regex(terminal_widget, matcher->vte_regex, 0);
+#else
+    int id = vte_terminal_match_add_gregex(terminal_widget, matcher->vte_regex, 0);
+#endif
+    vte_terminal_match_set_cursor_name(terminal_widget, id, "pointer");
+}
+
+void stulto_matcher_free(StultoMatcher *matcher) {
+    if (matcher == NULL) {
+        return;
+    }
+
+    for (guint i = 0; i < matcher->rules->len; i++) {
+        StultoMatchRule *rule = g_ptr_array_index(matcher->rules, i);
+
+        g_free(rule->name);
+        g_free(rule->regex);
+        g_free(rule->program);
+        g_free(rule);
+    }
+    g_ptr_array_free(matcher->rules, TRUE);
+
+#ifdef VTE_TYPE_REGEX
+    g_clear_pointer(&matcher->vte_regex, vte_regex_unref);
+    g_clear_pointer(&matcher->dispatch_match_data, pcre2_match_data_free);
+    g_clear_pointer(&matcher->dispatch_code, pcre2_code_free);
+#else
+    g_clear_pointer(&matcher->vte_regex, g_regex_unref);
+    g_clear_pointer(&matcher->dispatch_code, g_regex_unref);
+#endif
+
+    g_free(matcher->rule_groups);
+    g_free(matcher);
+}
+
+/*
+ * Find the rule responsible for a match VTE reported, i.e., the rule whose group took part in the match. The rule must
+ * match the whole of the text, not just some part of a hyperlink URI
+ */
+const StultoMatchRule *stulto_matcher_lookup(StultoMatcher *matcher, const gchar *match) {
+    g_return_val_if_fail(matcher->dispatch_code != NULL, NULL);
+
+#ifdef VTE_TYPE_REGEX
+    int rc = pcre2_match(
+            matcher->dispatch_code,
+            (PCRE2_SPTR) match, strlen(match),
+            0, PCRE2_ANCHORED | PCRE2_ENDANCHORED,
+            matcher->dispatch_match_data,
+            NULL);
+
+    if (rc < 0) {
+        return NULL;
+    }
+
+    PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(matcher->dispatch_match_data);
+
+    for (guint i = 0; i < matcher->rules->len; i++) {
+        gint group = matcher->rule_groups[i];
+
+        if (group > 0 && group < rc && ovector[2 * group] != PCRE2_UNSET) {
+            return g_ptr_array_index(matcher->rules, i);
+        }
+    }
+
+    return NULL;
+#else
+    GMatchInfo *match_info = NULL;
+    const StultoMatchRule *found = NULL;
+
+    gint match_end = -1;
+
+    if (g_regex_match(matcher->dispatch_code, match, G_REGEX_MATCH_ANCHORED, &match_info)
+        && g_match_info_fetch_pos(match_info, 0, NULL, &match_end)
+        && (gsize) match_end == strlen(match)) {
+        for (guint i = 0; i < matcher->rules->len && found == NULL; i++) {
+            gint start = -1;
+
+            if (g_match_info_fetch_pos(match_info, matcher->rule_groups[i], &start, NULL) && start >= 0) {
+                found = g_ptr_array_index(matcher->rules, i);
+            }
+        }
+    }
+    g_match_info_free(match_info);
+
+    return found;
+#endif
+}
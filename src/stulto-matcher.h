@@ -0,0 +1,77 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_MATCHER_H
+#define STULTO_MATCHER_H
+
+#include <vte/vte.h>
+
+#ifdef VTE_TYPE_REGEX
+#define PCRE2_CODE_UNIT_WIDTH 8
+
+#include <pcre2.h>
+
+#endif
+
+/*
+ * A set of output match rules (URLs, file:line references, ticket IDs, ...), each with its own handler program
+ *
+ * All rules are compiled into a single alternation with one named group per rule, so VTE only tests one regex however
+ * many rules there are. The same pattern is JIT-compiled a second time on our side to find out which rule matched.
+ * A matcher belongs to a profile, and the compiled regexes are shared by every terminal using that profile
+ */
+
+typedef struct _StultoMatchRule {
+    gchar *name;
+    gchar *regex;
+    gchar *program;
+    gboolean batch;
+    gboolean end_of_options;
+} StultoMatchRule;
+
+typedef struct _StultoMatcher {
+    GPtrArray *rules;
+#ifdef VTE_TYPE_REGEX
+    VteRegex *vte_regex;
+    pcre2_code *dispatch_code;
+    pcre2_match_data *dispatch_match_data;
+#else
+    GRegex *vte_regex;
+    GRegex *dispatch_code;
+#endif
+    gint *rule_groups;
+} StultoMatcher;
+
+StultoMatcher *stulto_matcher_new();
+
+gboolean stulto_matcher_add_rule(StultoMatcher *matcher,
+                                 const gchar *name,
+                                 const gchar *regex,
+                                 const gchar *program,
+                                 gboolean batch,
+                                 gboolean end_of_options,
+                                 GError **error);
+gboolean stulto_matcher_compile(StultoMatcher *matcher, GError **error);
+
+void stulto_matcher_apply(StultoMatcher *matcher, VteTerminal *terminal_widget);
+const StultoMatchRule *stulto_matcher_lookup(StultoMatcher *matcher, const gchar *match);
+
+void stulto_matcher_free(StultoMatcher *matcher);
+
+#endif //STULTO_MATCHER_H
@@ -0,0 +1,255 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* For posix_spawn_file_actions_addclosefrom_np() */
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stulto-opener.h"
+
+/* Identical requests within this window are treated as one */
+#define STULTO_OPENER_DEDUP_USEC (500 * 1000)
+/* How long the worker waits for further requests before launching what it has */
+#define STULTO_OPENER_BATCH_USEC (50 * 1000)
+/* Dedup entries kept before expired ones are pruned */
+#define STULTO_OPENER_MAX_RECENT 64
+
+extern char **environ;
+
+typedef struct _OpenRequest {
+    gchar *program;
+    gchar *argument;
+    gboolean batch;
+    gboolean end_of_options;
+    gboolean launched;
+} OpenRequest;
+
+static GAsyncQueue *request_queue = NULL;
+static GHashTable *recent_requests = NULL;
+
+static void open_request_free(gpointer data) {
+    OpenRequest *request = data;
+
+    g_free(request->program);
+    g_free(request->argument);
+    g_free(request);
+}
+
+// region Worker thread
+
+static void child_reaped_cb(GPid pid, gint status, gpointer data) {
+    g_spawn_close_pid(pid);
+}
+
+static const gchar *resolve_program(GHashTable *paths, const gchar *program) {
+    const gchar *path = g_hash_table_lookup(paths, program);
+
+    if (path != NULL) {
+        return path;
+    }
+
+    gchar *resolved = strchr(program, '/') != NULL
+            ? g_strdup(program)
+            : g_find_program_in_path(program);
+
+    if (resolved == NULL) {
+        g_printerr("Failed to execute '%s': not found in PATH\n", program);
+        return NULL;
+    }
+
+    g_hash_table_insert(paths, g_strdup(program), resolved);
+
+    return resolved;
+}
+
+/*
+ * Run the program with nothing of Stulto's but stderr: no terminal input, and none of its PTY masters or sockets
+ */
+static void spawn_program(const gchar *path, GPtrArray *argv) {
+    GPid pid;
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 34)
+    posix_spawn_file_actions_t file_actions;
+
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_addopen(&file_actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addclosefrom_np(&file_actions, STDERR_FILENO + 1);
+
+    int rc = posix_spawn(&pid, path, &file_actions, NULL, (gchar **) argv->pdata, environ);
+
+    posix_spawn_file_actions_destroy(&file_actions);
+
+    if (rc != 0) {
+        g_printerr("Failed to execute '%s': %s\n", path, g_strerror(rc));
+        return;
+    }
+#else
+    /* Without closefrom in posix_spawn, GLib closes the other fds itself, at the cost of a fork */
+    GError *error = NULL;
+
+    g_ptr_array_insert(argv, 0, (gpointer) path);
+
+    gboolean spawned = g_spawn_async(
+            NULL, (gchar **) argv->pdata, NULL,
+            G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_FILE_AND_ARGV_ZERO
+            | G_SPAWN_STDIN_FROM_DEV_NULL | G_SPAWN_STDOUT_TO_DEV_NULL,
+            NULL, NULL, &pid, &error);
+
+    g_ptr_array_remove_index(argv, 0);
+
+    if (!spawned) {
+        g_printerr("Failed to execute '%s': %s\n", path, error->message);
+        g_error_free(error);
+        return;
+    }
+#endif
+
+    /* Reaped from the main loop; adding the watch from here is thread-safe */
+    g_child_watch_add(pid, child_reaped_cb, NULL);
+}
+
+static void launch_requests(GPtrArray *requests, GHashTable *paths) {
+    for (guint i = 0; i < requests->len; i++) {
+        OpenRequest *request = g_ptr_array_index(requests, i);
+
+        if (request->launched) {
+            continue;
+        }
+
+        const gchar *path = resolve_program(paths, request->program);
+
+        if (path == NULL) {
+            continue;
+        }
+
+        GPtrArray *argv = g_ptr_array_new();
+
+        g_ptr_array_add(argv, request->program);
+        if (request->end_of_options) {
+            g_ptr_array_add(argv, "--");
+        }
+        g_ptr_array_add(argv, request->argument);
+
+        if (request->batch) {
+            for (guint j = i + 1; j < requests->len; j++) {
+                OpenRequest *other = g_ptr_array_index(requests, j);
+
+                if (other->batch && !other->launched
+                    && other->end_of_options == request->end_of_options
+                    && g_str_equal(other->program, request->program)) {
+                    g_ptr_array_add(argv, other->argument);
+                    other->launched = TRUE;
+                }
+            }
+        }
+
+        g_ptr_array_add(argv, NULL);
+
+        spawn_program(path, argv);
+
+        g_ptr_array_free(argv, TRUE);
+    }
+}
+
+static gpointer opener_thread(gpointer data) {
+    GAsyncQueue *queue = data;
+    GHashTable *paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    for (;;) {
+        GPtrArray *requests = g_ptr_array_new_with_free_func(open_request_free);
+        OpenRequest *request = g_async_queue_pop(queue);
+
+        do {
+            g_ptr_array_add(requests, request);
+        } while ((request = g_async_queue_timeout_pop(queue, STULTO_OPENER_BATCH_USEC)) != NULL);
+
+        launch_requests(requests, paths);
+
+        g_ptr_array_unref(requests);
+    }
+
+    return NULL;
+}
+
+// endregion
+
+// region Main thread
+
+static gboolean recent_request_expired(gpointer key, gpointer value, gpointer data) {
+    gint64 now = *(gint64 *) data;
+
+    return now - GPOINTER_TO_SIZE(value) > STULTO_OPENER_DEDUP_USEC;
+}
+
+/*
+ * Returns TRUE if the same request was made within the dedup window
+ */
+static gboolean is_duplicate(const gchar *program, const gchar *argument) {
+    gint64 now = g_get_monotonic_time();
+    gchar *key = g_strconcat(program, "\n", argument, NULL);
+
+    if (recent_requests == NULL) {
+        recent_requests = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    gpointer last = NULL;
+
+    if (g_hash_table_lookup_extended(recent_requests, key, NULL, &last)
+        && now - GPOINTER_TO_SIZE(last) <= STULTO_OPENER_DEDUP_USEC) {
+        g_free(key);
+        return TRUE;
+    }
+
+    if (g_hash_table_size(recent_requests) >= STULTO_OPENER_MAX_RECENT) {
+        g_hash_table_foreach_remove(recent_requests, recent_request_expired, &now);
+    }
+
+    g_hash_table_insert(recent_requests, key, GSIZE_TO_POINTER(now));
+
+    return FALSE;
+}
+
+void stulto_opener_open(const gchar *program, const gchar *argument, gboolean batch, gboolean end_of_options) {
+    g_return_if_fail(program != NULL && argument != NULL);
+
+    if (is_duplicate(program, argument)) {
+        return;
+    }
+
+    if (request_queue == NULL) {
+        request_queue = g_async_queue_new();
+        g_thread_unref(g_thread_new("stulto-opener", opener_thread, request_queue));
+    }
+
+    OpenRequest *request = g_new0(OpenRequest, 1);
+
+    request->program = g_strdup(program);
+    request->argument = g_strdup(argument);
+    request->batch = batch;
+    request->end_of_options = end_of_options;
+
+    g_async_queue_push(request_queue, request);
+}
+
+// endregion
@@ -0,0 +1,40 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_OPENER_H
+#define STULTO_OPENER_H
+
+#include <glib.h>
+
+/*
+ * Launches match and hyperlink handler programs off the GUI thread
+ *
+ * Requests are handed to a single long-lived worker thread, which resolves each program's path once and starts it with
+ * posix_spawn() rather than forking the whole (large) Stulto process, inheriting none of its fds but stderr. Repeated
+ * requests for the same program and argument within a short window - e.g., an accidental double click - are dropped,
+ * and requests that arrive together are launched together, merged into a single invocation for programs that accept
+ * several arguments. For programs that accept it, the arguments follow a -- so that none of them can be taken for an
+ * option
+ */
+
+#define STULTO_OPENER_DEFAULT_PROGRAM "xdg-open"
+
+void stulto_opener_open(const gchar *program, const gchar *argument, gboolean batch, gboolean end_of_options);
+
+#endif //STULTO_OPENER_H
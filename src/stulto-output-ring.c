@@ -0,0 +1,246 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+
+#include "stulto-output-ring.h"
+
+struct _StultoOutputRing {
+    guint8 *data;
+    gsize size;
+    /* Bytes appended so far; the ring holds the last MIN(end, size) of them */
+    guint64 end;
+
+    /* Of RingSubscriber */
+    GPtrArray *subscribers;
+};
+
+typedef struct _RingSubscriber {
+    StultoOutputRing *ring;
+    gint fd;
+    /* Sent ahead of any output, e.g. a reply to the request that subscribed */
+    GString *preamble;
+    /* The next byte to send, as a position in the whole stream */
+    guint64 position;
+    guint64 dropped;
+    guint write_source;
+    guint hangup_source;
+} RingSubscriber;
+
+static void subscriber_free(RingSubscriber *subscriber) {
+    if (subscriber->write_source != 0) {
+        g_source_remove(subscriber->write_source);
+    }
+    if (subscriber->hangup_source != 0) {
+        g_source_remove(subscriber->hangup_source);
+    }
+
+    if (subscriber->dropped > 0) {
+        g_debug("Output subscriber missed %" G_GUINT64_FORMAT " bytes", subscriber->dropped);
+    }
+
+    close(subscriber->fd);
+    g_string_free(subscriber->preamble, TRUE);
+    g_free(subscriber);
+}
+
+/*
+ * Send from a buffer without blocking; returns the bytes sent, or -1 if the subscriber is gone
+ */
+static gssize send_some(gint fd, const void *data, gsize len) {
+    gssize n;
+
+    do {
+        n = send(fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return errno == EAGAIN ? 0 : -1;
+    }
+
+    return n;
+}
+
+/*
+ * Send as much as the subscriber takes; FALSE once it is gone
+ */
+static gboolean subscriber_flush(RingSubscriber *subscriber) {
+    StultoOutputRing *ring = subscriber->ring;
+    guint64 start = ring->end - MIN(ring->end, ring->size);
+
+    while (subscriber->preamble->len > 0) {
+        gssize n = send_some(subscriber->fd, subscriber->preamble->str, subscriber->preamble->len);
+
+        if (n <= 0) {
+            return n == 0;
+        }
+
+        g_string_erase(subscriber->preamble, 0, n);
+    }
+
+    if (subscriber->position < start) {
+        subscriber->dropped += start - subscriber->position;
+        subscriber->position = start;
+    }
+
+    while (subscriber->position < ring->end) {
+        gsize offset = subscriber->position % ring->size;
+        /* Up to the end of the ring's memory, at most */
+        gsize len = MIN(ring->end - subscriber->position, ring->size - offset);
+        gssize n = send_some(subscriber->fd, ring->data + offset, len);
+
+        if (n <= 0) {
+            return n == 0;
+        }
+
+        subscriber->position += n;
+    }
+
+    return TRUE;
+}
+
+static gboolean subscriber_writable_cb(gint fd, GIOCondition condition, gpointer data) {
+    RingSubscriber *subscriber = data;
+    StultoOutputRing *ring = subscriber->ring;
+
+    if (!subscriber_flush(subscriber)) {
+        subscriber->write_source = 0;
+        g_ptr_array_remove(ring->subscribers, subscriber);
+
+        return G_SOURCE_REMOVE;
+    }
+
+    if (subscriber->preamble->len > 0 || subscriber->position < ring->end) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    subscriber->write_source = 0;
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Subscribers don't send anything; input is discarded, and the subscription lasts until they hang up
+ *
+ * The end of their input alone doesn't end it, as clients like stultoctl shut down their side once their commands are
+ * sent
+ */
+static gboolean subscriber_hangup_cb(gint fd, GIOCondition condition, gpointer data) {
+    RingSubscriber *subscriber = data;
+    gchar buf[256];
+    gssize n = 0;
+
+    if (!(condition & (G_IO_HUP | G_IO_ERR))) {
+        do {
+            n = read(fd, buf, sizeof(buf));
+        } while (n < 0 && errno == EINTR);
+
+        if (n > 0 || (n < 0 && errno == EAGAIN)) {
+            return G_SOURCE_CONTINUE;
+        }
+
+        if (n == 0) {
+            subscriber->hangup_source = g_unix_fd_add(fd, G_IO_HUP | G_IO_ERR, subscriber_hangup_cb, subscriber);
+            return G_SOURCE_REMOVE;
+        }
+    }
+
+    subscriber->hangup_source = 0;
+    g_ptr_array_remove(subscriber->ring->subscribers, subscriber);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void subscriber_schedule(RingSubscriber *subscriber) {
+    if (subscriber->write_source == 0) {
+        /* Below the terminal's own reads and redraws */
+        subscriber->write_source = g_unix_fd_add_full(
+                G_PRIORITY_LOW, subscriber->fd, G_IO_OUT, subscriber_writable_cb, subscriber, NULL);
+    }
+}
+
+StultoOutputRing *stulto_output_ring_new(gsize size) {
+    StultoOutputRing *ring = g_new0(StultoOutputRing, 1);
+
+    ring->data = g_malloc(size);
+    ring->size = size;
+    ring->subscribers = g_ptr_array_new_with_free_func((GDestroyNotify) subscriber_free);
+
+    return ring;
+}
+
+/*
+ * Subscribers see the end of the stream
+ */
+void stulto_output_ring_free(StultoOutputRing *ring) {
+    if (ring == NULL) {
+        return;
+    }
+
+    g_ptr_array_unref(ring->subscribers);
+    g_free(ring->data);
+    g_free(ring);
+}
+
+void stulto_output_ring_append(StultoOutputRing *ring, const gchar *data, gsize len) {
+    /* Only the tail of output longer than the ring could ever be sent */
+    if (len > ring->size) {
+        ring->end += len - ring->size;
+        data += len - ring->size;
+        len = ring->size;
+    }
+
+    gsize offset = ring->end % ring->size;
+    gsize first = MIN(len, ring->size - offset);
+
+    memcpy(ring->data + offset, data, first);
+    memcpy(ring->data, data + first, len - first);
+
+    ring->end += len;
+
+    for (guint i = 0; i < ring->subscribers->len; i++) {
+        subscriber_schedule(g_ptr_array_index(ring->subscribers, i));
+    }
+}
+
+/*
+ * Stream the output from here on to fd, which the ring takes over; preamble goes first
+ */
+void stulto_output_ring_subscribe(StultoOutputRing *ring, gint fd, const gchar *preamble, gsize preamble_len) {
+    RingSubscriber *subscriber = g_new0(RingSubscriber, 1);
+
+    subscriber->ring = ring;
+    subscriber->fd = fd;
+    subscriber->preamble = g_string_new_len(preamble, (gssize) preamble_len);
+    subscriber->position = ring->end;
+
+    g_unix_set_fd_nonblocking(fd, TRUE, NULL);
+    subscriber->hangup_source = g_unix_fd_add(fd, G_IO_IN | G_IO_HUP | G_IO_ERR, subscriber_hangup_cb, subscriber);
+
+    g_ptr_array_add(ring->subscribers, subscriber);
+
+    if (subscriber->preamble->len > 0) {
+        subscriber_schedule(subscriber);
+    }
+}
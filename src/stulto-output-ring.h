@@ -0,0 +1,42 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_OUTPUT_RING_H
+#define STULTO_OUTPUT_RING_H
+
+#include <glib.h>
+
+/*
+ * A terminal's most recent output, streamed to subscribers' sockets
+ *
+ * Output is copied into the ring once, however many subscribers there are; each subscriber only keeps its position in
+ * it, and is sent its share straight from the ring whenever its descriptor is writable. A subscriber that falls more
+ * than the ring's size behind skips ahead to the oldest output still in the ring, so a slow one loses output but never
+ * holds up the terminal
+ */
+
+typedef struct _StultoOutputRing StultoOutputRing;
+
+StultoOutputRing *stulto_output_ring_new(gsize size);
+void stulto_output_ring_free(StultoOutputRing *ring);
+
+void stulto_output_ring_append(StultoOutputRing *ring, const gchar *data, gsize len);
+void stulto_output_ring_subscribe(StultoOutputRing *ring, gint fd, const gchar *preamble, gsize preamble_len);
+
+#endif //STULTO_OUTPUT_RING_H
@@ -0,0 +1,210 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string.h>
+
+#include "stulto-paste.h"
+
+/* Converted text staged for the PTY at a time */
+#define STULTO_PASTE_CHUNK_SIZE 16384
+/* Time spent writing per main loop iteration before yielding to input and redraws */
+#define STULTO_PASTE_SLICE_USEC 4000
+
+static const gchar BRACKET_START[] = "\033[200~";
+static const gchar BRACKET_END[] = "\033[201~";
+
+struct _StultoPaste {
+    StultoPty *pty;
+
+    gchar *text;
+    gsize len;
+    gsize offset;
+
+    gboolean bracketed;
+    gboolean bracket_opened;
+    gboolean bracket_closed;
+    gboolean prev_was_cr;
+
+    gchar chunk[STULTO_PASTE_CHUNK_SIZE];
+    gsize chunk_len;
+    gsize chunk_offset;
+
+    guint watch;
+    gint64 start_time;
+
+    StultoPasteProgressFunc progress_func;
+    StultoPasteFinishedFunc finished_func;
+    gpointer user_data;
+};
+
+/*
+ * Stage the next chunk of text, converted the way VTE converts pasted text: newlines become carriage returns, and
+ * CRLF pairs collapse into a single CR. Inside brackets, ESC is dropped so the payload can't close the bracket early
+ */
+static void fill_chunk(StultoPaste *paste) {
+    const gchar *src = paste->text + paste->offset;
+    const gchar *src_end = paste->text + paste->len;
+    gchar *out = paste->chunk;
+    gchar *out_end = paste->chunk + STULTO_PASTE_CHUNK_SIZE;
+
+    while (src < src_end && out < out_end) {
+        gchar c = *src++;
+
+        if (c == '\n') {
+            if (!paste->prev_was_cr) {
+                *out++ = '\r';
+            }
+            paste->prev_was_cr = FALSE;
+            continue;
+        }
+
+        paste->prev_was_cr = c == '\r';
+
+        if (paste->bracketed && c == '\033') {
+            continue;
+        }
+
+        *out++ = c;
+    }
+
+    paste->offset = src - paste->text;
+    paste->chunk_len = out - paste->chunk;
+    paste->chunk_offset = 0;
+}
+
+static void stage_bytes(StultoPaste *paste, const gchar *data, gsize len) {
+    memcpy(paste->chunk, data, len);
+    paste->chunk_len = len;
+    paste->chunk_offset = 0;
+}
+
+static void finish(StultoPaste *paste, gboolean cancelled) {
+    g_debug("Pasted %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes in %.1f ms%s",
+            paste->offset, paste->len,
+            (g_get_monotonic_time() - paste->start_time) / 1000.0,
+            cancelled ? " (cancelled)" : "");
+
+    paste->finished_func(cancelled, paste->user_data);
+}
+
+static gboolean pty_writable_cb(gint fd, GIOCondition condition, gpointer data) {
+    StultoPaste *paste = data;
+
+    gint64 deadline = g_get_monotonic_time() + STULTO_PASTE_SLICE_USEC;
+
+    do {
+        if (paste->chunk_offset == paste->chunk_len) {
+            /* The first chunk of a bracketed paste is the start bracket itself */
+            paste->bracket_opened = paste->bracketed;
+
+            if (paste->offset < paste->len) {
+                fill_chunk(paste);
+            } else if (paste->bracketed && !paste->bracket_closed) {
+                stage_bytes(paste, BRACKET_END, strlen(BRACKET_END));
+                paste->bracket_closed = TRUE;
+            } else {
+                paste->watch = 0;
+                finish(paste, FALSE);
+
+                return G_SOURCE_REMOVE;
+            }
+        }
+
+        gsize n = stulto_pty_try_write(paste->pty,
+                                       paste->chunk + paste->chunk_offset,
+                                       paste->chunk_len - paste->chunk_offset);
+
+        /* The PTY is full (or keystrokes are queued ahead of us) - wait until it drains */
+        if (n == 0) {
+            break;
+        }
+
+        paste->chunk_offset += n;
+    } while (g_get_monotonic_time() < deadline);
+
+    paste->progress_func(paste->offset, paste->len, paste->user_data);
+
+    return G_SOURCE_CONTINUE;
+}
+
+StultoPaste *stulto_paste_new(StultoPty *pty,
+                              gchar *text,
+                              StultoPasteProgressFunc progress_func,
+                              StultoPasteFinishedFunc finished_func,
+                              gpointer user_data) {
+    StultoPaste *paste = g_new0(StultoPaste, 1);
+
+    paste->pty = pty;
+    paste->text = text;
+    paste->len = strlen(text);
+    paste->bracketed = stulto_pty_get_bracketed_paste(pty);
+
+    paste->progress_func = progress_func;
+    paste->finished_func = finished_func;
+    paste->user_data = user_data;
+
+    if (paste->bracketed) {
+        stage_bytes(paste, BRACKET_START, strlen(BRACKET_START));
+    }
+
+    paste->start_time = g_get_monotonic_time();
+    paste->watch = stulto_pty_add_writable_watch(pty, pty_writable_cb, paste);
+
+    return paste;
+}
+
+void stulto_paste_cancel(StultoPaste *paste) {
+    if (paste->watch == 0) {
+        return;
+    }
+
+    g_source_remove(paste->watch);
+    paste->watch = 0;
+
+    /*
+     * Whatever part of the chunk was already written stays written. A start bracket cut short is completed rather than
+     * left as a stray escape sequence; one never begun needs no closing
+     */
+    if (paste->bracketed && !paste->bracket_opened && paste->chunk_offset > 0) {
+        stulto_pty_write(paste->pty,
+                         paste->chunk + paste->chunk_offset,
+                         paste->chunk_len - paste->chunk_offset);
+        paste->bracket_opened = TRUE;
+    }
+
+    if (paste->bracket_opened && !paste->bracket_closed) {
+        stulto_pty_write(paste->pty, BRACKET_END, strlen(BRACKET_END));
+        paste->bracket_closed = TRUE;
+    }
+
+    finish(paste, TRUE);
+}
+
+void stulto_paste_free(StultoPaste *paste) {
+    if (paste == NULL) {
+        return;
+    }
+
+    if (paste->watch) {
+        g_source_remove(paste->watch);
+    }
+
+    g_free(paste->text);
+    g_free(paste);
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_PASTE_H
+#define STULTO_PASTE_H
+
+#include <glib.h>
+
+#include "stulto-pty.h"
+
+/*
+ * A paste in progress
+ *
+ * Text is converted and written a chunk at a time, only as fast as the PTY accepts it, so pasting a multi-megabyte
+ * clipboard neither blocks the main loop nor buffers the whole payload a second time. When the application has enabled
+ * bracketed paste, the whole paste is wrapped in a single pair of brackets, which is closed even if the paste is
+ * cancelled, as long as it was opened
+ */
+
+typedef struct _StultoPaste StultoPaste;
+
+typedef void (*StultoPasteProgressFunc)(gsize written, gsize total, gpointer user_data);
+typedef void (*StultoPasteFinishedFunc)(gboolean cancelled, gpointer user_data);
+
+StultoPaste *stulto_paste_new(StultoPty *pty,
+                              gchar *text,
+                              StultoPasteProgressFunc progress_func,
+                              StultoPasteFinishedFunc finished_func,
+                              gpointer user_data);
+void stulto_paste_cancel(StultoPaste *paste);
+void stulto_paste_free(StultoPaste *paste);
+
+#endif //STULTO_PASTE_H
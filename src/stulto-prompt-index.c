@@ -0,0 +1,148 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stulto-prompt-index.h"
+
+struct _StultoPromptIndex {
+    GArray *marks;
+};
+
+StultoPromptIndex *stulto_prompt_index_new() {
+    StultoPromptIndex *index = g_new0(StultoPromptIndex, 1);
+
+    index->marks = g_array_new(FALSE, FALSE, sizeof(StultoPromptMark));
+
+    return index;
+}
+
+void stulto_prompt_index_free(StultoPromptIndex *index) {
+    if (index == NULL) {
+        return;
+    }
+
+    g_array_unref(index->marks);
+    g_free(index);
+}
+
+/*
+ * Number of marks whose prompt row is before row (or at it, if inclusive)
+ */
+static guint count_before(StultoPromptIndex *index, glong row, gboolean inclusive) {
+    guint low = 0;
+    guint high = index->marks->len;
+
+    while (low < high) {
+        guint mid = low + (high - low) / 2;
+        glong mid_row = g_array_index(index->marks, StultoPromptMark, mid).prompt_row;
+
+        if (mid_row < row || (inclusive && mid_row == row)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static StultoPromptMark *last_mark(StultoPromptIndex *index) {
+    if (index->marks->len == 0) {
+        return NULL;
+    }
+
+    return &g_array_index(index->marks, StultoPromptMark, index->marks->len - 1);
+}
+
+void stulto_prompt_index_add_mark(StultoPromptIndex *index, gchar kind, glong row, gint exit_code) {
+    StultoPromptMark *mark = last_mark(index);
+
+    switch (kind) {
+        case 'A': {
+            /* Redrawing a prompt in place (e.g., on resize) doesn't make a new command */
+            if (mark != NULL && mark->prompt_row == row) {
+                return;
+            }
+
+            /* The screen was cleared or the terminal reset under us; rows before this are stale */
+            if (mark != NULL && mark->prompt_row > row) {
+                g_array_set_size(index->marks, count_before(index, row, FALSE));
+            }
+
+            StultoPromptMark new_mark = {
+                    .prompt_row = row,
+                    .output_row = -1,
+                    .end_row = -1,
+                    .exit_code = -1,
+            };
+
+            g_array_append_val(index->marks, new_mark);
+        }
+            break;
+        case 'C':
+            if (mark != NULL && mark->output_row < 0) {
+                mark->output_row = row;
+                mark->start_time = g_get_monotonic_time();
+            }
+            break;
+        case 'D':
+            if (mark != NULL && mark->output_row >= 0 && mark->end_row < 0) {
+                mark->end_row = row;
+                mark->end_time = g_get_monotonic_time();
+                mark->exit_code = exit_code;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void stulto_prompt_index_prune(StultoPromptIndex *index, glong first_row) {
+    guint stale = count_before(index, first_row, FALSE);
+
+    if (stale > 0) {
+        g_array_remove_range(index->marks, 0, stale);
+    }
+}
+
+/*
+ * The last command whose prompt is above row
+ */
+const StultoPromptMark *stulto_prompt_index_find_before(StultoPromptIndex *index, glong row) {
+    guint n = count_before(index, row, FALSE);
+
+    return n > 0 ? &g_array_index(index->marks, StultoPromptMark, n - 1) : NULL;
+}
+
+/*
+ * The first command whose prompt is below row
+ */
+const StultoPromptMark *stulto_prompt_index_find_after(StultoPromptIndex *index, glong row) {
+    guint n = count_before(index, row, TRUE);
+
+    return n < index->marks->len ? &g_array_index(index->marks, StultoPromptMark, n) : NULL;
+}
+
+/*
+ * The command whose prompt or output contains row
+ */
+const StultoPromptMark *stulto_prompt_index_find_at(StultoPromptIndex *index, glong row) {
+    guint n = count_before(index, row, TRUE);
+
+    return n > 0 ? &g_array_index(index->marks, StultoPromptMark, n - 1) : NULL;
+}
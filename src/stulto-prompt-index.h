@@ -0,0 +1,54 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_PROMPT_INDEX_H
+#define STULTO_PROMPT_INDEX_H
+
+#include <glib.h>
+
+/*
+ * An index of the commands run in a terminal, built from shell integration marks (OSC 133)
+ *
+ * Marks are appended in row order, so lookups are binary searches. Entries whose prompt has scrolled out of the
+ * scrollback are pruned, which keeps the index bounded by the scrollback size
+ */
+
+typedef struct _StultoPromptMark {
+    /* Absolute rows, as used by VteTerminal's cursor position and scrollback adjustment; -1 if not reached yet */
+    glong prompt_row;
+    glong output_row;
+    glong end_row;
+    gint64 start_time;
+    gint64 end_time;
+    gint exit_code;
+} StultoPromptMark;
+
+typedef struct _StultoPromptIndex StultoPromptIndex;
+
+StultoPromptIndex *stulto_prompt_index_new();
+void stulto_prompt_index_free(StultoPromptIndex *index);
+
+void stulto_prompt_index_add_mark(StultoPromptIndex *index, gchar kind, glong row, gint exit_code);
+void stulto_prompt_index_prune(StultoPromptIndex *index, glong first_row);
+
+const StultoPromptMark *stulto_prompt_index_find_before(StultoPromptIndex *index, glong row);
+const StultoPromptMark *stulto_prompt_index_find_after(StultoPromptIndex *index, glong row);
+const StultoPromptMark *stulto_prompt_index_find_at(StultoPromptIndex *index, glong row);
+
+#endif //STULTO_PROMPT_INDEX_H
@@ -0,0 +1,633 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stulto-holder.h"
+#include "stulto-pty.h"
+
+/* Size of a single read from the PTY */
+#define STULTO_PTY_READ_SIZE 65536
+/* Reads per main loop dispatch; bounds the time spent parsing output before input and redraws get a turn */
+#define STULTO_PTY_MAX_READS 4
+
+#define BRACKETED_PASTE_MODE 2004
+#define SHELL_INTEGRATION_OSC "133;"
+
+typedef enum {
+    SCAN_GROUND,
+    SCAN_ESCAPE,
+    SCAN_CSI,
+    SCAN_PRIVATE_MODE,
+    SCAN_OSC,
+    SCAN_OSC_ESCAPE,
+} ScanState;
+
+struct _StultoPty {
+    VtePty *vte_pty;
+    gint fd;
+    GPid child_pid;
+
+    glong rows;
+    glong columns;
+
+    guint read_source;
+    guint write_source;
+    guint child_watch;
+
+    /* Non-zero when the PTY is held by the PTY holder, which then also reaps the child */
+    guint holder_id;
+    gboolean detached;
+
+    GCancellable *spawn_cancellable;
+
+    /* Input that the kernel didn't accept yet, in the order it was committed */
+    GByteArray *outgoing;
+
+    /* Output scanner state, carried across reads so sequences split between reads are still seen */
+    ScanState scan_state;
+    gint scan_param;
+    gboolean scan_matched;
+    gboolean bracketed_paste;
+    gchar osc_buf[32];
+    gsize osc_len;
+    gboolean osc_overflow;
+    gchar mark_kind;
+    gint mark_exit_code;
+
+    StultoPtyOutputFunc output_func;
+    StultoPtyMarkFunc mark_func;
+    StultoPtyExitedFunc exited_func;
+    StultoPtySpawnedFunc spawned_func;
+    gpointer user_data;
+};
+
+// region Output scanning
+
+/*
+ * Finish an OSC string; shell integration marks (OSC 133) are reported to the owner
+ */
+static gboolean finish_osc(StultoPty *pty) {
+    gchar *payload = pty->osc_buf;
+
+    pty->osc_buf[pty->osc_len] = '\0';
+
+    if (pty->osc_overflow || pty->mark_func == NULL || !g_str_has_prefix(payload, SHELL_INTEGRATION_OSC)) {
+        return FALSE;
+    }
+
+    payload += strlen(SHELL_INTEGRATION_OSC);
+
+    if (payload[0] == '\0') {
+        return FALSE;
+    }
+
+    pty->mark_kind = payload[0];
+    pty->mark_exit_code = -1;
+
+    if (payload[0] == 'D' && payload[1] == ';') {
+        pty->mark_exit_code = (gint) g_ascii_strtoll(payload + 2, NULL, 10);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Pass output on to the owner, tracking the few bits of terminal state we need along the way: the bracketed paste mode
+ * and shell integration marks
+ *
+ * Only ESC bytes are searched for in the common case, so the cost is a memchr() per read for plain output. Output is
+ * handed over in segments split at each mark, so the owner sees every mark with the output before it already applied
+ */
+static void process_output(StultoPty *pty, const gchar *data, gsize len) {
+    const gchar *p = data;
+    const gchar *end = data + len;
+    const gchar *segment = data;
+
+    while (p < end) {
+        gboolean mark = FALSE;
+
+        switch (pty->scan_state) {
+            case SCAN_GROUND:
+                p = memchr(p, '\033', end - p);
+                if (p == NULL) {
+                    p = end;
+                    break;
+                }
+                pty->scan_state = SCAN_ESCAPE;
+                p++;
+                break;
+            case SCAN_ESCAPE:
+                if (*p == '[') {
+                    pty->scan_state = SCAN_CSI;
+                } else if (*p == ']') {
+                    pty->scan_state = SCAN_OSC;
+                    pty->osc_len = 0;
+                    pty->osc_overflow = FALSE;
+                } else {
+                    /* RIS resets every mode */
+                    if (*p == 'c') {
+                        pty->bracketed_paste = FALSE;
+                    }
+                    pty->scan_state = SCAN_GROUND;
+                }
+                p++;
+                break;
+            case SCAN_CSI:
+                if (*p == '?') {
+                    pty->scan_state = SCAN_PRIVATE_MODE;
+                    pty->scan_param = 0;
+                    pty->scan_matched = FALSE;
+                    p++;
+                } else {
+                    pty->scan_state = SCAN_GROUND;
+                }
+                break;
+            case SCAN_PRIVATE_MODE: {
+                gchar c = *p++;
+
+                if (c >= '0' && c <= '9') {
+                    pty->scan_param = MIN(pty->scan_param * 10 + (c - '0'), G_MAXINT / 10);
+                    break;
+                }
+
+                pty->scan_matched |= pty->scan_param == BRACKETED_PASTE_MODE;
+                pty->scan_param = 0;
+
+                if (c == ';') {
+                    break;
+                }
+
+                if (pty->scan_matched && (c == 'h' || c == 'l')) {
+                    pty->bracketed_paste = c == 'h';
+                }
+                pty->scan_state = SCAN_GROUND;
+            }
+                break;
+            case SCAN_OSC: {
+                gchar c = *p++;
+
+                if (c == '\007') {
+                    pty->scan_state = SCAN_GROUND;
+                    mark = finish_osc(pty);
+                } else if (c == '\033') {
+                    pty->scan_state = SCAN_OSC_ESCAPE;
+                } else if (pty->osc_len < sizeof(pty->osc_buf) - 1) {
+                    pty->osc_buf[pty->osc_len++] = c;
+                } else {
+                    pty->osc_overflow = TRUE;
+                }
+            }
+                break;
+            case SCAN_OSC_ESCAPE:
+                mark = finish_osc(pty);
+
+                /* Anything but ST both ends the string and starts a new sequence */
+                if (*p == '\\') {
+                    pty->scan_state = SCAN_GROUND;
+                    p++;
+                } else {
+                    pty->scan_state = SCAN_ESCAPE;
+                }
+                break;
+        }
+
+        if (mark) {
+            pty->output_func(segment, p - segment, pty->user_data);
+            segment = p;
+
+            pty->mark_func(pty->mark_kind, pty->mark_exit_code, pty->user_data);
+        }
+    }
+
+    if (segment < end) {
+        pty->output_func(segment, end - segment, pty->user_data);
+    }
+}
+
+// endregion
+
+// region Callbacks
+
+/*
+ * Read and feed up to max_reads chunks of output; returns G_SOURCE_REMOVE once the PTY has hung up
+ */
+static gboolean pty_read(StultoPty *pty, gint max_reads) {
+    static gchar buf[STULTO_PTY_READ_SIZE];
+
+    for (gint i = 0; i < max_reads; i++) {
+        gssize n = read(pty->fd, buf, sizeof(buf));
+
+        if (n > 0) {
+            process_output(pty, buf, n);
+
+            if ((gsize) n < sizeof(buf)) {
+                return G_SOURCE_CONTINUE;
+            }
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            return G_SOURCE_CONTINUE;
+        }
+
+        /* EOF, or EIO once the child side is closed - the child watch takes it from here */
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean pty_readable_cb(gint fd, GIOCondition condition, gpointer data) {
+    StultoPty *pty = data;
+
+    if (pty_read(pty, STULTO_PTY_MAX_READS) == G_SOURCE_REMOVE) {
+        pty->read_source = 0;
+
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean pty_writable_cb(gint fd, GIOCondition condition, gpointer data) {
+    StultoPty *pty = data;
+
+    gssize n;
+
+    do {
+        n = write(fd, pty->outgoing->data, pty->outgoing->len);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0 && errno != EAGAIN) {
+        g_byte_array_set_size(pty->outgoing, 0);
+    } else if (n > 0) {
+        g_byte_array_remove_range(pty->outgoing, 0, n);
+    }
+
+    if (pty->outgoing->len > 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    pty->write_source = 0;
+
+    return G_SOURCE_REMOVE;
+}
+
+static void child_exited(StultoPty *pty, gint status) {
+    /* Flush whatever the child wrote before exiting so it isn't lost with the widget */
+    if (pty->read_source != 0) {
+        pty_read(pty, G_MAXINT);
+
+        g_source_remove(pty->read_source);
+        pty->read_source = 0;
+    }
+
+    pty->child_pid = -1;
+
+    pty->exited_func(status, pty->user_data);
+}
+
+static void child_exited_cb(GPid pid, gint status, gpointer data) {
+    StultoPty *pty = data;
+
+    pty->child_watch = 0;
+    g_spawn_close_pid(pid);
+
+    child_exited(pty, status);
+}
+
+static void held_child_exited_cb(gint status, gpointer data) {
+    child_exited(data, status);
+}
+
+static void start_io(StultoPty *pty) {
+    pty->fd = vte_pty_get_fd(pty->vte_pty);
+
+    g_unix_set_fd_nonblocking(pty->fd, TRUE, NULL);
+
+    pty->read_source = g_unix_fd_add(pty->fd, G_IO_IN | G_IO_HUP | G_IO_ERR, pty_readable_cb, pty);
+
+    if (pty->outgoing->len > 0) {
+        pty->write_source = g_unix_fd_add(pty->fd, G_IO_OUT, pty_writable_cb, pty);
+    }
+}
+
+static void pty_spawn_ready_cb(GObject *source, GAsyncResult *result, gpointer data) {
+    GError *error = NULL;
+    GPid pid = -1;
+
+    if (!vte_pty_spawn_finish(VTE_PTY(source), result, &pid, &error)) {
+        if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            /* The pty has already been freed */
+            g_error_free(error);
+
+            return;
+        }
+    }
+
+    StultoPty *pty = data;
+
+    g_clear_object(&pty->spawn_cancellable);
+
+    if (error) {
+        pty->spawned_func(-1, error, pty->user_data);
+        g_error_free(error);
+
+        return;
+    }
+
+    pty->child_pid = pid;
+    pty->child_watch = g_child_watch_add(pid, child_exited_cb, pty);
+
+    start_io(pty);
+
+    pty->spawned_func(pid, NULL, pty->user_data);
+}
+
+// endregion
+
+// region Lifecycle
+
+StultoPty *stulto_pty_new(StultoPtyOutputFunc output_func,
+                          StultoPtyMarkFunc mark_func,
+                          StultoPtyExitedFunc exited_func,
+                          gpointer user_data) {
+    StultoPty *pty = g_new0(StultoPty, 1);
+
+    pty->fd = -1;
+    pty->child_pid = -1;
+    pty->outgoing = g_byte_array_new();
+
+    pty->output_func = output_func;
+    pty->mark_func = mark_func;
+    pty->exited_func = exited_func;
+    pty->user_data = user_data;
+
+    return pty;
+}
+
+void stulto_pty_free(StultoPty *pty) {
+    if (pty == NULL) {
+        return;
+    }
+
+    if (pty->spawn_cancellable) {
+        g_cancellable_cancel(pty->spawn_cancellable);
+        g_object_unref(pty->spawn_cancellable);
+    }
+
+    if (pty->read_source) {
+        g_source_remove(pty->read_source);
+    }
+    if (pty->write_source) {
+        g_source_remove(pty->write_source);
+    }
+    if (pty->child_watch) {
+        g_source_remove(pty->child_watch);
+    }
+
+    /* Same courtesy VTE extends to children of a destroyed widget; held children are left to the holder */
+    if (pty->holder_id != 0) {
+        StultoHolder *holder = stulto_holder_get_default();
+
+        if (holder != NULL && !pty->detached) {
+            stulto_holder_close(holder, pty->holder_id);
+        }
+    } else if (pty->child_pid > 0) {
+        kill(pty->child_pid, SIGHUP);
+    }
+
+    g_clear_object(&pty->vte_pty);
+    g_byte_array_unref(pty->outgoing);
+
+    g_free(pty);
+}
+
+/*
+ * Attach to the PTY the holder kept for exec_data, replaying its output, or start the command on a new held PTY if that
+ * one has since gone
+ */
+static void spawn_held(StultoPty *pty, StultoHolder *holder, StultoExecData *exec_data, gchar **envv) {
+    GError *error = NULL;
+    GBytes *replay = NULL;
+    gint fd = -1;
+    GPid pid = -1;
+
+    if (exec_data->holder_id != 0 && stulto_holder_attach(holder, exec_data->holder_id, &fd, &pid, &replay, NULL)) {
+        pty->holder_id = exec_data->holder_id;
+    } else {
+        pty->holder_id = stulto_holder_spawn(
+                holder, exec_data->command_argv, envv, exec_data->cwd, pty->rows, pty->columns, &fd, &pid, &error);
+    }
+
+    if (pty->holder_id != 0) {
+        pty->vte_pty = vte_pty_new_foreign_sync(fd, NULL, &error);
+
+        if (pty->vte_pty == NULL) {
+            close(fd);
+            stulto_holder_close(holder, pty->holder_id);
+            pty->holder_id = 0;
+        }
+    }
+
+    if (error) {
+        pty->spawned_func(-1, error, pty->user_data);
+        g_error_free(error);
+
+        return;
+    }
+
+    /* So that a saved layout names this PTY */
+    exec_data->holder_id = pty->holder_id;
+
+    pty->child_pid = pid;
+
+    if (pty->rows > 0 && pty->columns > 0) {
+        vte_pty_set_size(pty->vte_pty, pty->rows, pty->columns, NULL);
+    }
+
+    if (replay != NULL) {
+        process_output(pty, g_bytes_get_data(replay, NULL), g_bytes_get_size(replay));
+        g_bytes_unref(replay);
+    }
+
+    start_io(pty);
+    stulto_holder_watch(holder, pty->holder_id, held_child_exited_cb, pty);
+
+    pty->spawned_func(pid, NULL, pty->user_data);
+}
+
+void stulto_pty_spawn_async(StultoPty *pty, StultoExecData *exec_data, StultoPtySpawnedFunc spawned_func) {
+    GError *error = NULL;
+    StultoHolder *holder = stulto_holder_get_default();
+
+    g_return_if_fail(pty->vte_pty == NULL);
+
+    pty->spawned_func = spawned_func;
+
+    gchar **envv = g_get_environ();
+    envv = g_environ_setenv(envv, "TERM", "xterm-256color", TRUE);
+    envv = g_environ_setenv(envv, "COLORTERM", "truecolor", TRUE);
+
+    if (holder != NULL) {
+        spawn_held(pty, holder, exec_data, envv);
+        g_strfreev(envv);
+
+        return;
+    }
+
+    pty->vte_pty = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, &error);
+
+    if (error) {
+        spawned_func(-1, error, pty->user_data);
+        g_error_free(error);
+        g_strfreev(envv);
+
+        return;
+    }
+
+    if (pty->rows > 0 && pty->columns > 0) {
+        vte_pty_set_size(pty->vte_pty, pty->rows, pty->columns, NULL);
+    }
+
+    pty->spawn_cancellable = g_cancellable_new();
+
+    vte_pty_spawn_async(
+            pty->vte_pty,
+            exec_data->cwd,
+            exec_data->command_argv,
+            envv,
+            G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+            NULL, NULL, NULL,
+            -1,
+            pty->spawn_cancellable,
+            pty_spawn_ready_cb,
+            pty);
+
+    g_strfreev(envv);
+}
+
+/*
+ * Leave a held PTY, and its child, to the holder; snapshot is replayed when a later Stulto attaches to it
+ */
+gboolean stulto_pty_detach(StultoPty *pty, const gchar *snapshot, gsize len) {
+    StultoHolder *holder = stulto_holder_get_default();
+
+    if (pty->holder_id == 0 || pty->detached || holder == NULL) {
+        return FALSE;
+    }
+
+    /* The holder reads from here on */
+    if (pty->read_source != 0) {
+        g_source_remove(pty->read_source);
+        pty->read_source = 0;
+    }
+
+    stulto_holder_detach(holder, pty->holder_id, snapshot, len);
+    pty->detached = TRUE;
+
+    return TRUE;
+}
+
+// endregion
+
+// region I/O
+
+void stulto_pty_set_size(StultoPty *pty, glong rows, glong columns) {
+    if (rows == pty->rows && columns == pty->columns) {
+        return;
+    }
+
+    pty->rows = rows;
+    pty->columns = columns;
+
+    if (pty->vte_pty == NULL) {
+        return;
+    }
+
+    vte_pty_set_size(pty->vte_pty, rows, columns, NULL);
+}
+
+/*
+ * Write as much of data as the kernel accepts right now, without queueing the rest
+ *
+ * Nothing is written while earlier input is still queued, so callers pacing their own writes can never overtake
+ * keystrokes
+ */
+gsize stulto_pty_try_write(StultoPty *pty, const gchar *data, gsize len) {
+    gssize n;
+
+    if (pty->fd < 0 || pty->outgoing->len > 0 || len == 0) {
+        return 0;
+    }
+
+    do {
+        n = write(pty->fd, data, len);
+    } while (n < 0 && errno == EINTR);
+
+    return n > 0 ? n : 0;
+}
+
+void stulto_pty_write(StultoPty *pty, const gchar *data, gsize len) {
+    gsize written = stulto_pty_try_write(pty, data, len);
+
+    if (written == len) {
+        return;
+    }
+
+    g_byte_array_append(pty->outgoing, (const guint8 *) data + written, len - written);
+
+    if (pty->fd >= 0 && pty->write_source == 0) {
+        pty->write_source = g_unix_fd_add(pty->fd, G_IO_OUT, pty_writable_cb, pty);
+    }
+}
+
+/*
+ * Watch for the PTY accepting more input, at a priority below input events and redraws
+ */
+guint stulto_pty_add_writable_watch(StultoPty *pty, GUnixFDSourceFunc func, gpointer data) {
+    g_return_val_if_fail(pty->fd >= 0, 0);
+
+    return g_unix_fd_add_full(G_PRIORITY_DEFAULT_IDLE, pty->fd, G_IO_OUT, func, data, NULL);
+}
+
+// endregion
+
+// region Properties
+
+gint stulto_pty_get_fd(StultoPty *pty) {
+    return pty->fd;
+}
+
+GPid stulto_pty_get_child_pid(StultoPty *pty) {
+    return pty->child_pid;
+}
+
+gboolean stulto_pty_get_bracketed_paste(StultoPty *pty) {
+    return pty->bracketed_paste;
+}
+
+// endregion
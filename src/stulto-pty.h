@@ -0,0 +1,67 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_PTY_H
+#define STULTO_PTY_H
+
+#include <glib-unix.h>
+#include <vte/vte.h>
+
+#include "stulto-exec-data.h"
+
+/*
+ * An object that owns a terminal's pseudo-terminal and child process
+ *
+ * VTE is never handed the PTY; instead, Stulto reads the child's output itself and feeds it to the widget, and writes
+ * everything the widget commits back to the child. Owning both directions lets us pace large writes by the PTY's
+ * actual write readiness and observe the output stream (e.g., to track the bracketed paste mode)
+ *
+ * Shell integration marks (OSC 133 - A: prompt start, B: command start, C: command output start, D: command finished,
+ * with its exit status) are reported through the mark callback as they pass by
+ *
+ * While the PTY holder is running, PTYs are opened and children started by it instead (see stulto-holder.h)
+ */
+
+typedef struct _StultoPty StultoPty;
+
+typedef void (*StultoPtyOutputFunc)(const gchar *data, gsize len, gpointer user_data);
+typedef void (*StultoPtyMarkFunc)(gchar kind, gint exit_code, gpointer user_data);
+typedef void (*StultoPtySpawnedFunc)(GPid pid, GError *error, gpointer user_data);
+typedef void (*StultoPtyExitedFunc)(gint status, gpointer user_data);
+
+StultoPty *stulto_pty_new(StultoPtyOutputFunc output_func,
+                          StultoPtyMarkFunc mark_func,
+                          StultoPtyExitedFunc exited_func,
+                          gpointer user_data);
+void stulto_pty_free(StultoPty *pty);
+
+void stulto_pty_spawn_async(StultoPty *pty, StultoExecData *exec_data, StultoPtySpawnedFunc spawned_func);
+gboolean stulto_pty_detach(StultoPty *pty, const gchar *snapshot, gsize len);
+
+void stulto_pty_set_size(StultoPty *pty, glong rows, glong columns);
+
+void stulto_pty_write(StultoPty *pty, const gchar *data, gsize len);
+gsize stulto_pty_try_write(StultoPty *pty, const gchar *data, gsize len);
+guint stulto_pty_add_writable_watch(StultoPty *pty, GUnixFDSourceFunc func, gpointer data);
+
+gint stulto_pty_get_fd(StultoPty *pty);
+GPid stulto_pty_get_child_pid(StultoPty *pty);
+gboolean stulto_pty_get_bracketed_paste(StultoPty *pty);
+
+#endif //STULTO_PTY_H
@@ -0,0 +1,269 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stulto-resources.h"
+
+/* Where a process's tree isn't known yet */
+#define ROOT_UNKNOWN (-2)
+/* Where a process belongs to none of the trees */
+#define ROOT_NONE (-1)
+
+typedef struct _ProcEntry {
+    GPid pid;
+    GPid ppid;
+    guint64 cpu_ticks;
+    guint64 rss_pages;
+    /* Index of the tree the process belongs to, or ROOT_NONE */
+    gint root;
+} ProcEntry;
+
+/*
+ * Read a small /proc file into buf, without going through stdio or the heap; returns the length, or -1
+ */
+static gssize read_proc_file(const gchar *path, gchar *buf, gsize size) {
+    gint fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    gssize n = read(fd, buf, size - 1);
+
+    close(fd);
+
+    if (n < 0) {
+        return -1;
+    }
+
+    buf[n] = '\0';
+
+    return n;
+}
+
+/*
+ * Parse /proc/PID/stat; the command name may contain anything, so fields are counted from its closing parenthesis
+ */
+static gboolean read_stat(GPid pid, ProcEntry *entry) {
+    gchar path[64];
+    gchar buf[1024];
+
+    g_snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+    if (read_proc_file(path, buf, sizeof(buf)) < 0) {
+        return FALSE;
+    }
+
+    gchar *p = strrchr(buf, ')');
+
+    if (p == NULL) {
+        return FALSE;
+    }
+
+    /* Fields from the state (3) on; utime is 14, stime 15, cutime 16, cstime 17 and rss 24 */
+    guint64 fields[22] = {0};
+    guint field = 0;
+
+    p += 2;
+    while (field < G_N_ELEMENTS(fields) && *p != '\0') {
+        gchar *end;
+
+        fields[field++] = g_ascii_strtoull(p, &end, 10);
+        p = strchr(end, ' ');
+        if (p == NULL) {
+            break;
+        }
+        p++;
+    }
+
+    if (field < G_N_ELEMENTS(fields)) {
+        return FALSE;
+    }
+
+    entry->pid = pid;
+    entry->ppid = (GPid) fields[1];
+    entry->cpu_ticks = fields[11] + fields[12] + fields[13] + fields[14];
+    entry->rss_pages = fields[21];
+    entry->root = ROOT_UNKNOWN;
+
+    return TRUE;
+}
+
+/*
+ * Storage-level reads and writes from /proc/PID/io, which is only readable for processes we could ptrace
+ */
+static guint64 read_io(GPid pid) {
+    gchar path[64];
+    gchar buf[512];
+    guint64 total = 0;
+
+    g_snprintf(path, sizeof(path), "/proc/%d/io", pid);
+
+    if (read_proc_file(path, buf, sizeof(buf)) < 0) {
+        return 0;
+    }
+
+    const gchar *keys[] = {"\nread_bytes: ", "\nwrite_bytes: "};
+
+    for (guint i = 0; i < G_N_ELEMENTS(keys); i++) {
+        const gchar *value = strstr(buf, keys[i]);
+
+        if (value != NULL) {
+            total += g_ascii_strtoull(value + strlen(keys[i]), NULL, 10);
+        }
+    }
+
+    return total;
+}
+
+/*
+ * The tree a process belongs to, found by walking up its ancestors; everything on the way is remembered
+ */
+static gint resolve_root(GArray *entries, GHashTable *by_pid, GHashTable *roots, guint index) {
+    GArray *path = g_array_new(FALSE, FALSE, sizeof(guint));
+    gint root = ROOT_NONE;
+
+    while (TRUE) {
+        ProcEntry *entry = &g_array_index(entries, ProcEntry, index);
+        gpointer root_index;
+
+        if (entry->root != ROOT_UNKNOWN) {
+            root = entry->root;
+            break;
+        }
+
+        g_array_append_val(path, index);
+
+        if (g_hash_table_lookup_extended(roots, GINT_TO_POINTER(entry->pid), NULL, &root_index)) {
+            root = GPOINTER_TO_INT(root_index);
+            break;
+        }
+
+        gpointer parent;
+
+        if (entry->ppid <= 1 || !g_hash_table_lookup_extended(by_pid, GINT_TO_POINTER(entry->ppid), NULL, &parent)) {
+            break;
+        }
+
+        index = GPOINTER_TO_UINT(parent);
+    }
+
+    for (guint i = 0; i < path->len; i++) {
+        g_array_index(entries, ProcEntry, g_array_index(path, guint, i)).root = root;
+    }
+
+    g_array_free(path, TRUE);
+
+    return root;
+}
+
+/*
+ * Fill in usages[i] for the tree of processes under roots[i]; roots that aren't running are left with zero usage
+ */
+void stulto_resources_collect(const GPid *roots, StultoResourceUsage *usages, guint n_roots) {
+    gint64 start_time = g_get_monotonic_time();
+    GDir *dir = g_dir_open("/proc", 0, NULL);
+    GArray *entries = g_array_new(FALSE, FALSE, sizeof(ProcEntry));
+    GHashTable *by_pid = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTable *root_pids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    const gchar *name;
+
+    memset(usages, 0, n_roots * sizeof(StultoResourceUsage));
+
+    for (guint i = 0; i < n_roots; i++) {
+        if (roots[i] > 0) {
+            g_hash_table_insert(root_pids, GINT_TO_POINTER(roots[i]), GINT_TO_POINTER(i));
+        }
+    }
+
+    while (dir != NULL && (name = g_dir_read_name(dir)) != NULL) {
+        ProcEntry entry;
+
+        if (!g_ascii_isdigit(name[0]) || !read_stat((GPid) strtol(name, NULL, 10), &entry)) {
+            continue;
+        }
+
+        g_hash_table_insert(by_pid, GINT_TO_POINTER(entry.pid), GUINT_TO_POINTER(entries->len));
+        g_array_append_val(entries, entry);
+    }
+
+    glong ticks_per_second = sysconf(_SC_CLK_TCK);
+    glong page_size = sysconf(_SC_PAGESIZE);
+
+    for (guint i = 0; i < entries->len; i++) {
+        gint root = resolve_root(entries, by_pid, root_pids, i);
+
+        if (root < 0) {
+            continue;
+        }
+
+        ProcEntry *entry = &g_array_index(entries, ProcEntry, i);
+        StultoResourceUsage *usage = &usages[root];
+
+        usage->n_processes++;
+        usage->cpu_time_ms += entry->cpu_ticks * 1000 / ticks_per_second;
+        usage->rss_bytes += entry->rss_pages * page_size;
+        usage->io_bytes += read_io(entry->pid);
+    }
+
+    g_debug("Collected resource usage of %u trees among %u processes in %.2f ms",
+            n_roots, entries->len, (g_get_monotonic_time() - start_time) / 1000.0);
+
+    g_hash_table_unref(root_pids);
+    g_hash_table_unref(by_pid);
+    g_array_free(entries, TRUE);
+    if (dir != NULL) {
+        g_dir_close(dir);
+    }
+}
+
+void stulto_resources_add(StultoResourceUsage *usage, const StultoResourceUsage *other) {
+    usage->n_processes += other->n_processes;
+    usage->cpu_time_ms += other->cpu_time_ms;
+    usage->rss_bytes += other->rss_bytes;
+    usage->io_bytes += other->io_bytes;
+}
+
+/*
+ * A short summary, e.g. "CPU 12% · 340.2 MB · I/O 1.2 MB/s", with rates over the interval since the previous sample
+ */
+gchar *stulto_resources_format(const StultoResourceUsage *usage,
+                               const StultoResourceUsage *previous,
+                               gint64 interval_ms) {
+    /* Counters drop as processes leave the tree; that interval counts as idle */
+    guint64 cpu_ms = usage->cpu_time_ms > previous->cpu_time_ms ? usage->cpu_time_ms - previous->cpu_time_ms : 0;
+    guint64 io_bytes = usage->io_bytes > previous->io_bytes ? usage->io_bytes - previous->io_bytes : 0;
+
+    if (interval_ms <= 0) {
+        interval_ms = 1;
+    }
+
+    gchar *rss = g_format_size(usage->rss_bytes);
+    gchar *io_rate = g_format_size(io_bytes * 1000 / interval_ms);
+    gchar *text = g_strdup_printf("CPU %d%% · %s · I/O %s/s", (gint) (cpu_ms * 100 / interval_ms), rss, io_rate);
+
+    g_free(io_rate);
+    g_free(rss);
+
+    return text;
+}
@@ -0,0 +1,48 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_RESOURCES_H
+#define STULTO_RESOURCES_H
+
+#include <glib.h>
+
+/*
+ * What trees of processes (e.g., each terminal's child and everything it started) are using
+ *
+ * One pass over /proc covers all the trees at once, so a collection costs the same however many trees are asked
+ * about: each process's stat is read once, and its I/O counters only if it belongs to one of the trees
+ */
+
+typedef struct _StultoResourceUsage {
+    guint n_processes;
+    /* CPU time of the processes, and of the children they have already reaped, in ms */
+    guint64 cpu_time_ms;
+    guint64 rss_bytes;
+    /* Read from and written to storage, for the processes the kernel lets us see into */
+    guint64 io_bytes;
+} StultoResourceUsage;
+
+void stulto_resources_collect(const GPid *roots, StultoResourceUsage *usages, guint n_roots);
+
+void stulto_resources_add(StultoResourceUsage *usage, const StultoResourceUsage *other);
+gchar *stulto_resources_format(const StultoResourceUsage *usage,
+                               const StultoResourceUsage *previous,
+                               gint64 interval_ms);
+
+#endif //STULTO_RESOURCES_H
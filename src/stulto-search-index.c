@@ -0,0 +1,522 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string.h>
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+
+#include <pcre2.h>
+
+#include "stulto-search-index.h"
+#include "stulto-line-splitter.h"
+
+/* Text stored per block before a new one is started */
+#define STULTO_SEARCH_INDEX_BLOCK_SIZE (32 * 1024)
+/* Lines longer than this are indexed on their first bytes only */
+#define STULTO_SEARCH_INDEX_MAX_LINE 4096
+/* Bloom filter size per block, in bits; must be a power of two */
+#define STULTO_SEARCH_INDEX_BLOOM_BITS 8192
+/* Memory budget for the whole index */
+#define STULTO_SEARCH_INDEX_MAX_BYTES (64 * 1024 * 1024)
+/* Tasks allowed to queue up for the worker before output is skipped rather than buffered */
+#define STULTO_SEARCH_INDEX_MAX_BACKLOG 256
+/* Hits reported per source; only the most recent ones are kept */
+#define STULTO_SEARCH_INDEX_MAX_HITS 50
+
+/* Allocated per block up front, so appending never reallocates */
+#define BLOCK_ALLOC_SIZE (STULTO_SEARCH_INDEX_BLOCK_SIZE + STULTO_SEARCH_INDEX_MAX_LINE + 1)
+#define BLOCK_BYTES (sizeof(IndexBlock) + BLOCK_ALLOC_SIZE)
+
+typedef struct _IndexBlock {
+    GString *text;
+    guint lines;
+    guint8 bloom[STULTO_SEARCH_INDEX_BLOOM_BITS / 8];
+} IndexBlock;
+
+struct _StultoSearchIndexSource {
+    StultoSearchIndex *index;
+    guint id;
+
+    /* Main thread only */
+    gboolean overflowed;
+
+    /* Worker thread only */
+    glong max_lines;
+    StultoLineSplitter *splitter;
+    GQueue blocks;
+    gsize lines;
+    gsize bytes;
+};
+
+struct _StultoSearchIndex {
+    GThreadPool *pool;
+    guint next_source_id;
+    gint latest_query;
+
+    /* Worker thread only */
+    GPtrArray *sources;
+    gsize bytes;
+};
+
+typedef enum {
+    TASK_ADD,
+    TASK_FEED,
+    TASK_REMOVE,
+    TASK_QUERY,
+} IndexTaskType;
+
+typedef struct _IndexQuery {
+    gint serial;
+    gchar *text;
+    StultoSearchIndexResultsFunc results_func;
+    gpointer user_data;
+
+    GPtrArray *hits;
+    StultoSearchIndexStats stats;
+} IndexQuery;
+
+typedef struct _IndexTask {
+    IndexTaskType type;
+    StultoSearchIndexSource *source;
+    GBytes *bytes;
+    IndexQuery *query;
+} IndexTask;
+
+static void hit_free(gpointer data) {
+    StultoSearchIndexHit *hit = data;
+
+    g_free(hit->line);
+    g_free(hit);
+}
+
+static void query_free(IndexQuery *query) {
+    if (query->hits != NULL) {
+        g_ptr_array_unref(query->hits);
+    }
+    g_free(query->text);
+    g_free(query);
+}
+
+// region Blocks
+
+static guint trigram_bit(guchar a, guchar b, guchar c) {
+    guint32 h = (g_ascii_tolower(a) << 16) | (g_ascii_tolower(b) << 8) | g_ascii_tolower(c);
+
+    return (h * 2654435761u) >> 16 & (STULTO_SEARCH_INDEX_BLOOM_BITS - 1);
+}
+
+static IndexBlock *block_new() {
+    IndexBlock *block = g_new0(IndexBlock, 1);
+
+    block->text = g_string_sized_new(BLOCK_ALLOC_SIZE);
+
+    return block;
+}
+
+static void block_free(IndexBlock *block) {
+    g_string_free(block->text, TRUE);
+    g_free(block);
+}
+
+static void block_append(IndexBlock *block, const gchar *line, gsize len) {
+    const guchar *p = (const guchar *) line;
+
+    for (gsize i = 2; i < len; i++) {
+        guint bit = trigram_bit(p[i - 2], p[i - 1], p[i]);
+
+        block->bloom[bit / 8] |= 1 << (bit % 8);
+    }
+
+    g_string_append_len(block->text, line, len);
+    g_string_append_c(block->text, '\n');
+    block->lines++;
+}
+
+static gboolean block_may_contain(IndexBlock *block, const guint *bits, guint n_bits) {
+    for (guint i = 0; i < n_bits; i++) {
+        if (!(block->bloom[bits[i] / 8] & 1 << (bits[i] % 8))) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// endregion
+
+// region Worker thread
+
+static void source_drop_oldest_block(StultoSearchIndexSource *source) {
+    IndexBlock *block = g_queue_pop_head(&source->blocks);
+
+    source->lines -= block->lines;
+    source->bytes -= BLOCK_BYTES;
+    source->index->bytes -= BLOCK_BYTES;
+
+    block_free(block);
+}
+
+static void source_add_line(const gchar *line, gsize len, gpointer data) {
+    StultoSearchIndexSource *source = data;
+    IndexBlock *block = g_queue_peek_tail(&source->blocks);
+
+    if (block == NULL || block->text->len >= STULTO_SEARCH_INDEX_BLOCK_SIZE) {
+        block = block_new();
+        g_queue_push_tail(&source->blocks, block);
+
+        source->bytes += BLOCK_BYTES;
+        source->index->bytes += BLOCK_BYTES;
+    }
+
+    block_append(block, line, len);
+    source->lines++;
+
+    /* Lines that fell out of the scrollback go once a whole block of them has */
+    IndexBlock *oldest = g_queue_peek_head(&source->blocks);
+
+    while (oldest != block && source->lines - oldest->lines >= (gsize) source->max_lines) {
+        source_drop_oldest_block(source);
+        oldest = g_queue_peek_head(&source->blocks);
+    }
+}
+
+static void source_free(StultoSearchIndexSource *source) {
+    while (!g_queue_is_empty(&source->blocks)) {
+        source_drop_oldest_block(source);
+    }
+
+    stulto_line_splitter_free(source->splitter);
+    g_free(source);
+}
+
+/*
+ * Drop the oldest blocks of the largest sources until the index fits its memory budget again
+ */
+static void enforce_budget(StultoSearchIndex *index) {
+    while (index->bytes > STULTO_SEARCH_INDEX_MAX_BYTES) {
+        StultoSearchIndexSource *largest = NULL;
+
+        for (guint i = 0; i < index->sources->len; i++) {
+            StultoSearchIndexSource *source = g_ptr_array_index(index->sources, i);
+
+            if (source->blocks.length > 1 && (largest == NULL || source->bytes > largest->bytes)) {
+                largest = source;
+            }
+        }
+
+        if (largest == NULL) {
+            break;
+        }
+
+        source_drop_oldest_block(largest);
+    }
+}
+
+static gboolean query_finished_cb(gpointer data) {
+    IndexQuery *query = data;
+
+    query->results_func(query->hits, &query->stats, query->user_data);
+    query_free(query);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * The literal text, matched case-sensitively only if it contains an upper case letter; bytes are matched as they are,
+ * since lines may have been cut off in the middle of a character
+ */
+static pcre2_code *compile_query(const gchar *text) {
+    gchar *escaped = g_regex_escape_string(text, -1);
+    guint32 flags = PCRE2_CASELESS;
+    int error_code;
+    PCRE2_SIZE error_offset;
+
+    for (const gchar *p = text; *p != '\0'; p++) {
+        if (g_ascii_isupper(*p)) {
+            flags = 0;
+            break;
+        }
+    }
+
+    pcre2_code *code = pcre2_compile(
+            (PCRE2_SPTR) escaped, PCRE2_ZERO_TERMINATED,
+            flags,
+            &error_code, &error_offset,
+            NULL);
+
+    if (code != NULL) {
+        pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+    }
+
+    g_free(escaped);
+
+    return code;
+}
+
+static void query_source(StultoSearchIndexSource *source,
+                         IndexQuery *query,
+                         pcre2_code *code,
+                         pcre2_match_data *match_data,
+                         const guint *bits,
+                         guint n_bits) {
+    GPtrArray *source_hits = g_ptr_array_new();
+    gint matches = 0;
+
+    for (GList *l = source->blocks.head; l != NULL; l = l->next) {
+        IndexBlock *block = l->data;
+        const gchar *text = block->text->str;
+        gsize len = block->text->len;
+        PCRE2_SIZE offset = 0;
+        const gchar *last_line = NULL;
+
+        if (!block_may_contain(block, bits, n_bits)) {
+            continue;
+        }
+
+        while (offset < len && pcre2_match(code, (PCRE2_SPTR) text, len, offset, 0, match_data, NULL) >= 0) {
+            PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+            const gchar *line = text + ovector[0];
+
+            if (ovector[1] <= ovector[0]) {
+                break;
+            }
+
+            while (line > text && line[-1] != '\n') {
+                line--;
+            }
+
+            /* One hit per line, however many matches it has */
+            if (line != last_line) {
+                StultoSearchIndexHit *hit = g_new0(StultoSearchIndexHit, 1);
+
+                hit->source_id = source->id;
+                hit->line = g_strndup(line, strchr(line, '\n') - line);
+                hit->nth_from_end = matches;
+                g_ptr_array_add(source_hits, hit);
+
+                last_line = line;
+            }
+
+            matches++;
+            offset = ovector[1];
+        }
+
+        /* Keep the most recent hits only */
+        if (source_hits->len > 2 * STULTO_SEARCH_INDEX_MAX_HITS) {
+            for (guint i = 0; i < source_hits->len - STULTO_SEARCH_INDEX_MAX_HITS; i++) {
+                hit_free(g_ptr_array_index(source_hits, i));
+            }
+            g_ptr_array_remove_range(source_hits, 0, source_hits->len - STULTO_SEARCH_INDEX_MAX_HITS);
+        }
+    }
+
+    guint first = source_hits->len > STULTO_SEARCH_INDEX_MAX_HITS ? source_hits->len - STULTO_SEARCH_INDEX_MAX_HITS : 0;
+
+    for (guint i = 0; i < source_hits->len; i++) {
+        StultoSearchIndexHit *hit = g_ptr_array_index(source_hits, i);
+
+        if (i < first) {
+            hit_free(hit);
+            continue;
+        }
+
+        /* Until now this held the number of matches before the hit */
+        hit->nth_from_end = matches - hit->nth_from_end;
+        g_ptr_array_add(query->hits, hit);
+    }
+
+    g_ptr_array_free(source_hits, TRUE);
+}
+
+static void run_query(StultoSearchIndex *index, IndexQuery *query) {
+    gint64 start_time = g_get_monotonic_time();
+
+    query->stats.sources = index->sources->len;
+    query->stats.bytes = index->bytes;
+    for (guint i = 0; i < index->sources->len; i++) {
+        StultoSearchIndexSource *source = g_ptr_array_index(index->sources, i);
+
+        query->stats.lines += source->lines;
+    }
+
+    /* Superseded while queued - nobody wants these results any more */
+    if (query->serial != g_atomic_int_get(&index->latest_query)) {
+        return;
+    }
+
+    query->hits = g_ptr_array_new_with_free_func(hit_free);
+
+    pcre2_code *code = compile_query(query->text);
+
+    if (code == NULL) {
+        return;
+    }
+
+    pcre2_match_data *match_data = pcre2_match_data_create(1, NULL);
+    gsize text_len = strlen(query->text);
+    guint n_bits = text_len > 2 ? text_len - 2 : 0;
+    guint *bits = g_new(guint, n_bits);
+    const guchar *text = (const guchar *) query->text;
+
+    for (guint i = 0; i < n_bits; i++) {
+        bits[i] = trigram_bit(text[i], text[i + 1], text[i + 2]);
+    }
+
+    for (guint i = 0; i < index->sources->len; i++) {
+        query_source(g_ptr_array_index(index->sources, i), query, code, match_data, bits, n_bits);
+    }
+
+    g_free(bits);
+    pcre2_match_data_free(match_data);
+    pcre2_code_free(code);
+
+    query->stats.query_usec = g_get_monotonic_time() - start_time;
+
+    g_debug("Searched %" G_GSIZE_FORMAT " lines in %u sources (%" G_GSIZE_FORMAT " KiB indexed) in %.1f ms",
+            query->stats.lines, query->stats.sources, query->stats.bytes / 1024,
+            query->stats.query_usec / 1000.0);
+}
+
+static void index_process_task(gpointer task_data, gpointer index_data) {
+    IndexTask *task = task_data;
+    StultoSearchIndex *index = index_data;
+
+    switch (task->type) {
+        case TASK_ADD:
+            g_ptr_array_add(index->sources, task->source);
+            break;
+        case TASK_FEED: {
+            gsize len;
+            const gchar *data = g_bytes_get_data(task->bytes, &len);
+
+            /* An empty chunk marks output skipped under backlog; the partial line before it is meaningless now */
+            if (len == 0) {
+                stulto_line_splitter_reset(task->source->splitter);
+            }
+
+            stulto_line_splitter_feed(task->source->splitter, data, len, source_add_line, task->source);
+            enforce_budget(index);
+
+            g_bytes_unref(task->bytes);
+        }
+            break;
+        case TASK_REMOVE:
+            g_ptr_array_remove(index->sources, task->source);
+            source_free(task->source);
+            break;
+        case TASK_QUERY:
+            run_query(index, task->query);
+            g_idle_add(query_finished_cb, task->query);
+            break;
+    }
+
+    g_free(task);
+}
+
+// endregion
+
+StultoSearchIndex *stulto_search_index_get_default() {
+    static StultoSearchIndex *index = NULL;
+
+    if (index == NULL) {
+        index = g_new0(StultoSearchIndex, 1);
+
+        index->sources = g_ptr_array_new();
+
+        /* A single thread keeps each source's output in order and needs no locking */
+        index->pool = g_thread_pool_new(index_process_task, index, 1, FALSE, NULL);
+    }
+
+    return index;
+}
+
+static void push_task(StultoSearchIndex *index, IndexTaskType type, StultoSearchIndexSource *source, GBytes *bytes) {
+    IndexTask *task = g_new0(IndexTask, 1);
+
+    task->type = type;
+    task->source = source;
+    task->bytes = bytes;
+
+    g_thread_pool_push(index->pool, task, NULL);
+}
+
+/*
+ * Register a terminal's output; max_lines is its scrollback, or -1 for unlimited (bounded by the index's budget only)
+ */
+StultoSearchIndexSource *stulto_search_index_add_source(StultoSearchIndex *index, glong max_lines) {
+    StultoSearchIndexSource *source = g_new0(StultoSearchIndexSource, 1);
+
+    source->index = index;
+    source->id = ++index->next_source_id;
+    source->max_lines = max_lines >= 0 ? max_lines : G_MAXLONG;
+    source->splitter = stulto_line_splitter_new(STULTO_SEARCH_INDEX_MAX_LINE);
+    g_queue_init(&source->blocks);
+
+    push_task(index, TASK_ADD, source, NULL);
+
+    return source;
+}
+
+/*
+ * Drop a source and everything indexed for it; the source must not be used afterwards
+ */
+void stulto_search_index_remove_source(StultoSearchIndexSource *source) {
+    push_task(source->index, TASK_REMOVE, source, NULL);
+}
+
+guint stulto_search_index_source_get_id(StultoSearchIndexSource *source) {
+    return source->id;
+}
+
+void stulto_search_index_feed(StultoSearchIndexSource *source, const gchar *data, gsize len) {
+    if (g_thread_pool_unprocessed(source->index->pool) >= STULTO_SEARCH_INDEX_MAX_BACKLOG) {
+        if (!source->overflowed) {
+            push_task(source->index, TASK_FEED, source, g_bytes_new(NULL, 0));
+            source->overflowed = TRUE;
+        }
+
+        return;
+    }
+
+    source->overflowed = FALSE;
+
+    push_task(source->index, TASK_FEED, source, g_bytes_new(data, len));
+}
+
+/*
+ * Search every source for the literal text; results are delivered on the main thread, in source order
+ */
+void stulto_search_index_query(StultoSearchIndex *index,
+                               const gchar *text,
+                               StultoSearchIndexResultsFunc results_func,
+                               gpointer user_data) {
+    IndexQuery *query = g_new0(IndexQuery, 1);
+
+    query->serial = g_atomic_int_add(&index->latest_query, 1) + 1;
+    query->text = g_strdup(text);
+    query->results_func = results_func;
+    query->user_data = user_data;
+
+    IndexTask *task = g_new0(IndexTask, 1);
+
+    task->type = TASK_QUERY;
+    task->query = query;
+
+    g_thread_pool_push(index->pool, task, NULL);
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_SEARCH_INDEX_H
+#define STULTO_SEARCH_INDEX_H
+
+#include <glib.h>
+
+/*
+ * A text index over the output of every open terminal, for searching all sessions at once
+ *
+ * Each terminal registers as a source and copies its output to the index as it arrives; a single worker thread splits
+ * it into lines and appends them to fixed-size blocks, each with a bloom filter of the trigrams it contains, so a query
+ * only scans the blocks that can possibly match. Whole blocks are dropped once a source holds more lines than its
+ * scrollback, and the oldest blocks of the largest sources are dropped whenever the index as a whole outgrows its
+ * memory budget. Queries also run on the worker, so the GUI thread never does more than a memcpy per read
+ */
+
+typedef struct _StultoSearchIndex StultoSearchIndex;
+typedef struct _StultoSearchIndexSource StultoSearchIndexSource;
+
+typedef struct _StultoSearchIndexHit {
+    guint source_id;
+    gchar *line;
+    /* Position of the line's first match counting back from the source's last match, which is 1 */
+    gint nth_from_end;
+} StultoSearchIndexHit;
+
+typedef struct _StultoSearchIndexStats {
+    guint sources;
+    gsize lines;
+    gsize bytes;
+    gint64 query_usec;
+} StultoSearchIndexStats;
+
+/* hits is NULL if the query was superseded by a newer one before it ran; both are freed once the callback returns */
+typedef void (*StultoSearchIndexResultsFunc)(GPtrArray *hits, const StultoSearchIndexStats *stats, gpointer user_data);
+
+StultoSearchIndex *stulto_search_index_get_default();
+
+StultoSearchIndexSource *stulto_search_index_add_source(StultoSearchIndex *index, glong max_lines);
+void stulto_search_index_remove_source(StultoSearchIndexSource *source);
+guint stulto_search_index_source_get_id(StultoSearchIndexSource *source);
+void stulto_search_index_feed(StultoSearchIndexSource *source, const gchar *data, gsize len);
+
+void stulto_search_index_query(StultoSearchIndex *index,
+                               const gchar *text,
+                               StultoSearchIndexResultsFunc results_func,
+                               gpointer user_data);
+
+#endif //STULTO_SEARCH_INDEX_H
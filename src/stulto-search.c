@@ -0,0 +1,541 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stulto-search.h"
+#include "stulto-terminal.h"
+
+#ifdef VTE_TYPE_REGEX
+#define PCRE2_CODE_UNIT_WIDTH 8
+
+#include <pcre2.h>
+
+#endif
+
+/* Rows fetched from VTE at a time while counting */
+#define STULTO_SEARCH_SLICE_ROWS 256
+/* Time spent counting per main loop iteration before yielding to input and redraws */
+#define STULTO_SEARCH_SLICE_USEC 4000
+/* Compiled patterns kept per search; the cache simply starts over once it is full */
+#define STULTO_SEARCH_CACHE_SIZE 64
+
+typedef struct _StultoSearchPattern {
+#ifdef VTE_TYPE_REGEX
+    VteRegex *vte_regex;
+    pcre2_code *code;
+#else
+    GRegex *vte_regex;
+#endif
+} StultoSearchPattern;
+
+struct _StultoSearch {
+    VteTerminal *terminal_widget;
+    gulong contents_changed_handler;
+
+    GHashTable *patterns;
+    gchar *text;
+    StultoSearchPattern *pattern;
+#ifdef VTE_TYPE_REGEX
+    pcre2_match_data *match_data;
+#endif
+
+    guint scan_source;
+    glong scan_row;
+    glong scan_end_row;
+    /* The bottom of the view when the search started, which is where VTE starts looking */
+    glong split_row;
+    /* The start of a line which continues in the next slice */
+    GString *carry;
+    gint64 scan_start_time;
+    gboolean dirty;
+
+    gint total;
+    gint before_split;
+    gint current;
+    /* Moves made while the first match's position was still being counted */
+    gboolean current_pending;
+    gint pending_delta;
+
+    /* Moves still to make, a slice per main loop iteration, to reach a match several away */
+    guint repeat_source;
+    gint repeat_left;
+    gboolean repeat_backwards;
+
+    StultoSearchCountFunc count_func;
+    gpointer user_data;
+};
+
+// region Patterns
+
+static void pattern_free(StultoSearchPattern *pattern) {
+#ifdef VTE_TYPE_REGEX
+    vte_regex_unref(pattern->vte_regex);
+    pcre2_code_free(pattern->code);
+#else
+    g_regex_unref(pattern->vte_regex);
+#endif
+    g_free(pattern);
+}
+
+static gboolean has_upper(const gchar *text) {
+    for (const gchar *p = text; *p != '\0'; p = g_utf8_next_char(p)) {
+        if (g_unichar_isupper(g_utf8_get_char(p))) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * The search text is taken literally, and only matches case-sensitively if it contains an upper case letter
+ */
+static StultoSearchPattern *pattern_new(const gchar *text, GError **error) {
+    StultoSearchPattern *pattern = g_new0(StultoSearchPattern, 1);
+    gchar *escaped = g_regex_escape_string(text, -1);
+    gboolean caseless = !has_upper(text);
+
+#ifdef VTE_TYPE_REGEX
+    guint32 flags = PCRE2_MULTILINE | (caseless ? PCRE2_CASELESS : 0);
+    int error_code;
+    PCRE2_SIZE error_offset;
+
+    pattern->vte_regex = vte_regex_new_for_search(escaped, -1, flags, error);
+
+    if (pattern->vte_regex == NULL) {
+        g_free(pattern);
+        g_free(escaped);
+        return NULL;
+    }
+
+    /* Not fatal - PCRE2 falls back to the interpreter where JIT isn't available */
+    vte_regex_jit(pattern->vte_regex, PCRE2_JIT_COMPLETE, NULL);
+
+    pattern->code = pcre2_compile(
+            (PCRE2_SPTR) escaped, PCRE2_ZERO_TERMINATED,
+            PCRE2_UTF | flags,
+            &error_code, &error_offset,
+            NULL);
+
+    if (pattern->code == NULL) {
+        PCRE2_UCHAR message[256];
+
+        pcre2_get_error_message(error_code, message, sizeof(message));
+        g_set_error(error, G_REGEX_ERROR, G_REGEX_ERROR_COMPILE, "%s at offset %" G_GSIZE_FORMAT,
+                    (gchar *) message, (gsize) error_offset);
+
+        vte_regex_unref(pattern->vte_regex);
+        g_free(pattern);
+        g_free(escaped);
+        return NULL;
+    }
+
+    pcre2_jit_compile(pattern->code, PCRE2_JIT_COMPLETE);
+#else
+    GRegexCompileFlags flags = G_REGEX_MULTILINE | G_REGEX_OPTIMIZE | (caseless ? G_REGEX_CASELESS : 0);
+
+    pattern->vte_regex = g_regex_new(escaped, flags, 0, error);
+
+    if (pattern->vte_regex == NULL) {
+        g_free(pattern);
+        g_free(escaped);
+        return NULL;
+    }
+#endif
+
+    g_free(escaped);
+
+    return pattern;
+}
+
+// endregion
+
+// region Counting
+
+/*
+ * Hand VTE any output the terminal is still holding back, so the search sees what the user sees
+ */
+static void flush_output(StultoSearch *search) {
+    GtkWidget *terminal = gtk_widget_get_ancestor(GTK_WIDGET(search->terminal_widget), STULTO_TYPE_TERMINAL);
+
+    if (terminal != NULL) {
+        stulto_terminal_flush_output(STULTO_TERMINAL(terminal));
+    }
+}
+
+static void report(StultoSearch *search) {
+    search->count_func(
+            search->current_pending ? 0 : search->current,
+            search->total,
+            search->scan_source == 0,
+            search->user_data);
+}
+
+/*
+ * Wrap a 1-based match position into [1, total]
+ */
+static gint wrap_position(gint position, gint total) {
+    return ((position - 1) % total + total) % total + 1;
+}
+
+static gint count_matches(StultoSearch *search, const gchar *text, gsize len) {
+    gint n = 0;
+
+#ifdef VTE_TYPE_REGEX
+    PCRE2_SIZE offset = 0;
+
+    while (offset < len) {
+        int rc = pcre2_match(
+                search->pattern->code,
+                (PCRE2_SPTR) text, len,
+                offset, PCRE2_NO_UTF_CHECK,
+                search->match_data,
+                NULL);
+
+        if (rc < 0) {
+            break;
+        }
+
+        PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(search->match_data);
+
+        /* A literal can't match the empty string, but don't spin if it somehow did */
+        if (ovector[1] <= ovector[0]) {
+            break;
+        }
+
+        n++;
+        offset = ovector[1];
+    }
+#else
+    GMatchInfo *match_info = NULL;
+
+    g_regex_match_full(search->pattern->vte_regex, text, len, 0, 0, &match_info, NULL);
+    while (g_match_info_matches(match_info)) {
+        n++;
+        g_match_info_next(match_info, NULL);
+    }
+    g_match_info_free(match_info);
+#endif
+
+    return n;
+}
+
+static void finish_scan(StultoSearch *search) {
+    search->scan_source = 0;
+
+    g_debug("Counted %d matches up to row %ld in %.1f ms",
+            search->total, search->scan_end_row,
+            (g_get_monotonic_time() - search->scan_start_time) / 1000.0);
+
+    if (search->total == 0) {
+        search->current = 0;
+    } else if (search->current_pending) {
+        /* VTE found the last match above the bottom of the view, or wrapped around to the very last one */
+        search->current = wrap_position(search->before_split + search->pending_delta, search->total);
+    } else if (search->current > search->total) {
+        search->current = search->total;
+    }
+    search->current_pending = FALSE;
+
+    report(search);
+}
+
+static gboolean scan_cb(gpointer data) {
+    StultoSearch *search = data;
+
+    gint64 deadline = g_get_monotonic_time() + STULTO_SEARCH_SLICE_USEC;
+    glong columns = vte_terminal_get_column_count(search->terminal_widget);
+
+    do {
+        if (search->scan_row >= search->scan_end_row) {
+            /* The last line doesn't necessarily end in a newline */
+            search->total += count_matches(search, search->carry->str, search->carry->len);
+            g_string_truncate(search->carry, 0);
+
+            finish_scan(search);
+
+            return G_SOURCE_REMOVE;
+        }
+
+        gboolean before_split = search->scan_row < search->split_row;
+        glong end_row = MIN(search->scan_row + STULTO_SEARCH_SLICE_ROWS, search->scan_end_row);
+
+        if (before_split) {
+            end_row = MIN(end_row, search->split_row);
+        }
+
+        gchar *text = vte_terminal_get_text_range(
+                search->terminal_widget,
+                search->scan_row, 0,
+                end_row - 1, columns - 1,
+                NULL, NULL, NULL);
+
+        if (text != NULL) {
+            g_string_append(search->carry, text);
+            g_free(text);
+        }
+
+        /* Only count complete lines, so matches in lines wrapped across slices aren't missed */
+        const gchar *last_newline = g_strrstr_len(search->carry->str, search->carry->len, "\n");
+
+        if (last_newline != NULL) {
+            gsize len = last_newline + 1 - search->carry->str;
+            gint n = count_matches(search, search->carry->str, len);
+
+            search->total += n;
+            if (before_split) {
+                search->before_split += n;
+            }
+
+            g_string_erase(search->carry, 0, len);
+        }
+
+        search->scan_row = end_row;
+    } while (g_get_monotonic_time() < deadline);
+
+    report(search);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void stop_scan(StultoSearch *search) {
+    if (search->scan_source != 0) {
+        g_source_remove(search->scan_source);
+        search->scan_source = 0;
+    }
+}
+
+static void start_scan(StultoSearch *search) {
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(search->terminal_widget));
+
+    stop_scan(search);
+    flush_output(search);
+
+    search->scan_row = (glong) gtk_adjustment_get_lower(adjustment);
+    search->scan_end_row = (glong) gtk_adjustment_get_upper(adjustment);
+    search->split_row = (glong) (gtk_adjustment_get_value(adjustment) + gtk_adjustment_get_page_size(adjustment));
+    g_string_truncate(search->carry, 0);
+
+    search->total = 0;
+    search->before_split = 0;
+    search->dirty = FALSE;
+
+    search->scan_start_time = g_get_monotonic_time();
+    search->scan_source = g_idle_add(scan_cb, search);
+}
+
+static void stop_repeat(StultoSearch *search) {
+    if (search->repeat_source != 0) {
+        g_source_remove(search->repeat_source);
+        search->repeat_source = 0;
+    }
+    search->repeat_left = 0;
+}
+
+static void find_step(StultoSearch *search, gboolean backwards);
+
+static gboolean repeat_cb(gpointer data) {
+    StultoSearch *search = data;
+
+    gint64 deadline = g_get_monotonic_time() + STULTO_SEARCH_SLICE_USEC;
+
+    do {
+        find_step(search, search->repeat_backwards);
+    } while (--search->repeat_left > 0 && g_get_monotonic_time() < deadline);
+
+    report(search);
+
+    if (search->repeat_left > 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    search->repeat_source = 0;
+
+    return G_SOURCE_REMOVE;
+}
+
+static void contents_changed_cb(VteTerminal *terminal_widget, gpointer data) {
+    StultoSearch *search = data;
+
+    search->dirty = TRUE;
+}
+
+// endregion
+
+StultoSearch *stulto_search_new(VteTerminal *terminal_widget, StultoSearchCountFunc count_func, gpointer user_data) {
+    StultoSearch *search = g_new0(StultoSearch, 1);
+
+    search->terminal_widget = g_object_ref(terminal_widget);
+    search->patterns = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) pattern_free);
+#ifdef VTE_TYPE_REGEX
+    search->match_data = pcre2_match_data_create(1, NULL);
+#endif
+    search->carry = g_string_new(NULL);
+
+    search->count_func = count_func;
+    search->user_data = user_data;
+
+    search->contents_changed_handler = g_signal_connect(
+            terminal_widget, "contents-changed", G_CALLBACK(contents_changed_cb), search);
+
+    vte_terminal_search_set_wrap_around(terminal_widget, TRUE);
+
+    return search;
+}
+
+void stulto_search_free(StultoSearch *search) {
+    if (search == NULL) {
+        return;
+    }
+
+    stop_scan(search);
+    stop_repeat(search);
+
+    g_signal_handler_disconnect(search->terminal_widget, search->contents_changed_handler);
+#ifdef VTE_TYPE_REGEX
+    vte_terminal_search_set_regex(search->terminal_widget, NULL, 0);
+    pcre2_match_data_free(search->match_data);
+#else
+    vte_terminal_search_set_gregex(search->terminal_widget, NULL, 0);
+#endif
+    g_object_unref(search->terminal_widget);
+
+    g_hash_table_destroy(search->patterns);
+    g_free(search->text);
+    g_string_free(search->carry, TRUE);
+    g_free(search);
+}
+
+/*
+ * Search for new text, starting over from the bottom of the view; empty text ends the search. Setting the text that
+ * is already being searched for keeps the current match
+ */
+gboolean stulto_search_set_text(StultoSearch *search, const gchar *text, GError **error) {
+    StultoSearchPattern *pattern = NULL;
+
+    if (text != NULL && text[0] == '\0') {
+        text = NULL;
+    }
+
+    if (g_strcmp0(text, search->text) == 0) {
+        return TRUE;
+    }
+
+    stop_scan(search);
+    stop_repeat(search);
+
+    search->total = 0;
+    search->current = 0;
+    search->current_pending = FALSE;
+    search->pending_delta = 0;
+
+    if (text != NULL) {
+        pattern = g_hash_table_lookup(search->patterns, text);
+
+        if (pattern == NULL) {
+            pattern = pattern_new(text, error);
+
+            if (pattern == NULL) {
+                return FALSE;
+            }
+
+            if (g_hash_table_size(search->patterns) >= STULTO_SEARCH_CACHE_SIZE) {
+                search->pattern = NULL;
+                g_hash_table_remove_all(search->patterns);
+            }
+            g_hash_table_insert(search->patterns, g_strdup(text), pattern);
+        }
+    }
+
+    search->pattern = pattern;
+
+    g_free(search->text);
+    search->text = g_strdup(text);
+
+#ifdef VTE_TYPE_REGEX
+    vte_terminal_search_set_regex(search->terminal_widget, pattern ? pattern->vte_regex : NULL, 0);
+#else
+    vte_terminal_search_set_gregex(search->terminal_widget, pattern ? pattern->vte_regex : NULL, 0);
+#endif
+    vte_terminal_unselect_all(search->terminal_widget);
+
+    if (pattern != NULL) {
+        start_scan(search);
+
+        search->current_pending = vte_terminal_search_find_previous(search->terminal_widget);
+    }
+
+    report(search);
+
+    return TRUE;
+}
+
+static void find_step(StultoSearch *search, gboolean backwards) {
+    gint step = backwards ? -1 : 1;
+    gboolean found;
+
+    flush_output(search);
+
+    if (backwards) {
+        found = vte_terminal_search_find_previous(search->terminal_widget);
+    } else {
+        found = vte_terminal_search_find_next(search->terminal_widget);
+    }
+
+    if (!found) {
+        search->current = 0;
+        search->current_pending = FALSE;
+    } else if (search->current_pending) {
+        search->pending_delta += step;
+    } else if (search->current > 0 && search->total > 0) {
+        search->current = wrap_position(search->current + step, search->total);
+    }
+
+    /* New output arrived since the count; recount it, keeping our place */
+    if (search->dirty && search->scan_source == 0) {
+        start_scan(search);
+    }
+}
+
+/*
+ * Move to the previous (older) or next match, wrapping around at either end of the scrollback
+ */
+void stulto_search_find(StultoSearch *search, gboolean backwards) {
+    if (search->pattern == NULL) {
+        return;
+    }
+
+    stop_repeat(search);
+    find_step(search, backwards);
+    report(search);
+}
+
+/*
+ * Move count matches at once; each move is a search of its own, so they are spread over main loop iterations
+ */
+void stulto_search_find_repeat(StultoSearch *search, gboolean backwards, gint count) {
+    if (search->pattern == NULL || count <= 0) {
+        return;
+    }
+
+    stop_repeat(search);
+
+    search->repeat_left = count;
+    search->repeat_backwards = backwards;
+    search->repeat_source = g_idle_add(repeat_cb, search);
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_SEARCH_H
+#define STULTO_SEARCH_H
+
+#include <vte/vte.h>
+
+/*
+ * An incremental search over a terminal's scrollback
+ *
+ * VTE finds and selects one match at a time; to tell the user where that match stands among all the others, the whole
+ * scrollback is counted a slice of rows per main loop iteration, so even a very long buffer never holds up input.
+ * Patterns are compiled once and cached for as long as the search lives, so editing the query back and forth doesn't
+ * recompile anything
+ */
+
+typedef struct _StultoSearch StultoSearch;
+
+/* current is 0 while the position of the selected match isn't known (or nothing is selected) */
+typedef void (*StultoSearchCountFunc)(gint current, gint total, gboolean complete, gpointer user_data);
+
+StultoSearch *stulto_search_new(VteTerminal *terminal_widget, StultoSearchCountFunc count_func, gpointer user_data);
+void stulto_search_free(StultoSearch *search);
+
+gboolean stulto_search_set_text(StultoSearch *search, const gchar *text, GError **error);
+void stulto_search_find(StultoSearch *search, gboolean backwards);
+void stulto_search_find_repeat(StultoSearch *search, gboolean backwards, gint count);
+
+#endif //STULTO_SEARCH_H
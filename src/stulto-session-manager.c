@@ -19,6 +19,15 @@
 
 #include "stulto-session-manager.h"
 #include "stulto-session.h"
+#include "stulto-switcher-index.h"
+
+/* How long a workspace took to come up, until each of its terminals' first output */
+typedef struct _WorkspaceLaunch {
+    gchar *path;
+    guint panes;
+    guint pending;
+    gint64 start_time;
+} WorkspaceLaunch;
 
 enum {
     PROP_0,
@@ -28,6 +37,9 @@ enum {
 
 struct _StultoSessionManager {
     GtkNotebook parent_instance;
+
+    /* What the session switcher searches, kept up to date one session at a time */
+    StultoSwitcherIndex *switcher_index;
 };
 
 G_DEFINE_FINAL_TYPE(StultoSessionManager, stulto_session_manager, GTK_TYPE_NOTEBOOK)
@@ -55,21 +67,76 @@ void stulto_session_manager_set_active_session_id(StultoSessionManager *session_
 
 gint stulto_session_manager_get_n_sessions(StultoSessionManager *session_manager);
 
+gint stulto_session_manager_find_session_by_index_id(StultoSessionManager *session_manager, guint index_id);
+GPtrArray *stulto_session_manager_find_sessions(StultoSessionManager *session_manager, const gchar *query, guint max);
+const gchar *stulto_session_manager_describe_session(StultoSessionManager *session_manager, StultoSession *session);
+
+void stulto_session_manager_add_workspace(StultoSessionManager *session_manager,
+                                          StultoWorkspace *workspace,
+                                          StultoTerminalProfile *default_profile);
+
+/* Helpers */
+static void update_switcher_entry(StultoSessionManager *session_manager, StultoSession *session);
+
 // endregion
 
 // region Callbacks
 
+static void workspace_launch_free(WorkspaceLaunch *launch) {
+    g_free(launch->path);
+}
+
+static void workspace_launch_release(gpointer data, GClosure *closure) {
+    g_rc_box_release_full(data, (GDestroyNotify) workspace_launch_free);
+}
+
+static void terminal_ready_cb(StultoTerminal *terminal, gpointer data) {
+    WorkspaceLaunch *launch = data;
+
+    if (--launch->pending == 0) {
+        g_debug("Workspace %s: %u panes ready in %.1f ms",
+                launch->path, launch->panes, (g_get_monotonic_time() - launch->start_time) / 1000.0);
+    }
+
+    g_signal_handlers_disconnect_by_func(terminal, terminal_ready_cb, launch);
+}
+
+static void session_notify_cb(GObject *object, GParamSpec *pspec, gpointer data) {
+    update_switcher_entry(STULTO_SESSION_MANAGER(data), STULTO_SESSION(object));
+}
+
 static void page_added_cb(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer data) {
     StultoSessionManager *session_manager = STULTO_SESSION_MANAGER(notebook);
     StultoSession *session = STULTO_SESSION(child);
-    StultoTerminal *terminal = stulto_session_get_active_terminal(session);
 
-    stulto_session_manager_set_active_session(session_manager, session);
+    update_switcher_entry(session_manager, session);
+
+    g_signal_connect_object(session, "notify::title", G_CALLBACK(session_notify_cb), session_manager, 0);
+    g_signal_connect_object(session, "notify::foreground", G_CALLBACK(session_notify_cb), session_manager, 0);
+    g_signal_connect_object(session, "notify::cwd", G_CALLBACK(session_notify_cb), session_manager, 0);
+    g_signal_connect_object(session, "child-notify::tab-label", G_CALLBACK(session_notify_cb), session_manager, 0);
+
+    /* Lazy sessions wait in the background until they're selected */
+    if (!stulto_session_is_lazy(session)) {
+        stulto_session_manager_set_active_session(session_manager, session);
+    }
+}
+
+static void page_removed_cb(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer data) {
+    StultoSessionManager *session_manager = STULTO_SESSION_MANAGER(notebook);
+
+    g_signal_handlers_disconnect_by_func(child, session_notify_cb, session_manager);
+    stulto_switcher_index_remove(session_manager->switcher_index, child);
 }
 
 static void switch_page_cb(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer data) {
+    StultoSessionManager *session_manager = STULTO_SESSION_MANAGER(notebook);
+
+    stulto_session_materialize(STULTO_SESSION(child));
     gtk_widget_show_all(child);
 
+    stulto_switcher_index_touch(session_manager->switcher_index, child);
+
     g_object_notify(G_OBJECT(notebook), "active-session");
 }
 
@@ -82,6 +149,10 @@ static void stulto_session_manager_dispose(GObject *object) {
 }
 
 static void stulto_session_manager_finalize(GObject *object) {
+    StultoSessionManager *session_manager = STULTO_SESSION_MANAGER(object);
+
+    stulto_switcher_index_free(session_manager->switcher_index);
+
     G_OBJECT_CLASS(stulto_session_manager_parent_class)->finalize(object);
 }
 
@@ -133,10 +204,13 @@ static void stulto_session_manager_class_init(StultoSessionManagerClass *klass)
 }
 
 static void stulto_session_manager_init(StultoSessionManager *session_manager) {
+    session_manager->switcher_index = stulto_switcher_index_new();
+
     gtk_notebook_set_show_tabs(GTK_NOTEBOOK(session_manager), FALSE);
     gtk_notebook_set_show_border(GTK_NOTEBOOK(session_manager), FALSE);
 
     g_signal_connect(session_manager, "page-added", G_CALLBACK(page_added_cb), NULL);
+    g_signal_connect(session_manager, "page-removed", G_CALLBACK(page_removed_cb), NULL);
     g_signal_connect_after(session_manager, "switch-page", G_CALLBACK(switch_page_cb), NULL);
 }
 
@@ -186,6 +260,46 @@ gint stulto_session_manager_get_n_sessions(StultoSessionManager *session_manager
     return gtk_notebook_get_n_pages(notebook);
 }
 
+/*
+ * The number of the session whose terminal feeds the given search index source, or -1 if it isn't in this window
+ */
+gint stulto_session_manager_find_session_by_index_id(StultoSessionManager *session_manager, guint index_id) {
+    g_return_val_if_fail(STULTO_IS_SESSION_MANAGER(session_manager), -1);
+
+    GtkNotebook *notebook = GTK_NOTEBOOK(session_manager);
+
+    gint num_pages = gtk_notebook_get_n_pages(notebook);
+
+    for (gint i = 0; i < num_pages; i++) {
+        StultoSession *session = STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i));
+
+        if (stulto_session_find_terminal_by_index_id(session, index_id) != NULL) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * The sessions whose name, title, foreground process or working directory fuzzily match query, most recently shown
+ * first and at most max of them; free the array with g_ptr_array_unref
+ */
+GPtrArray *stulto_session_manager_find_sessions(StultoSessionManager *session_manager, const gchar *query, guint max) {
+    g_return_val_if_fail(STULTO_IS_SESSION_MANAGER(session_manager), NULL);
+
+    return stulto_switcher_index_query(session_manager->switcher_index, query, max);
+}
+
+/*
+ * A one-line description of the session, as matched by stulto_session_manager_find_sessions
+ */
+const gchar *stulto_session_manager_describe_session(StultoSessionManager *session_manager, StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION_MANAGER(session_manager), NULL);
+
+    return stulto_switcher_index_get_text(session_manager->switcher_index, session);
+}
+
 void stulto_session_manager_add_session(StultoSessionManager *session_manager, StultoTerminal *first_terminal) {
     g_return_if_fail(STULTO_IS_SESSION_MANAGER(session_manager));
 
@@ -202,6 +316,59 @@ void stulto_session_manager_add_session(StultoSessionManager *session_manager, S
     stulto_session_manager_set_active_session(session_manager, session);
 }
 
+/*
+ * Open every session of a workspace, taking them over from it
+ *
+ * Unless the workspace is lazy, every session's terminals are created and their children started at once, rather than
+ * one by one as each session is first shown. Lazy sessions only count towards the number of sessions until then
+ */
+void stulto_session_manager_add_workspace(StultoSessionManager *session_manager,
+                                          StultoWorkspace *workspace,
+                                          StultoTerminalProfile *default_profile) {
+    g_return_if_fail(STULTO_IS_SESSION_MANAGER(session_manager));
+
+    GtkNotebook *notebook = GTK_NOTEBOOK(session_manager);
+    StultoSession *active_session = NULL;
+    guint active = MIN(workspace->active, workspace->sessions->len - 1);
+    guint index = 0;
+    WorkspaceLaunch *launch = g_rc_box_new0(WorkspaceLaunch);
+
+    launch->path = g_strdup(workspace->path);
+    launch->start_time = g_get_monotonic_time();
+
+    while (workspace->sessions->len > 0) {
+        StultoWorkspaceSession *workspace_session = g_ptr_array_steal_index(workspace->sessions, 0);
+        StultoSession *session = stulto_session_new_lazy(workspace_session, default_profile);
+
+        gtk_notebook_append_page(notebook, GTK_WIDGET(session), gtk_label_new(workspace_session->name));
+
+        if (index++ == active) {
+            active_session = session;
+        }
+
+        if (workspace->lazy) {
+            continue;
+        }
+
+        stulto_session_materialize(session);
+
+        GList *terminals = stulto_session_get_terminals(session);
+
+        for (GList *l = terminals; l != NULL; l = l->next) {
+            g_signal_connect_data(l->data, "ready", G_CALLBACK(terminal_ready_cb),
+                                  g_rc_box_acquire(launch), workspace_launch_release, 0);
+            launch->panes++;
+            launch->pending++;
+        }
+
+        g_list_free(terminals);
+    }
+
+    stulto_session_manager_set_active_session(session_manager, active_session);
+
+    g_rc_box_release_full(launch, (GDestroyNotify) workspace_launch_free);
+}
+
 void stulto_session_manager_prev_session(StultoSessionManager *session_manager) {
     g_return_if_fail(STULTO_IS_SESSION_MANAGER(session_manager));
 
@@ -245,3 +412,35 @@ void stulto_session_manager_next_session(StultoSessionManager *session_manager)
 }
 
 // endregion
+
+// region Helpers
+
+/*
+ * Rebuild one session's switcher entry; the rest of the index is left alone
+ */
+static void update_switcher_entry(StultoSessionManager *session_manager, StultoSession *session) {
+    const gchar *name = gtk_notebook_get_tab_label_text(GTK_NOTEBOOK(session_manager), GTK_WIDGET(session));
+    const gchar *title = stulto_session_get_title(session);
+    const gchar *foreground = stulto_session_get_foreground(session);
+    gchar *cwd = stulto_session_get_cwd(session);
+    GString *text = g_string_new(name != NULL ? name : "");
+
+    if (title != NULL && *title != '\0') {
+        g_string_append_printf(text, ": %s", title);
+    }
+
+    if (foreground != NULL) {
+        g_string_append_printf(text, " [%s]", foreground);
+    }
+
+    if (cwd != NULL) {
+        g_string_append_printf(text, " (%s)", cwd);
+    }
+
+    stulto_switcher_index_update(session_manager->switcher_index, session, text->str);
+
+    g_string_free(text, TRUE);
+    g_free(cwd);
+}
+
+// endregion
@@ -24,6 +24,7 @@
 
 #include "stulto-terminal.h"
 #include "stulto-session.h"
+#include "stulto-workspace.h"
 
 G_BEGIN_DECLS
 
@@ -39,7 +40,14 @@ gint stulto_session_manager_get_active_session_id(StultoSessionManager *session_
 
 gint stulto_session_manager_get_n_sessions(StultoSessionManager *session_manager);
 
+gint stulto_session_manager_find_session_by_index_id(StultoSessionManager *session_manager, guint index_id);
+GPtrArray *stulto_session_manager_find_sessions(StultoSessionManager *session_manager, const gchar *query, guint max);
+const gchar *stulto_session_manager_describe_session(StultoSessionManager *session_manager, StultoSession *session);
+
 void stulto_session_manager_add_session(StultoSessionManager *session_manager, StultoTerminal *first_terminal);
+void stulto_session_manager_add_workspace(StultoSessionManager *session_manager,
+                                          StultoWorkspace *workspace,
+                                          StultoTerminalProfile *default_profile);
 
 void stulto_session_manager_prev_session(StultoSessionManager *session_manager);
 void stulto_session_manager_next_session(StultoSessionManager *session_manager);
@@ -0,0 +1,398 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "stulto-session-state.h"
+#include "stulto-holder-protocol.h"
+#include "stulto-journal.h"
+#include "stulto-workspace.h"
+
+#define STATE_FILE_NAME "state.ini"
+#define SCROLLBACK_SUFFIX ".ansi"
+
+/*
+ * Where the state and scrollback files are kept
+ */
+gchar *stulto_session_state_get_dir() {
+    return g_build_filename(g_get_user_data_dir(), "stulto", "state", NULL);
+}
+
+static gchar *get_state_path() {
+    return g_build_filename(g_get_user_data_dir(), "stulto", "state", STATE_FILE_NAME, NULL);
+}
+
+/*
+ * The process's peak resident set size, as reported by the kernel, or NULL
+ */
+static gchar *get_peak_rss() {
+    gchar *status = NULL;
+    gchar *peak = NULL;
+
+    if (!g_file_get_contents("/proc/self/status", &status, NULL, NULL)) {
+        return NULL;
+    }
+
+    const gchar *line = strstr(status, "VmHWM:");
+
+    if (line != NULL) {
+        line += strlen("VmHWM:");
+        peak = g_strstrip(g_strndup(line, strcspn(line, "\n")));
+    }
+
+    g_free(status);
+
+    return peak;
+}
+
+// region Saving
+
+static gchar *quote_command(gchar **argv) {
+    GString *command = g_string_new(NULL);
+
+    for (gchar **arg = argv; arg != NULL && *arg != NULL; arg++) {
+        gchar *quoted = g_shell_quote(*arg);
+
+        if (command->len > 0) {
+            g_string_append_c(command, ' ');
+        }
+        g_string_append(command, quoted);
+        g_free(quoted);
+    }
+
+    return g_string_free(command, FALSE);
+}
+
+static void write_pane(GKeyFile *file,
+                       const gchar *group,
+                       StultoExecData *exec_data,
+                       const gchar *cwd,
+                       StultoTerminalProfile *profile,
+                       StultoTerminalProfile *default_profile,
+                       const gchar *parent,
+                       GtkOrientation split,
+                       gdouble ratio,
+                       const gchar *scrollback_path) {
+    gchar *command = quote_command(exec_data->command_argv);
+
+    g_key_file_set_string(file, group, "command", command);
+
+    if (cwd != NULL) {
+        g_key_file_set_string(file, group, "cwd", cwd);
+    }
+    if (profile != NULL && profile != default_profile && profile->config_file != NULL) {
+        g_key_file_set_string(file, group, "profile", profile->config_file);
+    }
+    if (parent != NULL) {
+        g_key_file_set_string(file, group, "parent", parent);
+        g_key_file_set_string(file, group, "split", split == GTK_ORIENTATION_VERTICAL ? "below" : "right");
+        g_key_file_set_double(file, group, "ratio", ratio);
+    }
+    if (scrollback_path != NULL) {
+        g_key_file_set_string(file, group, "scrollback", scrollback_path);
+    }
+    if (exec_data->holder_id != 0) {
+        g_key_file_set_integer(file, group, STULTO_HOLDER_PANE_KEY, (gint) exec_data->holder_id);
+    }
+
+    g_free(command);
+}
+
+/*
+ * A session that was never shown still has its description, and its scrollback files, to pass on as they are
+ */
+static void write_pending_session(GKeyFile *file,
+                                  guint session_index,
+                                  const StultoWorkspaceSession *pending,
+                                  StultoTerminalProfile *default_profile,
+                                  GHashTable *referenced) {
+    GHashTable *groups = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+    const gchar *previous = NULL;
+
+    for (guint i = 0; i < pending->panes->len; i++) {
+        StultoWorkspacePane *pane = g_ptr_array_index(pending->panes, i);
+        gchar *group = g_strdup_printf("pane:s%up%u", session_index, i);
+        const gchar *parent = NULL;
+
+        if (i > 0) {
+            parent = pane->parent != NULL ? g_hash_table_lookup(groups, pane->parent) : NULL;
+            parent = parent != NULL ? parent : previous;
+        }
+
+        /* Parents are named by pane, not group */
+        write_pane(file, group, pane->exec_data, pane->exec_data->cwd, pane->profile, default_profile,
+                   parent != NULL ? parent + strlen("pane:") : NULL, pane->split, pane->ratio, pane->scrollback_path);
+
+        if (pane->scrollback_path != NULL && referenced != NULL) {
+            g_hash_table_add(referenced, g_strdup(pane->scrollback_path));
+        }
+
+        g_hash_table_insert(groups, pane->name, group);
+        previous = group;
+    }
+
+    g_hash_table_unref(groups);
+}
+
+/*
+ * Without a state directory, the session's scrollback isn't saved, and its panes are marked with their journal ids
+ */
+static void write_session(GKeyFile *file,
+                          guint session_index,
+                          StultoSession *session,
+                          StultoTerminalProfile *default_profile,
+                          const gchar *state_dir,
+                          gint64 generation,
+                          GHashTable *referenced) {
+    GArray *steps = stulto_session_get_layout(session);
+    GHashTable *names = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+    for (guint i = 0; i < steps->len; i++) {
+        StultoTilesStep *step = &g_array_index(steps, StultoTilesStep, i);
+        StultoTerminal *terminal = STULTO_TERMINAL(step->widget);
+        gchar *name = g_strdup_printf("s%up%u", session_index, i);
+        gchar *group = g_strdup_printf("pane:%s", name);
+        gchar *scrollback_path = NULL;
+        gchar *cwd = stulto_terminal_get_cwd(terminal);
+        GError *error = NULL;
+
+        if (state_dir != NULL) {
+            gchar *file_name = g_strdup_printf("%s-%" G_GINT64_FORMAT SCROLLBACK_SUFFIX, name, generation);
+
+            scrollback_path = g_build_filename(state_dir, file_name, NULL);
+            g_free(file_name);
+
+            if (stulto_terminal_save_history(terminal, scrollback_path, &error)) {
+                g_hash_table_add(referenced, g_strdup(scrollback_path));
+            } else {
+                g_printerr("Error saving scrollback: %s\n", error->message);
+                g_clear_error(&error);
+                g_clear_pointer(&scrollback_path, g_free);
+            }
+        } else {
+            g_key_file_set_integer(file, group, STULTO_JOURNAL_PANE_KEY, (gint) stulto_terminal_get_search_index_id(terminal));
+        }
+
+        write_pane(file, group, stulto_terminal_get_exec_data(terminal), cwd,
+                   stulto_terminal_get_profile(terminal), default_profile,
+                   step->sibling != NULL ? g_hash_table_lookup(names, step->sibling) : NULL,
+                   step->orientation, step->ratio, scrollback_path);
+
+        g_hash_table_insert(names, terminal, name);
+
+        g_free(group);
+        g_free(scrollback_path);
+        g_free(cwd);
+    }
+
+    g_hash_table_unref(names);
+    g_array_unref(steps);
+}
+
+static void write_sessions(GKeyFile *file,
+                           StultoSessionManager *session_manager,
+                           StultoTerminalProfile *default_profile,
+                           const gchar *state_dir,
+                           gint64 generation,
+                           GHashTable *referenced) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(session_manager);
+    gint n_pages = gtk_notebook_get_n_pages(notebook);
+
+    g_key_file_set_boolean(file, "workspace", "lazy", TRUE);
+    g_key_file_set_integer(file, "workspace", "active", MAX(gtk_notebook_get_current_page(notebook), 0));
+
+    for (gint i = 0; i < n_pages; i++) {
+        StultoSession *session = STULTO_SESSION(gtk_notebook_get_nth_page(notebook, i));
+        const StultoWorkspaceSession *pending = stulto_session_get_pending(session);
+        gchar *group = g_strdup_printf("session:s%d", i);
+        const gchar *name = gtk_notebook_get_tab_label_text(notebook, GTK_WIDGET(session));
+
+        g_key_file_set_string(file, group, "name", name != NULL ? name : "");
+
+        if (pending != NULL) {
+            write_pending_session(file, i, pending, default_profile, referenced);
+        } else {
+            write_session(file, i, session, default_profile, state_dir, generation, referenced);
+        }
+
+        g_free(group);
+    }
+}
+
+/*
+ * Remove scrollback files no longer named by the state, e.g. those of sessions since closed
+ */
+static void remove_unreferenced(const gchar *state_dir, GHashTable *referenced) {
+    GDir *dir = g_dir_open(state_dir, 0, NULL);
+    const gchar *name;
+
+    if (dir == NULL) {
+        return;
+    }
+
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        gchar *path = g_build_filename(state_dir, name, NULL);
+
+        if (g_str_has_suffix(name, SCROLLBACK_SUFFIX) && !g_hash_table_contains(referenced, path)) {
+            g_unlink(path);
+        }
+
+        g_free(path);
+    }
+
+    g_dir_close(dir);
+}
+
+gboolean stulto_session_state_save(StultoSessionManager *session_manager,
+                                   StultoTerminalProfile *default_profile,
+                                   GError **error) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(session_manager);
+    gchar *state_dir = stulto_session_state_get_dir();
+    gchar *state_path = get_state_path();
+    GKeyFile *file = g_key_file_new();
+    GHashTable *referenced = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    /* Fresh file names per save, so the files pending sessions still refer to are never overwritten */
+    gint64 generation = g_get_real_time();
+    gint64 start_time = g_get_monotonic_time();
+    gint n_pages = gtk_notebook_get_n_pages(notebook);
+    gboolean saved = FALSE;
+
+    if (g_mkdir_with_parents(state_dir, 0700) < 0) {
+        int saved_errno = errno;
+
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Failed to create %s: %s", state_dir, g_strerror(saved_errno));
+        goto out;
+    }
+
+    write_sessions(file, session_manager, default_profile, state_dir, generation, referenced);
+
+    gchar *data = g_key_file_to_data(file, NULL, NULL);
+
+    /* Replaced as a whole, never left half written */
+    saved = g_file_set_contents(state_path, data, -1, error);
+    g_free(data);
+
+    if (saved) {
+        remove_unreferenced(state_dir, referenced);
+    }
+
+    g_debug("Saved %d sessions in %.1f ms", n_pages, (g_get_monotonic_time() - start_time) / 1000.0);
+
+out:
+    g_hash_table_unref(referenced);
+    g_key_file_free(file);
+    g_free(state_path);
+    g_free(state_dir);
+
+    return saved;
+}
+
+/*
+ * Describe a single session the way it would be saved, but without its scrollback, for the journal
+ */
+gchar *stulto_session_state_describe(StultoSession *session) {
+    GKeyFile *file = g_key_file_new();
+    GtkWidget *notebook = gtk_widget_get_parent(GTK_WIDGET(session));
+    const gchar *name = GTK_IS_NOTEBOOK(notebook)
+            ? gtk_notebook_get_tab_label_text(GTK_NOTEBOOK(notebook), GTK_WIDGET(session))
+            : NULL;
+    const StultoWorkspaceSession *pending = stulto_session_get_pending(session);
+
+    g_key_file_set_string(file, "session:s0", "name", name != NULL ? name : "");
+
+    /* Without a default profile, every pane names its own */
+    if (pending != NULL) {
+        write_pending_session(file, 0, pending, NULL, NULL);
+    } else {
+        write_session(file, 0, session, NULL, NULL, 0, NULL);
+    }
+
+    gchar *data = g_key_file_to_data(file, NULL, NULL);
+
+    g_key_file_free(file);
+
+    return data;
+}
+
+/*
+ * Describe every session the way it would be saved, but without scrollback, for the PTY holder
+ */
+gchar *stulto_session_state_describe_all(StultoSessionManager *session_manager,
+                                         StultoTerminalProfile *default_profile) {
+    GKeyFile *file = g_key_file_new();
+
+    write_sessions(file, session_manager, default_profile, NULL, 0, NULL);
+
+    gchar *data = g_key_file_to_data(file, NULL, NULL);
+
+    g_key_file_free(file);
+
+    return data;
+}
+
+// endregion
+
+// region Restoring
+
+gboolean stulto_session_state_exists() {
+    gchar *state_path = get_state_path();
+    gboolean exists = g_file_test(state_path, G_FILE_TEST_IS_REGULAR);
+
+    g_free(state_path);
+
+    return exists;
+}
+
+/*
+ * Reopen the saved sessions; the state is used up, so that quitting without saving again doesn't bring them back
+ */
+gboolean stulto_session_state_restore(StultoSessionManager *session_manager,
+                                      StultoTerminalProfile *default_profile,
+                                      GError **error) {
+    gchar *state_path = get_state_path();
+    gint64 start_time = g_get_monotonic_time();
+    StultoWorkspace *workspace = stulto_workspace_load(state_path, error);
+
+    if (workspace == NULL) {
+        g_free(state_path);
+        return FALSE;
+    }
+
+    stulto_session_manager_add_workspace(session_manager, workspace, default_profile);
+
+    gchar *peak_rss = get_peak_rss();
+
+    g_debug("Restored %u sessions in %.1f ms, peak RSS %s",
+            workspace->sessions->len, (g_get_monotonic_time() - start_time) / 1000.0,
+            peak_rss != NULL ? peak_rss : "unknown");
+
+    g_unlink(state_path);
+
+    g_free(peak_rss);
+    stulto_workspace_free(workspace);
+    g_free(state_path);
+
+    return TRUE;
+}
+
+// endregion
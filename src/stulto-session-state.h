@@ -0,0 +1,51 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_SESSION_STATE_H
+#define STULTO_SESSION_STATE_H
+
+#include <gtk/gtk.h>
+
+#include "stulto-session-manager.h"
+
+/*
+ * Saved sessions, kept across restarts in the user's data directory (stulto/state)
+ *
+ * The state is itself a workspace file, listing every session's panes with their commands, working directories,
+ * profiles and layout, and a scrollback file per pane. Scrollback is saved as ANSI text with CRLF line endings,
+ * uncompressed, so that restoring it is a matter of mapping the file and feeding it to the terminal as it is
+ *
+ * Sessions are restored lazily: only the selected one is started, and the rest map their scrollback once shown
+ */
+
+gchar *stulto_session_state_get_dir();
+gboolean stulto_session_state_exists();
+
+gboolean stulto_session_state_save(StultoSessionManager *session_manager,
+                                   StultoTerminalProfile *default_profile,
+                                   GError **error);
+gboolean stulto_session_state_restore(StultoSessionManager *session_manager,
+                                      StultoTerminalProfile *default_profile,
+                                      GError **error);
+
+gchar *stulto_session_state_describe(StultoSession *session);
+gchar *stulto_session_state_describe_all(StultoSessionManager *session_manager,
+                                         StultoTerminalProfile *default_profile);
+
+#endif //STULTO_SESSION_STATE_H
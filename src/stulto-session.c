@@ -18,11 +18,38 @@
  */
 
 #include "stulto-session.h"
+#include "stulto-search.h"
+#include "stulto-tiles.h"
+#include "stulto-journal.h"
+#include "stulto-session-state.h"
 
 struct _StultoSession {
     GtkBin parent_instance;
 
     StultoTerminal *active_terminal;
+
+    GtkBox *box;
+    StultoTiles *tiles;
+    GtkSearchBar *search_bar;
+    GtkSearchEntry *search_entry;
+    GtkLabel *search_count_label;
+
+    StultoSearch *search;
+
+    /* The panes to create once the session is first needed, for lazy sessions */
+    StultoWorkspaceSession *pending;
+    StultoTerminalProfile *default_profile;
+
+    StultoJournalLog *journal_log;
+    guint journal_layout_source;
+
+    StultoActivity *activity;
+
+    /* The last two samples of the terminals' process trees' usage, with when they were taken */
+    StultoResourceUsage usage;
+    StultoResourceUsage previous_usage;
+    gint64 usage_time_ms;
+    gint64 previous_usage_time_ms;
 };
 
 G_DEFINE_FINAL_TYPE(StultoSession, stulto_session, GTK_TYPE_BIN)
@@ -30,6 +57,10 @@ G_DEFINE_FINAL_TYPE(StultoSession, stulto_session, GTK_TYPE_BIN)
 enum {
     PROP_0,
     PROP_ACTIVE_TERMINAL,
+    PROP_FOREGROUND,
+    PROP_TITLE,
+    PROP_CWD,
+    PROP_ACTIVITY,
     N_PROPERTIES
 };
 
@@ -45,16 +76,310 @@ static void stulto_session_get_property(GObject *object, guint prop_id, GValue *
 static void stulto_session_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
 
 StultoSession *stulto_session_new(StultoTerminal *terminal);
+StultoSession *stulto_session_new_lazy(StultoWorkspaceSession *workspace_session, StultoTerminalProfile *default_profile);
+
+gboolean stulto_session_is_lazy(StultoSession *session);
+void stulto_session_materialize(StultoSession *session);
 
 /* Getters & setters */
 StultoTerminal *stulto_session_get_active_terminal(StultoSession *session);
 void stulto_session_set_active_terminal(StultoSession *session, StultoTerminal *terminal);
 
+GList *stulto_session_get_terminals(StultoSession *session);
+const gchar *stulto_session_get_foreground(StultoSession *session);
+const gchar *stulto_session_get_title(StultoSession *session);
+gchar *stulto_session_get_cwd(StultoSession *session);
+gboolean stulto_session_is_busy(StultoSession *session);
+StultoActivityState stulto_session_get_activity(StultoSession *session);
+void stulto_session_set_resource_usage(StultoSession *session, const StultoResourceUsage *usage, gint64 time_ms);
+const StultoResourceUsage *stulto_session_get_resource_usage(StultoSession *session);
+gchar *stulto_session_describe_resource_usage(StultoSession *session);
+StultoTerminal *stulto_session_find_terminal_by_index_id(StultoSession *session, guint index_id);
+GArray *stulto_session_get_layout(StultoSession *session);
+gint stulto_session_count_panes(StultoSession *session, GtkOrientation orientation);
+const StultoWorkspaceSession *stulto_session_get_pending(StultoSession *session);
+
+void stulto_session_split(StultoSession *session, StultoTerminal *terminal, GtkOrientation orientation);
+gboolean stulto_session_remove_terminal(StultoSession *session, StultoTerminal *terminal);
+void stulto_session_focus_neighbor(StultoSession *session, GtkDirectionType direction);
+void stulto_session_resize_active(StultoSession *session, GtkDirectionType direction, gint cells);
+void stulto_session_toggle_zoom(StultoSession *session);
+void stulto_session_toggle_broadcast(StultoSession *session);
+
+void stulto_session_start_search(StultoSession *session);
+void stulto_session_search_for(StultoSession *session, const gchar *text, gint nth_from_end);
+
+/* Helpers */
+static void update_cell_size(StultoSession *session);
+static void set_active(StultoSession *session, StultoTerminal *terminal, gboolean grab_focus);
+static void queue_journal_layout(StultoSession *session);
+
+// endregion
+
+// region Callbacks
+
+static gboolean terminal_focus_in_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
+    StultoSession *session = data;
+    GtkWidget *terminal = gtk_widget_get_ancestor(widget, STULTO_TYPE_TERMINAL);
+
+    if (terminal != NULL) {
+        set_active(session, STULTO_TERMINAL(terminal), FALSE);
+    }
+
+    return FALSE;
+}
+
+static void terminal_char_size_changed_cb(VteTerminal *terminal_widget, guint width, guint height, gpointer data) {
+    StultoSession *session = data;
+
+    if (session->active_terminal != NULL &&
+        stulto_terminal_get_terminal_widget(session->active_terminal) == terminal_widget) {
+        update_cell_size(session);
+    }
+}
+
+static void terminal_directory_changed_cb(VteTerminal *terminal_widget, gpointer data) {
+    StultoSession *session = data;
+
+    queue_journal_layout(session);
+
+    if (session->active_terminal != NULL &&
+        stulto_terminal_get_terminal_widget(session->active_terminal) == terminal_widget) {
+        g_object_notify_by_pspec(G_OBJECT(session), obj_properties[PROP_CWD]);
+    }
+}
+
+/*
+ * The session's foreground and title follow its active terminal's
+ */
+static void terminal_notify_cb(GObject *object, GParamSpec *pspec, gpointer data) {
+    StultoSession *session = data;
+
+    if (STULTO_TERMINAL(object) != session->active_terminal) {
+        return;
+    }
+
+    if (g_str_equal(pspec->name, "foreground")) {
+        g_object_notify_by_pspec(G_OBJECT(session), obj_properties[PROP_FOREGROUND]);
+    } else if (g_str_equal(pspec->name, "title")) {
+        g_object_notify_by_pspec(G_OBJECT(session), obj_properties[PROP_TITLE]);
+    }
+}
+
+static void activity_changed_cb(StultoActivityState state, gpointer data) {
+    StultoSession *session = data;
+
+    g_object_notify_by_pspec(G_OBJECT(session), obj_properties[PROP_ACTIVITY]);
+}
+
+/* Hidden sessions are unmapped by the notebook */
+static void map_cb(GtkWidget *widget, gpointer data) {
+    StultoSession *session = STULTO_SESSION(widget);
+
+    if (session->activity != NULL) {
+        stulto_activity_set_watched(session->activity, TRUE);
+    }
+}
+
+static void unmap_cb(GtkWidget *widget, gpointer data) {
+    StultoSession *session = STULTO_SESSION(widget);
+
+    if (session->activity != NULL) {
+        stulto_activity_set_watched(session->activity, FALSE);
+    }
+}
+
+static gboolean journal_layout_cb(gpointer data) {
+    StultoSession *session = data;
+    gchar *layout = stulto_session_state_describe(session);
+
+    session->journal_layout_source = 0;
+
+    stulto_journal_set_layout(session->journal_log, layout);
+
+    g_free(layout);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void search_count_cb(gint current, gint total, gboolean complete, gpointer data) {
+    StultoSession *session = data;
+    const gchar *ellipsis = complete ? "" : "\u2026";
+    gchar *text;
+
+    if (complete && total == 0) {
+        text = g_strdup(gtk_entry_get_text(GTK_ENTRY(session->search_entry))[0] ? "No matches" : "");
+    } else if (current > 0) {
+        text = g_strdup_printf("%d of %d%s", current, total, ellipsis);
+    } else {
+        text = g_strdup_printf("%d matches%s", total, ellipsis);
+    }
+
+    gtk_label_set_text(session->search_count_label, text);
+
+    g_free(text);
+}
+
+static void search_changed_cb(GtkSearchEntry *entry, gpointer data) {
+    StultoSession *session = data;
+    GError *error = NULL;
+
+    if (session->search == NULL) {
+        return;
+    }
+
+    if (!stulto_search_set_text(session->search, gtk_entry_get_text(GTK_ENTRY(entry)), &error)) {
+        gtk_label_set_text(session->search_count_label, error->message);
+        g_error_free(error);
+    }
+}
+
+static void search_previous_cb(GtkWidget *widget, gpointer data) {
+    StultoSession *session = data;
+
+    if (session->search != NULL) {
+        stulto_search_find(session->search, TRUE);
+    }
+}
+
+static void search_next_cb(GtkWidget *widget, gpointer data) {
+    StultoSession *session = data;
+
+    if (session->search != NULL) {
+        stulto_search_find(session->search, FALSE);
+    }
+}
+
+static void search_mode_enabled_cb(GObject *object, GParamSpec *pspec, gpointer data) {
+    StultoSession *session = data;
+
+    if (gtk_search_bar_get_search_mode(session->search_bar)) {
+        return;
+    }
+
+    g_clear_pointer(&session->search, stulto_search_free);
+    gtk_label_set_text(session->search_count_label, "");
+
+    if (session->active_terminal != NULL) {
+        gtk_widget_grab_focus(GTK_WIDGET(stulto_terminal_get_terminal_widget(session->active_terminal)));
+    }
+}
+
+// endregion
+
+// region Helpers
+
+/*
+ * Panes are snapped to the active terminal's cells, plus its padding
+ */
+static void update_cell_size(StultoSession *session) {
+    VteTerminal *terminal_widget = stulto_terminal_get_terminal_widget(session->active_terminal);
+    GtkStyleContext *style_context = gtk_widget_get_style_context(GTK_WIDGET(terminal_widget));
+    GtkBorder padding;
+
+    gtk_style_context_get_padding(style_context, gtk_style_context_get_state(style_context), &padding);
+
+    stulto_tiles_set_cell_size(
+            session->tiles,
+            (gint) vte_terminal_get_char_width(terminal_widget),
+            (gint) vte_terminal_get_char_height(terminal_widget),
+            padding.left + padding.right,
+            padding.top + padding.bottom);
+}
+
+static void attach_search(StultoSession *session) {
+    g_clear_pointer(&session->search, stulto_search_free);
+
+    session->search = stulto_search_new(
+            stulto_terminal_get_terminal_widget(session->active_terminal),
+            search_count_cb,
+            session);
+
+    /* Pick up any text left in the entry from the last search */
+    search_changed_cb(session->search_entry, session);
+}
+
+/*
+ * Journal the layout once the current round of changes is done
+ */
+static void queue_journal_layout(StultoSession *session) {
+    if (session->journal_log != NULL && session->journal_layout_source == 0) {
+        session->journal_layout_source = g_idle_add(journal_layout_cb, session);
+    }
+}
+
+static void connect_terminal(StultoSession *session, StultoTerminal *terminal) {
+    VteTerminal *terminal_widget = stulto_terminal_get_terminal_widget(terminal);
+
+    g_signal_connect_object(terminal_widget, "focus-in-event", G_CALLBACK(terminal_focus_in_cb), session, 0);
+    g_signal_connect_object(terminal_widget, "char-size-changed", G_CALLBACK(terminal_char_size_changed_cb), session, 0);
+    g_signal_connect_object(terminal_widget, "current-directory-uri-changed", G_CALLBACK(terminal_directory_changed_cb), session, 0);
+    g_signal_connect_object(terminal, "notify::foreground", G_CALLBACK(terminal_notify_cb), session, 0);
+    g_signal_connect_object(terminal, "notify::title", G_CALLBACK(terminal_notify_cb), session, 0);
+
+    stulto_terminal_set_journal_log(terminal, session->journal_log);
+    stulto_terminal_set_activity(terminal, session->activity);
+    queue_journal_layout(session);
+}
+
+static void set_active(StultoSession *session, StultoTerminal *terminal, gboolean grab_focus) {
+    if (session->active_terminal != terminal) {
+        session->active_terminal = terminal;
+
+        update_cell_size(session);
+
+        /* The search bar follows the active pane */
+        if (session->search != NULL) {
+            attach_search(session);
+        }
+
+        g_object_notify_by_pspec(G_OBJECT(session), obj_properties[PROP_ACTIVE_TERMINAL]);
+        g_object_notify_by_pspec(G_OBJECT(session), obj_properties[PROP_FOREGROUND]);
+        g_object_notify_by_pspec(G_OBJECT(session), obj_properties[PROP_TITLE]);
+        g_object_notify_by_pspec(G_OBJECT(session), obj_properties[PROP_CWD]);
+    }
+
+    if (grab_focus) {
+        gtk_widget_grab_focus(GTK_WIDGET(stulto_terminal_get_terminal_widget(terminal)));
+    }
+}
+
 // endregion
 
 // region GObject/GtkWidget lifecycle
 
 static void stulto_session_dispose(GObject *object) {
+    StultoSession *session = STULTO_SESSION(object);
+
+    g_clear_pointer(&session->search, stulto_search_free);
+    g_clear_pointer(&session->pending, stulto_workspace_session_free);
+
+    if (session->activity != NULL) {
+        GList *terminals = stulto_session_get_terminals(session);
+
+        for (GList *l = terminals; l != NULL; l = l->next) {
+            stulto_terminal_set_activity(l->data, NULL);
+        }
+        g_list_free(terminals);
+
+        g_clear_pointer(&session->activity, stulto_activity_free);
+    }
+
+    if (session->journal_log != NULL) {
+        GList *terminals = stulto_session_get_terminals(session);
+
+        for (GList *l = terminals; l != NULL; l = l->next) {
+            stulto_terminal_set_journal_log(l->data, NULL);
+        }
+        g_list_free(terminals);
+
+        if (session->journal_layout_source != 0) {
+            g_source_remove(session->journal_layout_source);
+            session->journal_layout_source = 0;
+        }
+        g_clear_pointer(&session->journal_log, stulto_journal_close_log);
+    }
+
     G_OBJECT_CLASS(stulto_session_parent_class)->dispose(object);
 }
 
@@ -70,6 +395,18 @@ static void stulto_session_get_property(GObject *object, guint prop_id, GValue *
         case PROP_ACTIVE_TERMINAL:
             g_value_set_object(value, STULTO_TERMINAL(stulto_session_get_active_terminal(session)));
             break;
+        case PROP_FOREGROUND:
+            g_value_set_string(value, stulto_session_get_foreground(session));
+            break;
+        case PROP_TITLE:
+            g_value_set_string(value, stulto_session_get_title(session));
+            break;
+        case PROP_CWD:
+            g_value_take_string(value, stulto_session_get_cwd(session));
+            break;
+        case PROP_ACTIVITY:
+            g_value_set_int(value, stulto_session_get_activity(session));
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
             break;
@@ -103,13 +440,96 @@ static void stulto_session_class_init(StultoSessionClass *klass) {
             "active-terminal",
             "The session's active terminal widget",
             STULTO_TYPE_TERMINAL,
-            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+            G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+    obj_properties[PROP_FOREGROUND] = g_param_spec_string(
+            "foreground",
+            "foreground",
+            "The name of the active terminal's foreground process",
+            NULL,
+            G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+    obj_properties[PROP_TITLE] = g_param_spec_string(
+            "title",
+            "title",
+            "The active terminal's window title",
+            NULL,
+            G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+    obj_properties[PROP_CWD] = g_param_spec_string(
+            "cwd",
+            "cwd",
+            "The active terminal's working directory",
+            NULL,
+            G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+    obj_properties[PROP_ACTIVITY] = g_param_spec_int(
+            "activity",
+            "activity",
+            "What the session has been up to while hidden, as a StultoActivityState",
+            STULTO_ACTIVITY_NONE,
+            STULTO_ACTIVITY_BELL,
+            STULTO_ACTIVITY_NONE,
+            G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
 
     g_object_class_install_properties(object_class, N_PROPERTIES, obj_properties);
 }
 
 static void stulto_session_init(StultoSession *session) {
-    // Nothing to do here
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+
+    /* Search bar: entry, match count, previous/next buttons */
+    GtkWidget *search_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+
+    GtkWidget *search_entry = gtk_search_entry_new();
+    gtk_entry_set_width_chars(GTK_ENTRY(search_entry), 30);
+    gtk_box_pack_start(GTK_BOX(search_box), search_entry, FALSE, FALSE, 0);
+
+    GtkWidget *search_count_label = gtk_label_new(NULL);
+    gtk_label_set_width_chars(GTK_LABEL(search_count_label), 14);
+    gtk_box_pack_start(GTK_BOX(search_box), search_count_label, FALSE, FALSE, 0);
+
+    GtkWidget *previous_button = gtk_button_new_from_icon_name("go-up-symbolic", GTK_ICON_SIZE_BUTTON);
+    gtk_widget_set_tooltip_text(previous_button, "Previous match (Enter)");
+    gtk_box_pack_start(GTK_BOX(search_box), previous_button, FALSE, FALSE, 0);
+
+    GtkWidget *next_button = gtk_button_new_from_icon_name("go-down-symbolic", GTK_ICON_SIZE_BUTTON);
+    gtk_widget_set_tooltip_text(next_button, "Next match (Ctrl+g)");
+    gtk_box_pack_start(GTK_BOX(search_box), next_button, FALSE, FALSE, 0);
+
+    GtkWidget *search_bar = gtk_search_bar_new();
+    gtk_search_bar_set_show_close_button(GTK_SEARCH_BAR(search_bar), TRUE);
+    gtk_search_bar_connect_entry(GTK_SEARCH_BAR(search_bar), GTK_ENTRY(search_entry));
+    gtk_container_add(GTK_CONTAINER(search_bar), search_box);
+    gtk_box_pack_start(GTK_BOX(box), search_bar, FALSE, FALSE, 0);
+
+    GtkWidget *tiles = GTK_WIDGET(stulto_tiles_new());
+    gtk_box_pack_start(GTK_BOX(box), tiles, TRUE, TRUE, 0);
+
+    gtk_container_add(GTK_CONTAINER(session), box);
+
+    session->box = GTK_BOX(box);
+    session->tiles = STULTO_TILES(tiles);
+    session->search_bar = GTK_SEARCH_BAR(search_bar);
+    session->search_entry = GTK_SEARCH_ENTRY(search_entry);
+    session->search_count_label = GTK_LABEL(search_count_label);
+
+    if (stulto_journal_get_default() != NULL) {
+        session->journal_log = stulto_journal_open_log(stulto_journal_get_default());
+    }
+
+    session->activity = stulto_activity_new(activity_changed_cb, session);
+
+    g_signal_connect(session, "map", G_CALLBACK(map_cb), NULL);
+    g_signal_connect(session, "unmap", G_CALLBACK(unmap_cb), NULL);
+
+    g_signal_connect(search_entry, "search-changed", G_CALLBACK(search_changed_cb), session);
+    g_signal_connect(search_entry, "activate", G_CALLBACK(search_previous_cb), session);
+    g_signal_connect(search_entry, "previous-match", G_CALLBACK(search_previous_cb), session);
+    g_signal_connect(search_entry, "next-match", G_CALLBACK(search_next_cb), session);
+    g_signal_connect(previous_button, "clicked", G_CALLBACK(search_previous_cb), session);
+    g_signal_connect(next_button, "clicked", G_CALLBACK(search_next_cb), session);
+    g_signal_connect(search_bar, "notify::search-mode-enabled", G_CALLBACK(search_mode_enabled_cb), session);
 }
 
 StultoSession *stulto_session_new(StultoTerminal *terminal)
@@ -120,11 +540,100 @@ StultoSession *stulto_session_new(StultoTerminal *terminal)
             NULL
     ));
 
-    session->active_terminal = terminal;
+    return session;
+}
+
+/*
+ * A session which only creates and starts its terminals once it is first shown, or otherwise needed; it takes over
+ * the workspace session
+ */
+StultoSession *stulto_session_new_lazy(StultoWorkspaceSession *workspace_session, StultoTerminalProfile *default_profile) {
+    StultoSession *session = STULTO_SESSION(g_object_new(STULTO_TYPE_SESSION, NULL));
+
+    session->pending = workspace_session;
+    session->default_profile = default_profile;
+
+    queue_journal_layout(session);
 
     return session;
 }
 
+gboolean stulto_session_is_lazy(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), FALSE);
+
+    return session->pending != NULL;
+}
+
+/*
+ * Create a lazy session's terminals and start their children, all at once
+ */
+void stulto_session_materialize(StultoSession *session) {
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    if (session->pending == NULL) {
+        return;
+    }
+
+    StultoWorkspaceSession *pending = session->pending;
+    GPtrArray *panes = pending->panes;
+    GHashTable *terminals_by_name = g_hash_table_new(g_str_hash, g_str_equal);
+    StultoTerminal *previous = NULL;
+    gint64 start_time = g_get_monotonic_time();
+
+    session->pending = NULL;
+
+    for (guint i = 0; i < panes->len; i++) {
+        StultoWorkspacePane *pane = g_ptr_array_index(panes, i);
+        StultoTerminal *terminal = stulto_terminal_new(
+                pane->profile != NULL ? pane->profile : session->default_profile,
+                g_steal_pointer(&pane->exec_data));
+        StultoTerminal *sibling = previous;
+        GError *error = NULL;
+
+        if (pane->parent != NULL) {
+            sibling = g_hash_table_lookup(terminals_by_name, pane->parent);
+
+            if (sibling == NULL) {
+                g_printerr("Pane '%s' must follow its parent '%s'\n", pane->name, pane->parent);
+                sibling = previous;
+            }
+        }
+
+        if (previous == NULL) {
+            stulto_session_set_active_terminal(session, terminal);
+        } else {
+            stulto_tiles_split(session->tiles, GTK_WIDGET(sibling), GTK_WIDGET(terminal), pane->split);
+            stulto_tiles_set_ratio(session->tiles, GTK_WIDGET(terminal), pane->ratio);
+            connect_terminal(session, terminal);
+        }
+
+        /* Before the program starts, so its output follows */
+        if (pane->scrollback_path != NULL && !stulto_terminal_load_history(terminal, pane->scrollback_path, &error)) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+        }
+
+        g_hash_table_insert(terminals_by_name, pane->name, terminal);
+        previous = terminal;
+    }
+
+    g_hash_table_unref(terminals_by_name);
+
+    GList *terminals = stulto_session_get_terminals(session);
+
+    for (GList *l = terminals; l != NULL; l = l->next) {
+        gtk_widget_show_all(GTK_WIDGET(l->data));
+        stulto_terminal_spawn(l->data);
+    }
+
+    g_list_free(terminals);
+
+    g_debug("Materialized session %s (%u panes) in %.1f ms",
+            pending->name, panes->len, (g_get_monotonic_time() - start_time) / 1000.0);
+
+    stulto_workspace_session_free(pending);
+}
+
 // endregion
 
 // region Properties
@@ -133,10 +642,336 @@ StultoTerminal *stulto_session_get_active_terminal(StultoSession *session) {
     return session->active_terminal;
 }
 
+/*
+ * Make one of the session's terminals the active one and focus it; a terminal not in the session yet becomes its
+ * first pane
+ */
 void stulto_session_set_active_terminal(StultoSession *session, StultoTerminal *terminal) {
-    session->active_terminal = terminal;
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    if (gtk_widget_get_parent(GTK_WIDGET(terminal)) == NULL) {
+        g_return_if_fail(session->active_terminal == NULL);
+
+        gtk_container_add(GTK_CONTAINER(session->tiles), GTK_WIDGET(terminal));
+        connect_terminal(session, terminal);
+    }
+
+    set_active(session, terminal, TRUE);
+}
+
+/*
+ * The session's terminals, in layout order; free the list with g_list_free
+ */
+GList *stulto_session_get_terminals(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), NULL);
+
+    return gtk_container_get_children(GTK_CONTAINER(session->tiles));
+}
+
+/*
+ * The name of the active terminal's foreground process, or NULL if unknown
+ */
+const gchar *stulto_session_get_foreground(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), NULL);
+
+    if (session->active_terminal == NULL) {
+        return NULL;
+    }
+
+    return stulto_terminal_get_foreground(session->active_terminal, NULL);
+}
+
+/*
+ * The active terminal's window title, or NULL if it has none
+ */
+const gchar *stulto_session_get_title(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), NULL);
+
+    if (session->active_terminal == NULL) {
+        return NULL;
+    }
+
+    return vte_terminal_get_window_title(stulto_terminal_get_terminal_widget(session->active_terminal));
+}
+
+/*
+ * The active terminal's working directory (see stulto_terminal_get_cwd), or NULL
+ */
+gchar *stulto_session_get_cwd(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), NULL);
+
+    if (session->active_terminal == NULL) {
+        return NULL;
+    }
+
+    return stulto_terminal_get_cwd(session->active_terminal);
+}
+
+/*
+ * What the session has been up to since it was last shown
+ */
+StultoActivityState stulto_session_get_activity(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), STULTO_ACTIVITY_NONE);
+
+    return session->activity != NULL ? stulto_activity_get_state(session->activity) : STULTO_ACTIVITY_NONE;
+}
+
+/*
+ * Whether any of the session's terminals is running something besides its shell
+ */
+gboolean stulto_session_is_busy(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), FALSE);
+
+    GList *terminals = stulto_session_get_terminals(session);
+    gboolean busy = FALSE;
+
+    for (GList *l = terminals; l != NULL && !busy; l = l->next) {
+        busy = stulto_terminal_is_busy(STULTO_TERMINAL(l->data));
+    }
+
+    g_list_free(terminals);
+
+    return busy;
+}
+
+/*
+ * Record a new sample of what the session's process trees use; rates are worked out against the one before
+ */
+void stulto_session_set_resource_usage(StultoSession *session, const StultoResourceUsage *usage, gint64 time_ms) {
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    session->previous_usage = session->usage;
+    session->previous_usage_time_ms = session->usage_time_ms;
+    session->usage = *usage;
+    session->usage_time_ms = time_ms;
+}
+
+const StultoResourceUsage *stulto_session_get_resource_usage(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), NULL);
+
+    return &session->usage;
+}
+
+/*
+ * A summary of the session's latest resource usage (see stulto_resources_format), or NULL before there are two samples
+ */
+gchar *stulto_session_describe_resource_usage(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), NULL);
+
+    if (session->previous_usage_time_ms == 0) {
+        return NULL;
+    }
+
+    return stulto_resources_format(
+            &session->usage,
+            &session->previous_usage,
+            session->usage_time_ms - session->previous_usage_time_ms);
+}
+
+/*
+ * The terminal which feeds the given search index source, or NULL if it isn't in this session
+ */
+StultoTerminal *stulto_session_find_terminal_by_index_id(StultoSession *session, guint index_id) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), NULL);
+
+    GList *terminals = stulto_session_get_terminals(session);
+    StultoTerminal *found = NULL;
+
+    for (GList *l = terminals; l != NULL && found == NULL; l = l->next) {
+        if (stulto_terminal_get_search_index_id(l->data) == index_id) {
+            found = l->data;
+        }
+    }
+
+    g_list_free(terminals);
+
+    return found;
+}
+
+/*
+ * How to rebuild the session's layout, of StultoTilesStep with StultoTerminals for widgets
+ */
+GArray *stulto_session_get_layout(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), NULL);
+
+    return stulto_tiles_get_steps(session->tiles);
+}
+
+/*
+ * The most panes across the session in an orientation, as laid out now
+ */
+gint stulto_session_count_panes(StultoSession *session, GtkOrientation orientation) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), 0);
+
+    return stulto_tiles_count_panes(session->tiles, orientation);
+}
+
+/*
+ * What a lazy session will create once it is needed, or NULL
+ */
+const StultoWorkspaceSession *stulto_session_get_pending(StultoSession *session) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), NULL);
+
+    return session->pending;
+}
+
+/*
+ * Split the active terminal's pane, putting a new terminal beside it (horizontal) or below it (vertical)
+ */
+void stulto_session_split(StultoSession *session, StultoTerminal *terminal, GtkOrientation orientation) {
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    stulto_session_materialize(session);
+
+    stulto_tiles_split(session->tiles, GTK_WIDGET(session->active_terminal), GTK_WIDGET(terminal), orientation);
+    connect_terminal(session, terminal);
+
+    gtk_widget_show_all(GTK_WIDGET(terminal));
+    set_active(session, terminal, TRUE);
+}
+
+/*
+ * Close a terminal's pane, unless it is the session's last one; returns whether it was removed
+ */
+gboolean stulto_session_remove_terminal(StultoSession *session, StultoTerminal *terminal) {
+    g_return_val_if_fail(STULTO_IS_SESSION(session), FALSE);
+
+    GList *terminals = stulto_session_get_terminals(session);
+    guint n_terminals = g_list_length(terminals);
+    StultoTerminal *next_active = NULL;
+
+    g_list_free(terminals);
+
+    if (n_terminals < 2) {
+        return FALSE;
+    }
+
+    gboolean was_active = session->active_terminal == terminal;
+
+    if (was_active) {
+        /* Prefer a pane next to it, which takes over some of its space */
+        for (GtkDirectionType direction = GTK_DIR_UP; next_active == NULL && direction <= GTK_DIR_RIGHT; direction++) {
+            next_active = STULTO_TERMINAL(stulto_tiles_get_neighbor(session->tiles, GTK_WIDGET(terminal), direction));
+        }
+
+        session->active_terminal = NULL;
+    }
+
+    stulto_terminal_set_journal_log(terminal, NULL);
+    stulto_terminal_set_activity(terminal, NULL);
+    gtk_container_remove(GTK_CONTAINER(session->tiles), GTK_WIDGET(terminal));
+    queue_journal_layout(session);
+
+    if (was_active && session->active_terminal == NULL) {
+        if (next_active == NULL) {
+            terminals = stulto_session_get_terminals(session);
+            next_active = terminals->data;
+            g_list_free(terminals);
+        }
+
+        set_active(session, next_active, TRUE);
+    }
+
+    return TRUE;
+}
+
+void stulto_session_focus_neighbor(StultoSession *session, GtkDirectionType direction) {
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    stulto_session_materialize(session);
+
+    GtkWidget *neighbor = stulto_tiles_get_neighbor(session->tiles, GTK_WIDGET(session->active_terminal), direction);
+
+    if (neighbor != NULL) {
+        stulto_tiles_set_zoomed(session->tiles, NULL);
+        set_active(session, STULTO_TERMINAL(neighbor), TRUE);
+    }
+}
+
+/*
+ * Move the edge of the active terminal's pane, by whole cells
+ */
+void stulto_session_resize_active(StultoSession *session, GtkDirectionType direction, gint cells) {
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    stulto_session_materialize(session);
+
+    stulto_tiles_resize(session->tiles, GTK_WIDGET(session->active_terminal), direction, cells);
+    queue_journal_layout(session);
+}
+
+/*
+ * Let the active terminal fill the whole session, or put it back in its pane
+ */
+void stulto_session_toggle_zoom(StultoSession *session) {
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    stulto_session_materialize(session);
+
+    gboolean zoomed = stulto_tiles_get_zoomed(session->tiles) != NULL;
+
+    stulto_tiles_set_zoomed(session->tiles, zoomed ? NULL : GTK_WIDGET(session->active_terminal));
+}
+
+/*
+ * Put all the session's terminals in the broadcast group, or take them all out if they already are
+ */
+void stulto_session_toggle_broadcast(StultoSession *session) {
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    stulto_session_materialize(session);
+
+    GList *terminals = stulto_session_get_terminals(session);
+    gboolean all = TRUE;
+
+    for (GList *l = terminals; l != NULL && all; l = l->next) {
+        all = stulto_terminal_get_broadcast(STULTO_TERMINAL(l->data));
+    }
+
+    for (GList *l = terminals; l != NULL; l = l->next) {
+        stulto_terminal_set_broadcast(STULTO_TERMINAL(l->data), !all);
+    }
+
+    g_list_free(terminals);
+}
+
+/*
+ * Open the search bar over the active terminal, or focus it again if it is already open
+ */
+void stulto_session_start_search(StultoSession *session) {
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    stulto_session_materialize(session);
+
+    gtk_search_bar_set_search_mode(session->search_bar, TRUE);
+    gtk_widget_grab_focus(GTK_WIDGET(session->search_entry));
+
+    if (session->search == NULL) {
+        attach_search(session);
+    }
+}
+
+/*
+ * Search for text and select one particular match, counting back from the most recent one
+ */
+void stulto_session_search_for(StultoSession *session, const gchar *text, gint nth_from_end) {
+    g_return_if_fail(STULTO_IS_SESSION(session));
+
+    stulto_session_materialize(session);
+
+    VteTerminal *terminal_widget = stulto_terminal_get_terminal_widget(session->active_terminal);
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal_widget));
+
+    /* The search starts from the bottom of the view */
+    gtk_adjustment_set_value(adjustment, gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_page_size(adjustment));
+
+    stulto_session_start_search(session);
+
+    /* The entry's own (delayed) change notification then finds the search already running */
+    gtk_entry_set_text(GTK_ENTRY(session->search_entry), text);
+    stulto_search_set_text(session->search, text, NULL);
 
-    gtk_container_add(GTK_CONTAINER(session), GTK_WIDGET(terminal));
+    stulto_search_find_repeat(session->search, TRUE, nth_from_end - 1);
 }
 
 // endregion
@@ -22,10 +22,14 @@
 
 #include <gtk/gtk.h>
 #include "stulto-terminal.h"
+#include "stulto-workspace.h"
+#include "stulto-tiles.h"
+#include "stulto-resources.h"
 
 /**
  * A container type that hosts multiple terminal sessions as tiled widgets
- * WIP - currently only hosts a single session
+ *
+ * One of the terminals is active: it has the focus, new panes split its space, and the search bar searches it
  */
 
 G_BEGIN_DECLS
@@ -34,10 +38,38 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE(StultoSession, stulto_session, STULTO, SESSION, GtkBin)
 
 StultoSession *stulto_session_new(StultoTerminal *terminal);
+StultoSession *stulto_session_new_lazy(StultoWorkspaceSession *workspace_session, StultoTerminalProfile *default_profile);
+
+gboolean stulto_session_is_lazy(StultoSession *session);
+void stulto_session_materialize(StultoSession *session);
 
 StultoTerminal *stulto_session_get_active_terminal(StultoSession *session);
 void stulto_session_set_active_terminal(StultoSession *session, StultoTerminal *terminal);
 
+GList *stulto_session_get_terminals(StultoSession *session);
+const gchar *stulto_session_get_foreground(StultoSession *session);
+const gchar *stulto_session_get_title(StultoSession *session);
+gchar *stulto_session_get_cwd(StultoSession *session);
+gboolean stulto_session_is_busy(StultoSession *session);
+StultoActivityState stulto_session_get_activity(StultoSession *session);
+void stulto_session_set_resource_usage(StultoSession *session, const StultoResourceUsage *usage, gint64 time_ms);
+const StultoResourceUsage *stulto_session_get_resource_usage(StultoSession *session);
+gchar *stulto_session_describe_resource_usage(StultoSession *session);
+StultoTerminal *stulto_session_find_terminal_by_index_id(StultoSession *session, guint index_id);
+GArray *stulto_session_get_layout(StultoSession *session);
+gint stulto_session_count_panes(StultoSession *session, GtkOrientation orientation);
+const StultoWorkspaceSession *stulto_session_get_pending(StultoSession *session);
+
+void stulto_session_split(StultoSession *session, StultoTerminal *terminal, GtkOrientation orientation);
+gboolean stulto_session_remove_terminal(StultoSession *session, StultoTerminal *terminal);
+void stulto_session_focus_neighbor(StultoSession *session, GtkDirectionType direction);
+void stulto_session_resize_active(StultoSession *session, GtkDirectionType direction, gint cells);
+void stulto_session_toggle_zoom(StultoSession *session);
+void stulto_session_toggle_broadcast(StultoSession *session);
+
+void stulto_session_start_search(StultoSession *session);
+void stulto_session_search_for(StultoSession *session, const gchar *text, gint nth_from_end);
+
 G_END_DECLS
 
 #endif //STULTO_SESSION_H
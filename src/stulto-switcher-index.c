@@ -0,0 +1,163 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stulto-switcher-index.h"
+
+typedef struct _SwitcherEntry {
+    gpointer key;
+    /* As shown */
+    gchar *text;
+    /* As matched */
+    gchar *folded;
+    /* Higher is more recent */
+    guint64 last_used;
+} SwitcherEntry;
+
+struct _StultoSwitcherIndex {
+    /* Of SwitcherEntry, by key */
+    GHashTable *entries;
+    guint64 clock;
+};
+
+static void switcher_entry_free(SwitcherEntry *entry) {
+    g_free(entry->text);
+    g_free(entry->folded);
+    g_free(entry);
+}
+
+StultoSwitcherIndex *stulto_switcher_index_new() {
+    StultoSwitcherIndex *index = g_new0(StultoSwitcherIndex, 1);
+
+    index->entries = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) switcher_entry_free);
+
+    return index;
+}
+
+void stulto_switcher_index_free(StultoSwitcherIndex *index) {
+    if (index == NULL) {
+        return;
+    }
+
+    g_hash_table_unref(index->entries);
+    g_free(index);
+}
+
+/*
+ * Add the entry for key, or replace its text; a new entry counts as just used
+ */
+void stulto_switcher_index_update(StultoSwitcherIndex *index, gpointer key, const gchar *text) {
+    SwitcherEntry *entry = g_hash_table_lookup(index->entries, key);
+
+    if (entry == NULL) {
+        entry = g_new0(SwitcherEntry, 1);
+        entry->key = key;
+        entry->last_used = ++index->clock;
+        g_hash_table_insert(index->entries, key, entry);
+    } else if (g_strcmp0(entry->text, text) == 0) {
+        return;
+    }
+
+    g_free(entry->text);
+    g_free(entry->folded);
+    entry->text = g_strdup(text);
+    entry->folded = g_utf8_casefold(text, -1);
+}
+
+void stulto_switcher_index_remove(StultoSwitcherIndex *index, gpointer key) {
+    g_hash_table_remove(index->entries, key);
+}
+
+void stulto_switcher_index_touch(StultoSwitcherIndex *index, gpointer key) {
+    SwitcherEntry *entry = g_hash_table_lookup(index->entries, key);
+
+    if (entry != NULL) {
+        entry->last_used = ++index->clock;
+    }
+}
+
+const gchar *stulto_switcher_index_get_text(StultoSwitcherIndex *index, gpointer key) {
+    SwitcherEntry *entry = g_hash_table_lookup(index->entries, key);
+
+    return entry != NULL ? entry->text : NULL;
+}
+
+/*
+ * Whether the (folded) query's characters all appear in text, in order
+ */
+static gboolean fuzzy_match(const gchar *text, const gchar *query) {
+    while (*query != '\0') {
+        gunichar wanted = g_utf8_get_char(query);
+
+        /* Spaces only separate the parts of a query */
+        if (g_unichar_isspace(wanted)) {
+            query = g_utf8_next_char(query);
+            continue;
+        }
+
+        while (*text != '\0' && g_utf8_get_char(text) != wanted) {
+            text = g_utf8_next_char(text);
+        }
+
+        if (*text == '\0') {
+            return FALSE;
+        }
+
+        text = g_utf8_next_char(text);
+        query = g_utf8_next_char(query);
+    }
+
+    return TRUE;
+}
+
+static gint entry_recency_compare(gconstpointer a, gconstpointer b) {
+    const SwitcherEntry *entry_a = *(SwitcherEntry **) a;
+    const SwitcherEntry *entry_b = *(SwitcherEntry **) b;
+
+    return entry_a->last_used < entry_b->last_used ? 1 : entry_a->last_used > entry_b->last_used ? -1 : 0;
+}
+
+/*
+ * The keys of the entries matching query, most recently used first and at most max_results of them; free the array
+ * with g_ptr_array_unref
+ */
+GPtrArray *stulto_switcher_index_query(StultoSwitcherIndex *index, const gchar *query, guint max_results) {
+    gchar *folded_query = g_utf8_casefold(query, -1);
+    GPtrArray *matches = g_ptr_array_sized_new(g_hash_table_size(index->entries));
+    GPtrArray *keys = g_ptr_array_new();
+    GHashTableIter iter;
+    SwitcherEntry *entry;
+
+    g_hash_table_iter_init(&iter, index->entries);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &entry)) {
+        if (fuzzy_match(entry->folded, folded_query)) {
+            g_ptr_array_add(matches, entry);
+        }
+    }
+
+    g_ptr_array_sort(matches, entry_recency_compare);
+
+    for (guint i = 0; i < matches->len && i < max_results; i++) {
+        g_ptr_array_add(keys, ((SwitcherEntry *) g_ptr_array_index(matches, i))->key);
+    }
+
+    g_ptr_array_unref(matches);
+    g_free(folded_query);
+
+    return keys;
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_SWITCHER_INDEX_H
+#define STULTO_SWITCHER_INDEX_H
+
+#include <glib.h>
+
+/*
+ * What the session switcher matches against: a line of text per session (its name, title, foreground process and
+ * working directory), kept case-folded, plus when the session was last used
+ *
+ * Entries are replaced one at a time as the sessions change, so a query only has to scan them: each is fuzzy-matched
+ * (the query's characters in order, not necessarily together) and the matches come out most recently used first
+ */
+
+typedef struct _StultoSwitcherIndex StultoSwitcherIndex;
+
+StultoSwitcherIndex *stulto_switcher_index_new();
+void stulto_switcher_index_free(StultoSwitcherIndex *index);
+
+void stulto_switcher_index_update(StultoSwitcherIndex *index, gpointer key, const gchar *text);
+void stulto_switcher_index_remove(StultoSwitcherIndex *index, gpointer key);
+void stulto_switcher_index_touch(StultoSwitcherIndex *index, gpointer key);
+
+const gchar *stulto_switcher_index_get_text(StultoSwitcherIndex *index, gpointer key);
+GPtrArray *stulto_switcher_index_query(StultoSwitcherIndex *index, const gchar *query, guint max_results);
+
+#endif //STULTO_SWITCHER_INDEX_H
@@ -0,0 +1,248 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stulto-switcher.h"
+
+/* Only this many matches are shown; the rows are made once and reused, however many sessions there are */
+#define STULTO_SWITCHER_MAX_ROWS 15
+
+struct _StultoSwitcher {
+    GtkWindow parent_instance;
+
+    StultoSessionManager *session_manager;
+
+    GtkSearchEntry *search_entry;
+    GtkListBox *list_box;
+    GtkListBoxRow *rows[STULTO_SWITCHER_MAX_ROWS];
+    GtkLabel *labels[STULTO_SWITCHER_MAX_ROWS];
+
+    /* The sessions the visible rows stand for */
+    GPtrArray *sessions;
+};
+
+G_DEFINE_FINAL_TYPE(StultoSwitcher, stulto_switcher, GTK_TYPE_WINDOW)
+
+// region Declarations
+
+/* Vfunc implementations */
+static void stulto_switcher_finalize(GObject *object);
+
+static void stulto_switcher_class_init(StultoSwitcherClass *klass);
+static void stulto_switcher_init(StultoSwitcher *switcher);
+
+StultoSwitcher *stulto_switcher_new(GtkWindow *parent, StultoSessionManager *session_manager);
+
+/* Helpers */
+static void update_rows(StultoSwitcher *switcher);
+
+// endregion
+
+// region Callbacks
+
+static void search_changed_cb(GtkEditable *editable, gpointer data) {
+    update_rows(STULTO_SWITCHER(data));
+}
+
+static void row_activated_cb(GtkListBox *list_box, GtkListBoxRow *row, gpointer data) {
+    StultoSwitcher *switcher = data;
+    gint index = gtk_list_box_row_get_index(row);
+
+    if (index < 0 || (guint) index >= switcher->sessions->len) {
+        return;
+    }
+
+    /* The session may have been closed since the rows were filled in */
+    GtkWidget *page = g_ptr_array_index(switcher->sessions, index);
+
+    if (gtk_notebook_page_num(GTK_NOTEBOOK(switcher->session_manager), page) >= 0) {
+        stulto_session_manager_set_active_session(switcher->session_manager, STULTO_SESSION(page));
+    }
+
+    gtk_widget_destroy(GTK_WIDGET(switcher));
+}
+
+static void search_activate_cb(GtkEntry *entry, gpointer data) {
+    StultoSwitcher *switcher = data;
+    GtkListBoxRow *row = gtk_list_box_get_selected_row(switcher->list_box);
+
+    if (row != NULL) {
+        row_activated_cb(switcher->list_box, row, switcher);
+    }
+}
+
+static void stop_search_cb(GtkSearchEntry *entry, gpointer data) {
+    gtk_widget_destroy(GTK_WIDGET(data));
+}
+
+static gboolean key_press_event_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
+    StultoSwitcher *switcher = STULTO_SWITCHER(widget);
+    GtkListBoxRow *row = gtk_list_box_get_selected_row(switcher->list_box);
+    gint index = row != NULL ? gtk_list_box_row_get_index(row) : 0;
+
+    /* The entry keeps the focus; Up and Down move the selection instead */
+    switch (event->key.keyval) {
+        case GDK_KEY_Up:
+            index--;
+            break;
+        case GDK_KEY_Down:
+            index++;
+            break;
+        default:
+            return FALSE;
+    }
+
+    if (index >= 0 && (guint) index < switcher->sessions->len) {
+        gtk_list_box_select_row(switcher->list_box, switcher->rows[index]);
+    }
+
+    return TRUE;
+}
+
+static gboolean focus_out_event_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
+    gtk_widget_destroy(widget);
+
+    return FALSE;
+}
+
+// endregion
+
+// region GObject/GtkWidget lifecycle
+
+static void stulto_switcher_finalize(GObject *object) {
+    StultoSwitcher *switcher = STULTO_SWITCHER(object);
+
+    g_ptr_array_unref(switcher->sessions);
+
+    G_OBJECT_CLASS(stulto_switcher_parent_class)->finalize(object);
+}
+
+static void stulto_switcher_class_init(StultoSwitcherClass *klass) {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+    object_class->finalize = stulto_switcher_finalize;
+}
+
+static void stulto_switcher_init(StultoSwitcher *switcher) {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_container_set_border_width(GTK_CONTAINER(box), 6);
+
+    GtkWidget *search_entry = gtk_search_entry_new();
+    gtk_box_pack_start(GTK_BOX(box), search_entry, FALSE, FALSE, 0);
+
+    GtkWidget *list_box = gtk_list_box_new();
+    gtk_list_box_set_selection_mode(GTK_LIST_BOX(list_box), GTK_SELECTION_BROWSE);
+    gtk_box_pack_start(GTK_BOX(box), list_box, TRUE, TRUE, 0);
+
+    for (gint i = 0; i < STULTO_SWITCHER_MAX_ROWS; i++) {
+        GtkWidget *row = gtk_list_box_row_new();
+        GtkWidget *label = gtk_label_new(NULL);
+
+        gtk_label_set_xalign(GTK_LABEL(label), 0);
+        gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_MIDDLE);
+        gtk_container_add(GTK_CONTAINER(row), label);
+        gtk_widget_show(label);
+        gtk_container_add(GTK_CONTAINER(list_box), row);
+
+        switcher->rows[i] = GTK_LIST_BOX_ROW(row);
+        switcher->labels[i] = GTK_LABEL(label);
+    }
+
+    gtk_container_add(GTK_CONTAINER(switcher), box);
+    gtk_widget_show(search_entry);
+    gtk_widget_show(list_box);
+    gtk_widget_show(box);
+
+    switcher->search_entry = GTK_SEARCH_ENTRY(search_entry);
+    switcher->list_box = GTK_LIST_BOX(list_box);
+    switcher->sessions = g_ptr_array_new();
+
+    gtk_window_set_decorated(GTK_WINDOW(switcher), FALSE);
+    gtk_window_set_default_size(GTK_WINDOW(switcher), 640, -1);
+    gtk_window_set_type_hint(GTK_WINDOW(switcher), GDK_WINDOW_TYPE_HINT_DIALOG);
+    gtk_window_set_position(GTK_WINDOW(switcher), GTK_WIN_POS_CENTER_ON_PARENT);
+    gtk_window_set_destroy_with_parent(GTK_WINDOW(switcher), TRUE);
+
+    /* "changed" rather than "search-changed": filtering is cheap enough not to wait for the typing to stop */
+    g_signal_connect(search_entry, "changed", G_CALLBACK(search_changed_cb), switcher);
+    g_signal_connect(search_entry, "activate", G_CALLBACK(search_activate_cb), switcher);
+    g_signal_connect(search_entry, "stop-search", G_CALLBACK(stop_search_cb), switcher);
+    g_signal_connect(list_box, "row-activated", G_CALLBACK(row_activated_cb), switcher);
+    g_signal_connect(switcher, "key-press-event", G_CALLBACK(key_press_event_cb), NULL);
+    g_signal_connect(switcher, "focus-out-event", G_CALLBACK(focus_out_event_cb), NULL);
+}
+
+StultoSwitcher *stulto_switcher_new(GtkWindow *parent, StultoSessionManager *session_manager) {
+    StultoSwitcher *switcher = STULTO_SWITCHER(g_object_new(STULTO_TYPE_SWITCHER, NULL));
+
+    switcher->session_manager = session_manager;
+
+    gtk_window_set_transient_for(GTK_WINDOW(switcher), parent);
+
+    update_rows(switcher);
+
+    return switcher;
+}
+
+// endregion
+
+// region Helpers
+
+/*
+ * Fill the rows in with the sessions matching the entry's text, and hide the rest
+ */
+static void update_rows(StultoSwitcher *switcher) {
+    gint64 start_time = g_get_monotonic_time();
+    GtkNotebook *notebook = GTK_NOTEBOOK(switcher->session_manager);
+    GPtrArray *sessions = stulto_session_manager_find_sessions(
+            switcher->session_manager,
+            gtk_entry_get_text(GTK_ENTRY(switcher->search_entry)),
+            STULTO_SWITCHER_MAX_ROWS);
+
+    g_ptr_array_unref(switcher->sessions);
+    switcher->sessions = sessions;
+
+    for (guint i = 0; i < STULTO_SWITCHER_MAX_ROWS; i++) {
+        if (i >= sessions->len) {
+            gtk_widget_hide(GTK_WIDGET(switcher->rows[i]));
+            continue;
+        }
+
+        StultoSession *session = g_ptr_array_index(sessions, i);
+
+        // GtkNotebook uses zero-based page numbering, hence we add 1 for user-friendly output
+        gchar *text = g_strdup_printf(
+                "[%d] %s",
+                gtk_notebook_page_num(notebook, GTK_WIDGET(session)) + 1,
+                stulto_session_manager_describe_session(switcher->session_manager, session));
+
+        gtk_label_set_text(switcher->labels[i], text);
+        gtk_widget_show(GTK_WIDGET(switcher->rows[i]));
+
+        g_free(text);
+    }
+
+    if (sessions->len > 0) {
+        gtk_list_box_select_row(switcher->list_box, switcher->rows[0]);
+    }
+
+    g_debug("Switcher: %u sessions shown of %d, filtered in %.2f ms",
+            sessions->len, gtk_notebook_get_n_pages(notebook), (g_get_monotonic_time() - start_time) / 1000.0);
+}
+
+// endregion
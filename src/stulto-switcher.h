@@ -0,0 +1,41 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_SWITCHER_H
+#define STULTO_SWITCHER_H
+
+#include <gtk/gtk.h>
+
+#include "stulto-session-manager.h"
+
+/*
+ * A popup which fuzzy-finds a session in a window by its name, title, foreground process or working directory, most
+ * recently used first, and switches to the one picked
+ */
+
+G_BEGIN_DECLS
+
+#define STULTO_TYPE_SWITCHER stulto_switcher_get_type()
+G_DECLARE_FINAL_TYPE(StultoSwitcher, stulto_switcher, STULTO, SWITCHER, GtkWindow)
+
+StultoSwitcher *stulto_switcher_new(GtkWindow *parent, StultoSessionManager *session_manager);
+
+G_END_DECLS
+
+#endif //STULTO_SWITCHER_H
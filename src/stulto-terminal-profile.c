@@ -17,38 +17,92 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#include <string.h>
+
 #include "stulto-terminal-profile.h"
 
 #define STULTO_DEFAULT_PROFILE "stulto.ini"
+/* MiB of journal for all sessions together */
+#define STULTO_DEFAULT_JOURNAL_SIZE 64
 
-static void parse_options(GKeyFile *file, const gchar *filename, StultoTerminalProfile *profile)
+/*
+ * Each option is read with its own error, so one bad value neither hides the rest nor leaves an error set for the next
+ */
+static void report_option_error(const gchar *filename, GError *error)
+{
+    switch (error->code)
+    {
+        case G_KEY_FILE_ERROR_GROUP_NOT_FOUND:
+        case G_KEY_FILE_ERROR_KEY_NOT_FOUND:
+            break;
+        default:
+            g_printerr(
+                    "Error parsing '%s': %s\n", filename, error->message
+            );
+    }
+    g_error_free(error);
+}
+
+static gchar *get_string_option(GKeyFile *file, const gchar *filename, const gchar *key)
 {
     GError *error = NULL;
+    gchar *value = g_key_file_get_string(file, "options", key, &error);
 
-    profile->font = g_key_file_get_string(file, "options", "font", &error);
-    profile->lines = g_key_file_get_integer(file, "options", "lines", &error);
-    profile->bold_is_bright = g_key_file_get_boolean(file, "options", "bold-is-bright", &error);
-    profile->scroll_on_output = g_key_file_get_boolean(file, "options", "scroll-on-output", &error);
-    profile->scroll_on_keystroke = g_key_file_get_boolean(file, "options", "scroll-on-keystroke", &error);
-    profile->mouse_autohide = g_key_file_get_boolean(file, "options", "mouse-autohide", &error);
-    profile->sync_clipboard = g_key_file_get_boolean(file, "options", "sync-clipboard", &error);
-    profile->urgent_on_bell = g_key_file_get_boolean(file, "options", "urgent-on-bell", &error);
+    if (error)
+    {
+        report_option_error(filename, error);
+    }
+
+    return value;
+}
+
+static gint get_integer_option(GKeyFile *file, const gchar *filename, const gchar *key)
+{
+    GError *error = NULL;
+    gint value = g_key_file_get_integer(file, "options", key, &error);
 
     if (error)
     {
-        switch (error->code)
-        {
-            case G_KEY_FILE_ERROR_GROUP_NOT_FOUND:
-            case G_KEY_FILE_ERROR_KEY_NOT_FOUND:
-                break;
-            default:
-                g_printerr(
-                        "Error parsing '%s': %s\n", filename, error->message
-                );
-        }
-        g_error_free(error);
-        error = NULL;
+        report_option_error(filename, error);
+    }
+
+    return value;
+}
+
+static gboolean get_boolean_option(GKeyFile *file, const gchar *filename, const gchar *key)
+{
+    GError *error = NULL;
+    gboolean value = g_key_file_get_boolean(file, "options", key, &error);
+
+    if (error)
+    {
+        report_option_error(filename, error);
+    }
+
+    return value;
+}
+
+static void parse_options(GKeyFile *file, const gchar *filename, StultoTerminalProfile *profile)
+{
+    profile->font = get_string_option(file, filename, "font");
+    profile->lines = get_integer_option(file, filename, "lines");
+    profile->bold_is_bright = get_boolean_option(file, filename, "bold-is-bright");
+    profile->scroll_on_output = get_boolean_option(file, filename, "scroll-on-output");
+    profile->scroll_on_keystroke = get_boolean_option(file, filename, "scroll-on-keystroke");
+    profile->mouse_autohide = get_boolean_option(file, filename, "mouse-autohide");
+    profile->sync_clipboard = get_boolean_option(file, filename, "sync-clipboard");
+    profile->urgent_on_bell = get_boolean_option(file, filename, "urgent-on-bell");
+    profile->allow_hyperlink = get_boolean_option(file, filename, "allow-hyperlink");
+    profile->timestamps = get_boolean_option(file, filename, "timestamps");
+    profile->persist_sessions = get_boolean_option(file, filename, "persist-sessions");
+    profile->journal = get_boolean_option(file, filename, "journal");
+    profile->journal_size = get_integer_option(file, filename, "journal-size");
+    if (profile->journal_size <= 0) {
+        profile->journal_size = STULTO_DEFAULT_JOURNAL_SIZE;
     }
+    profile->pty_holder = get_boolean_option(file, filename, "pty-holder");
+    profile->control_socket = get_boolean_option(file, filename, "control-socket");
+    profile->resource_usage = get_boolean_option(file, filename, "resource-usage");
 }
 
 static gboolean parse_color(GKeyFile *file, const gchar *filename, const gchar *key, gboolean required, GdkRGBA *out) {
@@ -105,17 +159,23 @@ static void parse_colors(GKeyFile *file, const gchar *filename, StultoTerminalPr
     }
 }
 
-static void parse_urlmatch(GKeyFile *file, const gchar *filename, StultoTerminalProfile *profile) {
+#define MATCH_GROUP_PREFIX "match:"
+
+/*
+ * Parse a single match rule from either the legacy [urlmatch] section or a [match:NAME] section
+ */
+static void parse_match_rule(GKeyFile *file, const gchar *filename, const gchar *group, const gchar *name, StultoTerminalProfile *profile) {
     GError *error = NULL;
+    gchar *program;
     gchar *regex;
 
-    profile->program = g_key_file_get_string(file, "urlmatch", "program", &error);
+    program = g_key_file_get_string(file, group, "program", &error);
     if (error) {
         if (error->code == G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
             g_printerr(
                     "Error parsing '%s': "
-                    "section [urlmatch] must specify program\n",
-                    filename);
+                    "section [%s] must specify program\n",
+                    filename, group);
         } else {
             g_printerr(
                     "Error parsing '%s': %s\n",
@@ -126,41 +186,172 @@ static void parse_urlmatch(GKeyFile *file, const gchar *filename, StultoTerminal
         return;
     }
 
-    regex = g_key_file_get_value(file, "urlmatch", "regex", &error);
+    regex = g_key_file_get_value(file, group, "regex", &error);
     if (error) {
         if (error->code == G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
             g_printerr(
                     "Error parsing '%s': "
-                    "section [urlmatch] must specify regex\n",
-                    filename);
+                    "section [%s] must specify regex\n",
+                    filename, group);
         } else {
             g_printerr(
                     "Error parsing '%s': %s\n",
                     filename, error->message);
         }
         g_error_free(error);
-        g_free(profile->program);
-        profile->program = NULL;
+        g_free(program);
+
+        return;
+    }
+
+    if (profile->matcher == NULL) {
+        profile->matcher = stulto_matcher_new();
+    }
+
+    /* Optional - whether program accepts several matches in one invocation */
+    gboolean batch = g_key_file_get_boolean(file, group, "batch", NULL);
+    /* Optional - whether program takes -- before its arguments */
+    gboolean end_of_options = g_key_file_get_boolean(file, group, "end-of-options", NULL);
+
+    if (!stulto_matcher_add_rule(profile->matcher, name, regex, program, batch, end_of_options, &error)) {
+        g_printerr(
+                "Error compiling regex '%s': %s\n",
+                regex, error->message);
+        g_error_free(error);
+    }
+
+    g_free(program);
+    g_free(regex);
+}
 
+static void parse_match_rules(GKeyFile *file, const gchar *filename, StultoTerminalProfile *profile) {
+    GError *error = NULL;
+    gchar **groups = g_key_file_get_groups(file, NULL);
+
+    for (gchar **group = groups; *group != NULL; group++) {
+        if (g_str_equal(*group, "urlmatch")) {
+            parse_match_rule(file, filename, *group, *group, profile);
+        } else if (g_str_has_prefix(*group, MATCH_GROUP_PREFIX)) {
+            parse_match_rule(file, filename, *group, *group + strlen(MATCH_GROUP_PREFIX), profile);
+        }
+    }
+
+    g_strfreev(groups);
+
+    if (profile->matcher == NULL || profile->matcher->rules->len == 0) {
+        g_clear_pointer(&profile->matcher, stulto_matcher_free);
         return;
     }
 
-#ifdef VTE_TYPE_REGEX
-    profile->regex = vte_regex_new_for_match(regex, -1, PCRE2_MULTILINE, &error);
-#else
-    profile->regex = g_regex_new(regex, G_REGEX_MULTILINE, 0, &error);
-#endif
+    /* All rules compiled on their own, so this can only fail if, e.g., a rule hijacks another's group name */
+    if (!stulto_matcher_compile(profile->matcher, &error)) {
+        g_printerr(
+                "Error compiling match rules in '%s': %s\n",
+                filename, error->message);
+        g_error_free(error);
+        g_clear_pointer(&profile->matcher, stulto_matcher_free);
+    }
+}
+
+#define TRIGGER_GROUP_PREFIX "trigger:"
+#define TRIGGER_DEFAULT_RATE_LIMIT_MS 1000
+
+static void parse_trigger(GKeyFile *file, const gchar *filename, const gchar *group, StultoTerminalProfile *profile) {
+    GError *error = NULL;
+    StultoTriggerAction action;
+
+    gchar *regex = g_key_file_get_value(file, group, "regex", &error);
     if (error) {
+        if (error->code == G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            g_printerr(
+                    "Error parsing '%s': "
+                    "section [%s] must specify regex\n",
+                    filename, group);
+        } else {
+            g_printerr(
+                    "Error parsing '%s': %s\n",
+                    filename, error->message);
+        }
+        g_error_free(error);
+
+        return;
+    }
+
+    gchar *action_name = g_key_file_get_string(file, group, "action", NULL);
+    gchar *command = g_key_file_get_string(file, group, "command", NULL);
+
+    if (action_name == NULL || g_str_equal(action_name, "notify")) {
+        action = STULTO_TRIGGER_ACTION_NOTIFY;
+    } else if (g_str_equal(action_name, "highlight")) {
+        action = STULTO_TRIGGER_ACTION_HIGHLIGHT;
+    } else if (g_str_equal(action_name, "command") && command != NULL) {
+        action = STULTO_TRIGGER_ACTION_COMMAND;
+    } else {
+        g_printerr(
+                "Error parsing '%s': "
+                "section [%s] must specify action as notify, highlight, or command (with a command)\n",
+                filename, group);
+        g_free(action_name);
+        g_free(command);
+        g_free(regex);
+
+        return;
+    }
+
+    gint rate_limit_ms = TRIGGER_DEFAULT_RATE_LIMIT_MS;
+
+    if (g_key_file_has_key(file, group, "rate-limit", NULL)) {
+        rate_limit_ms = MAX(g_key_file_get_integer(file, group, "rate-limit", NULL), 0);
+    }
+
+    if (profile->triggers == NULL) {
+        profile->triggers = stulto_trigger_set_new();
+    }
+
+    if (!stulto_trigger_set_add(profile->triggers,
+                                group + strlen(TRIGGER_GROUP_PREFIX),
+                                regex,
+                                action,
+                                command,
+                                (gint64) rate_limit_ms * 1000,
+                                &error)) {
         g_printerr(
                 "Error compiling regex '%s': %s\n",
                 regex, error->message);
         g_error_free(error);
-        g_free(profile->program);
-        profile->program = NULL;
     }
+
+    g_free(action_name);
+    g_free(command);
     g_free(regex);
 }
 
+static void parse_triggers(GKeyFile *file, const gchar *filename, StultoTerminalProfile *profile) {
+    GError *error = NULL;
+    gchar **groups = g_key_file_get_groups(file, NULL);
+
+    for (gchar **group = groups; *group != NULL; group++) {
+        if (g_str_has_prefix(*group, TRIGGER_GROUP_PREFIX)) {
+            parse_trigger(file, filename, *group, profile);
+        }
+    }
+
+    g_strfreev(groups);
+
+    if (profile->triggers == NULL || profile->triggers->triggers->len == 0) {
+        g_clear_pointer(&profile->triggers, stulto_trigger_set_free);
+        return;
+    }
+
+    if (!stulto_trigger_set_compile(profile->triggers, &error)) {
+        g_printerr(
+                "Error compiling triggers in '%s': %s\n",
+                filename, error->message);
+        g_error_free(error);
+        g_clear_pointer(&profile->triggers, stulto_trigger_set_free);
+    }
+}
+
 static void parse_file(StultoTerminalProfile *profile, GKeyFile *file, gchar *filename) {
     if (g_key_file_has_group(file, "options")) {
         parse_options(file, filename, profile);
@@ -168,9 +359,8 @@ static void parse_file(StultoTerminalProfile *profile, GKeyFile *file, gchar *fi
     if (g_key_file_has_group(file, "colors")) {
         parse_colors(file, filename, profile);
     }
-    if (g_key_file_has_group(file, "urlmatch")) {
-        parse_urlmatch(file, filename, profile);
-    }
+    parse_match_rules(file, filename, profile);
+    parse_triggers(file, filename, profile);
 }
 
 StultoTerminalProfile *stulto_terminal_profile_parse(gchar *filename) {
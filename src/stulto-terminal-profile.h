@@ -22,12 +22,8 @@
 
 #include <vte-2.91/vte/vte.h>
 
-#ifdef VTE_TYPE_REGEX
-#define PCRE2_CODE_UNIT_WIDTH 8
-
-#include <pcre2.h>
-
-#endif
+#include "stulto-matcher.h"
+#include "stulto-triggers.h"
 
 /*
  * An object that stores settings specifically for a terminal widget
@@ -48,12 +44,17 @@ typedef struct _StultoTerminalProfile {
     gboolean mouse_autohide;
     gboolean sync_clipboard;
     gboolean urgent_on_bell;
-#ifdef VTE_TYPE_REGEX
-    VteRegex *regex;
-#else
-    GRegex *regex;
-#endif
-    gchar *program;
+    gboolean allow_hyperlink;
+    gboolean timestamps;
+    gboolean persist_sessions;
+    gboolean journal;
+    /* In MiB per session */
+    gint journal_size;
+    gboolean pty_holder;
+    gboolean control_socket;
+    gboolean resource_usage;
+    StultoMatcher *matcher;
+    StultoTriggerSet *triggers;
     GdkRGBA background;
     GdkRGBA foreground;
     GdkRGBA highlight;
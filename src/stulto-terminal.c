@@ -17,9 +17,23 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include "stulto-terminal.h"
 
 #include "exit-status.h"
+#include "stulto-pty.h"
+#include "stulto-paste.h"
+#include "stulto-opener.h"
+#include "stulto-triggers.h"
+#include "stulto-prompt-index.h"
+#include "stulto-search-index.h"
+#include "stulto-export.h"
+#include "stulto-session.h"
+#include "stulto-journal.h"
+#include "stulto-output-ring.h"
 #include <vte/vte.h>
 
 struct _StultoTerminal {
@@ -32,6 +46,69 @@ struct _StultoTerminal {
 
     GtkLabel *title_widget;
     VteTerminal *terminal_widget;
+    GtkProgressBar *progress_widget;
+    GtkProgressBar *export_progress_widget;
+    GtkLabel *status_widget;
+    guint status_timeout_id;
+    GtkLabel *broadcast_widget;
+
+    StultoPty *pty;
+    StultoPaste *paste;
+    /* Typed while a paste is being written, and sent once it is done */
+    GByteArray *held_input;
+    StultoExport *export;
+    StultoTriggerWatch *trigger_watch;
+    StultoPromptIndex *prompt_index;
+    /*
+     * Marks whose row is only known once VTE has processed the output before them, each with its offset into the
+     * output held back behind them; output fed that VTE hasn't yet been seen processing
+     */
+    GArray *pending_marks;
+    GByteArray *marked_output;
+    gboolean feed_unprocessed;
+    guint pending_marks_source;
+    /* When the oldest output VTE hasn't yet processed arrived, for the rows it reaches */
+    gint64 feed_time_ms;
+    StultoSearchIndexSource *search_index_source;
+    StultoLineTimes *line_times;
+    /* The session's, which outlives the terminal's place in it */
+    StultoJournalLog *journal_log;
+    /* Only once someone subscribes to the output */
+    StultoOutputRing *output_ring;
+    /* The session's */
+    StultoActivity *activity;
+
+    /* Output held back from the widget at a reduced render rate, and when it is next shown */
+    StultoRenderRate render_rate;
+    GByteArray *pending_output;
+    guint pending_output_source;
+
+    /* The latest size the child asked for, applied on the next frame */
+    guint resize_width;
+    guint resize_height;
+    guint resize_tick_id;
+    /* Whether scrollback rewrap is put off until a window resize settles */
+    gboolean rewrap_deferred;
+    /* The width when rewrap was put off; the scrollback only needs reflowing if it has changed since */
+    glong rewrap_columns;
+
+    /* The PTY's foreground process group, looked up again only after output, input or focus */
+    GPid foreground_pid;
+    gchar *foreground_name;
+    /* Refreshes the foreground once its leader exits, in case nothing is printed then */
+    gint foreground_pidfd;
+    guint foreground_exit_source;
+    guint foreground_source;
+
+    /* Saved history is being fed back in; VTE's replies to the queries in it must not reach the child */
+    gboolean replaying;
+
+    gboolean spawned;
+    gboolean ready;
+    gboolean broadcast;
+    /* From a key press until the main loop comes round again: only what VTE commits in between was typed */
+    gboolean typing;
+    guint typing_source;
 };
 
 G_DEFINE_FINAL_TYPE(StultoTerminal, stulto_terminal, GTK_TYPE_BIN)
@@ -39,13 +116,49 @@ G_DEFINE_FINAL_TYPE(StultoTerminal, stulto_terminal, GTK_TYPE_BIN)
 enum {
     PROP_0,
     PROP_TITLE,
+    PROP_FOREGROUND,
     N_PROPERTIES
 };
 
 static GParamSpec *obj_properties[N_PROPERTIES];
 
+enum {
+    READY,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
 #define STULTO_TERMINAL_TITLEBAR_STYLE_CLASS "stulto-terminal-titlebar"
 
+#define STULTO_TERMINAL_STATUS_TIMEOUT_MS 3000
+
+/* Output kept for subscribers that fall behind */
+#define STULTO_TERMINAL_OUTPUT_RING_SIZE (1024 * 1024)
+
+/* Long enough for a shell to start the job just entered */
+#define STULTO_TERMINAL_FOREGROUND_INPUT_DELAY_MS 50
+
+/* Broadcasting slower than this is logged */
+#define STULTO_TERMINAL_BROADCAST_SLOW_US 1000
+
+/* How often an unfocused window's terminals show their output, and how much they may hold back in the meantime */
+#define STULTO_TERMINAL_REDUCED_RENDER_MS 100
+#define STULTO_TERMINAL_PENDING_OUTPUT_MAX (256 * 1024)
+
+/* How long a mark waits for VTE to show that it processed the output before it, in case that output changed nothing */
+#define STULTO_TERMINAL_MARK_TIMEOUT_MS 100
+
+/*
+ * Fed after saved history to undo whatever modes it left set, then a status query whose reply marks the point where
+ * VTE has processed all of it
+ */
+#define STULTO_TERMINAL_REPLAY_END "\033[!p\033[?1049l\r\n\033[5n"
+#define STULTO_TERMINAL_REPLAY_END_REPLY "\033[0n"
+
+/* Lines of history above the screen kept with a detached terminal, to show once it is attached again */
+#define STULTO_TERMINAL_DETACH_HISTORY_ROWS 1000
+
 // region Declarations
 
 /* Vfunc implementations */
@@ -68,8 +181,45 @@ static void stulto_terminal_set_profile(StultoTerminal *terminal, StultoTerminal
 const char *stulto_terminal_get_title(StultoTerminal *terminal);
 void stulto_terminal_set_title(StultoTerminal *terminal, gchar *title);
 
+VteTerminal *stulto_terminal_get_terminal_widget(StultoTerminal *terminal);
+guint stulto_terminal_get_search_index_id(StultoTerminal *terminal);
+
+gboolean stulto_terminal_export(StultoTerminal *terminal, const gchar *path, StultoExportFormat format, GError **error);
+
+void stulto_terminal_spawn(StultoTerminal *terminal);
+void stulto_terminal_write(StultoTerminal *terminal, const gchar *data, gsize len);
+void stulto_terminal_subscribe_output(StultoTerminal *terminal, gint fd, const gchar *preamble, gsize preamble_len);
+
+gboolean stulto_terminal_get_broadcast(StultoTerminal *terminal);
+void stulto_terminal_set_broadcast(StultoTerminal *terminal, gboolean broadcast);
+
+const gchar *stulto_terminal_get_foreground(StultoTerminal *terminal, GPid *pid);
+gboolean stulto_terminal_is_busy(StultoTerminal *terminal);
+GPid stulto_terminal_get_child_pid(StultoTerminal *terminal);
+
+StultoExecData *stulto_terminal_get_exec_data(StultoTerminal *terminal);
+StultoTerminalProfile *stulto_terminal_get_profile(StultoTerminal *terminal);
+gchar *stulto_terminal_get_cwd(StultoTerminal *terminal);
+
+gboolean stulto_terminal_load_history(StultoTerminal *terminal, const gchar *path, GError **error);
+gboolean stulto_terminal_save_history(StultoTerminal *terminal, const gchar *path, GError **error);
+gboolean stulto_terminal_detach(StultoTerminal *terminal);
+
+void stulto_terminal_set_journal_log(StultoTerminal *terminal, StultoJournalLog *journal_log);
+void stulto_terminal_set_activity(StultoTerminal *terminal, StultoActivity *activity);
+void stulto_terminal_set_render_rate(StultoTerminal *terminal, StultoRenderRate render_rate);
+void stulto_terminal_set_rewrap_deferred(StultoTerminal *terminal, gboolean deferred);
+void stulto_terminal_flush_output(StultoTerminal *terminal);
+
 // endregion
 
+/*
+ * The terminals whose input is broadcast: what is typed or pasted into any of them goes to all of them
+ *
+ * Not reffed; terminals leave it on their way out
+ */
+static GPtrArray *broadcast_group = NULL;
+
 // region Callbacks
 
 static void vte_window_title_changed_cb(VteTerminal *terminal_widget, gpointer data) {
@@ -92,15 +242,118 @@ static int vte_focus_in_event_cb(GtkWidget *widget, GdkEvent *event, gpointer da
     return FALSE;
 }
 
+static gboolean foreground_exited_cb(gint fd, GIOCondition condition, gpointer data);
+
+static void clear_foreground_watch(StultoTerminal *terminal) {
+    if (terminal->foreground_exit_source != 0) {
+        g_source_remove(terminal->foreground_exit_source);
+        terminal->foreground_exit_source = 0;
+    }
+
+    if (terminal->foreground_pidfd >= 0) {
+        close(terminal->foreground_pidfd);
+        terminal->foreground_pidfd = -1;
+    }
+}
+
+/*
+ * Ask the PTY for its foreground process group; /proc is only read when it has changed
+ */
+static void update_foreground(StultoTerminal *terminal) {
+    gint fd = terminal->pty != NULL ? stulto_pty_get_fd(terminal->pty) : -1;
+    GPid pid = fd >= 0 ? tcgetpgrp(fd) : -1;
+
+    if (pid <= 0) {
+        pid = -1;
+    }
+
+    if (pid == terminal->foreground_pid) {
+        return;
+    }
+
+    terminal->foreground_pid = pid;
+    g_clear_pointer(&terminal->foreground_name, g_free);
+    clear_foreground_watch(terminal);
+
+    if (pid > 0) {
+        gchar *path = g_strdup_printf("/proc/%d/comm", pid);
+
+        if (g_file_get_contents(path, &terminal->foreground_name, NULL, NULL)) {
+            g_strchomp(terminal->foreground_name);
+        }
+
+        g_free(path);
+
+#ifdef SYS_pidfd_open
+        terminal->foreground_pidfd = (gint) syscall(SYS_pidfd_open, pid, 0);
+
+        if (terminal->foreground_pidfd >= 0) {
+            terminal->foreground_exit_source = g_unix_fd_add(
+                    terminal->foreground_pidfd, G_IO_IN, foreground_exited_cb, terminal);
+        }
+#endif
+    }
+
+    g_object_notify_by_pspec(G_OBJECT(terminal), obj_properties[PROP_FOREGROUND]);
+}
+
+static gboolean foreground_update_cb(gpointer data) {
+    StultoTerminal *terminal = data;
+
+    terminal->foreground_source = 0;
+    update_foreground(terminal);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean foreground_exited_cb(gint fd, GIOCondition condition, gpointer data) {
+    StultoTerminal *terminal = data;
+
+    /* The watch goes with the pidfd */
+    terminal->foreground_exit_source = 0;
+    update_foreground(terminal);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Look the foreground up once the current burst of output is handled; a pending lookup covers any output after it
+ */
+static void queue_foreground_update(StultoTerminal *terminal) {
+    if (terminal->foreground_source == 0) {
+        terminal->foreground_source = g_idle_add_full(G_PRIORITY_LOW, foreground_update_cb, terminal, NULL);
+    }
+}
+
+static void activity_bell_cb(VteTerminal *terminal_widget, gpointer data) {
+    StultoTerminal *terminal = data;
+
+    if (terminal->activity != NULL) {
+        stulto_activity_note_bell(terminal->activity);
+    }
+}
+
+static gboolean foreground_focus_in_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
+    update_foreground(data);
+
+    return FALSE;
+}
+
 static void vte_child_exited_cb(VteTerminal *widget, int status, gpointer data) {
-    GtkWidget *notebook = gtk_widget_get_ancestor(GTK_WIDGET(widget), GTK_TYPE_NOTEBOOK);
+    GtkWidget *terminal = gtk_widget_get_ancestor(GTK_WIDGET(widget), STULTO_TYPE_TERMINAL);
+    GtkWidget *session = gtk_widget_get_ancestor(terminal, STULTO_TYPE_SESSION);
+    GtkWidget *notebook = gtk_widget_get_ancestor(session, GTK_TYPE_NOTEBOOK);
     GtkWidget *window = gtk_widget_get_ancestor(GTK_WIDGET(notebook), GTK_TYPE_WINDOW);
 
+    /* The session carries on while it has other panes */
+    if (stulto_session_remove_terminal(STULTO_SESSION(session), STULTO_TERMINAL(terminal))) {
+        return;
+    }
+
     gint num_pages = gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));
-    gint currentPage = gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook));
 
     if (num_pages > 1) {
-        gtk_notebook_remove_page(GTK_NOTEBOOK(notebook), currentPage);
+        gtk_notebook_remove_page(GTK_NOTEBOOK(notebook), gtk_notebook_page_num(GTK_NOTEBOOK(notebook), session));
         return;
     }
 
@@ -108,13 +361,295 @@ static void vte_child_exited_cb(VteTerminal *widget, int status, gpointer data)
     stulto_destroy_and_quit(window);
 }
 
+static void paste_progress_cb(gsize written, gsize total, gpointer data) {
+    StultoTerminal *terminal = data;
+
+    gdouble fraction = total > 0 ? (gdouble) written / total : 1.0;
+    gchar *text = g_strdup_printf("Pasting: %d%% (Esc to cancel)", (gint) (fraction * 100));
+
+    gtk_progress_bar_set_fraction(terminal->progress_widget, fraction);
+    gtk_progress_bar_set_text(terminal->progress_widget, text);
+    gtk_widget_show(GTK_WIDGET(terminal->progress_widget));
+
+    g_free(text);
+}
+
+static void paste_finished_cb(gboolean cancelled, gpointer data) {
+    StultoTerminal *terminal = data;
+
+    gtk_widget_hide(GTK_WIDGET(terminal->progress_widget));
+
+    stulto_paste_free(terminal->paste);
+    terminal->paste = NULL;
+
+    if (terminal->held_input != NULL) {
+        if (terminal->pty != NULL && stulto_pty_get_fd(terminal->pty) >= 0) {
+            stulto_pty_write(terminal->pty, (const gchar *) terminal->held_input->data, terminal->held_input->len);
+        }
+        g_clear_pointer(&terminal->held_input, g_byte_array_unref);
+    }
+}
+
+static void start_paste(StultoTerminal *terminal, const gchar *text) {
+    if (terminal->pty == NULL || stulto_pty_get_fd(terminal->pty) < 0) {
+        return;
+    }
+
+    if (terminal->paste != NULL) {
+        gtk_widget_error_bell(GTK_WIDGET(terminal));
+        return;
+    }
+
+    terminal->paste = stulto_paste_new(
+            terminal->pty,
+            g_strdup(text),
+            paste_progress_cb,
+            paste_finished_cb,
+            terminal);
+}
+
+static void clipboard_text_received_cb(GtkClipboard *clipboard, const gchar *text, gpointer data) {
+    StultoTerminal *terminal = data;
+
+    if (text == NULL || text[0] == '\0') {
+        g_object_unref(terminal);
+        return;
+    }
+
+    /* Each paste is paced by its own PTY, so a slow one doesn't hold up the others */
+    if (terminal->broadcast) {
+        for (guint i = 0; i < broadcast_group->len; i++) {
+            start_paste(g_ptr_array_index(broadcast_group, i), text);
+        }
+    } else {
+        start_paste(terminal, text);
+    }
+
+    g_object_unref(terminal);
+}
+
+static gboolean status_timeout_cb(gpointer data) {
+    StultoTerminal *terminal = data;
+
+    gtk_widget_hide(GTK_WIDGET(terminal->status_widget));
+    terminal->status_timeout_id = 0;
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Briefly show a message below the terminal
+ */
+static void show_status(StultoTerminal *terminal, const gchar *text) {
+    gtk_label_set_text(terminal->status_widget, text);
+    gtk_widget_show(GTK_WIDGET(terminal->status_widget));
+
+    if (terminal->status_timeout_id != 0) {
+        g_source_remove(terminal->status_timeout_id);
+    }
+    terminal->status_timeout_id = g_timeout_add(STULTO_TERMINAL_STATUS_TIMEOUT_MS, status_timeout_cb, terminal);
+}
+
+/*
+ * Briefly show what is known about a command: whether it is still running, how long it took, and how it exited
+ */
+static void show_prompt_status(StultoTerminal *terminal, const StultoPromptMark *mark) {
+    gchar *text;
+
+    if (mark->output_row < 0) {
+        text = g_strdup("Prompt");
+    } else if (mark->end_row < 0) {
+        text = g_strdup("Running");
+    } else {
+        text = g_strdup_printf(
+                "Finished in %.2f s with exit status %d",
+                (mark->end_time - mark->start_time) / (gdouble) G_USEC_PER_SEC,
+                mark->exit_code);
+    }
+
+    show_status(terminal, text);
+
+    g_free(text);
+}
+
+/*
+ * Scroll so the previous (or next) prompt is at the top of the view
+ */
+static void jump_to_prompt(StultoTerminal *terminal, gboolean backwards) {
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal->terminal_widget));
+    const StultoPromptMark *mark;
+
+    stulto_terminal_flush_output(terminal);
+
+    glong top_row = (glong) gtk_adjustment_get_value(adjustment);
+
+    if (backwards) {
+        mark = stulto_prompt_index_find_before(terminal->prompt_index, top_row);
+    } else {
+        mark = stulto_prompt_index_find_after(terminal->prompt_index, top_row);
+    }
+
+    if (mark == NULL) {
+        gtk_widget_error_bell(GTK_WIDGET(terminal));
+        return;
+    }
+
+    gtk_adjustment_set_value(adjustment, (gdouble) mark->prompt_row);
+    show_prompt_status(terminal, mark);
+}
+
+/*
+ * Copy the output of the command at the top of the view to the clipboard
+ */
+static void copy_prompt_output(StultoTerminal *terminal) {
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal->terminal_widget));
+    glong end_row;
+    gchar *text;
+
+    stulto_terminal_flush_output(terminal);
+
+    glong top_row = (glong) gtk_adjustment_get_value(adjustment);
+    const StultoPromptMark *mark = stulto_prompt_index_find_at(terminal->prompt_index, top_row);
+
+    if (mark == NULL || mark->output_row < 0) {
+        gtk_widget_error_bell(GTK_WIDGET(terminal));
+        return;
+    }
+
+    /* A command that is still running has produced output up to the cursor */
+    if (mark->end_row >= 0) {
+        end_row = mark->end_row;
+    } else {
+        vte_terminal_get_cursor_position(terminal->terminal_widget, NULL, &end_row);
+        end_row++;
+    }
+
+    if (end_row <= mark->output_row) {
+        gtk_widget_error_bell(GTK_WIDGET(terminal));
+        return;
+    }
+
+    text = vte_terminal_get_text_range(
+            terminal->terminal_widget,
+            mark->output_row, 0,
+            end_row - 1, vte_terminal_get_column_count(terminal->terminal_widget) - 1,
+            NULL, NULL, NULL);
+
+    if (text != NULL) {
+        gtk_clipboard_set_text(
+                gtk_widget_get_clipboard(GTK_WIDGET(terminal), GDK_SELECTION_CLIPBOARD),
+                text,
+                -1);
+        g_free(text);
+    }
+}
+
+static void export_progress_cb(glong rows_done, glong rows_total, gpointer data) {
+    StultoTerminal *terminal = data;
+
+    gdouble fraction = rows_total > 0 ? (gdouble) rows_done / rows_total : 1.0;
+    gchar *text = g_strdup_printf("Exporting: %d%% (Esc to cancel)", (gint) (fraction * 100));
+
+    gtk_progress_bar_set_fraction(terminal->export_progress_widget, fraction);
+    gtk_progress_bar_set_text(terminal->export_progress_widget, text);
+    gtk_widget_show(GTK_WIDGET(terminal->export_progress_widget));
+
+    g_free(text);
+}
+
+static void export_finished_cb(GError *error, gboolean cancelled, glong rows_lost, gpointer data) {
+    StultoTerminal *terminal = data;
+
+    gtk_widget_hide(GTK_WIDGET(terminal->export_progress_widget));
+
+    if (error != NULL) {
+        g_printerr("%s\n", error->message);
+        show_status(terminal, error->message);
+    } else if (!cancelled && rows_lost > 0) {
+        gchar *text = g_strdup_printf("Export truncated: %ld lines scrolled out before they were read", rows_lost);
+
+        show_status(terminal, text);
+        g_free(text);
+    } else if (!cancelled) {
+        show_status(terminal, "Export complete");
+    }
+
+    stulto_export_free(terminal->export);
+    terminal->export = NULL;
+}
+
+static void export_dialog_response_cb(GtkNativeDialog *dialog, gint response_id, gpointer data) {
+    StultoTerminal *terminal = data;
+    GError *error = NULL;
+
+    if (response_id == GTK_RESPONSE_ACCEPT) {
+        gchar *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+
+        if (!stulto_terminal_export(terminal, path, stulto_export_format_from_path(path), &error)) {
+            g_printerr("%s\n", error->message);
+            show_status(terminal, error->message);
+            g_error_free(error);
+        }
+
+        g_free(path);
+    }
+
+    g_object_unref(dialog);
+    g_object_unref(terminal);
+}
+
+/*
+ * Ask where to export to; the format follows the file name's extension (.txt, .ansi or .html)
+ */
+static void show_export_dialog(StultoTerminal *terminal) {
+    GtkWidget *window = gtk_widget_get_ancestor(GTK_WIDGET(terminal), GTK_TYPE_WINDOW);
+    GtkFileChooserNative *dialog = gtk_file_chooser_native_new(
+            "Export Scrollback",
+            GTK_WINDOW(window),
+            GTK_FILE_CHOOSER_ACTION_SAVE,
+            "_Export",
+            "_Cancel");
+
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), "scrollback.txt");
+
+    g_signal_connect(dialog, "response", G_CALLBACK(export_dialog_response_cb), g_object_ref(terminal));
+    gtk_native_dialog_show(GTK_NATIVE_DIALOG(dialog));
+}
+
+static gboolean typing_done_cb(gpointer data) {
+    StultoTerminal *terminal = data;
+
+    terminal->typing = FALSE;
+    terminal->typing_source = 0;
+
+    return G_SOURCE_REMOVE;
+}
+
 static gboolean key_press_event_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
     VteTerminal *vte = VTE_TERMINAL(widget);
+    StultoTerminal *terminal = STULTO_TERMINAL(gtk_widget_get_ancestor(widget, STULTO_TYPE_TERMINAL));
 
     GdkModifierType modifiers = gtk_accelerator_get_default_mod_mask();
 
     g_assert(event->type == GDK_KEY_PRESS);
 
+    /* VTE handles the key after us, committing its text (or the input method's) before the main loop goes on */
+    terminal->typing = TRUE;
+    if (terminal->typing_source == 0) {
+        terminal->typing_source = g_idle_add_full(G_PRIORITY_HIGH, typing_done_cb, terminal, NULL);
+    }
+
+    if (terminal->paste != NULL && event->key.keyval == GDK_KEY_Escape) {
+        stulto_paste_cancel(terminal->paste);
+        return TRUE;
+    }
+
+    if (terminal->export != NULL && event->key.keyval == GDK_KEY_Escape) {
+        stulto_export_cancel(terminal->export);
+        return TRUE;
+    }
+
     if ((event->key.state & modifiers) == (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) {
         switch (event->key.hardware_keycode) {
             case 21: /* + on US keyboards */
@@ -132,94 +667,562 @@ static gboolean key_press_event_cb(GtkWidget *widget, GdkEvent *event, gpointer
                 vte_terminal_copy_clipboard_format(vte, VTE_FORMAT_TEXT);
                 return TRUE;
             case GDK_KEY_v:
-                vte_terminal_paste_clipboard(vte);
+                gtk_clipboard_request_text(
+                        gtk_widget_get_clipboard(widget, GDK_SELECTION_CLIPBOARD),
+                        clipboard_text_received_cb,
+                        g_object_ref(terminal));
+                return TRUE;
+            case GDK_KEY_o:
+                copy_prompt_output(terminal);
+                return TRUE;
+            case GDK_KEY_e:
+                show_export_dialog(terminal);
+                return TRUE;
+            case GDK_KEY_Up:
+                jump_to_prompt(terminal, TRUE);
                 return TRUE;
+            case GDK_KEY_Down:
+                jump_to_prompt(terminal, FALSE);
+                return TRUE;
+            case GDK_KEY_i:
+                stulto_terminal_set_broadcast(terminal, !terminal->broadcast);
+                return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * Hand a match or hyperlink to the handler of the rule it matches; hyperlinks no rule claims go to the default opener
+ */
+static void open_match(StultoTerminalProfile *profile, const gchar *text, gboolean is_hyperlink) {
+    /* Hyperlink URIs come from the output; one that looks like an option must not reach the handler as one */
+    if (text[0] == '-' || g_ascii_isspace(text[0])) {
+        g_printerr("Refusing to open '%s'\n", text);
+        return;
+    }
+
+    const StultoMatchRule *rule = profile->matcher ? stulto_matcher_lookup(profile->matcher, text) : NULL;
+
+    if (rule != NULL) {
+        stulto_opener_open(rule->program, text, rule->batch, rule->end_of_options);
+    } else if (is_hyperlink) {
+        stulto_opener_open(STULTO_OPENER_DEFAULT_PROGRAM, text, FALSE, FALSE);
+    }
+}
+
+static gboolean vte_button_press_event_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
+    StultoTerminalProfile *profile = data;
+    VteTerminal *terminal_widget = VTE_TERMINAL(widget);
+
+    char *match;
+    int tag;
+
+    if (event->button.button != 3) {
+        return FALSE;
+    }
+
+    if (profile->allow_hyperlink) {
+        match = vte_terminal_hyperlink_check_event(terminal_widget, event);
+        if (match != NULL) {
+            open_match(profile, match, TRUE);
+            g_free(match);
+
+            return FALSE;
+        }
+    }
+
+    if (profile->matcher) {
+        match = vte_terminal_match_check_event(terminal_widget, event, &tag);
+        if (match != NULL) {
+            open_match(profile, match, FALSE);
+            g_free(match);
         }
     }
 
     return FALSE;
 }
 
-static gboolean vte_button_press_event_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
-    gchar *program = data;
+static gboolean vte_selection_changed_cb(VteTerminal *terminal_widget, gpointer data) {
+    if (vte_terminal_get_has_selection(terminal_widget)) {
+        vte_terminal_copy_clipboard_format(terminal_widget, VTE_FORMAT_TEXT);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Resize the window for the size the child last asked for; a burst of requests comes down to one per frame
+ */
+static gboolean resize_window_tick_cb(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data) {
+    StultoTerminal *terminal = data;
+    GtkWidget *window = gtk_widget_get_ancestor(widget, GTK_TYPE_WINDOW);
+    VteTerminal *terminal_widget = VTE_TERMINAL(widget);
+
+    terminal->resize_tick_id = 0;
+
+    if (window == NULL) {
+        return G_SOURCE_REMOVE;
+    }
+
+    glong row_count = vte_terminal_get_row_count(terminal_widget);
+    glong column_count = vte_terminal_get_column_count(terminal_widget);
+    glong char_width = vte_terminal_get_char_width(terminal_widget);
+    glong char_height = vte_terminal_get_char_height(terminal_widget);
+    gint owidth;
+    gint oheight;
+    GtkBorder padding;
+
+    gtk_window_get_size(GTK_WINDOW(window), &owidth, &oheight);
+
+    /* Take into account border overhead. */
+    gtk_style_context_get_padding(
+            gtk_widget_get_style_context(widget),
+            gtk_widget_get_state_flags(widget),
+            &padding);
+
+    owidth -= char_width * column_count + padding.left + padding.right;
+    oheight -= char_height * row_count + padding.top + padding.bottom;
+    gtk_window_resize(GTK_WINDOW(window), terminal->resize_width + owidth, terminal->resize_height + oheight);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void vte_resize_window_cb(GtkWidget *widget, guint width, guint height, gpointer data) {
+    GtkWidget *terminal_widget = gtk_widget_get_ancestor(widget, STULTO_TYPE_TERMINAL);
+
+    if (terminal_widget == NULL) {
+        return;
+    }
+
+    StultoTerminal *terminal = STULTO_TERMINAL(terminal_widget);
+
+    terminal->resize_width = MAX(width, 2);
+    terminal->resize_height = MAX(height, 2);
+
+    if (terminal->resize_tick_id == 0) {
+        terminal->resize_tick_id = gtk_widget_add_tick_callback(widget, resize_window_tick_cb, terminal, NULL);
+    }
+}
+
+/*
+ * Input typed during a paste would land in the middle of it, inside its brackets; it follows the paste instead
+ */
+static void write_input(StultoTerminal *terminal, const gchar *text, gsize size) {
+    if (terminal->paste != NULL) {
+        if (terminal->held_input == NULL) {
+            terminal->held_input = g_byte_array_new();
+        }
+        g_byte_array_append(terminal->held_input, (const guint8 *) text, size);
+        return;
+    }
+
+    stulto_pty_write(terminal->pty, text, size);
+}
+
+/*
+ * Write input straight to every member's PTY; none of them sees a key event
+ */
+static void broadcast_write(const gchar *text, gsize size) {
+    gint64 start_time = g_get_monotonic_time();
+
+    for (guint i = 0; i < broadcast_group->len; i++) {
+        StultoTerminal *member = g_ptr_array_index(broadcast_group, i);
+
+        if (member->pty != NULL) {
+            write_input(member, text, size);
+        }
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - start_time;
+
+    if (elapsed > STULTO_TERMINAL_BROADCAST_SLOW_US) {
+        g_debug("Broadcast to %u terminals took %.2f ms", broadcast_group->len, elapsed / 1000.0);
+    }
+}
+
+static void vte_commit_cb(VteTerminal *terminal_widget, gchar *text, guint size, gpointer data) {
+    StultoTerminal *terminal = data;
+
+    if (terminal->pty == NULL) {
+        return;
+    }
+
+    /* Answers to queries in replayed history, which were answered when it was first shown */
+    if (terminal->replaying) {
+        if (size == sizeof(STULTO_TERMINAL_REPLAY_END_REPLY) - 1
+            && memcmp(text, STULTO_TERMINAL_REPLAY_END_REPLY, size) == 0) {
+            terminal->replaying = FALSE;
+        }
+        return;
+    }
+
+    /* A job may be starting, silently; give the shell a moment to hand it the terminal */
+    if (memchr(text, '\r', size) != NULL) {
+        if (terminal->foreground_source != 0) {
+            g_source_remove(terminal->foreground_source);
+        }
+        terminal->foreground_source = g_timeout_add(
+                STULTO_TERMINAL_FOREGROUND_INPUT_DELAY_MS, foreground_update_cb, terminal);
+    }
+
+    /* Replies to queries, focus and mouse reports are this terminal's own business */
+    if (terminal->broadcast && terminal->typing) {
+        broadcast_write(text, size);
+        return;
+    }
+
+    write_input(terminal, text, size);
+}
+
+static void vte_size_allocate_cb(GtkWidget *widget, GdkRectangle *allocation, gpointer data) {
+    StultoTerminal *terminal = data;
+    VteTerminal *terminal_widget = VTE_TERMINAL(widget);
+
+    if (terminal->pty == NULL) {
+        return;
+    }
+
+    stulto_pty_set_size(
+            terminal->pty,
+            vte_terminal_get_row_count(terminal_widget),
+            vte_terminal_get_column_count(terminal_widget));
+}
+
+/*
+ * Show when the row under the pointer arrived
+ */
+static gboolean vte_query_tooltip_cb(GtkWidget *widget, gint x, gint y, gboolean keyboard_mode, GtkTooltip *tooltip,
+                                     gpointer data) {
+    StultoTerminal *terminal = data;
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(widget));
+    glong char_height = vte_terminal_get_char_height(terminal->terminal_widget);
+
+    if (keyboard_mode || char_height <= 0) {
+        return FALSE;
+    }
+
+    glong row = (glong) gtk_adjustment_get_value(adjustment) + y / char_height;
+    gchar *time = stulto_line_times_format(terminal->line_times, row);
+
+    if (time == NULL) {
+        return FALSE;
+    }
+
+    gtk_tooltip_set_text(tooltip, time);
+    g_free(time);
+
+    return TRUE;
+}
+
+typedef struct _PendingMark {
+    gchar kind;
+    gint exit_code;
+    gsize offset;
+} PendingMark;
+
+/*
+ * Hand output to the widget, which processes it later, on its own schedule
+ */
+static void feed_widget(StultoTerminal *terminal, const gchar *data, gsize len) {
+    if (!terminal->feed_unprocessed) {
+        terminal->feed_time_ms = g_get_real_time() / 1000;
+    }
+
+    vte_terminal_feed(terminal->terminal_widget, data, len);
+    terminal->feed_unprocessed = TRUE;
+}
+
+static gboolean pending_marks_cb(gpointer data);
+
+/*
+ * Place the marks whose output VTE has processed at the cursor, then feed it the output up to the next mark
+ */
+static void resolve_marks(StultoTerminal *terminal) {
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal->terminal_widget));
+    guint resolved = 0;
+    glong row;
+
+    vte_terminal_get_cursor_position(terminal->terminal_widget, NULL, &row);
+
+    while (resolved < terminal->pending_marks->len
+           && g_array_index(terminal->pending_marks, PendingMark, resolved).offset == 0) {
+        PendingMark *mark = &g_array_index(terminal->pending_marks, PendingMark, resolved++);
+
+        stulto_prompt_index_add_mark(terminal->prompt_index, mark->kind, row, mark->exit_code);
+    }
+
+    stulto_prompt_index_prune(terminal->prompt_index, (glong) gtk_adjustment_get_lower(adjustment));
+    g_array_remove_range(terminal->pending_marks, 0, resolved);
+
+    gsize len = terminal->pending_marks->len > 0
+            ? g_array_index(terminal->pending_marks, PendingMark, 0).offset
+            : terminal->marked_output->len;
+
+    if (len == 0) {
+        return;
+    }
+
+    feed_widget(terminal, (const gchar *) terminal->marked_output->data, len);
+    g_byte_array_remove_range(terminal->marked_output, 0, len);
+
+    for (guint i = 0; i < terminal->pending_marks->len; i++) {
+        g_array_index(terminal->pending_marks, PendingMark, i).offset -= len;
+    }
+
+    if (terminal->pending_marks->len > 0 && terminal->pending_marks_source == 0) {
+        terminal->pending_marks_source = g_timeout_add(STULTO_TERMINAL_MARK_TIMEOUT_MS, pending_marks_cb, terminal);
+    }
+}
+
+/*
+ * VTE has processed what it was fed, so the cursor is where the output left it
+ */
+static void output_processed(StultoTerminal *terminal) {
+    /* Once per batch, not per byte: rows the cursor has reached so far get the time their output arrived */
+    if (terminal->feed_unprocessed && terminal->line_times != NULL) {
+        GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal->terminal_widget));
+        glong row;
+
+        vte_terminal_get_cursor_position(terminal->terminal_widget, NULL, &row);
+
+        stulto_line_times_record(terminal->line_times, row, terminal->feed_time_ms);
+        stulto_line_times_prune(terminal->line_times, (glong) gtk_adjustment_get_lower(adjustment));
+    }
+
+    terminal->feed_unprocessed = FALSE;
+
+    if (terminal->pending_marks->len > 0) {
+        if (terminal->pending_marks_source != 0) {
+            g_source_remove(terminal->pending_marks_source);
+            terminal->pending_marks_source = 0;
+        }
+        resolve_marks(terminal);
+    }
+}
+
+static gboolean pending_marks_cb(gpointer data) {
+    StultoTerminal *terminal = data;
+
+    terminal->pending_marks_source = 0;
+    output_processed(terminal);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void vte_processed_cb(VteTerminal *terminal_widget, gpointer data) {
+    output_processed(data);
+}
+
+/*
+ * Hand output to the widget, unless it must wait behind a mark
+ */
+static void feed_output(StultoTerminal *terminal, const gchar *data, gsize len) {
+    if (terminal->pending_marks->len > 0) {
+        g_byte_array_append(terminal->marked_output, (const guint8 *) data, len);
+        return;
+    }
+
+    feed_widget(terminal, data, len);
+}
+
+/*
+ * Show whatever output was held back
+ */
+static void flush_pending_output(StultoTerminal *terminal) {
+    if (terminal->pending_output_source != 0) {
+        g_source_remove(terminal->pending_output_source);
+        terminal->pending_output_source = 0;
+    }
+
+    if (terminal->pending_output == NULL || terminal->pending_output->len == 0) {
+        return;
+    }
+
+    feed_output(terminal, (const gchar *) terminal->pending_output->data, terminal->pending_output->len);
+    g_byte_array_set_size(terminal->pending_output, 0);
+}
+
+/*
+ * Get all output to the widget, placing any marks still waiting as best it can; anything reading the screen or
+ * scrollback calls this first, or it misses output held back at a reduced render rate or behind a mark
+ */
+void stulto_terminal_flush_output(StultoTerminal *terminal) {
+    flush_pending_output(terminal);
+
+    while (terminal->pending_marks->len > 0) {
+        resolve_marks(terminal);
+    }
+
+    if (terminal->pending_marks_source != 0) {
+        g_source_remove(terminal->pending_marks_source);
+        terminal->pending_marks_source = 0;
+    }
+}
+
+static gboolean pending_output_cb(gpointer data) {
+    StultoTerminal *terminal = data;
+
+    terminal->pending_output_source = 0;
+    flush_pending_output(terminal);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void pty_output_cb(const gchar *data, gsize len, gpointer user_data) {
+    StultoTerminal *terminal = user_data;
+
+    /* An unfocused window repaints once per batch rather than once per read */
+    if (terminal->render_rate == STULTO_RENDER_RATE_REDUCED) {
+        if (terminal->pending_output == NULL) {
+            terminal->pending_output = g_byte_array_new();
+        }
+
+        g_byte_array_append(terminal->pending_output, (const guint8 *) data, len);
+
+        if (terminal->pending_output->len >= STULTO_TERMINAL_PENDING_OUTPUT_MAX) {
+            flush_pending_output(terminal);
+        } else if (terminal->pending_output_source == 0) {
+            terminal->pending_output_source = g_timeout_add(
+                    STULTO_TERMINAL_REDUCED_RENDER_MS,
+                    pending_output_cb,
+                    terminal);
+        }
+    } else {
+        feed_output(terminal, data, len);
+    }
+
+    /* The child's first output, normally its prompt */
+    if (!terminal->ready) {
+        terminal->ready = TRUE;
+        g_signal_emit(terminal, signals[READY], 0);
+    }
+
+    if (terminal->trigger_watch != NULL) {
+        stulto_trigger_watch_feed(terminal->trigger_watch, data, len);
+    }
+
+    if (terminal->search_index_source != NULL) {
+        stulto_search_index_feed(terminal->search_index_source, data, len);
+    }
+
+    if (terminal->journal_log != NULL) {
+        stulto_journal_append_output(terminal->journal_log, stulto_terminal_get_search_index_id(terminal), data, len);
+    }
+
+    if (terminal->output_ring != NULL) {
+        stulto_output_ring_append(terminal->output_ring, data, len);
+    }
+
+    queue_foreground_update(terminal);
+
+    if (terminal->activity != NULL) {
+        stulto_activity_note_output(terminal->activity);
+    }
+}
+
+static void pty_mark_cb(gchar kind, gint exit_code, gpointer data) {
+    StultoTerminal *terminal = data;
+
+    /* The mark belongs where the output before it ends, which is only known once VTE has processed that output */
+    flush_pending_output(terminal);
+
+    PendingMark mark = {kind, exit_code, terminal->marked_output->len};
+
+    g_array_append_val(terminal->pending_marks, mark);
 
-    char *match;
-    int tag;
+    if (terminal->pending_marks->len > 1) {
+        return;
+    }
 
-    if (event->button.button != 3) {
-        return FALSE;
+    if (!terminal->feed_unprocessed) {
+        resolve_marks(terminal);
+    } else if (terminal->pending_marks_source == 0) {
+        terminal->pending_marks_source = g_timeout_add(STULTO_TERMINAL_MARK_TIMEOUT_MS, pending_marks_cb, terminal);
     }
+}
 
-    match = vte_terminal_match_check_event(VTE_TERMINAL(widget), event, &tag);
-    if (match != NULL) {
-        GError *error = NULL;
-        gchar *argv[3] = {program, match, NULL};
+static void trigger_fired_cb(const StultoTrigger *trigger, const gchar *line, gpointer data) {
+    StultoTerminal *terminal = data;
+    GtkWidget *window = gtk_widget_get_ancestor(GTK_WIDGET(terminal), GTK_TYPE_WINDOW);
 
-        if (!g_spawn_async(NULL, argv, NULL,
-                           G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL,
-                           NULL, NULL, NULL, &error)) {
-            g_printerr("%s\n", error->message);
-            g_error_free(error);
+    switch (trigger->action) {
+        case STULTO_TRIGGER_ACTION_NOTIFY: {
+            gchar *message = g_strdup_printf("%s: %s", trigger->name, line);
+
+            stulto_opener_open("notify-send", message, FALSE, TRUE);
+            g_free(message);
         }
-        g_free(match);
+            break;
+        case STULTO_TRIGGER_ACTION_HIGHLIGHT:
+            if (window != NULL && !gtk_window_is_active(GTK_WINDOW(window))) {
+                gtk_window_set_urgency_hint(GTK_WINDOW(window), TRUE);
+            }
+            break;
+        case STULTO_TRIGGER_ACTION_COMMAND:
+            /* The line is output, and may well start with a dash */
+            stulto_opener_open(trigger->command, line, FALSE, TRUE);
+            break;
     }
-
-    return FALSE;
 }
 
-static gboolean vte_selection_changed_cb(VteTerminal *terminal_widget, gpointer data) {
-    if (vte_terminal_get_has_selection(terminal_widget)) {
-        vte_terminal_copy_clipboard_format(terminal_widget, VTE_FORMAT_TEXT);
-    }
+/*
+ * A terminal in a window that can't be seen keeps taking output in, but doesn't paint it
+ */
+static gboolean vte_draw_cb(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    StultoTerminal *terminal = data;
 
-    return TRUE;
+    return terminal->render_rate == STULTO_RENDER_RATE_PAUSED;
 }
 
-static void vte_resize_window_cb(GtkWidget *widget, guint width, guint height, gpointer data) {
-    GtkWidget *window = gtk_widget_get_ancestor(widget, GTK_TYPE_WINDOW);
-    VteTerminal *terminal_widget = VTE_TERMINAL(widget);
+static void toplevel_notify_render_rate_cb(GObject *object, GParamSpec *pspec, gpointer data) {
+    gint render_rate;
 
-    glong row_count = vte_terminal_get_row_count(terminal_widget);
-    glong column_count = vte_terminal_get_column_count(terminal_widget);
-    glong char_width = vte_terminal_get_char_width(terminal_widget);
-    glong char_height = vte_terminal_get_char_height(terminal_widget);
-    gint owidth;
-    gint oheight;
-    GtkBorder padding;
+    g_object_get(object, "render-rate", &render_rate, NULL);
+    stulto_terminal_set_render_rate(STULTO_TERMINAL(data), render_rate);
+}
+
+/*
+ * Follow the render rate of whichever window the terminal ends up in
+ */
+static void hierarchy_changed_cb(GtkWidget *widget, GtkWidget *previous_toplevel, gpointer data) {
+    GtkWidget *toplevel = gtk_widget_get_toplevel(widget);
 
-    if (width < 2) {
-        width = 2;
+    if (previous_toplevel != NULL) {
+        g_signal_handlers_disconnect_by_func(previous_toplevel, toplevel_notify_render_rate_cb, widget);
     }
-    if (height < 2) {
-        height = 2;
+
+    if (!gtk_widget_is_toplevel(toplevel) ||
+        g_object_class_find_property(G_OBJECT_GET_CLASS(toplevel), "render-rate") == NULL) {
+        stulto_terminal_set_render_rate(STULTO_TERMINAL(widget), STULTO_RENDER_RATE_FULL);
+        return;
     }
 
-    gtk_window_get_size(GTK_WINDOW(window), &owidth, &oheight);
+    g_signal_connect_object(toplevel, "notify::render-rate", G_CALLBACK(toplevel_notify_render_rate_cb), widget, 0);
+    toplevel_notify_render_rate_cb(G_OBJECT(toplevel), NULL, widget);
+}
 
-    /* Take into account border overhead. */
-    gtk_style_context_get_padding(
-            gtk_widget_get_style_context(widget),
-            gtk_widget_get_state_flags(widget),
-            &padding);
+static void pty_exited_cb(gint status, gpointer data) {
+    StultoTerminal *terminal = data;
 
-    owidth -= char_width * column_count + padding.left + padding.right;
-    oheight -= char_height * row_count + padding.top + padding.bottom;
-    gtk_window_resize(GTK_WINDOW(window), width + owidth, height + oheight);
+    stulto_terminal_flush_output(terminal);
+
+    if (terminal->paste != NULL) {
+        stulto_paste_cancel(terminal->paste);
+    }
+
+    vte_child_exited_cb(terminal->terminal_widget, status, NULL);
 }
 
-static void vte_terminal_spawn_cb(VteTerminal *terminal_widget, GPid pid, GError *error, gpointer data) {
-    GtkWidget *widget = GTK_WIDGET(terminal_widget);
-    GtkWidget *window = gtk_widget_get_ancestor(widget, GTK_TYPE_WINDOW);
+static void pty_spawned_cb(GPid pid, GError *error, gpointer data) {
+    StultoTerminal *terminal = data;
+    GtkWidget *window = gtk_widget_get_ancestor(GTK_WIDGET(terminal), GTK_TYPE_WINDOW);
 
     if (pid < 0) {
         g_printerr("%s\n", error->message);
-        g_error_free(error);
         stulto_destroy_and_quit(window);
-
-        return;
     }
-
-    g_signal_connect(widget, "child-exited", G_CALLBACK(vte_child_exited_cb), NULL);
 }
 
 // endregion
@@ -239,8 +1242,8 @@ static void connect_terminal_signals(VteTerminal *terminal_widget, StultoTermina
     g_signal_connect(terminal_widget, "key-press-event", G_CALLBACK(key_press_event_cb), NULL);
 
     /* Connect to the "button-press" event. */
-    if (profile->program) {
-        g_signal_connect(widget, "button-press-event", G_CALLBACK(vte_button_press_event_cb), profile->program);
+    if (profile->matcher || profile->allow_hyperlink) {
+        g_signal_connect(widget, "button-press-event", G_CALLBACK(vte_button_press_event_cb), profile);
     }
 
     /* Connect to application request signals. */
@@ -266,6 +1269,7 @@ static void configure_terminal(VteTerminal *terminal_widget, StultoTerminalProfi
     vte_terminal_set_cursor_blink_mode(terminal_widget, VTE_CURSOR_BLINK_OFF);
     vte_terminal_set_cursor_shape(terminal_widget, VTE_CURSOR_SHAPE_BLOCK);
     vte_terminal_set_bold_is_bright(terminal_widget, profile->bold_is_bright);
+    vte_terminal_set_allow_hyperlink(terminal_widget, profile->allow_hyperlink);
     if (profile->lines) {
         vte_terminal_set_scrollback_lines(terminal_widget, profile->lines);
     }
@@ -284,14 +1288,8 @@ static void configure_terminal(VteTerminal *terminal_widget, StultoTerminalProfi
         vte_terminal_set_font(terminal_widget, desc);
         pango_font_description_free(desc);
     }
-    if (profile->regex) {
-#ifdef VTE_TYPE_REGEX
-        int id = vte_terminal_match_add_regex(terminal_widget, profile->regex, 0);
-#else
-        int id = vte_terminal_match_add_gregex(terminal_widget, profile->regex, 0);
-        g_regex_unref(profile->regex);
-#endif
-        vte_terminal_match_set_cursor_name(terminal_widget, id, "pointer");
+    if (profile->matcher) {
+        stulto_matcher_apply(profile->matcher, terminal_widget);
     }
 }
 
@@ -300,10 +1298,65 @@ static void configure_terminal(VteTerminal *terminal_widget, StultoTerminalProfi
 // region GObject/GtkWidget lifecycle
 
 static void stulto_terminal_dispose(GObject *object) {
+    StultoTerminal *terminal = STULTO_TERMINAL(object);
+
+    stulto_terminal_set_broadcast(terminal, FALSE);
+
+    if (terminal->typing_source != 0) {
+        g_source_remove(terminal->typing_source);
+        terminal->typing_source = 0;
+    }
+
+    g_clear_pointer(&terminal->paste, stulto_paste_free);
+    g_clear_pointer(&terminal->held_input, g_byte_array_unref);
+    g_clear_pointer(&terminal->export, stulto_export_free);
+    g_clear_pointer(&terminal->line_times, stulto_line_times_free);
+    g_clear_pointer(&terminal->trigger_watch, stulto_trigger_watch_free);
+    g_clear_pointer(&terminal->pty, stulto_pty_free);
+
+    if (terminal->pending_output_source != 0) {
+        g_source_remove(terminal->pending_output_source);
+        terminal->pending_output_source = 0;
+    }
+    g_clear_pointer(&terminal->pending_output, g_byte_array_unref);
+
+    if (terminal->resize_tick_id != 0) {
+        gtk_widget_remove_tick_callback(GTK_WIDGET(terminal->terminal_widget), terminal->resize_tick_id);
+        terminal->resize_tick_id = 0;
+    }
+
+    /* After the PTY, which may still flush output on its way out */
+    g_clear_pointer(&terminal->output_ring, stulto_output_ring_free);
+    g_clear_pointer(&terminal->prompt_index, stulto_prompt_index_free);
+
+    if (terminal->pending_marks_source != 0) {
+        g_source_remove(terminal->pending_marks_source);
+        terminal->pending_marks_source = 0;
+    }
+    g_clear_pointer(&terminal->pending_marks, g_array_unref);
+    g_clear_pointer(&terminal->marked_output, g_byte_array_unref);
+
+    g_clear_pointer(&terminal->search_index_source, stulto_search_index_remove_source);
+
+    if (terminal->status_timeout_id != 0) {
+        g_source_remove(terminal->status_timeout_id);
+        terminal->status_timeout_id = 0;
+    }
+
+    if (terminal->foreground_source != 0) {
+        g_source_remove(terminal->foreground_source);
+        terminal->foreground_source = 0;
+    }
+    clear_foreground_watch(terminal);
+
     G_OBJECT_CLASS(stulto_terminal_parent_class)->dispose(object);
 }
 
 static void stulto_terminal_finalize(GObject *object) {
+    StultoTerminal *terminal = STULTO_TERMINAL(object);
+
+    g_free(terminal->foreground_name);
+
     G_OBJECT_CLASS(stulto_terminal_parent_class)->finalize(object);
 }
 
@@ -315,6 +1368,9 @@ static void stulto_terminal_get_property(GObject *object, guint prop_id, GValue
         case PROP_TITLE:
             g_value_set_string (value, stulto_terminal_get_title(terminal));
             break;
+        case PROP_FOREGROUND:
+            g_value_set_string (value, terminal->foreground_name);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
             break;
@@ -344,19 +1400,7 @@ static void stulto_terminal_realize(GtkWidget *widget) {
 
     GTK_WIDGET_CLASS(stulto_terminal_parent_class)->realize(widget);
 
-    vte_terminal_spawn_async(
-            terminal->terminal_widget,
-            VTE_PTY_DEFAULT,
-            NULL,
-            terminal->exec_data->command_argv, /* TODO - this should be configurable */
-            NULL,
-            G_SPAWN_SEARCH_PATH,
-            NULL,
-            NULL,
-            NULL,
-            -1,
-            NULL, &vte_terminal_spawn_cb,
-            NULL);
+    stulto_terminal_spawn(terminal);
 }
 
 static void stulto_terminal_class_init(StultoTerminalClass *klass) {
@@ -377,18 +1421,81 @@ static void stulto_terminal_class_init(StultoTerminalClass *klass) {
             "Stulto",
             G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
+    obj_properties[PROP_FOREGROUND] = g_param_spec_string(
+            "foreground",
+            "foreground",
+            "The name of the terminal's foreground process",
+            NULL,
+            G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
     g_object_class_install_properties(object_class, G_N_ELEMENTS(obj_properties), obj_properties);
+
+    /* Emitted once, on the child's first output */
+    signals[READY] = g_signal_new(
+            "ready",
+            G_TYPE_FROM_CLASS(klass),
+            G_SIGNAL_RUN_LAST,
+            0, NULL, NULL,
+            g_cclosure_marshal_VOID__VOID,
+            G_TYPE_NONE,
+            0
+    );
 }
 
 static void stulto_terminal_init(StultoTerminal *terminal) {
     GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
 
+    /* Only shown while the terminal's input is broadcast */
+    GtkWidget *broadcast_widget = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(broadcast_widget), 0);
+    gtk_widget_set_no_show_all(broadcast_widget, TRUE);
+    gtk_box_pack_start(GTK_BOX(box), broadcast_widget, FALSE, FALSE, 0);
+
     GtkWidget *terminal_widget = vte_terminal_new();
     gtk_box_pack_start(GTK_BOX(box), terminal_widget, TRUE, TRUE, 0);
 
+    /* Only shown while a paste is too large to complete in one go */
+    GtkWidget *progress_widget = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(progress_widget), TRUE);
+    gtk_widget_set_no_show_all(progress_widget, TRUE);
+    gtk_box_pack_end(GTK_BOX(box), progress_widget, FALSE, FALSE, 0);
+
+    /* Only shown while an export is in progress, which may overlap a paste */
+    GtkWidget *export_progress_widget = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(export_progress_widget), TRUE);
+    gtk_widget_set_no_show_all(export_progress_widget, TRUE);
+    gtk_box_pack_end(GTK_BOX(box), export_progress_widget, FALSE, FALSE, 0);
+
+    /* Only shown briefly after jumping between prompts */
+    GtkWidget *status_widget = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(status_widget), 0);
+    gtk_widget_set_no_show_all(status_widget, TRUE);
+    gtk_box_pack_end(GTK_BOX(box), status_widget, FALSE, FALSE, 0);
+
     gtk_container_add(GTK_CONTAINER(terminal), box);
 
     terminal->terminal_widget = VTE_TERMINAL(terminal_widget);
+    terminal->progress_widget = GTK_PROGRESS_BAR(progress_widget);
+    terminal->export_progress_widget = GTK_PROGRESS_BAR(export_progress_widget);
+    terminal->status_widget = GTK_LABEL(status_widget);
+    terminal->broadcast_widget = GTK_LABEL(broadcast_widget);
+
+    terminal->foreground_pid = -1;
+    terminal->foreground_pidfd = -1;
+
+    terminal->prompt_index = stulto_prompt_index_new();
+    terminal->pending_marks = g_array_new(FALSE, FALSE, sizeof(PendingMark));
+    terminal->marked_output = g_byte_array_new();
+    terminal->pty = stulto_pty_new(pty_output_cb, pty_mark_cb, pty_exited_cb, terminal);
+
+    g_signal_connect(terminal_widget, "commit", G_CALLBACK(vte_commit_cb), terminal);
+    g_signal_connect(terminal_widget, "focus-in-event", G_CALLBACK(foreground_focus_in_cb), terminal);
+    g_signal_connect(terminal_widget, "bell", G_CALLBACK(activity_bell_cb), terminal);
+    g_signal_connect(terminal_widget, "draw", G_CALLBACK(vte_draw_cb), terminal);
+    g_signal_connect(terminal_widget, "contents-changed", G_CALLBACK(vte_processed_cb), terminal);
+    g_signal_connect(terminal_widget, "cursor-moved", G_CALLBACK(vte_processed_cb), terminal);
+    g_signal_connect(terminal, "hierarchy-changed", G_CALLBACK(hierarchy_changed_cb), NULL);
+    g_signal_connect_after(terminal_widget, "size-allocate", G_CALLBACK(vte_size_allocate_cb), terminal);
 }
 
 StultoTerminal *stulto_terminal_new(StultoTerminalProfile *profile, StultoExecData *exec_data) {
@@ -410,6 +1517,24 @@ static void stulto_terminal_set_profile(StultoTerminal *terminal, StultoTerminal
     connect_terminal_signals(VTE_TERMINAL(terminal->terminal_widget), terminal->profile);
 
     configure_terminal(VTE_TERMINAL(terminal->terminal_widget), terminal->profile);
+
+    if (profile->triggers) {
+        terminal->trigger_watch = stulto_trigger_watch_new(profile->triggers, trigger_fired_cb, terminal);
+    }
+
+    if (profile->timestamps) {
+        terminal->line_times = stulto_line_times_new();
+
+        gtk_widget_set_has_tooltip(GTK_WIDGET(terminal->terminal_widget), TRUE);
+        g_signal_connect(terminal->terminal_widget, "query-tooltip", G_CALLBACK(vte_query_tooltip_cb), terminal);
+    }
+
+    /* Index as much as the scrollback holds, plus the screen itself */
+    glong scrollback_lines = vte_terminal_get_scrollback_lines(terminal->terminal_widget);
+
+    terminal->search_index_source = stulto_search_index_add_source(
+            stulto_search_index_get_default(),
+            scrollback_lines >= 0 ? scrollback_lines + vte_terminal_get_row_count(terminal->terminal_widget) : -1);
 }
 
 const char *stulto_terminal_get_title(StultoTerminal *terminal) {
@@ -430,4 +1555,322 @@ void stulto_terminal_set_title(StultoTerminal *terminal, gchar *title) {
     g_free(new_title_text);
 }
 
+VteTerminal *stulto_terminal_get_terminal_widget(StultoTerminal *terminal) {
+    return terminal->terminal_widget;
+}
+
+guint stulto_terminal_get_search_index_id(StultoTerminal *terminal) {
+    return terminal->search_index_source ? stulto_search_index_source_get_id(terminal->search_index_source) : 0;
+}
+
+/*
+ * Start exporting the scrollback and screen to a file; only one export runs at a time
+ */
+gboolean stulto_terminal_export(StultoTerminal *terminal, const gchar *path, StultoExportFormat format, GError **error) {
+    if (terminal->export != NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_BUSY, "An export is already in progress");
+        return FALSE;
+    }
+
+    stulto_terminal_flush_output(terminal);
+
+    terminal->export = stulto_export_new(
+            terminal->terminal_widget,
+            path,
+            format,
+            terminal->line_times,
+            export_progress_cb,
+            export_finished_cb,
+            terminal,
+            error);
+
+    return terminal->export != NULL;
+}
+
+/*
+ * Start the terminal's child now rather than once the terminal is first shown; it is resized once it is
+ */
+void stulto_terminal_spawn(StultoTerminal *terminal) {
+    g_return_if_fail(STULTO_IS_TERMINAL(terminal));
+
+    if (terminal->spawned) {
+        return;
+    }
+
+    terminal->spawned = TRUE;
+
+    stulto_pty_set_size(
+            terminal->pty,
+            vte_terminal_get_row_count(terminal->terminal_widget),
+            vte_terminal_get_column_count(terminal->terminal_widget));
+
+    stulto_pty_spawn_async(terminal->pty, terminal->exec_data, pty_spawned_cb);
+}
+
+/*
+ * Write to the child as if typed, behind any input the PTY hasn't taken yet, and after a paste under way
+ */
+void stulto_terminal_write(StultoTerminal *terminal, const gchar *data, gsize len) {
+    g_return_if_fail(STULTO_IS_TERMINAL(terminal));
+
+    write_input(terminal, data, len);
+}
+
+/*
+ * Stream the child's raw output from here on to fd, which the terminal takes over (see stulto-output-ring.h)
+ */
+void stulto_terminal_subscribe_output(StultoTerminal *terminal, gint fd, const gchar *preamble, gsize preamble_len) {
+    g_return_if_fail(STULTO_IS_TERMINAL(terminal));
+
+    if (terminal->output_ring == NULL) {
+        terminal->output_ring = stulto_output_ring_new(STULTO_TERMINAL_OUTPUT_RING_SIZE);
+    }
+
+    stulto_output_ring_subscribe(terminal->output_ring, fd, preamble, preamble_len);
+}
+
+gboolean stulto_terminal_get_broadcast(StultoTerminal *terminal) {
+    return terminal->broadcast;
+}
+
+/*
+ * Add the terminal to the broadcast group, or take it out; every member is labelled with the group's size
+ */
+void stulto_terminal_set_broadcast(StultoTerminal *terminal, gboolean broadcast) {
+    g_return_if_fail(STULTO_IS_TERMINAL(terminal));
+
+    if (terminal->broadcast == broadcast) {
+        return;
+    }
+
+    terminal->broadcast = broadcast;
+
+    if (broadcast_group == NULL) {
+        broadcast_group = g_ptr_array_new();
+    }
+
+    if (broadcast) {
+        g_ptr_array_add(broadcast_group, terminal);
+    } else {
+        g_ptr_array_remove(broadcast_group, terminal);
+        gtk_widget_hide(GTK_WIDGET(terminal->broadcast_widget));
+    }
+
+    gchar *markup = g_strdup_printf(
+            "<b>Input broadcast to %u terminal%s</b> (Ctrl+Shift+I to leave)",
+            broadcast_group->len,
+            broadcast_group->len == 1 ? "" : "s");
+
+    for (guint i = 0; i < broadcast_group->len; i++) {
+        StultoTerminal *member = g_ptr_array_index(broadcast_group, i);
+
+        gtk_label_set_markup(member->broadcast_widget, markup);
+        gtk_widget_show(GTK_WIDGET(member->broadcast_widget));
+    }
+
+    g_free(markup);
+}
+
+/*
+ * The name of the process in the foreground of the terminal, and its (group's) pid; NULL if unknown
+ */
+const gchar *stulto_terminal_get_foreground(StultoTerminal *terminal, GPid *pid) {
+    g_return_val_if_fail(STULTO_IS_TERMINAL(terminal), NULL);
+
+    if (pid != NULL) {
+        *pid = terminal->foreground_pid;
+    }
+
+    return terminal->foreground_name;
+}
+
+/*
+ * Whether something other than the terminal's own child (normally the shell) is in the foreground
+ */
+gboolean stulto_terminal_is_busy(StultoTerminal *terminal) {
+    g_return_val_if_fail(STULTO_IS_TERMINAL(terminal), FALSE);
+
+    GPid child_pid = terminal->pty != NULL ? stulto_pty_get_child_pid(terminal->pty) : -1;
+
+    return terminal->foreground_pid > 0 && child_pid > 0 && terminal->foreground_pid != child_pid;
+}
+
+GPid stulto_terminal_get_child_pid(StultoTerminal *terminal) {
+    g_return_val_if_fail(STULTO_IS_TERMINAL(terminal), -1);
+
+    return terminal->pty != NULL ? stulto_pty_get_child_pid(terminal->pty) : -1;
+}
+
+StultoExecData *stulto_terminal_get_exec_data(StultoTerminal *terminal) {
+    return terminal->exec_data;
+}
+
+StultoTerminalProfile *stulto_terminal_get_profile(StultoTerminal *terminal) {
+    return terminal->profile;
+}
+
+/*
+ * The child's working directory, as reported by the shell (OSC 7), or else the foreground process's as the kernel knows
+ * it; NULL if unknown
+ */
+gchar *stulto_terminal_get_cwd(StultoTerminal *terminal) {
+    const gchar *uri = vte_terminal_get_current_directory_uri(terminal->terminal_widget);
+    GPid pid = terminal->foreground_pid > 0 ? terminal->foreground_pid : stulto_pty_get_child_pid(terminal->pty);
+
+    if (uri != NULL) {
+        gchar *path = g_filename_from_uri(uri, NULL, NULL);
+
+        if (path != NULL) {
+            return path;
+        }
+    }
+
+    if (pid > 0) {
+        gchar *link = g_strdup_printf("/proc/%d/cwd", pid);
+        gchar *path = g_file_read_link(link, NULL);
+
+        g_free(link);
+        return path;
+    }
+
+    return NULL;
+}
+
+/*
+ * Feed previously saved output (see stulto_terminal_save_history) into the terminal, ahead of its child's
+ */
+gboolean stulto_terminal_load_history(StultoTerminal *terminal, const gchar *path, GError **error) {
+    GMappedFile *file = g_mapped_file_new(path, FALSE, error);
+
+    if (file == NULL) {
+        return FALSE;
+    }
+
+    const gchar *data = g_mapped_file_get_contents(file);
+    gsize len = g_mapped_file_get_length(file);
+
+    terminal->replaying = TRUE;
+
+    /* Straight from the mapping; the file already has the line endings a terminal expects */
+    vte_terminal_feed(terminal->terminal_widget, data, (gssize) len);
+
+    if (terminal->search_index_source != NULL) {
+        stulto_search_index_feed(terminal->search_index_source, data, len);
+    }
+
+    /* So that it survives a crash along with what follows */
+    if (terminal->journal_log != NULL) {
+        stulto_journal_append_output(terminal->journal_log, stulto_terminal_get_search_index_id(terminal), data, len);
+    }
+
+    vte_terminal_feed(terminal->terminal_widget, STULTO_TERMINAL_REPLAY_END, -1);
+
+    g_debug("Restored %" G_GSIZE_FORMAT " bytes of history from %s", len, path);
+
+    g_mapped_file_unref(file);
+
+    return TRUE;
+}
+
+/*
+ * Save the scrollback and screen, with their attributes, in a form stulto_terminal_load_history can map and feed back
+ */
+gboolean stulto_terminal_save_history(StultoTerminal *terminal, const gchar *path, GError **error) {
+    stulto_terminal_flush_output(terminal);
+
+    return stulto_export_save(terminal->terminal_widget, path, STULTO_EXPORT_FORMAT_ANSI, TRUE, error);
+}
+
+/*
+ * Leave the child running in the PTY holder, along with a snapshot of the screen and recent history for the next
+ * Stulto to show; FALSE if the PTY isn't held
+ */
+gboolean stulto_terminal_detach(StultoTerminal *terminal) {
+    stulto_terminal_flush_output(terminal);
+
+    glong rows = vte_terminal_get_row_count(terminal->terminal_widget) + STULTO_TERMINAL_DETACH_HISTORY_ROWS;
+    GBytes *snapshot = stulto_export_render(terminal->terminal_widget, STULTO_EXPORT_FORMAT_ANSI, TRUE, rows);
+    gsize len;
+    const gchar *data = g_bytes_get_data(snapshot, &len);
+    gboolean detached = stulto_pty_detach(terminal->pty, data, len);
+
+    g_bytes_unref(snapshot);
+
+    return detached;
+}
+
+/*
+ * Journal the terminal's output to its session's log, or stop given NULL
+ */
+void stulto_terminal_set_journal_log(StultoTerminal *terminal, StultoJournalLog *journal_log) {
+    g_return_if_fail(STULTO_IS_TERMINAL(terminal));
+
+    terminal->journal_log = journal_log;
+}
+
+void stulto_terminal_set_activity(StultoTerminal *terminal, StultoActivity *activity) {
+    g_return_if_fail(STULTO_IS_TERMINAL(terminal));
+
+    terminal->activity = activity;
+}
+
+/*
+ * Anything held back is shown at once when the rate goes back up, and the widget repaints once it may again
+ */
+void stulto_terminal_set_render_rate(StultoTerminal *terminal, StultoRenderRate render_rate) {
+    g_return_if_fail(STULTO_IS_TERMINAL(terminal));
+
+    StultoRenderRate previous_rate = terminal->render_rate;
+
+    if (render_rate == previous_rate) {
+        return;
+    }
+
+    terminal->render_rate = render_rate;
+
+    if (render_rate != STULTO_RENDER_RATE_REDUCED) {
+        flush_pending_output(terminal);
+    }
+
+    if (previous_rate == STULTO_RENDER_RATE_PAUSED) {
+        gtk_widget_queue_draw(GTK_WIDGET(terminal->terminal_widget));
+    }
+}
+
+/*
+ * While a window is being resized interactively, its terminals keep their scrollback as it is wrapped instead of
+ * reflowing all of it for every intermediate width; once the size settles, it is reflowed for the final one, if the
+ * width changed at all
+ */
+void stulto_terminal_set_rewrap_deferred(StultoTerminal *terminal, gboolean deferred) {
+    g_return_if_fail(STULTO_IS_TERMINAL(terminal));
+
+    VteTerminal *terminal_widget = terminal->terminal_widget;
+
+    if (deferred == terminal->rewrap_deferred) {
+        return;
+    }
+
+    terminal->rewrap_deferred = deferred;
+
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    vte_terminal_set_rewrap_on_resize(terminal_widget, !deferred);
+    G_GNUC_END_IGNORE_DEPRECATIONS
+
+    glong column_count = vte_terminal_get_column_count(terminal_widget);
+
+    if (deferred) {
+        terminal->rewrap_columns = column_count;
+        return;
+    }
+
+    /* VTE only rewraps when the width changes, so take it a column away and back */
+    glong row_count = vte_terminal_get_row_count(terminal_widget);
+
+    if (column_count > 1 && column_count != terminal->rewrap_columns) {
+        vte_terminal_set_size(terminal_widget, column_count - 1, row_count);
+        vte_terminal_set_size(terminal_widget, column_count, row_count);
+    }
+}
+
 // endregion
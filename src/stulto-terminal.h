@@ -21,9 +21,13 @@
 #define STULTO_TERMINAL_H
 
 #include <gtk/gtk.h>
+#include <vte/vte.h>
 
 #include "stulto-terminal-profile.h"
 #include "stulto-exec-data.h"
+#include "stulto-export.h"
+#include "stulto-journal.h"
+#include "stulto-activity.h"
 
 /*
  * This is Stulto's terminal widget - essentially a typical VteTerminal, but configured via its own config object type
@@ -32,6 +36,16 @@
 
 G_BEGIN_DECLS
 
+/*
+ * How eagerly a terminal shows its output, as decided by its window (see its "render-rate" property): output is always
+ * taken in, but an unfocused window's terminals show it in batches, and a window that can't be seen doesn't paint
+ */
+typedef enum {
+    STULTO_RENDER_RATE_FULL,
+    STULTO_RENDER_RATE_REDUCED,
+    STULTO_RENDER_RATE_PAUSED,
+} StultoRenderRate;
+
 #define STULTO_TYPE_TERMINAL stulto_terminal_get_type()
 G_DECLARE_FINAL_TYPE(StultoTerminal, stulto_terminal, STULTO, TERMINAL, GtkBin)
 
@@ -40,6 +54,36 @@ StultoTerminal *stulto_terminal_new(StultoTerminalProfile *profile, StultoExecDa
 const char *stulto_terminal_get_title(StultoTerminal *terminal);
 void stulto_terminal_set_title(StultoTerminal *terminal, gchar *title);
 
+VteTerminal *stulto_terminal_get_terminal_widget(StultoTerminal *terminal);
+guint stulto_terminal_get_search_index_id(StultoTerminal *terminal);
+
+gboolean stulto_terminal_export(StultoTerminal *terminal, const gchar *path, StultoExportFormat format, GError **error);
+
+void stulto_terminal_spawn(StultoTerminal *terminal);
+void stulto_terminal_write(StultoTerminal *terminal, const gchar *data, gsize len);
+void stulto_terminal_subscribe_output(StultoTerminal *terminal, gint fd, const gchar *preamble, gsize preamble_len);
+
+gboolean stulto_terminal_get_broadcast(StultoTerminal *terminal);
+void stulto_terminal_set_broadcast(StultoTerminal *terminal, gboolean broadcast);
+
+const gchar *stulto_terminal_get_foreground(StultoTerminal *terminal, GPid *pid);
+gboolean stulto_terminal_is_busy(StultoTerminal *terminal);
+GPid stulto_terminal_get_child_pid(StultoTerminal *terminal);
+
+StultoExecData *stulto_terminal_get_exec_data(StultoTerminal *terminal);
+StultoTerminalProfile *stulto_terminal_get_profile(StultoTerminal *terminal);
+gchar *stulto_terminal_get_cwd(StultoTerminal *terminal);
+
+gboolean stulto_terminal_load_history(StultoTerminal *terminal, const gchar *path, GError **error);
+gboolean stulto_terminal_save_history(StultoTerminal *terminal, const gchar *path, GError **error);
+gboolean stulto_terminal_detach(StultoTerminal *terminal);
+
+void stulto_terminal_set_journal_log(StultoTerminal *terminal, StultoJournalLog *journal_log);
+void stulto_terminal_set_activity(StultoTerminal *terminal, StultoActivity *activity);
+void stulto_terminal_set_render_rate(StultoTerminal *terminal, StultoRenderRate render_rate);
+void stulto_terminal_set_rewrap_deferred(StultoTerminal *terminal, gboolean deferred);
+void stulto_terminal_flush_output(StultoTerminal *terminal);
+
 G_END_DECLS
 
 #endif //STULTO_TERMINAL_H
@@ -0,0 +1,701 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stulto-tiles.h"
+
+/* Space between panes, in pixels */
+#define STULTO_TILES_DIVIDER 1
+
+typedef struct _TileNode TileNode;
+
+struct _TileNode {
+    TileNode *parent;
+
+    /* Leaves only */
+    GtkWidget *widget;
+
+    /* Splits only: the first child's share of the space, excluding the divider */
+    GtkOrientation orientation;
+    gdouble ratio;
+    TileNode *first;
+    TileNode *second;
+
+    GtkAllocation allocation;
+};
+
+struct _StultoTiles {
+    GtkContainer parent_instance;
+
+    TileNode *root;
+    TileNode *zoomed;
+
+    /* Splits are snapped to cells; each pane has a fixed extra (e.g., padding) around its cells */
+    gint cell_width;
+    gint cell_height;
+    gint extra_width;
+    gint extra_height;
+};
+
+G_DEFINE_FINAL_TYPE(StultoTiles, stulto_tiles, GTK_TYPE_CONTAINER)
+
+// region Declarations
+
+/* Vfunc implementations */
+static void stulto_tiles_dispose(GObject *object);
+
+static void stulto_tiles_get_preferred_width(GtkWidget *widget, gint *minimum, gint *natural);
+static void stulto_tiles_get_preferred_height(GtkWidget *widget, gint *minimum, gint *natural);
+static void stulto_tiles_size_allocate(GtkWidget *widget, GtkAllocation *allocation);
+static gboolean stulto_tiles_draw(GtkWidget *widget, cairo_t *cr);
+
+static void stulto_tiles_add(GtkContainer *container, GtkWidget *child);
+static void stulto_tiles_remove(GtkContainer *container, GtkWidget *child);
+static void stulto_tiles_forall(GtkContainer *container, gboolean include_internals, GtkCallback callback, gpointer data);
+static GType stulto_tiles_child_type(GtkContainer *container);
+
+static void stulto_tiles_class_init(StultoTilesClass *klass);
+static void stulto_tiles_init(StultoTiles *tiles);
+
+StultoTiles *stulto_tiles_new();
+
+void stulto_tiles_split(StultoTiles *tiles, GtkWidget *sibling, GtkWidget *child, GtkOrientation orientation);
+void stulto_tiles_resize(StultoTiles *tiles, GtkWidget *child, GtkDirectionType direction, gint cells);
+void stulto_tiles_set_ratio(StultoTiles *tiles, GtkWidget *child, gdouble ratio);
+
+GArray *stulto_tiles_get_steps(StultoTiles *tiles);
+
+GtkWidget *stulto_tiles_get_neighbor(StultoTiles *tiles, GtkWidget *child, GtkDirectionType direction);
+
+GtkWidget *stulto_tiles_get_zoomed(StultoTiles *tiles);
+void stulto_tiles_set_zoomed(StultoTiles *tiles, GtkWidget *child);
+gint stulto_tiles_count_panes(StultoTiles *tiles, GtkOrientation orientation);
+
+void stulto_tiles_set_cell_size(StultoTiles *tiles, gint cell_width, gint cell_height, gint extra_width, gint extra_height);
+
+// endregion
+
+// region Tree
+
+static TileNode *node_new_leaf(GtkWidget *widget) {
+    TileNode *node = g_new0(TileNode, 1);
+
+    node->widget = widget;
+
+    return node;
+}
+
+static void node_free(TileNode *node) {
+    if (node == NULL) {
+        return;
+    }
+
+    node_free(node->first);
+    node_free(node->second);
+    g_free(node);
+}
+
+static TileNode *find_leaf(TileNode *node, GtkWidget *widget) {
+    if (node == NULL || node->widget == widget) {
+        return node;
+    }
+
+    TileNode *leaf = find_leaf(node->first, widget);
+
+    return leaf != NULL ? leaf : find_leaf(node->second, widget);
+}
+
+static void collect_leaves(TileNode *node, GPtrArray *leaves) {
+    if (node == NULL) {
+        return;
+    }
+
+    if (node->widget != NULL) {
+        g_ptr_array_add(leaves, node);
+        return;
+    }
+
+    collect_leaves(node->first, leaves);
+    collect_leaves(node->second, leaves);
+}
+
+static void replace_node(StultoTiles *tiles, TileNode *old_node, TileNode *new_node) {
+    TileNode *parent = old_node->parent;
+
+    new_node->parent = parent;
+
+    if (parent == NULL) {
+        tiles->root = new_node;
+    } else if (parent->first == old_node) {
+        parent->first = new_node;
+    } else {
+        parent->second = new_node;
+    }
+}
+
+static GtkWidget *first_widget(TileNode *node) {
+    while (node->widget == NULL) {
+        node = node->first;
+    }
+
+    return node->widget;
+}
+
+/*
+ * Each split adds the first widget of its second half next to the first widget of its first half, which is already
+ * in place when the splits are replayed in this (pre-)order
+ */
+static void collect_steps(TileNode *node, GArray *steps) {
+    if (node->widget != NULL) {
+        return;
+    }
+
+    StultoTilesStep step = {
+            .widget = first_widget(node->second),
+            .sibling = first_widget(node->first),
+            .orientation = node->orientation,
+            .ratio = node->ratio,
+    };
+
+    g_array_append_val(steps, step);
+
+    collect_steps(node->first, steps);
+    collect_steps(node->second, steps);
+}
+
+/*
+ * The number of panes lined up along an orientation, i.e. how many pane extras and dividers a node spans
+ */
+static gint count_panes(TileNode *node, GtkOrientation orientation) {
+    if (node->widget != NULL) {
+        return 1;
+    }
+
+    gint first = count_panes(node->first, orientation);
+    gint second = count_panes(node->second, orientation);
+
+    return node->orientation == orientation ? first + second : MAX(first, second);
+}
+
+static gint measure_node(TileNode *node, GtkOrientation orientation, gboolean natural) {
+    if (node->widget != NULL) {
+        gint minimum_size = 0;
+        gint natural_size = 0;
+
+        if (gtk_widget_get_visible(node->widget)) {
+            if (orientation == GTK_ORIENTATION_HORIZONTAL) {
+                gtk_widget_get_preferred_width(node->widget, &minimum_size, &natural_size);
+            } else {
+                gtk_widget_get_preferred_height(node->widget, &minimum_size, &natural_size);
+            }
+        }
+
+        return natural ? natural_size : minimum_size;
+    }
+
+    gint first = measure_node(node->first, orientation, natural);
+    gint second = measure_node(node->second, orientation, natural);
+
+    return node->orientation == orientation ? first + STULTO_TILES_DIVIDER + second : MAX(first, second);
+}
+
+// endregion
+
+// region Layout
+
+/*
+ * Size of a split's first child: its share of the space, rounded to whole cells of the panes it spans
+ */
+static gint snap_first_size(StultoTiles *tiles, TileNode *node, gint space) {
+    gboolean horizontal = node->orientation == GTK_ORIENTATION_HORIZONTAL;
+    gint cell = horizontal ? tiles->cell_width : tiles->cell_height;
+    gint extra = horizontal ? tiles->extra_width : tiles->extra_height;
+    gint size = (gint) (space * node->ratio + 0.5);
+
+    if (cell > 0) {
+        gint panes = count_panes(node->first, node->orientation);
+        gint fixed = panes * extra + (panes - 1) * STULTO_TILES_DIVIDER;
+        gint cells = MAX((size - fixed + cell / 2) / cell, 1);
+
+        size = fixed + cells * cell;
+    }
+
+    return CLAMP(size, 0, space);
+}
+
+static void layout_node(StultoTiles *tiles, TileNode *node, const GtkAllocation *allocation) {
+    node->allocation = *allocation;
+
+    if (node->widget != NULL) {
+        return;
+    }
+
+    GtkAllocation first = *allocation;
+    GtkAllocation second = *allocation;
+
+    if (node->orientation == GTK_ORIENTATION_HORIZONTAL) {
+        gint space = MAX(allocation->width - STULTO_TILES_DIVIDER, 0);
+
+        first.width = snap_first_size(tiles, node, space);
+        second.x = allocation->x + first.width + STULTO_TILES_DIVIDER;
+        second.width = space - first.width;
+    } else {
+        gint space = MAX(allocation->height - STULTO_TILES_DIVIDER, 0);
+
+        first.height = snap_first_size(tiles, node, space);
+        second.y = allocation->y + first.height + STULTO_TILES_DIVIDER;
+        second.height = space - first.height;
+    }
+
+    layout_node(tiles, node->first, &first);
+    layout_node(tiles, node->second, &second);
+}
+
+static gboolean is_in_direction(const GtkAllocation *from, const GtkAllocation *to, GtkDirectionType direction,
+                                gint *gap, gint *overlap) {
+    switch (direction) {
+        case GTK_DIR_LEFT:
+        case GTK_DIR_RIGHT:
+            *gap = direction == GTK_DIR_LEFT ? from->x - (to->x + to->width) : to->x - (from->x + from->width);
+            *overlap = MIN(from->y + from->height, to->y + to->height) - MAX(from->y, to->y);
+            break;
+        case GTK_DIR_UP:
+        case GTK_DIR_DOWN:
+            *gap = direction == GTK_DIR_UP ? from->y - (to->y + to->height) : to->y - (from->y + from->height);
+            *overlap = MIN(from->x + from->width, to->x + to->width) - MAX(from->x, to->x);
+            break;
+        default:
+            return FALSE;
+    }
+
+    return *gap >= 0 && *overlap > 0;
+}
+
+// endregion
+
+// region GObject/GtkWidget lifecycle
+
+static void stulto_tiles_dispose(GObject *object) {
+    StultoTiles *tiles = STULTO_TILES(object);
+
+    /* Unparents every child, collapsing the tree as it goes */
+    while (tiles->root != NULL) {
+        GPtrArray *leaves = g_ptr_array_new();
+
+        collect_leaves(tiles->root, leaves);
+        gtk_container_remove(GTK_CONTAINER(tiles), ((TileNode *) g_ptr_array_index(leaves, 0))->widget);
+        g_ptr_array_unref(leaves);
+    }
+
+    G_OBJECT_CLASS(stulto_tiles_parent_class)->dispose(object);
+}
+
+static void stulto_tiles_get_preferred_width(GtkWidget *widget, gint *minimum, gint *natural) {
+    StultoTiles *tiles = STULTO_TILES(widget);
+    TileNode *node = tiles->zoomed != NULL ? tiles->zoomed : tiles->root;
+
+    *minimum = node != NULL ? measure_node(node, GTK_ORIENTATION_HORIZONTAL, FALSE) : 0;
+    *natural = node != NULL ? measure_node(node, GTK_ORIENTATION_HORIZONTAL, TRUE) : 0;
+}
+
+static void stulto_tiles_get_preferred_height(GtkWidget *widget, gint *minimum, gint *natural) {
+    StultoTiles *tiles = STULTO_TILES(widget);
+    TileNode *node = tiles->zoomed != NULL ? tiles->zoomed : tiles->root;
+
+    *minimum = node != NULL ? measure_node(node, GTK_ORIENTATION_VERTICAL, FALSE) : 0;
+    *natural = node != NULL ? measure_node(node, GTK_ORIENTATION_VERTICAL, TRUE) : 0;
+}
+
+static void stulto_tiles_size_allocate(GtkWidget *widget, GtkAllocation *allocation) {
+    StultoTiles *tiles = STULTO_TILES(widget);
+    gint64 start_time = g_get_monotonic_time();
+
+    gtk_widget_set_allocation(widget, allocation);
+
+    if (tiles->root == NULL) {
+        return;
+    }
+
+    /* The whole tree is laid out first, then every pane is allocated exactly once */
+    layout_node(tiles, tiles->root, allocation);
+
+    GPtrArray *leaves = g_ptr_array_new();
+
+    collect_leaves(tiles->root, leaves);
+
+    for (guint i = 0; i < leaves->len; i++) {
+        TileNode *leaf = g_ptr_array_index(leaves, i);
+        gboolean shown = tiles->zoomed == NULL || tiles->zoomed == leaf;
+
+        gtk_widget_set_child_visible(leaf->widget, shown);
+
+        if (shown) {
+            gtk_widget_size_allocate(leaf->widget, tiles->zoomed != NULL ? allocation : &leaf->allocation);
+        }
+    }
+
+    g_debug("Allocated %u panes of %dx%d in %.3f ms",
+            leaves->len, allocation->width, allocation->height,
+            (g_get_monotonic_time() - start_time) / 1000.0);
+
+    g_ptr_array_unref(leaves);
+}
+
+static void draw_dividers(TileNode *node, cairo_t *cr, const GtkAllocation *origin) {
+    if (node->widget != NULL) {
+        return;
+    }
+
+    GtkAllocation *first = &node->first->allocation;
+
+    if (node->orientation == GTK_ORIENTATION_HORIZONTAL) {
+        cairo_rectangle(cr, first->x + first->width - origin->x, node->allocation.y - origin->y,
+                        STULTO_TILES_DIVIDER, node->allocation.height);
+    } else {
+        cairo_rectangle(cr, node->allocation.x - origin->x, first->y + first->height - origin->y,
+                        node->allocation.width, STULTO_TILES_DIVIDER);
+    }
+
+    draw_dividers(node->first, cr, origin);
+    draw_dividers(node->second, cr, origin);
+}
+
+static gboolean stulto_tiles_draw(GtkWidget *widget, cairo_t *cr) {
+    StultoTiles *tiles = STULTO_TILES(widget);
+
+    if (tiles->root != NULL && tiles->zoomed == NULL) {
+        GtkStyleContext *style_context = gtk_widget_get_style_context(widget);
+        GtkAllocation allocation;
+        GdkRGBA color;
+
+        gtk_widget_get_allocation(widget, &allocation);
+        gtk_style_context_get_color(style_context, gtk_style_context_get_state(style_context), &color);
+
+        cairo_save(cr);
+        draw_dividers(tiles->root, cr, &allocation);
+        cairo_set_source_rgba(cr, color.red, color.green, color.blue, color.alpha * 0.3);
+        cairo_fill(cr);
+        cairo_restore(cr);
+    }
+
+    return GTK_WIDGET_CLASS(stulto_tiles_parent_class)->draw(widget, cr);
+}
+
+/*
+ * Children added without a sibling to split go beside the last pane
+ */
+static void stulto_tiles_add(GtkContainer *container, GtkWidget *child) {
+    StultoTiles *tiles = STULTO_TILES(container);
+
+    if (tiles->root == NULL) {
+        tiles->root = node_new_leaf(child);
+        gtk_widget_set_parent(child, GTK_WIDGET(tiles));
+        return;
+    }
+
+    GPtrArray *leaves = g_ptr_array_new();
+
+    collect_leaves(tiles->root, leaves);
+    stulto_tiles_split(
+            tiles,
+            ((TileNode *) g_ptr_array_index(leaves, leaves->len - 1))->widget,
+            child,
+            GTK_ORIENTATION_HORIZONTAL);
+    g_ptr_array_unref(leaves);
+}
+
+/*
+ * The removed child's sibling takes over the space of their split
+ */
+static void stulto_tiles_remove(GtkContainer *container, GtkWidget *child) {
+    StultoTiles *tiles = STULTO_TILES(container);
+    TileNode *leaf = find_leaf(tiles->root, child);
+
+    g_return_if_fail(leaf != NULL);
+
+    if (tiles->zoomed == leaf) {
+        tiles->zoomed = NULL;
+    }
+
+    TileNode *split = leaf->parent;
+
+    if (split == NULL) {
+        tiles->root = NULL;
+    } else {
+        TileNode *sibling = split->first == leaf ? split->second : split->first;
+
+        replace_node(tiles, split, sibling);
+        split->first = NULL;
+        split->second = NULL;
+        node_free(split);
+    }
+
+    node_free(leaf);
+
+    gboolean was_visible = gtk_widget_get_visible(child);
+
+    gtk_widget_unparent(child);
+
+    if (was_visible) {
+        gtk_widget_queue_resize(GTK_WIDGET(tiles));
+    }
+}
+
+static void stulto_tiles_forall(GtkContainer *container, gboolean include_internals, GtkCallback callback, gpointer data) {
+    StultoTiles *tiles = STULTO_TILES(container);
+    GPtrArray *leaves = g_ptr_array_new();
+
+    /* The callback may remove children */
+    collect_leaves(tiles->root, leaves);
+
+    for (guint i = 0; i < leaves->len; i++) {
+        callback(((TileNode *) g_ptr_array_index(leaves, i))->widget, data);
+    }
+
+    g_ptr_array_unref(leaves);
+}
+
+static GType stulto_tiles_child_type(GtkContainer *container) {
+    return GTK_TYPE_WIDGET;
+}
+
+static void stulto_tiles_class_init(StultoTilesClass *klass) {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
+    GtkContainerClass *container_class = GTK_CONTAINER_CLASS(klass);
+
+    object_class->dispose = stulto_tiles_dispose;
+
+    widget_class->get_preferred_width = stulto_tiles_get_preferred_width;
+    widget_class->get_preferred_height = stulto_tiles_get_preferred_height;
+    widget_class->size_allocate = stulto_tiles_size_allocate;
+    widget_class->draw = stulto_tiles_draw;
+
+    container_class->add = stulto_tiles_add;
+    container_class->remove = stulto_tiles_remove;
+    container_class->forall = stulto_tiles_forall;
+    container_class->child_type = stulto_tiles_child_type;
+}
+
+static void stulto_tiles_init(StultoTiles *tiles) {
+    gtk_widget_set_has_window(GTK_WIDGET(tiles), FALSE);
+}
+
+StultoTiles *stulto_tiles_new() {
+    return STULTO_TILES(g_object_new(STULTO_TYPE_TILES, NULL));
+}
+
+// endregion
+
+// region Splits
+
+/*
+ * Split a child's space in two, giving the second half to a new child
+ */
+void stulto_tiles_split(StultoTiles *tiles, GtkWidget *sibling, GtkWidget *child, GtkOrientation orientation) {
+    g_return_if_fail(STULTO_IS_TILES(tiles));
+
+    TileNode *leaf = find_leaf(tiles->root, sibling);
+
+    g_return_if_fail(leaf != NULL);
+
+    TileNode *split = g_new0(TileNode, 1);
+
+    split->orientation = orientation;
+    split->ratio = 0.5;
+    split->allocation = leaf->allocation;
+
+    replace_node(tiles, leaf, split);
+
+    split->first = leaf;
+    split->second = node_new_leaf(child);
+    leaf->parent = split;
+    split->second->parent = split;
+
+    /* A new pane isn't hidden behind a zoomed one */
+    tiles->zoomed = NULL;
+
+    gtk_widget_set_parent(child, GTK_WIDGET(tiles));
+    gtk_widget_queue_resize(GTK_WIDGET(tiles));
+}
+
+/*
+ * Move the edge of a child's pane in a direction, by whole cells
+ */
+void stulto_tiles_resize(StultoTiles *tiles, GtkWidget *child, GtkDirectionType direction, gint cells) {
+    g_return_if_fail(STULTO_IS_TILES(tiles));
+
+    TileNode *leaf = find_leaf(tiles->root, child);
+    GtkOrientation orientation = direction == GTK_DIR_LEFT || direction == GTK_DIR_RIGHT
+            ? GTK_ORIENTATION_HORIZONTAL
+            : GTK_ORIENTATION_VERTICAL;
+
+    g_return_if_fail(leaf != NULL);
+
+    /* The nearest split along that axis */
+    TileNode *split = leaf->parent;
+
+    while (split != NULL && split->orientation != orientation) {
+        split = split->parent;
+    }
+
+    if (split == NULL) {
+        return;
+    }
+
+    gboolean horizontal = orientation == GTK_ORIENTATION_HORIZONTAL;
+    gint cell = horizontal ? tiles->cell_width : tiles->cell_height;
+    gint space = (horizontal ? split->allocation.width : split->allocation.height) - STULTO_TILES_DIVIDER;
+    gint first = horizontal ? split->first->allocation.width : split->first->allocation.height;
+    gint delta = cells * MAX(cell, 1);
+
+    if (space <= 0) {
+        return;
+    }
+
+    /* Neither side shrinks below a cell */
+    first += direction == GTK_DIR_LEFT || direction == GTK_DIR_UP ? -delta : delta;
+    first = MIN(MAX(first, MAX(cell, 1)), space - MAX(cell, 1));
+    split->ratio = CLAMP((gdouble) first / space, 0.0, 1.0);
+
+    gtk_widget_queue_resize(GTK_WIDGET(tiles));
+}
+
+/*
+ * Set the share of the space a child gets from the split which added it
+ */
+void stulto_tiles_set_ratio(StultoTiles *tiles, GtkWidget *child, gdouble ratio) {
+    g_return_if_fail(STULTO_IS_TILES(tiles));
+
+    TileNode *leaf = find_leaf(tiles->root, child);
+
+    g_return_if_fail(leaf != NULL);
+
+    if (leaf->parent != NULL) {
+        leaf->parent->ratio = CLAMP(ratio, 0.0, 1.0);
+        gtk_widget_queue_resize(GTK_WIDGET(tiles));
+    }
+}
+
+/*
+ * The steps which rebuild the current layout, of StultoTilesStep; the first one only has a widget
+ */
+GArray *stulto_tiles_get_steps(StultoTiles *tiles) {
+    g_return_val_if_fail(STULTO_IS_TILES(tiles), NULL);
+
+    GArray *steps = g_array_new(FALSE, FALSE, sizeof(StultoTilesStep));
+
+    if (tiles->root != NULL) {
+        StultoTilesStep first = {.widget = first_widget(tiles->root)};
+
+        g_array_append_val(steps, first);
+        collect_steps(tiles->root, steps);
+    }
+
+    return steps;
+}
+
+// endregion
+
+// region Properties
+
+/*
+ * The pane next to a child's in a direction, preferring the closest and then the one most in line with it
+ */
+GtkWidget *stulto_tiles_get_neighbor(StultoTiles *tiles, GtkWidget *child, GtkDirectionType direction) {
+    g_return_val_if_fail(STULTO_IS_TILES(tiles), NULL);
+
+    TileNode *leaf = find_leaf(tiles->root, child);
+    TileNode *best = NULL;
+    gint best_gap = G_MAXINT;
+    gint best_overlap = 0;
+
+    g_return_val_if_fail(leaf != NULL, NULL);
+
+    GPtrArray *leaves = g_ptr_array_new();
+
+    collect_leaves(tiles->root, leaves);
+
+    for (guint i = 0; i < leaves->len; i++) {
+        TileNode *other = g_ptr_array_index(leaves, i);
+        gint gap;
+        gint overlap;
+
+        if (other == leaf || !is_in_direction(&leaf->allocation, &other->allocation, direction, &gap, &overlap)) {
+            continue;
+        }
+
+        if (gap < best_gap || (gap == best_gap && overlap > best_overlap)) {
+            best = other;
+            best_gap = gap;
+            best_overlap = overlap;
+        }
+    }
+
+    g_ptr_array_unref(leaves);
+
+    return best != NULL ? best->widget : NULL;
+}
+
+GtkWidget *stulto_tiles_get_zoomed(StultoTiles *tiles) {
+    g_return_val_if_fail(STULTO_IS_TILES(tiles), NULL);
+
+    return tiles->zoomed != NULL ? tiles->zoomed->widget : NULL;
+}
+
+/*
+ * Give one child all of the space, hiding the others, or lay them all out again given NULL
+ */
+void stulto_tiles_set_zoomed(StultoTiles *tiles, GtkWidget *child) {
+    g_return_if_fail(STULTO_IS_TILES(tiles));
+
+    tiles->zoomed = child != NULL ? find_leaf(tiles->root, child) : NULL;
+
+    gtk_widget_queue_resize(GTK_WIDGET(tiles));
+}
+
+/*
+ * The most panes laid out side by side (horizontally) or one above another (vertically); a zoomed pane is alone
+ */
+gint stulto_tiles_count_panes(StultoTiles *tiles, GtkOrientation orientation) {
+    g_return_val_if_fail(STULTO_IS_TILES(tiles), 0);
+
+    if (tiles->root == NULL) {
+        return 0;
+    }
+
+    return tiles->zoomed != NULL ? 1 : count_panes(tiles->root, orientation);
+}
+
+void stulto_tiles_set_cell_size(StultoTiles *tiles, gint cell_width, gint cell_height, gint extra_width, gint extra_height) {
+    g_return_if_fail(STULTO_IS_TILES(tiles));
+
+    if (tiles->cell_width == cell_width && tiles->cell_height == cell_height &&
+        tiles->extra_width == extra_width && tiles->extra_height == extra_height) {
+        return;
+    }
+
+    tiles->cell_width = cell_width;
+    tiles->cell_height = cell_height;
+    tiles->extra_width = extra_width;
+    tiles->extra_height = extra_height;
+
+    gtk_widget_queue_resize(GTK_WIDGET(tiles));
+}
+
+// endregion
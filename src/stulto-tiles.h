@@ -0,0 +1,65 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_TILES_H
+#define STULTO_TILES_H
+
+#include <gtk/gtk.h>
+
+/*
+ * A container that lays its children out as a tree of horizontal and vertical splits
+ *
+ * The whole tree is laid out in a single pass per size allocation, rather than through a chain of nested GtkPaneds
+ * that each allocate their own children in turn. Splits are snapped to whole character cells, so that a pane only
+ * ever changes size by whole rows and columns and no terminal has to reflow for a fraction of a cell
+ */
+
+G_BEGIN_DECLS
+
+#define STULTO_TYPE_TILES stulto_tiles_get_type()
+G_DECLARE_FINAL_TYPE(StultoTiles, stulto_tiles, STULTO, TILES, GtkContainer)
+
+/* One split of a layout: the widget is added by splitting its sibling's pane. Replaying a layout's steps in order
+ * (adding the first step's widget, which has no sibling, on its own) rebuilds it */
+typedef struct _StultoTilesStep {
+    GtkWidget *widget;
+    GtkWidget *sibling;
+    GtkOrientation orientation;
+    gdouble ratio;
+} StultoTilesStep;
+
+StultoTiles *stulto_tiles_new();
+
+void stulto_tiles_split(StultoTiles *tiles, GtkWidget *sibling, GtkWidget *child, GtkOrientation orientation);
+void stulto_tiles_resize(StultoTiles *tiles, GtkWidget *child, GtkDirectionType direction, gint cells);
+void stulto_tiles_set_ratio(StultoTiles *tiles, GtkWidget *child, gdouble ratio);
+
+GArray *stulto_tiles_get_steps(StultoTiles *tiles);
+
+GtkWidget *stulto_tiles_get_neighbor(StultoTiles *tiles, GtkWidget *child, GtkDirectionType direction);
+
+GtkWidget *stulto_tiles_get_zoomed(StultoTiles *tiles);
+void stulto_tiles_set_zoomed(StultoTiles *tiles, GtkWidget *child);
+gint stulto_tiles_count_panes(StultoTiles *tiles, GtkOrientation orientation);
+
+void stulto_tiles_set_cell_size(StultoTiles *tiles, gint cell_width, gint cell_height, gint extra_width, gint extra_height);
+
+G_END_DECLS
+
+#endif //STULTO_TILES_H
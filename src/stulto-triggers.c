@@ -0,0 +1,316 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string.h>
+
+#include "stulto-triggers.h"
+#include "stulto-line-splitter.h"
+
+/* Output chunks allowed to queue up for the worker before output is skipped rather than buffered */
+#define STULTO_TRIGGER_MAX_BACKLOG 64
+/* Lines longer than this are matched on their first bytes only */
+#define STULTO_TRIGGER_MAX_LINE 4096
+
+struct _StultoTriggerWatch {
+    gint ref_count;
+
+    StultoTriggerSet *set;
+    GThreadPool *pool;
+    gboolean overflowed;
+
+    /* Worker thread state */
+    StultoLineSplitter *splitter;
+    gint64 *last_fired;
+    /* Triggers that already fired on the partial line, so they don't again when it is complete */
+    gboolean *fired_on_line;
+    pcre2_match_data *match_data;
+
+    /* Main thread only; cleared once the owning terminal is gone */
+    StultoTriggerFiredFunc fired_func;
+    gpointer user_data;
+};
+
+typedef struct _TriggerFiring {
+    StultoTriggerWatch *watch;
+    const StultoTrigger *trigger;
+    gchar *line;
+} TriggerFiring;
+
+static pcre2_code *compile_regex(const gchar *regex, GError **error) {
+    int error_code;
+    PCRE2_SIZE error_offset;
+
+    pcre2_code *code = pcre2_compile((PCRE2_SPTR) regex, PCRE2_ZERO_TERMINATED, 0, &error_code, &error_offset, NULL);
+
+    if (code == NULL) {
+        PCRE2_UCHAR message[256];
+
+        pcre2_get_error_message(error_code, message, sizeof(message));
+        g_set_error(error, G_REGEX_ERROR, G_REGEX_ERROR_COMPILE, "%s at offset %" G_GSIZE_FORMAT,
+                    (gchar *) message, (gsize) error_offset);
+
+        return NULL;
+    }
+
+    /* Not fatal - PCRE2 falls back to the interpreter where JIT isn't available */
+    pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+
+    return code;
+}
+
+// region Trigger sets
+
+StultoTriggerSet *stulto_trigger_set_new() {
+    StultoTriggerSet *set = g_new0(StultoTriggerSet, 1);
+
+    set->triggers = g_ptr_array_new();
+
+    return set;
+}
+
+gboolean stulto_trigger_set_add(StultoTriggerSet *set,
+                                const gchar *name,
+                                const gchar *regex,
+                                StultoTriggerAction action,
+                                const gchar *command,
+                                gint64 rate_limit_usec,
+                                GError **error) {
+    g_return_val_if_fail(set->prefilter_code == NULL, FALSE);
+
+    pcre2_code *code = compile_regex(regex, error);
+
+    if (code == NULL) {
+        return FALSE;
+    }
+
+    StultoTrigger *trigger = g_new0(StultoTrigger, 1);
+
+    trigger->name = g_strdup(name);
+    trigger->regex = g_strdup(regex);
+    trigger->action = action;
+    trigger->command = g_strdup(command);
+    trigger->rate_limit_usec = rate_limit_usec;
+    trigger->code = code;
+
+    g_ptr_array_add(set->triggers, trigger);
+
+    return TRUE;
+}
+
+gboolean stulto_trigger_set_compile(StultoTriggerSet *set, GError **error) {
+    g_return_val_if_fail(set->triggers->len > 0, FALSE);
+
+    GString *pattern = g_string_new(NULL);
+
+    for (guint i = 0; i < set->triggers->len; i++) {
+        StultoTrigger *trigger = g_ptr_array_index(set->triggers, i);
+
+        if (i > 0) {
+            g_string_append_c(pattern, '|');
+        }
+        g_string_append_printf(pattern, "(?:%s)", trigger->regex);
+    }
+
+    set->prefilter_code = compile_regex(pattern->str, error);
+
+    g_string_free(pattern, TRUE);
+
+    return set->prefilter_code != NULL;
+}
+
+void stulto_trigger_set_free(StultoTriggerSet *set) {
+    if (set == NULL) {
+        return;
+    }
+
+    for (guint i = 0; i < set->triggers->len; i++) {
+        StultoTrigger *trigger = g_ptr_array_index(set->triggers, i);
+
+        g_free(trigger->name);
+        g_free(trigger->regex);
+        g_free(trigger->command);
+        pcre2_code_free(trigger->code);
+        g_free(trigger);
+    }
+    g_ptr_array_free(set->triggers, TRUE);
+
+    g_clear_pointer(&set->prefilter_code, pcre2_code_free);
+    g_free(set);
+}
+
+// endregion
+
+// region Worker thread
+
+static void watch_unref(StultoTriggerWatch *watch) {
+    if (!g_atomic_int_dec_and_test(&watch->ref_count)) {
+        return;
+    }
+
+    stulto_line_splitter_free(watch->splitter);
+    g_free(watch->last_fired);
+    g_free(watch->fired_on_line);
+    pcre2_match_data_free(watch->match_data);
+    g_free(watch);
+}
+
+static gboolean trigger_fired_cb(gpointer data) {
+    TriggerFiring *firing = data;
+    StultoTriggerWatch *watch = firing->watch;
+
+    if (watch->fired_func != NULL) {
+        watch->fired_func(firing->trigger, firing->line, watch->user_data);
+    }
+
+    watch_unref(watch);
+    g_free(firing->line);
+    g_free(firing);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean regex_matches(pcre2_code *code, pcre2_match_data *match_data, const gchar *line, gsize len) {
+    return pcre2_match(code, (PCRE2_SPTR) line, len, 0, 0, match_data, NULL) >= 0;
+}
+
+static void match_line(StultoTriggerWatch *watch, const gchar *line, gsize len, gboolean partial) {
+    StultoTriggerSet *set = watch->set;
+
+    if (!regex_matches(set->prefilter_code, watch->match_data, line, len)) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+
+    for (guint i = 0; i < set->triggers->len; i++) {
+        StultoTrigger *trigger = g_ptr_array_index(set->triggers, i);
+
+        if (watch->fired_on_line[i]) {
+            continue;
+        }
+        if (watch->last_fired[i] != 0 && now - watch->last_fired[i] < trigger->rate_limit_usec) {
+            continue;
+        }
+        if (!regex_matches(trigger->code, watch->match_data, line, len)) {
+            continue;
+        }
+
+        watch->last_fired[i] = now;
+        watch->fired_on_line[i] = partial;
+
+        TriggerFiring *firing = g_new0(TriggerFiring, 1);
+
+        g_atomic_int_inc(&watch->ref_count);
+        firing->watch = watch;
+        firing->trigger = trigger;
+        firing->line = g_strndup(line, len);
+
+        g_idle_add(trigger_fired_cb, firing);
+    }
+}
+
+static void complete_line(const gchar *line, gsize len, gpointer data) {
+    StultoTriggerWatch *watch = data;
+
+    if (len > 0) {
+        match_line(watch, line, len, FALSE);
+    }
+
+    memset(watch->fired_on_line, 0, watch->set->triggers->len * sizeof(gboolean));
+}
+
+static void watch_process_chunk(gpointer chunk_data, gpointer watch_data) {
+    GBytes *chunk = chunk_data;
+    StultoTriggerWatch *watch = watch_data;
+
+    gsize len;
+    const gchar *data = g_bytes_get_data(chunk, &len);
+
+    /* An empty chunk marks output skipped under backlog; the partial line before it is meaningless now */
+    if (len == 0) {
+        stulto_line_splitter_reset(watch->splitter);
+        memset(watch->fired_on_line, 0, watch->set->triggers->len * sizeof(gboolean));
+    }
+
+    stulto_line_splitter_feed(watch->splitter, data, len, complete_line, watch);
+
+    /* A prompt, e.g., for a password, is left unfinished for as long as it waits */
+    gsize partial_len;
+    const gchar *partial = stulto_line_splitter_peek(watch->splitter, &partial_len);
+
+    if (partial_len > 0) {
+        match_line(watch, partial, partial_len, TRUE);
+    }
+
+    g_bytes_unref(chunk);
+}
+
+// endregion
+
+// region Watches
+
+StultoTriggerWatch *stulto_trigger_watch_new(StultoTriggerSet *set, StultoTriggerFiredFunc fired_func, gpointer user_data) {
+    g_return_val_if_fail(set->prefilter_code != NULL, NULL);
+
+    StultoTriggerWatch *watch = g_new0(StultoTriggerWatch, 1);
+
+    watch->ref_count = 1;
+    watch->set = set;
+    watch->splitter = stulto_line_splitter_new(STULTO_TRIGGER_MAX_LINE);
+    watch->last_fired = g_new0(gint64, set->triggers->len);
+    watch->fired_on_line = g_new0(gboolean, set->triggers->len);
+    watch->match_data = pcre2_match_data_create(1, NULL);
+    watch->fired_func = fired_func;
+    watch->user_data = user_data;
+
+    /* A single thread per watch keeps chunks in order; idle pool threads are shared between watches */
+    watch->pool = g_thread_pool_new_full(watch_process_chunk, watch, (GDestroyNotify) g_bytes_unref, 1, FALSE, NULL);
+
+    return watch;
+}
+
+void stulto_trigger_watch_feed(StultoTriggerWatch *watch, const gchar *data, gsize len) {
+    if (g_thread_pool_unprocessed(watch->pool) >= STULTO_TRIGGER_MAX_BACKLOG) {
+        if (!watch->overflowed) {
+            g_thread_pool_push(watch->pool, g_bytes_new(NULL, 0), NULL);
+            watch->overflowed = TRUE;
+        }
+
+        return;
+    }
+
+    watch->overflowed = FALSE;
+
+    g_thread_pool_push(watch->pool, g_bytes_new(data, len), NULL);
+}
+
+void stulto_trigger_watch_free(StultoTriggerWatch *watch) {
+    if (watch == NULL) {
+        return;
+    }
+
+    watch->fired_func = NULL;
+
+    /* Drop queued output, but let the chunk in progress finish before the worker state goes away */
+    g_thread_pool_free(watch->pool, TRUE, TRUE);
+
+    watch_unref(watch);
+}
+
+// endregion
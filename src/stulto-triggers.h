@@ -0,0 +1,81 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_TRIGGERS_H
+#define STULTO_TRIGGERS_H
+
+#include <glib.h>
+
+#ifndef PCRE2_CODE_UNIT_WIDTH
+#define PCRE2_CODE_UNIT_WIDTH 8
+#endif
+
+#include <pcre2.h>
+
+/*
+ * Output triggers - regexes watched for in a terminal's output, each with an action to take when a line matches
+ *
+ * A StultoTriggerSet belongs to a profile and holds the compiled regexes: one JIT-compiled alternation of every
+ * trigger, used to reject non-matching lines in a single pass, plus each trigger's own regex to find out which ones
+ * fired. A StultoTriggerWatch runs a set against one terminal's output: raw output is copied off the PTY as it arrives
+ * and split into lines, stripped of escape sequences, and matched on a worker thread, so only newly completed lines (and
+ * the unfinished line each read leaves behind, such as a prompt) are ever examined and the GUI thread never does more
+ * than a memcpy per read
+ */
+
+typedef enum {
+    STULTO_TRIGGER_ACTION_NOTIFY,
+    STULTO_TRIGGER_ACTION_HIGHLIGHT,
+    STULTO_TRIGGER_ACTION_COMMAND,
+} StultoTriggerAction;
+
+typedef struct _StultoTrigger {
+    gchar *name;
+    gchar *regex;
+    StultoTriggerAction action;
+    gchar *command;
+    gint64 rate_limit_usec;
+    pcre2_code *code;
+} StultoTrigger;
+
+typedef struct _StultoTriggerSet {
+    GPtrArray *triggers;
+    pcre2_code *prefilter_code;
+} StultoTriggerSet;
+
+typedef struct _StultoTriggerWatch StultoTriggerWatch;
+
+typedef void (*StultoTriggerFiredFunc)(const StultoTrigger *trigger, const gchar *line, gpointer user_data);
+
+StultoTriggerSet *stulto_trigger_set_new();
+gboolean stulto_trigger_set_add(StultoTriggerSet *set,
+                                const gchar *name,
+                                const gchar *regex,
+                                StultoTriggerAction action,
+                                const gchar *command,
+                                gint64 rate_limit_usec,
+                                GError **error);
+gboolean stulto_trigger_set_compile(StultoTriggerSet *set, GError **error);
+void stulto_trigger_set_free(StultoTriggerSet *set);
+
+StultoTriggerWatch *stulto_trigger_watch_new(StultoTriggerSet *set, StultoTriggerFiredFunc fired_func, gpointer user_data);
+void stulto_trigger_watch_feed(StultoTriggerWatch *watch, const gchar *data, gsize len);
+void stulto_trigger_watch_free(StultoTriggerWatch *watch);
+
+#endif //STULTO_TRIGGERS_H
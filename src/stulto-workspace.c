@@ -0,0 +1,287 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string.h>
+
+#include "stulto-workspace.h"
+#include "stulto-holder-protocol.h"
+
+#define SESSION_GROUP_PREFIX "session:"
+#define PANE_GROUP_PREFIX "pane:"
+
+static void pane_free(StultoWorkspacePane *pane) {
+    g_free(pane->name);
+    g_free(pane->parent);
+    g_free(pane->scrollback_path);
+    /* Unless it went to the pane's terminal */
+    stulto_exec_data_free(pane->exec_data);
+    g_free(pane);
+}
+
+void stulto_workspace_session_free(StultoWorkspaceSession *session) {
+    if (session == NULL) {
+        return;
+    }
+
+    g_free(session->name);
+    g_ptr_array_unref(session->panes);
+    g_free(session);
+}
+
+/*
+ * Paths are taken relative to the workspace file, with ~ standing for the home directory
+ */
+static gchar *resolve_path(const gchar *workspace_path, const gchar *path) {
+    if (g_str_equal(path, "~") || g_str_has_prefix(path, "~/")) {
+        return g_build_filename(g_get_home_dir(), path + 1, NULL);
+    }
+
+    if (g_path_is_absolute(path)) {
+        return g_strdup(path);
+    }
+
+    gchar *dir = g_path_get_dirname(workspace_path);
+    gchar *resolved = g_build_filename(dir, path, NULL);
+
+    g_free(dir);
+
+    return resolved;
+}
+
+static StultoWorkspacePane *parse_pane(GKeyFile *file, const gchar *path, const gchar *group, GHashTable *profiles,
+                                       GError **error) {
+    gchar *command = g_key_file_get_string(file, group, "command", NULL);
+    gchar *cwd = g_key_file_get_string(file, group, "cwd", NULL);
+    gchar *profile_path = g_key_file_get_string(file, group, "profile", NULL);
+    gchar *split = g_key_file_get_string(file, group, "split", NULL);
+    gchar *scrollback = g_key_file_get_string(file, group, "scrollback", NULL);
+    gdouble ratio = 0.5;
+    gchar **argv = NULL;
+    StultoWorkspacePane *pane = NULL;
+
+    if (split != NULL && !g_str_equal(split, "right") && !g_str_equal(split, "below")) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "Section [%s] must specify split as right or below", group);
+        goto out;
+    }
+
+    if (g_key_file_has_key(file, group, "ratio", NULL)) {
+        ratio = g_key_file_get_double(file, group, "ratio", NULL);
+
+        if (ratio <= 0 || ratio >= 1) {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                        "Section [%s] must specify ratio between 0 and 1", group);
+            goto out;
+        }
+    }
+
+    if (command != NULL && !g_shell_parse_argv(command, NULL, &argv, error)) {
+        g_prefix_error(error, "Section [%s]: ", group);
+        goto out;
+    }
+
+    pane = g_new0(StultoWorkspacePane, 1);
+    pane->name = g_strdup(group + strlen(PANE_GROUP_PREFIX));
+    pane->exec_data = stulto_exec_data_create(argv);
+    pane->split = split != NULL && g_str_equal(split, "below") ? GTK_ORIENTATION_VERTICAL : GTK_ORIENTATION_HORIZONTAL;
+    pane->parent = g_key_file_get_string(file, group, "parent", NULL);
+    pane->ratio = ratio;
+    pane->exec_data->holder_id = (guint) MAX(g_key_file_get_integer(file, group, STULTO_HOLDER_PANE_KEY, NULL), 0);
+
+    if (scrollback != NULL) {
+        pane->scrollback_path = resolve_path(path, scrollback);
+    }
+
+    if (cwd != NULL) {
+        pane->exec_data->cwd = resolve_path(path, cwd);
+    }
+
+    /* Panes sharing a profile share its settings, matchers and triggers */
+    if (profile_path != NULL) {
+        gchar *resolved = resolve_path(path, profile_path);
+
+        pane->profile = g_hash_table_lookup(profiles, resolved);
+
+        if (pane->profile == NULL) {
+            /* The profile keeps the path it was parsed from */
+            pane->profile = stulto_terminal_profile_parse(resolved);
+            g_hash_table_insert(profiles, g_strdup(resolved), pane->profile);
+        } else {
+            g_free(resolved);
+        }
+    }
+
+out:
+    g_free(command);
+    g_free(cwd);
+    g_free(profile_path);
+    g_free(split);
+    g_free(scrollback);
+
+    return pane;
+}
+
+static StultoWorkspace *parse_workspace(GKeyFile *file, const gchar *path, GError **error) {
+    StultoWorkspace *workspace = g_new0(StultoWorkspace, 1);
+    GHashTable *profiles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    gchar **groups = g_key_file_get_groups(file, NULL);
+    StultoWorkspaceSession *session = NULL;
+    gboolean failed = FALSE;
+
+    workspace->path = g_strdup(path);
+    workspace->sessions = g_ptr_array_new_with_free_func((GDestroyNotify) stulto_workspace_session_free);
+    workspace->lazy = g_key_file_get_boolean(file, "workspace", "lazy", NULL);
+    workspace->active = MAX(g_key_file_get_integer(file, "workspace", "active", NULL), 0);
+
+    for (gchar **group = groups; *group != NULL && !failed; group++) {
+        if (g_str_has_prefix(*group, SESSION_GROUP_PREFIX)) {
+            session = g_new0(StultoWorkspaceSession, 1);
+            session->name = g_key_file_get_string(file, *group, "name", NULL);
+            if (session->name == NULL) {
+                session->name = g_strdup(*group + strlen(SESSION_GROUP_PREFIX));
+            }
+            session->panes = g_ptr_array_new_with_free_func((GDestroyNotify) pane_free);
+
+            g_ptr_array_add(workspace->sessions, session);
+        } else if (g_str_has_prefix(*group, PANE_GROUP_PREFIX)) {
+            if (session == NULL) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+                            "Section [%s] must follow a [%sNAME] section", *group, SESSION_GROUP_PREFIX);
+                failed = TRUE;
+                break;
+            }
+
+            StultoWorkspacePane *pane = parse_pane(file, path, *group, profiles, error);
+
+            if (pane == NULL) {
+                failed = TRUE;
+                break;
+            }
+
+            g_ptr_array_add(session->panes, pane);
+        }
+    }
+
+    /* A session without panes gets a shell */
+    for (guint i = 0; i < workspace->sessions->len && !failed; i++) {
+        StultoWorkspaceSession *empty = g_ptr_array_index(workspace->sessions, i);
+
+        if (empty->panes->len == 0) {
+            StultoWorkspacePane *pane = g_new0(StultoWorkspacePane, 1);
+
+            pane->name = g_strdup(empty->name);
+            pane->exec_data = stulto_exec_data_create(NULL);
+            pane->ratio = 0.5;
+            g_ptr_array_add(empty->panes, pane);
+        }
+    }
+
+    if (!failed && workspace->sessions->len == 0) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+                    "No [%sNAME] sections in %s", SESSION_GROUP_PREFIX, path);
+        failed = TRUE;
+    }
+
+    g_strfreev(groups);
+    g_hash_table_unref(profiles);
+
+    if (failed) {
+        stulto_workspace_free(workspace);
+        return NULL;
+    }
+
+    return workspace;
+}
+
+/*
+ * GKeyFile quietly merges a section given twice into one, which would merge two sessions or panes
+ */
+static gboolean check_unique_groups(const gchar *data, const gchar *path, GError **error) {
+    GHashTable *seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    gchar **lines = g_strsplit(data, "\n", -1);
+    gboolean unique = TRUE;
+
+    for (gchar **line = lines; *line != NULL && unique; line++) {
+        const gchar *start = *line;
+
+        while (g_ascii_isspace(*start)) {
+            start++;
+        }
+
+        const gchar *end = strchr(start, ']');
+
+        if (*start != '[' || end == NULL) {
+            continue;
+        }
+
+        gchar *group = g_strndup(start + 1, end - start - 1);
+
+        if (!g_str_has_prefix(group, SESSION_GROUP_PREFIX) && !g_str_has_prefix(group, PANE_GROUP_PREFIX)) {
+            g_free(group);
+        } else if (!g_hash_table_add(seen, group)) {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_PARSE,
+                        "Section [%s] appears more than once in %s", group, path);
+            unique = FALSE;
+        }
+    }
+
+    g_strfreev(lines);
+    g_hash_table_unref(seen);
+
+    return unique;
+}
+
+StultoWorkspace *stulto_workspace_load(const gchar *path, GError **error) {
+    gchar *data = NULL;
+    StultoWorkspace *workspace = NULL;
+
+    if (g_file_get_contents(path, &data, NULL, error)) {
+        workspace = stulto_workspace_load_data(data, path, error);
+    }
+
+    g_free(data);
+
+    return workspace;
+}
+
+/*
+ * Load a workspace description that isn't in a file; path stands in for the file's, for relative paths and errors
+ */
+StultoWorkspace *stulto_workspace_load_data(const gchar *data, const gchar *path, GError **error) {
+    GKeyFile *file = g_key_file_new();
+    StultoWorkspace *workspace = NULL;
+
+    if (check_unique_groups(data, path, error) && g_key_file_load_from_data(file, data, -1, G_KEY_FILE_NONE, error)) {
+        workspace = parse_workspace(file, path, error);
+    }
+
+    g_key_file_free(file);
+
+    return workspace;
+}
+
+void stulto_workspace_free(StultoWorkspace *workspace) {
+    if (workspace == NULL) {
+        return;
+    }
+
+    g_free(workspace->path);
+    g_ptr_array_unref(workspace->sessions);
+    g_free(workspace);
+}
@@ -0,0 +1,90 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef STULTO_WORKSPACE_H
+#define STULTO_WORKSPACE_H
+
+#include <gtk/gtk.h>
+
+#include "stulto-exec-data.h"
+#include "stulto-terminal-profile.h"
+
+/*
+ * A set of sessions and their panes, declared in a key file:
+ *
+ *   [session:ops]
+ *
+ *   [pane:logs]
+ *   command = journalctl -f
+ *   cwd = /var/log
+ *   profile = ~/.config/stulto/logs.ini
+ *
+ *   [pane:top]
+ *   command = htop
+ *   split = below
+ *
+ * Panes belong to the session above them, and their names must be unique within the file. Each pane after a
+ * session's first splits the previous pane's space, either to the right (the default) or below it. Panes without a
+ * command run the user's shell, and panes without a profile use the one Stulto was started with
+ *
+ * A session is labelled with its section's name, unless it has a name key. A pane can split an earlier pane other
+ * than the previous one by naming it as its parent, and take a ratio (0.5 by default) of the space, which is how saved
+ * sessions describe arbitrary layouts. A pane's scrollback file, if any, is fed to its terminal before its program
+ * starts
+ *
+ * A pane with a holder-id attaches to that PTY in the PTY holder, if it is still there, instead of starting its command
+ *
+ * With lazy = true in a [workspace] section, a session's terminals are only created and started once it is first
+ * shown
+ */
+
+typedef struct _StultoWorkspacePane {
+    gchar *name;
+    StultoExecData *exec_data;
+    /* NULL for the default profile */
+    StultoTerminalProfile *profile;
+    GtkOrientation split;
+    /* NULL for the previous pane */
+    gchar *parent;
+    gdouble ratio;
+    gchar *scrollback_path;
+} StultoWorkspacePane;
+
+typedef struct _StultoWorkspaceSession {
+    gchar *name;
+    /* Of StultoWorkspacePane */
+    GPtrArray *panes;
+} StultoWorkspaceSession;
+
+typedef struct _StultoWorkspace {
+    gchar *path;
+    /* Of StultoWorkspaceSession */
+    GPtrArray *sessions;
+    gboolean lazy;
+    /* The session to select */
+    guint active;
+} StultoWorkspace;
+
+StultoWorkspace *stulto_workspace_load(const gchar *path, GError **error);
+StultoWorkspace *stulto_workspace_load_data(const gchar *data, const gchar *path, GError **error);
+void stulto_workspace_free(StultoWorkspace *workspace);
+
+void stulto_workspace_session_free(StultoWorkspaceSession *session);
+
+#endif //STULTO_WORKSPACE_H
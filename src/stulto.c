@@ -23,11 +23,21 @@
 
 #include "stulto-application.h"
 #include "exit-status.h"
+#include "stulto-journal.h"
+#include "stulto-holder-daemon.h"
 
 int main(int argc, char *argv[]) {
+    /* The PTY holder runs from the same executable, but never connects to a display */
+    if (argc == 3 && g_str_equal(argv[1], STULTO_HOLDER_DAEMON_OPTION)) {
+        return stulto_holder_daemon_run(argv[2]);
+    }
+
     if (stulto_application_create(argc, argv)) {
         gtk_main();
     }
 
+    /* Sessions closed on the way out remove their logs */
+    stulto_journal_shutdown();
+
     return stulto_get_exit_status();
 }
@@ -0,0 +1,280 @@
+/*
+ * This file is part of Stulto.
+ * Copyright (C) 2022 Marĉjo Givens
+ *
+ * This is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Library General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * stultoctl: send commands to a running Stulto over its control socket (see stulto-control.h)
+ *
+ * Each argument is a command; without any, commands are read from standard input, one per line. They are all sent at
+ * once and their replies printed as they arrive, one JSON object per line. The exit status tells whether every
+ * command succeeded
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "stulto-control-protocol.h"
+
+#define STULTOCTL_READ_SIZE 65536
+
+static gint connect_socket(const gchar *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    gint fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+/*
+ * The Stulto this runs in, or else the one started last
+ */
+static gint connect_default() {
+    const gchar *env_path = g_getenv(STULTO_CONTROL_SOCKET_ENV);
+    gint fd = env_path != NULL ? connect_socket(env_path) : -1;
+
+    if (fd >= 0) {
+        return fd;
+    }
+
+    gchar *dir_path = g_build_filename(g_get_user_runtime_dir(), STULTO_CONTROL_SOCKET_DIR, NULL);
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    gchar *newest = NULL;
+    time_t newest_time = 0;
+    const gchar *name;
+
+    while (dir != NULL && (name = g_dir_read_name(dir)) != NULL) {
+        struct stat st;
+
+        if (!g_str_has_prefix(name, STULTO_CONTROL_SOCKET_PREFIX) || !g_str_has_suffix(name, STULTO_CONTROL_SOCKET_SUFFIX)) {
+            continue;
+        }
+
+        gchar *path = g_build_filename(dir_path, name, NULL);
+
+        if (stat(path, &st) == 0 && (newest == NULL || st.st_mtime > newest_time)) {
+            gint candidate = connect_socket(path);
+
+            /* Sockets of Stultos that crashed stay behind */
+            if (candidate >= 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                fd = candidate;
+                newest_time = st.st_mtime;
+                g_free(newest);
+                newest = g_steal_pointer(&path);
+            }
+        }
+
+        g_free(path);
+    }
+
+    if (dir != NULL) {
+        g_dir_close(dir);
+    }
+    g_free(newest);
+    g_free(dir_path);
+
+    return fd;
+}
+
+static gboolean write_all(gint fd, const gchar *data, gsize len) {
+    while (len > 0) {
+        gssize n = send(fd, data, len, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+    gchar *socket_path = NULL;
+    gboolean drop_down = FALSE;
+    gint repeat = 1;
+    gboolean show_time = FALSE;
+    gchar **commands = NULL;
+
+    GOptionEntry options[] = {
+            {
+                    .long_name = "socket",
+                    .short_name = 's',
+                    .arg = G_OPTION_ARG_FILENAME,
+                    .arg_data = &socket_path,
+                    .description = "Control socket of the Stulto to talk to",
+                    .arg_description = "PATH",
+            },
+            {
+                    .long_name = "drop-down",
+                    .short_name = 'd',
+                    .arg = G_OPTION_ARG_NONE,
+                    .arg_data = &drop_down,
+                    .description = "Talk to the drop-down Stulto (see stulto --drop-down)",
+            },
+            {
+                    .long_name = "repeat",
+                    .short_name = 'n',
+                    .arg = G_OPTION_ARG_INT,
+                    .arg_data = &repeat,
+                    .description = "Send the commands N times over, in the same batch",
+                    .arg_description = "N",
+            },
+            {
+                    .long_name = "time",
+                    .short_name = 't',
+                    .arg = G_OPTION_ARG_NONE,
+                    .arg_data = &show_time,
+                    .description = "Report how long the batch took, on standard error",
+            },
+            {
+                    .long_name = G_OPTION_REMAINING,
+                    .arg = G_OPTION_ARG_STRING_ARRAY,
+                    .arg_data = &commands,
+            },
+            {} /* terminator */
+    };
+
+    GOptionContext *context = g_option_context_new("[COMMAND...] - Script a running Stulto");
+    GError *error = NULL;
+
+    g_option_context_add_main_entries(context, options, NULL);
+
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_option_context_free(context);
+
+    if (drop_down && socket_path == NULL) {
+        socket_path = g_build_filename(
+                g_get_user_runtime_dir(),
+                STULTO_CONTROL_SOCKET_DIR,
+                STULTO_CONTROL_DROP_DOWN_SOCKET,
+                NULL);
+    }
+
+    GString *batch = g_string_new(NULL);
+
+    if (commands != NULL) {
+        for (gchar **command = commands; *command != NULL; command++) {
+            g_string_append_printf(batch, "%s\n", *command);
+        }
+    } else {
+        gchar buf[STULTOCTL_READ_SIZE];
+        gsize n;
+
+        while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+            g_string_append_len(batch, buf, (gssize) n);
+        }
+
+        if (batch->len > 0 && batch->str[batch->len - 1] != '\n') {
+            g_string_append_c(batch, '\n');
+        }
+    }
+
+    gsize batch_len = batch->len;
+
+    for (gint i = 1; i < repeat; i++) {
+        g_string_append_len(batch, batch->str, (gssize) batch_len);
+    }
+
+    gint fd = socket_path != NULL ? connect_socket(socket_path) : connect_default();
+
+    if (fd < 0) {
+        g_printerr("No Stulto to talk to; is control-socket enabled?\n");
+        return EXIT_FAILURE;
+    }
+
+    gint64 start_time = g_get_monotonic_time();
+
+    /* One write for the whole batch, and the end of it marked, so Stulto answers it all at once */
+    if (!write_all(fd, batch->str, batch->len) || shutdown(fd, SHUT_WR) < 0) {
+        g_printerr("Error sending commands: %s\n", g_strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    gchar buf[STULTOCTL_READ_SIZE];
+    gssize n;
+    guint n_replies = 0;
+    gboolean failed = FALSE;
+    gsize column = 0;
+
+    while ((n = recv(fd, buf, sizeof(buf), 0)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            g_printerr("Error receiving replies: %s\n", g_strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        /* Replies start with {"ok":true or {"ok":false */
+        for (gssize i = 0; i < n; i++) {
+            if (column == strlen("{\"ok\":") && buf[i] == 'f') {
+                failed = TRUE;
+            }
+
+            if (buf[i] == '\n') {
+                column = 0;
+                n_replies++;
+            } else {
+                column++;
+            }
+        }
+
+        fwrite(buf, 1, n, stdout);
+    }
+
+    if (show_time) {
+        g_printerr("%u replies in %.2f ms\n", n_replies, (g_get_monotonic_time() - start_time) / 1000.0);
+    }
+
+    close(fd);
+    g_string_free(batch, TRUE);
+    g_strfreev(commands);
+    g_free(socket_path);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}